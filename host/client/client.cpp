@@ -0,0 +1,428 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+
+#include "usb_mdio/client.hpp"
+
+namespace usb_mdio {
+
+// How long the I/O thread waits for a response before it checks the deadlines and the queue again
+static constexpr std::chrono::milliseconds poll_interval(10);
+
+// Longest a single command may keep the firmware busy without a response. A resync waits this long (plus the
+// timeout) for each response of a failed command before it gives up on the adapter.
+static constexpr std::chrono::microseconds longest_command(
+    std::max(USB_MDIO_POLL_TIMEOUT_MAX_US, USB_MDIO_PROGRAM_TIMEOUT_MAX_US));
+
+const char *status_name(status s) {
+    switch (s) {
+    case status::ok: return "ok";
+    case status::invalid: return "invalid";
+    case status::unsupported: return "unsupported";
+    case status::no_response: return "no response";
+    case status::timeout: return "timeout";
+    case status::transport_error: return "transport error";
+    }
+    return "unknown";
+}
+
+// ********** Commands **********
+// ******************************
+
+static std::vector<uint8_t> header(uint8_t op, uint8_t bus, uint8_t addr) {
+    return {USB_MDIO_EXT_MAGIC, op, bus, addr};
+}
+
+static void put16(std::vector<uint8_t> &p, uint16_t value) {
+    p.push_back(value & 0xff);
+    p.push_back(value >> 8);
+}
+
+static void put32(std::vector<uint8_t> &p, uint32_t value) {
+    put16(p, value & 0xffff);
+    put16(p, value >> 16);
+}
+
+static uint16_t get16(const std::vector<uint8_t> &p, size_t offset) {
+    return p[offset] | (p[offset + 1] << 8);
+}
+
+static uint32_t get32(const std::vector<uint8_t> &p, size_t offset) {
+    return get16(p, offset) | uint32_t(get16(p, offset + 2)) << 16;
+}
+
+command command::c22_read(uint8_t bus, uint8_t phy, uint8_t reg) {
+    command c{header(USB_MDIO_OP_C22_READ, bus, phy), reply::value};
+    c.packet.insert(c.packet.end(), {reg, 0});
+    return c;
+}
+
+command command::c22_write(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t value) {
+    command c{header(USB_MDIO_OP_C22_WRITE, bus, phy), reply::none};
+    c.packet.insert(c.packet.end(), {reg, 0});
+    put16(c.packet, value);
+    return c;
+}
+
+command command::c45_read(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg) {
+    command c{header(USB_MDIO_OP_C45_READ, bus, port), reply::value};
+    c.packet.insert(c.packet.end(), {devad, 0});
+    put16(c.packet, reg);
+    return c;
+}
+
+command command::c45_write(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t value) {
+    command c{header(USB_MDIO_OP_C45_WRITE, bus, port), reply::none};
+    c.packet.insert(c.packet.end(), {devad, 0});
+    put16(c.packet, reg);
+    put16(c.packet, value);
+    return c;
+}
+
+command command::c45_read_range(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint8_t count) {
+    command c{header(USB_MDIO_OP_C45_READ_RANGE, bus, port), reply::values};
+    c.packet.insert(c.packet.end(), {devad, count});
+    put16(c.packet, reg);
+    return c;
+}
+
+command command::smi_read(uint8_t bus, uint8_t smi_addr, uint8_t dev, uint8_t reg) {
+    command c{header(USB_MDIO_OP_SMI_READ, bus, smi_addr), reply::value};
+    c.packet.insert(c.packet.end(), {dev, reg});
+    return c;
+}
+
+command command::smi_write(uint8_t bus, uint8_t smi_addr, uint8_t dev, uint8_t reg, uint16_t value) {
+    command c{header(USB_MDIO_OP_SMI_WRITE, bus, smi_addr), reply::none};
+    c.packet.insert(c.packet.end(), {dev, reg});
+    put16(c.packet, value);
+    return c;
+}
+
+command command::batch(uint8_t bus, const std::vector<batch_op> &ops) {
+    if (ops.size() > USB_MDIO_BATCH_MAX)
+        throw std::invalid_argument("usb_mdio: too many batch commands");
+
+    command c{header(USB_MDIO_OP_BATCH, bus, static_cast<uint8_t>(ops.size())), reply::values};
+    for (const batch_op &op : ops) {
+        c.packet.insert(c.packet.end(), {op.write ? uint8_t(USB_MDIO_BATCH_WRITE) : uint8_t(USB_MDIO_BATCH_READ),
+                                         op.phy, op.reg});
+        if (op.write)
+            put16(c.packet, op.value);
+    }
+
+    if (c.packet.size() > USB_MDIO_PACKET_SIZE)
+        throw std::invalid_argument("usb_mdio: batch does not fit into one packet");
+
+    return c;
+}
+
+command command::dump_c22(uint8_t bus, uint8_t first_phy, uint8_t last_phy, uint8_t first_reg, uint8_t last_reg) {
+    command c{header(USB_MDIO_OP_DUMP, bus, first_phy), reply::dump};
+    c.packet.insert(c.packet.end(), {last_phy, USB_MDIO_DUMP_C22, 0, 0});
+    put16(c.packet, first_reg);
+    put16(c.packet, last_reg);
+    return c;
+}
+
+command command::run_program(uint8_t bus, uint8_t slot, uint16_t len, uint32_t timeout_us,
+                             const std::vector<uint16_t> &regs) {
+    if (regs.size() > USB_MDIO_PROG_REGS)
+        throw std::invalid_argument("usb_mdio: too many program registers");
+
+    command c{header(USB_MDIO_OP_RUN_PROGRAM, bus, slot), reply::program};
+    put16(c.packet, len);
+    put16(c.packet, timeout_us & 0xffff);
+    put16(c.packet, timeout_us >> 16);
+    for (uint16_t value : regs)
+        put16(c.packet, value);
+
+    if (c.packet.size() > USB_MDIO_PACKET_SIZE)
+        throw std::invalid_argument("usb_mdio: program registers do not fit into one packet");
+
+    return c;
+}
+
+command command::sniff(uint8_t bus, uint8_t mode) {
+    command c{header(USB_MDIO_OP_SNIFF, bus, 0), reply::none};
+    c.packet.push_back(mode);
+    return c;
+}
+
+command command::raw(std::vector<uint8_t> packet, reply kind) {
+    if (packet.empty() || packet.size() > USB_MDIO_PACKET_SIZE || packet[0] != USB_MDIO_EXT_MAGIC)
+        throw std::invalid_argument("usb_mdio: not an extended command");
+
+    return command{std::move(packet), kind};
+}
+
+static command sync_command(uint32_t token) {
+    command c{header(USB_MDIO_OP_SYNC, 0, 0), command::reply::none};
+    put32(c.packet, token);
+    return c;
+}
+
+static bool is_sync_echo(const std::vector<uint8_t> &packet, uint32_t token) {
+    return packet.size() == USB_MDIO_RESPONSE_HEADER_LEN + 4 && packet[0] == USB_MDIO_STATUS_OK &&
+           get32(packet, 2) == token;
+}
+
+/**
+ * @brief Add one response packet to the result. Returns true when the command is complete.
+ */
+static bool parse(const command &cmd, const std::vector<uint8_t> &packet, result &res) {
+    res.packets.push_back(packet);
+
+    if (packet.size() < USB_MDIO_RESPONSE_HEADER_LEN) {
+        res.st = status::transport_error;
+        return true;
+    }
+
+    res.st = static_cast<status>(packet[0]);
+
+    switch (cmd.kind) {
+    case command::reply::none:
+        break;
+    case command::reply::value:
+        if (packet.size() >= USB_MDIO_RESPONSE_HEADER_LEN + 2)
+            res.values.push_back(get16(packet, 2));
+        break;
+    case command::reply::values:
+        for (size_t i = 0; i < packet[1] && USB_MDIO_RESPONSE_HEADER_LEN + 2 * i + 1 < packet.size(); i++)
+            res.values.push_back(get16(packet, USB_MDIO_RESPONSE_HEADER_LEN + 2 * i));
+        break;
+    case command::reply::dump: {
+        size_t count = packet[1] & ~USB_MDIO_DUMP_LAST;
+        if (count && packet.size() >= USB_MDIO_DUMP_HEADER_LEN) {
+            dump_block block{packet[2], packet[3], get16(packet, 4), {}};
+            for (size_t i = 0; i < count && USB_MDIO_DUMP_HEADER_LEN + 2 * i + 1 < packet.size(); i++)
+                block.values.push_back(get16(packet, USB_MDIO_DUMP_HEADER_LEN + 2 * i));
+            res.values.insert(res.values.end(), block.values.begin(), block.values.end());
+            res.blocks.push_back(std::move(block));
+        }
+        return packet[1] & USB_MDIO_DUMP_LAST;
+    }
+    case command::reply::program: {
+        size_t count = packet[1] & ~USB_MDIO_PROGRAM_LAST;
+        if (packet.size() >= USB_MDIO_PROGRAM_HEADER_LEN)
+            res.pc = get16(packet, 2);
+        for (size_t i = 0; i < count && USB_MDIO_PROGRAM_HEADER_LEN + 2 * i + 1 < packet.size(); i++)
+            res.values.push_back(get16(packet, USB_MDIO_PROGRAM_HEADER_LEN + 2 * i));
+        return packet[1] & USB_MDIO_PROGRAM_LAST;
+    }
+    }
+
+    return true;
+}
+
+// ********** Client **********
+// ****************************
+
+client::client(std::unique_ptr<backend> backend, unsigned window, std::chrono::milliseconds timeout)
+    : backend_(std::move(backend)),
+      window_(std::clamp(window, 1u, unsigned(USB_MDIO_COMMAND_WINDOW))),
+      timeout_(timeout),
+      sync_token_(std::random_device{}()) {
+    io_ = std::thread(&client::run, this);
+}
+
+client::~client() {
+    wait_idle();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    io_.join();
+}
+
+void client::submit(command cmd, callback done) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(pending{std::move(cmd), std::move(done), {}, {}});
+    }
+    cv_.notify_all();
+}
+
+std::future<result> client::submit(command cmd) {
+    auto promise = std::make_shared<std::promise<result>>();
+    std::future<result> future = promise->get_future();
+
+    submit(std::move(cmd), [promise](const result &res) { promise->set_value(res); });
+    return future;
+}
+
+result client::execute(command cmd) {
+    return submit(std::move(cmd)).get();
+}
+
+void client::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return queue_.empty() && in_flight_.empty() && !completing_; });
+}
+
+bool client::load_program(uint8_t slot, const std::vector<uint8_t> &code) {
+    if (code.size() > USB_MDIO_PROGRAM_SIZE)
+        return false;
+
+    for (size_t offset = 0; offset < code.size(); offset += USB_MDIO_PROGRAM_CHUNK_MAX) {
+        size_t len = std::min<size_t>(code.size() - offset, USB_MDIO_PROGRAM_CHUNK_MAX);
+        std::vector<uint8_t> chunk(code.begin() + offset, code.begin() + offset + len);
+
+        if (!backend_->control_out(USB_MDIO_VENDOR_LOAD_PROGRAM, slot, static_cast<uint16_t>(offset), chunk,
+                                   timeout_))
+            return false;
+    }
+
+    return true;
+}
+
+bool client::read_sniffed(sniff_packet &packet, std::chrono::milliseconds timeout) {
+    std::vector<uint8_t> buf;
+
+    if (!backend_->receive_sniffed(buf, timeout) || buf.size() < USB_MDIO_SNIFF_HEADER_LEN ||
+        buf.size() != USB_MDIO_SNIFF_HEADER_LEN + USB_MDIO_SNIFF_RECORD_LEN * size_t(buf[1]))
+        return false;
+
+    packet.bus = buf[0];
+    packet.lost = get32(buf, 4);
+    packet.frames.clear();
+    for (size_t i = 0; i < buf[1]; i++) {
+        size_t offset = USB_MDIO_SNIFF_HEADER_LEN + USB_MDIO_SNIFF_RECORD_LEN * i;
+        packet.frames.push_back({get32(buf, offset), get32(buf, offset + 4)});
+    }
+
+    return true;
+}
+
+void client::complete(pending &p) {
+    if (p.done)
+        p.done(p.res);
+}
+
+/**
+ * @brief Complete everything in flight with a transport error. After a lost response the order of the
+ * responses can not be trusted any more, the next command waits for a resync.
+ */
+void client::fail_in_flight() {
+    std::deque<pending> failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed.swap(in_flight_);
+
+        // Not even the sync was answered: do not keep the queue waiting for an adapter that is gone
+        if (syncing_) {
+            std::move(queue_.begin(), queue_.end(), std::back_inserter(failed));
+            queue_.clear();
+        }
+        syncing_ = false;
+        resync_ = true;
+        completing_++;
+    }
+
+    for (pending &p : failed) {
+        p.res.st = status::transport_error;
+        complete(p);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completing_--;
+    }
+    cv_.notify_all();
+}
+
+void client::run() {
+    std::vector<uint8_t> packet;
+
+    for (;;) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return stop_ || !queue_.empty() || !in_flight_.empty(); });
+        if (stop_ && queue_.empty() && in_flight_.empty())
+            return;
+
+        // The responses of failed commands may still come. Send a sync and drop every response up to its echo
+        // before the next command, nothing else is sent until then.
+        if (resync_ && in_flight_.empty() && !queue_.empty()) {
+            pending p{sync_command(++sync_token_), {}, {},
+                      std::chrono::steady_clock::now() + timeout_ + longest_command};
+            std::vector<uint8_t> out = p.cmd.packet;
+            in_flight_.push_back(std::move(p));
+            resync_ = false;
+            syncing_ = true;
+            lock.unlock();
+
+            backend_->flush();
+            if (!backend_->send(out, timeout_))
+                fail_in_flight();
+            continue;
+        }
+
+        // Fill the window first, the firmware works on the next command while we wait for a response
+        if (!queue_.empty() && in_flight_.size() < window_ && !syncing_) {
+            pending p = std::move(queue_.front());
+            queue_.pop_front();
+            p.deadline = std::chrono::steady_clock::now() + timeout_;
+            std::vector<uint8_t> out = p.cmd.packet;
+            in_flight_.push_back(std::move(p));
+            lock.unlock();
+
+            if (!backend_->send(out, timeout_))
+                fail_in_flight();
+            continue;
+        }
+
+        auto deadline = in_flight_.front().deadline;
+        lock.unlock();
+
+        if (!backend_->receive(packet, poll_interval)) {
+            if (std::chrono::steady_clock::now() > deadline)
+                fail_in_flight();
+            continue;
+        }
+
+        lock.lock();
+        pending &front = in_flight_.front();
+        if (syncing_) {
+            if (!is_sync_echo(packet, sync_token_)) {
+                // A late response, the firmware is still working through the failed commands
+                front.deadline = std::chrono::steady_clock::now() + timeout_ + longest_command;
+                continue;
+            }
+
+            in_flight_.pop_front();
+            syncing_ = false;
+            lock.unlock();
+            cv_.notify_all();
+            continue;
+        }
+
+        if (!parse(front.cmd, packet, front.res)) {
+            front.deadline = std::chrono::steady_clock::now() + timeout_; // More dump blocks to come
+            continue;
+        }
+
+        pending done = std::move(front);
+        in_flight_.pop_front();
+        completing_++;
+        lock.unlock();
+
+        complete(done);
+
+        lock.lock();
+        completing_--;
+        lock.unlock();
+        cv_.notify_all();
+    }
+}
+
+} // namespace usb_mdio
@@ -0,0 +1,190 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// Client library against the simulated adapter: a few synchronous calls and microprograms, then the same
+// reads one at a time and pipelined. USB transfers take no virtual time in the mock, so both rates are limited
+// by the MDIO bus and should match: the firmware keeps the bus busy either way. On hardware the window also
+// hides the USB round trips between the commands. Another master runs frames on bus 3 while the adapter
+// sniffs it, "usb-mdio-client-demo <file.pcap>" writes them for Wireshark.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "usb_mdio/client.hpp"
+#include "usb_mdio/pcap.hpp"
+#include "usb_mdio/program.hpp"
+#include "usb_mdio/sim_backend.hpp"
+
+extern "C" {
+#include "mdio_model.h"
+}
+
+using namespace usb_mdio;
+
+#define DEMO_READS 200
+
+#define SNIFF_BUS 3
+#define SNIFF_MDC_PIN 20
+#define SNIFF_MDIO_PIN 21
+#define SNIFF_MDC_HZ 2500000
+#define SNIFF_FRAMES 100
+
+/**
+ * @brief Read register 1 of all ports DEMO_READS times. Returns the reads per second on the virtual clock.
+ */
+static double read_rate(unsigned window, bool &ok) {
+    client c(std::make_unique<sim_backend>(), window);
+    std::vector<std::future<result>> results;
+
+    uint64_t start_ps = mock_time_ps();
+    for (unsigned i = 0; i < DEMO_READS; i++)
+        results.push_back(c.submit(command::c22_read(0, i % MDIO_MODEL_RTL8305_PORTS, 1)));
+
+    for (std::future<result> &f : results)
+        ok &= f.get().ok();
+
+    uint64_t elapsed_ps = mock_time_ps() - start_ps;
+    return elapsed_ps ? DEMO_READS * 1e12 / elapsed_ps : 0;
+}
+
+/**
+ * @brief Frame number i of the other master: a Clause 22 read of PHY 1, with the data a PHY would drive
+ */
+static uint32_t sniff_frame(unsigned i) {
+    return 0x1u << 30 | 0x2u << 28 | 1u << 23 | (i & 0x1f) << 18 | 0x2u << 16 | ((0x1000 + i) & 0xffff);
+}
+
+/**
+ * @brief Sniff bus 3 while another master runs frames on it, write them to pcap_path if it is set
+ */
+static bool sniff(client &c, const char *pcap_path) {
+    if (!c.execute(command::sniff(SNIFF_BUS, USB_MDIO_SNIFF_START)).ok())
+        return false;
+
+    struct mdio_model_master *master = mdio_model_master_create(SNIFF_MDC_PIN, SNIFF_MDIO_PIN, SNIFF_MDC_HZ);
+    for (unsigned i = 0; i < SNIFF_FRAMES; i++)
+        mdio_model_master_frame(master, sniff_frame(i), MDIO_MODEL_PREAMBLE_BITS, 1);
+    mdio_model_master_release(master);
+
+    std::vector<sniffed_frame> frames;
+    sniff_packet packet;
+    bool ok = true;
+    while (frames.size() < SNIFF_FRAMES && c.read_sniffed(packet, std::chrono::milliseconds(2000))) {
+        ok &= packet.bus == SNIFF_BUS && !packet.lost;
+        frames.insert(frames.end(), packet.frames.begin(), packet.frames.end());
+    }
+
+    ok &= c.execute(command::sniff(SNIFF_BUS, USB_MDIO_SNIFF_STOP)).ok() && frames.size() == SNIFF_FRAMES;
+    for (size_t i = 0; ok && i < frames.size(); i++)
+        ok &= frames[i].bits == sniff_frame(i);
+    printf("Sniffer: %zu frames, first at %u us, last at %u us\n", frames.size(),
+           frames.empty() ? 0u : (uint) frames.front().timestamp_us,
+           frames.empty() ? 0u : (uint) frames.back().timestamp_us);
+
+    if (pcap_path) {
+        try {
+            pcap_writer pcap(pcap_path);
+            if (pcap.write(frames) && pcap.close())
+                return ok;
+        } catch (const std::runtime_error &) {
+        }
+        fprintf(stderr, "Cannot write %s\n", pcap_path);
+        return false;
+    }
+
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    struct mdio_model_bus *bus = mdio_model_bus_create(14, 15);
+    struct mdio_model_rtl8305 *rtl8305 = mdio_model_rtl8305_create(bus, 0);
+    mdio_model_phy_set_link(mdio_model_rtl8305_port(rtl8305, 2), true);
+
+    bool ok = true;
+    {
+        client c(std::make_unique<sim_backend>());
+
+        result id = c.c22_read(0, 2, 2);
+        printf("PHY 2 ID1: %s 0x%04x\n", status_name(id.st), (uint) id.value());
+        ok &= id.ok() && id.value() == MDIO_MODEL_RTL8305_PHY_ID >> 16;
+
+        result anar = c.c22_write(0, 2, 4, 0x0061);
+        ok &= anar.ok() && c.c22_read(0, 2, 4).value() == 0x0061;
+
+        result batch = c.execute(command::batch(0, {{false, 2, 2, 0}, {false, 2, 3, 0}, {true, 2, 4, 0x01e1}}));
+        printf("Batch: %s, %zu values\n", status_name(batch.st), batch.values.size());
+        ok &= batch.ok() && batch.values.size() == 2 && batch.values[1] == (MDIO_MODEL_RTL8305_PHY_ID & 0xffff);
+
+        // One command, one EP6 packet per PHY
+        result dump = c.execute(command::dump_c22(0, 0, MDIO_MODEL_RTL8305_PORTS - 1, 0, 3));
+        printf("Dump: %s, %zu blocks, %zu values\n", status_name(dump.st), dump.blocks.size(), dump.values.size());
+        ok &= dump.ok() && dump.values.size() == MDIO_MODEL_RTL8305_PORTS * 4;
+
+        // Callbacks run on the I/O thread
+        std::atomic<unsigned> done{0};
+        for (unsigned port = 0; port < MDIO_MODEL_RTL8305_PORTS; port++)
+            c.submit(command::c22_read(0, port, 1), [&done](const result &res) { done += res.ok(); });
+        c.wait_idle();
+        ok &= done == MDIO_MODEL_RTL8305_PORTS;
+
+        // Microprogram: BMSR of every port, then restart autonegotiation on port 2 and wait for the link
+        program p;
+        program::label port_loop = p.set(0, MDIO_MODEL_RTL8305_PORTS).set(1, 0).here();
+        program::label no_link = p.new_label();
+        p.read(2, program::from_reg(1), 1).emit(2).add(1, 1).loop(0, port_loop);
+        p.modify(2, 0, 0x0200, 0x0200).poll(2, 1, 0x0004, 0x0004, 100, 50000).jmp_ifnot(no_link).end();
+        p.bind(no_link).fail(USB_MDIO_STATUS_TIMEOUT);
+
+        result run = c.load_program(0, p.code()) ? c.run_program(0, 0, p.size(), 100000) : result{};
+        printf("Program: %s at 0x%04x, %zu values, port 2 BMSR 0x%04x\n", status_name(run.st), (uint) run.pc,
+               run.values.size(), run.values.size() > 2 ? (uint) run.values[2] : 0u);
+        ok &= run.ok() && run.values.size() == MDIO_MODEL_RTL8305_PORTS && run.values[2] == 0x786d;
+
+        // More than one EP0 packet and one chunk to load, more than one EP6 packet of values
+        program counter;
+        counter.set(0, 100).set(1, 0);
+        for (unsigned i = 0; i < 60; i++)
+            counter.add(1, 1);
+        program::label count_loop = counter.here();
+        counter.emit(1).add(1, 1).loop(0, count_loop).end();
+
+        run = c.load_program(1, counter.code()) ? c.run_program(0, 1, counter.size(), 100000) : result{};
+        printf("Program: %s, %u bytes, %zu values in %zu packets\n", status_name(run.st), (uint) counter.size(),
+               run.values.size(), run.packets.size());
+        ok &= run.ok() && run.values.size() == 100 && run.values.front() == 60 && run.values.back() == 159;
+
+        ok &= sniff(c, argc > 1 ? argv[1] : nullptr);
+    }
+
+    // The client gives up on a poll that runs longer than its timeout, and on the read behind it. Their late
+    // responses must be dropped, not taken for the response of the next read.
+    {
+        client c(std::make_unique<sim_backend>(), USB_MDIO_COMMAND_WINDOW, std::chrono::milliseconds(50));
+
+        std::vector<uint8_t> poll = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_POLL, 0, 0, 1, 0, 0x04, 0x00, 0x04, 0x00};
+        for (uint32_t value : {100u, uint32_t(USB_MDIO_POLL_TIMEOUT_MAX_US)})
+            for (unsigned i = 0; i < 4; i++)
+                poll.push_back((value >> (8 * i)) & 0xff);
+
+        std::future<result> no_link = c.submit(command::raw(poll, command::reply::value));
+        std::future<result> behind = c.submit(command::c22_read(0, 2, 1));
+        ok &= no_link.get().st == status::transport_error && behind.get().st == status::transport_error;
+
+        result id = c.c22_read(0, 2, 3);
+        printf("After a timeout: %s 0x%04x\n", status_name(id.st), (uint) id.value());
+        ok &= id.ok() && id.value() == (MDIO_MODEL_RTL8305_PHY_ID & 0xffff);
+    }
+
+    double sync_rate = read_rate(1, ok);
+    double pipelined_rate = read_rate(USB_MDIO_COMMAND_WINDOW, ok);
+    printf("%d reads: %.0f/s one at a time, %.0f/s with %d in flight\n", DEMO_READS, sync_rate, pipelined_rate,
+           USB_MDIO_COMMAND_WINDOW);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
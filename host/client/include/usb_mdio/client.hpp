@@ -0,0 +1,231 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef USB_MDIO_CLIENT_HPP_
+#define USB_MDIO_CLIENT_HPP_
+
+// Host side of the EP2/EP6 extended command protocol (usb_mdio_protocol.h).
+//
+// The firmware accepts up to USB_MDIO_COMMAND_WINDOW commands while earlier ones are still executing and
+// answers them strictly in order. The client keeps that many commands in flight from an I/O thread and
+// matches the responses to the commands by their order. Every command can be run synchronously, with a
+// future or with a callback; callbacks run on the I/O thread and must not wait for other commands.
+//
+// After a timeout or a transport error everything in flight fails and the next command is preceded by
+// USB_MDIO_OP_SYNC: the late responses of the failed commands are dropped up to its echo, so they are never
+// taken for the responses of later commands.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "usb_mdio_protocol.h"
+
+namespace usb_mdio {
+
+enum class status : uint8_t {
+    ok = USB_MDIO_STATUS_OK,
+    invalid = USB_MDIO_STATUS_INVALID,
+    unsupported = USB_MDIO_STATUS_UNSUPPORTED,
+    no_response = USB_MDIO_STATUS_NO_RESPONSE,
+    timeout = USB_MDIO_STATUS_TIMEOUT,
+    transport_error = 0xff, // No response from the adapter, or the backend failed
+};
+
+const char *status_name(status s);
+
+// ********** Backend **********
+// *****************************
+
+// Moves packets between the client and the adapter. send() and receive() are only called from the I/O
+// thread of one client, but a backend may keep transfers in flight on its own. control_out() and
+// receive_sniffed() are called from the thread using the client, while the I/O thread keeps running.
+class backend {
+public:
+    virtual ~backend() = default;
+
+    // Send one command packet on EP2. Returns false if it was not accepted within the timeout.
+    virtual bool send(const std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) = 0;
+
+    // Receive the next EP6 packet. Returns false if there was none within the timeout.
+    virtual bool receive(std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) = 0;
+
+    // Receive the next EP8 packet of the bus sniffer. Returns false if there was none within the timeout.
+    virtual bool receive_sniffed(std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) = 0;
+
+    // Vendor OUT request on EP0 (USB_MDIO_VENDOR_*). Returns false if it failed.
+    virtual bool control_out(uint8_t request, uint16_t value, uint16_t index, const std::vector<uint8_t> &data,
+                             std::chrono::milliseconds timeout) = 0;
+
+    // Drop the EP6 packets received but not returned by receive() yet and recover EP6 after an error. Called
+    // from the I/O thread before it resynchronizes with the firmware after a failed command.
+    virtual void flush() {}
+};
+
+// ********** Commands **********
+// ******************************
+
+struct batch_op {
+    bool write;
+    uint8_t phy;
+    uint8_t reg;
+    uint16_t value; // Writes only
+};
+
+struct command {
+    enum class reply {
+        none,    // Status only
+        value,   // byte 2..3
+        values,  // Count in byte 1, values from byte 2
+        dump,    // Stream of dump blocks up to USB_MDIO_DUMP_LAST
+        program, // Stream of EMIT values up to USB_MDIO_PROGRAM_LAST
+    };
+
+    std::vector<uint8_t> packet;
+    reply kind = reply::none;
+
+    static command c22_read(uint8_t bus, uint8_t phy, uint8_t reg);
+    static command c22_write(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t value);
+    static command c45_read(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg);
+    static command c45_write(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t value);
+    static command c45_read_range(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint8_t count);
+    static command smi_read(uint8_t bus, uint8_t smi_addr, uint8_t dev, uint8_t reg);
+    static command smi_write(uint8_t bus, uint8_t smi_addr, uint8_t dev, uint8_t reg, uint16_t value);
+    static command batch(uint8_t bus, const std::vector<batch_op> &ops);
+    static command dump_c22(uint8_t bus, uint8_t first_phy, uint8_t last_phy, uint8_t first_reg, uint8_t last_reg);
+
+    // Run len bytes of the program loaded into a slot (client::load_program), starting with r0, r1, ... = regs
+    static command run_program(uint8_t bus, uint8_t slot, uint16_t len, uint32_t timeout_us,
+                               const std::vector<uint16_t> &regs = {});
+
+    // Start, stop or query the bus sniffer (USB_MDIO_SNIFF_*), the frames are read with client::read_sniffed()
+    static command sniff(uint8_t bus, uint8_t mode);
+
+    // Any other extended command, answered with one packet
+    static command raw(std::vector<uint8_t> packet, reply kind = reply::none);
+};
+
+struct dump_block {
+    uint8_t phy;
+    uint8_t mmd;
+    uint16_t first_reg;
+    std::vector<uint16_t> values;
+};
+
+struct result {
+    status st = status::transport_error;
+    std::vector<uint16_t> values; // Read values in command order, one for the single reads
+    uint16_t pc = 0;              // Programs: the instruction the program stopped at
+    std::vector<dump_block> blocks;
+    std::vector<std::vector<uint8_t>> packets; // Responses as received
+
+    bool ok() const { return st == status::ok; }
+    uint16_t value() const { return values.empty() ? 0xffff : values.front(); }
+};
+
+// One EP8 packet of the bus sniffer
+struct sniffed_frame {
+    uint32_t timestamp_us; // Right after the last bit
+    uint32_t bits;         // The 32 bits following the preamble, ST in bit 31..30
+};
+
+struct sniff_packet {
+    uint8_t bus = 0;
+    uint32_t lost = 0; // Frames lost since START, an increase means frames are missing before this packet
+    std::vector<sniffed_frame> frames;
+};
+
+// ********** Client **********
+// ****************************
+
+class client {
+public:
+    using callback = std::function<void(const result &)>;
+
+    // window: commands in flight, at most USB_MDIO_COMMAND_WINDOW. timeout: per command, from sending it.
+    explicit client(std::unique_ptr<backend> backend, unsigned window = USB_MDIO_COMMAND_WINDOW,
+                    std::chrono::milliseconds timeout = std::chrono::milliseconds(2000));
+    ~client();
+
+    client(const client &) = delete;
+    client &operator=(const client &) = delete;
+
+    void submit(command cmd, callback done);
+    std::future<result> submit(command cmd);
+    result execute(command cmd);
+
+    // Wait until every submitted command completed
+    void wait_idle();
+
+    // Load a program into a slot (USB_MDIO_VENDOR_LOAD_PROGRAM). This is a control transfer, it is not ordered
+    // with the submitted commands: do not load a slot while a run of it is still pending.
+    bool load_program(uint8_t slot, const std::vector<uint8_t> &code);
+
+    // Next EP8 packet of the bus sniffer. It is not ordered with the commands: start the sniffer with
+    // command::sniff() first and keep reading while it runs. Returns false on a timeout or a malformed packet.
+    bool read_sniffed(sniff_packet &packet, std::chrono::milliseconds timeout);
+
+    // Synchronous shortcuts
+    result c22_read(uint8_t bus, uint8_t phy, uint8_t reg) { return execute(command::c22_read(bus, phy, reg)); }
+    result c22_write(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t value) {
+        return execute(command::c22_write(bus, phy, reg, value));
+    }
+    result c45_read(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg) {
+        return execute(command::c45_read(bus, port, devad, reg));
+    }
+    result c45_write(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t value) {
+        return execute(command::c45_write(bus, port, devad, reg, value));
+    }
+    result smi_read(uint8_t bus, uint8_t smi_addr, uint8_t dev, uint8_t reg) {
+        return execute(command::smi_read(bus, smi_addr, dev, reg));
+    }
+    result smi_write(uint8_t bus, uint8_t smi_addr, uint8_t dev, uint8_t reg, uint16_t value) {
+        return execute(command::smi_write(bus, smi_addr, dev, reg, value));
+    }
+    result run_program(uint8_t bus, uint8_t slot, uint16_t len, uint32_t timeout_us,
+                       const std::vector<uint16_t> &regs = {}) {
+        return execute(command::run_program(bus, slot, len, timeout_us, regs));
+    }
+
+private:
+    struct pending {
+        command cmd;
+        callback done;
+        result res;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void run();
+    void complete(pending &p);
+    void fail_in_flight();
+
+    std::unique_ptr<backend> backend_;
+    unsigned window_;
+    std::chrono::milliseconds timeout_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<pending> queue_;     // Not sent yet
+    std::deque<pending> in_flight_; // Sent, in the order the responses arrive
+    unsigned completing_ = 0;       // Callbacks running
+    bool resync_ = false;           // A command failed, sync before sending the next one
+    bool syncing_ = false;          // The front of in_flight_ is the sync, responses are dropped up to its echo
+    uint32_t sync_token_;           // I/O thread only
+    bool stop_ = false;
+    std::thread io_;
+};
+
+} // namespace usb_mdio
+
+#endif
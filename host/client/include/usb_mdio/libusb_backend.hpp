@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef USB_MDIO_LIBUSB_BACKEND_HPP_
+#define USB_MDIO_LIBUSB_BACKEND_HPP_
+
+#include "usb_mdio/client.hpp"
+
+namespace usb_mdio {
+
+// Real adapter through libusb. EP6 is read with several bulk IN transfers queued at all times, so a response
+// is picked up as soon as the firmware queued it, not one round trip after the previous one. EP8 of the sniffer
+// is read with one bulk transfer per receive_sniffed().
+class libusb_backend : public backend {
+public:
+    static constexpr uint16_t default_vid = 0x1286;
+    static constexpr uint16_t default_pid = 0x1fa4;
+
+    // Opens the first adapter with the VID/PID, detaching the mdio-mvusb kernel driver. Throws
+    // std::runtime_error if there is none.
+    explicit libusb_backend(unsigned in_transfers = 4, uint16_t vid = default_vid, uint16_t pid = default_pid);
+    ~libusb_backend() override;
+
+    bool send(const std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) override;
+    bool receive(std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) override;
+    bool receive_sniffed(std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) override;
+    bool control_out(uint8_t request, uint16_t value, uint16_t index, const std::vector<uint8_t> &data,
+                     std::chrono::milliseconds timeout) override;
+    void flush() override;
+
+private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+};
+
+} // namespace usb_mdio
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef USB_MDIO_PCAP_HPP_
+#define USB_MDIO_PCAP_HPP_
+
+// libpcap file of the frames of the bus sniffer for Wireshark or tcpdump: link type USER0, one packet per frame
+// with the 32 frame bits in big endian and the timestamp of the adapter.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "usb_mdio/client.hpp"
+
+namespace usb_mdio {
+
+class pcap_writer {
+public:
+    // Creates the file and writes the header. Throws std::runtime_error if that fails.
+    explicit pcap_writer(const std::string &path);
+    ~pcap_writer();
+
+    pcap_writer(const pcap_writer &) = delete;
+    pcap_writer &operator=(const pcap_writer &) = delete;
+
+    bool write(const sniffed_frame &frame);
+    bool write(const std::vector<sniffed_frame> &frames);
+
+    // Returns false if anything could not be written
+    bool close();
+
+private:
+    std::FILE *file_;
+    bool ok_ = true;
+};
+
+} // namespace usb_mdio
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef USB_MDIO_PROGRAM_HPP_
+#define USB_MDIO_PROGRAM_HPP_
+
+// Assembler for the microprograms run by USB_MDIO_OP_RUN_PROGRAM (USB_MDIO_PROG_* in usb_mdio_protocol.h).
+// Load the code with client::load_program() and run it with client::run_program():
+//
+//     program p;
+//     program::label next = p.set(0, 6).set(1, 0).here();
+//     p.read(2, program::from_reg(1), 1).emit(2).add(1, 1).loop(0, next).end();
+//     c.load_program(0, p.code());
+//     result r = c.run_program(0, 0, p.size(), 100000); // BMSR of PHY 0 .. 5 in r.values
+
+#include <cstdint>
+#include <vector>
+
+#include "usb_mdio_protocol.h"
+
+namespace usb_mdio {
+
+class program {
+public:
+    using label = unsigned;
+
+    // Address operand taken from a register instead of an immediate
+    static constexpr uint8_t from_reg(uint8_t r) { return USB_MDIO_PROG_ADDR_REG | r; }
+
+    program &read(uint8_t rd, uint8_t phy, uint8_t reg);
+    program &write(uint8_t phy, uint8_t reg, uint16_t value);
+    program &write_reg(uint8_t phy, uint8_t reg, uint8_t rs);
+    program &modify(uint8_t phy, uint8_t reg, uint16_t mask, uint16_t value);
+    program &poll(uint8_t phy, uint8_t reg, uint16_t mask, uint16_t expected, uint16_t interval_us,
+                  uint32_t timeout_us);
+    program &c45_read(uint8_t rd, uint8_t port, uint8_t devad, uint16_t reg);
+    program &c45_write(uint8_t port, uint8_t devad, uint16_t reg, uint16_t value);
+    program &delay(uint32_t us);
+    program &set(uint8_t rd, uint16_t value);
+    program &mov(uint8_t rd, uint8_t rs);
+    program &add(uint8_t rd, uint16_t value);
+    program &bit_and(uint8_t rd, uint16_t value);
+    program &bit_or(uint8_t rd, uint16_t value);
+    program &test(uint8_t rs, uint16_t mask, uint16_t expected);
+    program &jmp(label target);
+    program &jmp_if(label target);
+    program &jmp_ifnot(label target);
+    program &loop(uint8_t rd, label target);
+    program &emit(uint8_t rs);
+    program &bus(uint8_t bus);
+    program &fail(uint8_t status);
+    program &end();
+
+    // Labels: here() is bound to the next instruction, new_label() is bound later with bind() (forward jumps)
+    label here();
+    label new_label();
+    program &bind(label l);
+
+    // The code with all jumps resolved. Throws std::logic_error for unbound labels.
+    std::vector<uint8_t> code() const;
+    uint16_t size() const { return static_cast<uint16_t>(code_.size()); }
+
+private:
+    struct fixup {
+        size_t offset;
+        label target;
+    };
+
+    program &op(uint8_t opcode, std::initializer_list<uint8_t> operands);
+    program &jump(uint8_t opcode, std::initializer_list<uint8_t> operands, label target);
+    void put16(uint16_t value);
+
+    std::vector<uint8_t> code_;
+    std::vector<long> labels_; // Offset of each label, -1 until bound
+    std::vector<fixup> fixups_;
+};
+
+} // namespace usb_mdio
+
+#endif
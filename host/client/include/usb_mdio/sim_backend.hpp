@@ -0,0 +1,31 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef USB_MDIO_SIM_BACKEND_HPP_
+#define USB_MDIO_SIM_BACKEND_HPP_
+
+#include "usb_mdio/client.hpp"
+
+namespace usb_mdio {
+
+// In-process adapter: the host build of the firmware on the mock HAL (host/). The firmware is started and
+// enumerated by the first sim_backend and keeps running until the process exits, so attach the device
+// models (models/mdio_model.h) before creating it. Only one client may use the simulated adapter at a time.
+class sim_backend : public backend {
+public:
+    sim_backend();
+
+    bool send(const std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) override;
+    bool receive(std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) override;
+    bool receive_sniffed(std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) override;
+    bool control_out(uint8_t request, uint16_t value, uint16_t index, const std::vector<uint8_t> &data,
+                     std::chrono::milliseconds timeout) override;
+};
+
+} // namespace usb_mdio
+
+#endif
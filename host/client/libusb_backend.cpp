@@ -0,0 +1,206 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+#include <libusb.h>
+
+#include "usb_mdio/libusb_backend.hpp"
+
+namespace usb_mdio {
+
+#define LIBUSB_EP_COMMAND 0x02
+#define LIBUSB_EP_RESPONSE 0x86
+#define LIBUSB_EP_SNIFF 0x88
+#define LIBUSB_INTERFACE 0
+
+struct libusb_backend::impl {
+    libusb_context *ctx = nullptr;
+    libusb_device_handle *handle = nullptr;
+    bool claimed = false;
+
+    std::vector<libusb_transfer *> transfers;
+    std::vector<std::vector<uint8_t>> buffers;
+    std::atomic<unsigned> active{0}; // Submitted IN transfers
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::vector<uint8_t>> received;
+    std::vector<libusb_transfer *> stopped; // Not submitted again after an error, see flush()
+    bool failed = false;
+
+    std::atomic<bool> stop{false};
+    std::thread events;
+
+    static void LIBUSB_CALL in_done(libusb_transfer *t);
+    void close();
+};
+
+/**
+ * @brief Completion of an EP6 transfer. Runs in the event thread and submits the transfer again right away,
+ * unless EP6 failed: then it waits in the stopped list for flush().
+ */
+void LIBUSB_CALL libusb_backend::impl::in_done(libusb_transfer *t) {
+    impl *self = static_cast<impl *>(t->user_data);
+    bool resubmit;
+
+    {
+        std::lock_guard<std::mutex> lock(self->mutex);
+        if (t->status == LIBUSB_TRANSFER_COMPLETED)
+            self->received.emplace_back(t->buffer, t->buffer + t->actual_length);
+        else if (t->status != LIBUSB_TRANSFER_CANCELLED && t->status != LIBUSB_TRANSFER_TIMED_OUT)
+            self->failed = true;
+        resubmit = !self->stop && !self->failed;
+    }
+    self->cv.notify_all();
+
+    if (resubmit && libusb_submit_transfer(t) == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(self->mutex);
+        self->stopped.push_back(t);
+    }
+    self->active--;
+}
+
+void libusb_backend::impl::close() {
+    stop = true;
+    for (libusb_transfer *t : transfers)
+        libusb_cancel_transfer(t);
+
+    // The event thread keeps running until every cancelled transfer came back
+    if (events.joinable())
+        events.join();
+
+    for (libusb_transfer *t : transfers)
+        libusb_free_transfer(t);
+    if (claimed)
+        libusb_release_interface(handle, LIBUSB_INTERFACE);
+    if (handle)
+        libusb_close(handle);
+    if (ctx)
+        libusb_exit(ctx);
+}
+
+libusb_backend::libusb_backend(unsigned in_transfers, uint16_t vid, uint16_t pid) : impl_(std::make_unique<impl>()) {
+    impl &d = *impl_;
+
+    if (libusb_init(&d.ctx) != 0)
+        throw std::runtime_error("usb_mdio: libusb_init failed");
+
+    d.handle = libusb_open_device_with_vid_pid(d.ctx, vid, pid);
+    if (!d.handle) {
+        d.close();
+        throw std::runtime_error("usb_mdio: no adapter found");
+    }
+
+    libusb_set_auto_detach_kernel_driver(d.handle, 1);
+    int err = libusb_claim_interface(d.handle, LIBUSB_INTERFACE);
+    if (err != 0) {
+        d.close();
+        throw std::runtime_error(std::string("usb_mdio: cannot claim the interface: ") + libusb_error_name(err));
+    }
+    d.claimed = true;
+
+    d.buffers.resize(in_transfers ? in_transfers : 1, std::vector<uint8_t>(USB_MDIO_PACKET_SIZE));
+    for (std::vector<uint8_t> &buf : d.buffers) {
+        libusb_transfer *t = libusb_alloc_transfer(0);
+        libusb_fill_bulk_transfer(t, d.handle, LIBUSB_EP_RESPONSE, buf.data(), static_cast<int>(buf.size()),
+                                  impl::in_done, &d, 0);
+        d.transfers.push_back(t);
+
+        if (libusb_submit_transfer(t) == 0)
+            d.active++;
+        else
+            d.stopped.push_back(t);
+    }
+
+    d.events = std::thread([&d] {
+        while (!d.stop || d.active) {
+            timeval tv{0, 100000};
+            libusb_handle_events_timeout_completed(d.ctx, &tv, nullptr);
+        }
+    });
+}
+
+libusb_backend::~libusb_backend() {
+    impl_->close();
+}
+
+bool libusb_backend::send(const std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) {
+    int transferred = 0;
+    int err = libusb_bulk_transfer(impl_->handle, LIBUSB_EP_COMMAND, const_cast<uint8_t *>(packet.data()),
+                                   static_cast<int>(packet.size()), &transferred,
+                                   static_cast<unsigned>(timeout.count()));
+
+    return err == 0 && transferred == static_cast<int>(packet.size());
+}
+
+bool libusb_backend::receive(std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(impl_->mutex);
+
+    if (!impl_->cv.wait_for(lock, timeout, [this] { return !impl_->received.empty() || impl_->failed; }))
+        return false;
+    if (impl_->received.empty())
+        return false;
+
+    packet = std::move(impl_->received.front());
+    impl_->received.pop_front();
+    return true;
+}
+
+bool libusb_backend::receive_sniffed(std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) {
+    int transferred = 0;
+
+    packet.resize(USB_MDIO_PACKET_SIZE);
+    int err = libusb_bulk_transfer(impl_->handle, LIBUSB_EP_SNIFF, packet.data(), static_cast<int>(packet.size()),
+                                   &transferred, static_cast<unsigned>(timeout.count()));
+    packet.resize(transferred);
+
+    return err == 0;
+}
+
+void libusb_backend::flush() {
+    std::vector<libusb_transfer *> restart;
+    {
+        std::lock_guard<std::mutex> lock(impl_->mutex);
+        impl_->received.clear();
+        if (!impl_->failed)
+            return;
+
+        impl_->failed = false;
+        restart.swap(impl_->stopped);
+    }
+
+    // The error (a STALL, a babble) halted EP6 on the host side, clear it before the transfers go out again
+    libusb_clear_halt(impl_->handle, LIBUSB_EP_RESPONSE);
+
+    for (libusb_transfer *t : restart) {
+        if (libusb_submit_transfer(t) == 0) {
+            impl_->active++;
+        } else {
+            std::lock_guard<std::mutex> lock(impl_->mutex);
+            impl_->stopped.push_back(t);
+            impl_->failed = true;
+        }
+    }
+}
+
+bool libusb_backend::control_out(uint8_t request, uint16_t value, uint16_t index, const std::vector<uint8_t> &data,
+                                 std::chrono::milliseconds timeout) {
+    int len = libusb_control_transfer(impl_->handle, LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR |
+                                      LIBUSB_RECIPIENT_DEVICE, request, value, index,
+                                      const_cast<uint8_t *>(data.data()), static_cast<uint16_t>(data.size()),
+                                      static_cast<unsigned>(timeout.count()));
+
+    return len == static_cast<int>(data.size());
+}
+
+} // namespace usb_mdio
@@ -0,0 +1,53 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stdexcept>
+
+#include "usb_mdio/pcap.hpp"
+
+namespace usb_mdio {
+
+#define PCAP_LINKTYPE_USER0 147
+
+pcap_writer::pcap_writer(const std::string &path) : file_(std::fopen(path.c_str(), "wb")) {
+    if (!file_)
+        throw std::runtime_error("usb_mdio: cannot create " + path);
+
+    // Native byte order, version 2.4, microseconds
+    const uint32_t header[6] = {0xa1b2c3d4, 2 | 4 << 16, 0, 0, 65535, PCAP_LINKTYPE_USER0};
+    ok_ = std::fwrite(header, sizeof(header), 1, file_) == 1;
+}
+
+pcap_writer::~pcap_writer() {
+    close();
+}
+
+bool pcap_writer::write(const sniffed_frame &frame) {
+    const uint32_t record[4] = {frame.timestamp_us / 1000000, frame.timestamp_us % 1000000, 4, 4};
+    const uint8_t bits[4] = {uint8_t(frame.bits >> 24), uint8_t(frame.bits >> 16), uint8_t(frame.bits >> 8),
+                             uint8_t(frame.bits)};
+
+    ok_ &= file_ && std::fwrite(record, sizeof(record), 1, file_) == 1 &&
+           std::fwrite(bits, sizeof(bits), 1, file_) == 1;
+    return ok_;
+}
+
+bool pcap_writer::write(const std::vector<sniffed_frame> &frames) {
+    for (const sniffed_frame &frame : frames)
+        write(frame);
+    return ok_;
+}
+
+bool pcap_writer::close() {
+    if (file_) {
+        ok_ &= std::fclose(file_) == 0;
+        file_ = nullptr;
+    }
+    return ok_;
+}
+
+} // namespace usb_mdio
@@ -0,0 +1,185 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stdexcept>
+
+#include "usb_mdio/program.hpp"
+
+namespace usb_mdio {
+
+void program::put16(uint16_t value) {
+    code_.push_back(value & 0xff);
+    code_.push_back(value >> 8);
+}
+
+program &program::op(uint8_t opcode, std::initializer_list<uint8_t> operands) {
+    code_.push_back(opcode);
+    code_.insert(code_.end(), operands);
+    return *this;
+}
+
+program &program::jump(uint8_t opcode, std::initializer_list<uint8_t> operands, label target) {
+    op(opcode, operands);
+    fixups_.push_back({code_.size(), target});
+    put16(0);
+    return *this;
+}
+
+program &program::read(uint8_t rd, uint8_t phy, uint8_t reg) {
+    return op(USB_MDIO_PROG_READ, {rd, phy, reg});
+}
+
+program &program::write(uint8_t phy, uint8_t reg, uint16_t value) {
+    op(USB_MDIO_PROG_WRITE, {phy, reg});
+    put16(value);
+    return *this;
+}
+
+program &program::write_reg(uint8_t phy, uint8_t reg, uint8_t rs) {
+    return op(USB_MDIO_PROG_WRITE_REG, {phy, reg, rs});
+}
+
+program &program::modify(uint8_t phy, uint8_t reg, uint16_t mask, uint16_t value) {
+    op(USB_MDIO_PROG_MODIFY, {phy, reg});
+    put16(mask);
+    put16(value);
+    return *this;
+}
+
+program &program::poll(uint8_t phy, uint8_t reg, uint16_t mask, uint16_t expected, uint16_t interval_us,
+                       uint32_t timeout_us) {
+    op(USB_MDIO_PROG_POLL, {phy, reg});
+    put16(mask);
+    put16(expected);
+    put16(interval_us);
+    put16(timeout_us & 0xffff);
+    put16(timeout_us >> 16);
+    return *this;
+}
+
+program &program::c45_read(uint8_t rd, uint8_t port, uint8_t devad, uint16_t reg) {
+    op(USB_MDIO_PROG_C45_READ, {rd, port, devad});
+    put16(reg);
+    return *this;
+}
+
+program &program::c45_write(uint8_t port, uint8_t devad, uint16_t reg, uint16_t value) {
+    op(USB_MDIO_PROG_C45_WRITE, {port, devad});
+    put16(reg);
+    put16(value);
+    return *this;
+}
+
+program &program::delay(uint32_t us) {
+    op(USB_MDIO_PROG_DELAY, {});
+    put16(us & 0xffff);
+    put16(us >> 16);
+    return *this;
+}
+
+program &program::set(uint8_t rd, uint16_t value) {
+    op(USB_MDIO_PROG_SET, {rd});
+    put16(value);
+    return *this;
+}
+
+program &program::mov(uint8_t rd, uint8_t rs) {
+    return op(USB_MDIO_PROG_MOV, {rd, rs});
+}
+
+program &program::add(uint8_t rd, uint16_t value) {
+    op(USB_MDIO_PROG_ADD, {rd});
+    put16(value);
+    return *this;
+}
+
+program &program::bit_and(uint8_t rd, uint16_t value) {
+    op(USB_MDIO_PROG_AND, {rd});
+    put16(value);
+    return *this;
+}
+
+program &program::bit_or(uint8_t rd, uint16_t value) {
+    op(USB_MDIO_PROG_OR, {rd});
+    put16(value);
+    return *this;
+}
+
+program &program::test(uint8_t rs, uint16_t mask, uint16_t expected) {
+    op(USB_MDIO_PROG_TEST, {rs});
+    put16(mask);
+    put16(expected);
+    return *this;
+}
+
+program &program::jmp(label target) {
+    return jump(USB_MDIO_PROG_JMP, {}, target);
+}
+
+program &program::jmp_if(label target) {
+    return jump(USB_MDIO_PROG_JMP_IF, {}, target);
+}
+
+program &program::jmp_ifnot(label target) {
+    return jump(USB_MDIO_PROG_JMP_IFNOT, {}, target);
+}
+
+program &program::loop(uint8_t rd, label target) {
+    return jump(USB_MDIO_PROG_LOOP, {rd}, target);
+}
+
+program &program::emit(uint8_t rs) {
+    return op(USB_MDIO_PROG_EMIT, {rs});
+}
+
+program &program::bus(uint8_t bus) {
+    return op(USB_MDIO_PROG_BUS, {bus});
+}
+
+program &program::fail(uint8_t status) {
+    return op(USB_MDIO_PROG_FAIL, {status});
+}
+
+program &program::end() {
+    return op(USB_MDIO_PROG_END, {});
+}
+
+program::label program::here() {
+    label l = new_label();
+    bind(l);
+    return l;
+}
+
+program::label program::new_label() {
+    labels_.push_back(-1);
+    return static_cast<label>(labels_.size() - 1);
+}
+
+program &program::bind(label l) {
+    labels_.at(l) = static_cast<long>(code_.size());
+    return *this;
+}
+
+std::vector<uint8_t> program::code() const {
+    std::vector<uint8_t> code = code_;
+
+    for (const fixup &f : fixups_) {
+        long target = labels_.at(f.target);
+        if (target < 0)
+            throw std::logic_error("usb_mdio: jump to an unbound label");
+
+        code[f.offset] = target & 0xff;
+        code[f.offset + 1] = (target >> 8) & 0xff;
+    }
+
+    if (code.size() > USB_MDIO_PROGRAM_SIZE)
+        throw std::length_error("usb_mdio: program does not fit into a slot");
+
+    return code;
+}
+
+} // namespace usb_mdio
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <mutex>
+#include <stdexcept>
+
+#include "usb_mdio/sim_backend.hpp"
+
+extern "C" {
+#include "mock_hal.h"
+
+int firmware_main(void);
+}
+
+namespace usb_mdio {
+
+#define SIM_EP_COMMAND 2
+#define SIM_EP_RESPONSE 6
+#define SIM_EP_SNIFF 8
+
+sim_backend::sim_backend() {
+    static std::once_flag started;
+    static bool enumerated;
+
+    std::call_once(started, [] {
+        mock_hal_start(firmware_main);
+        enumerated = mock_usb_enumerate();
+    });
+
+    if (!enumerated)
+        throw std::runtime_error("usb_mdio: the simulated adapter did not enumerate");
+}
+
+bool sim_backend::send(const std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) {
+    return mock_usb_out_wait(SIM_EP_COMMAND, packet.data(), static_cast<uint16_t>(packet.size()),
+                             static_cast<uint32_t>(timeout.count()));
+}
+
+bool sim_backend::receive(std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) {
+    uint8_t buf[USB_MDIO_PACKET_SIZE];
+
+    int len = mock_usb_in_wait(SIM_EP_RESPONSE, buf, sizeof(buf), static_cast<uint32_t>(timeout.count()));
+    if (len < 0)
+        return false;
+
+    packet.assign(buf, buf + len);
+    return true;
+}
+
+bool sim_backend::receive_sniffed(std::vector<uint8_t> &packet, std::chrono::milliseconds timeout) {
+    uint8_t buf[USB_MDIO_PACKET_SIZE];
+
+    int len = mock_usb_in_wait(SIM_EP_SNIFF, buf, sizeof(buf), static_cast<uint32_t>(timeout.count()));
+    if (len < 0)
+        return false;
+
+    packet.assign(buf, buf + len);
+    return true;
+}
+
+bool sim_backend::control_out(uint8_t request, uint16_t value, uint16_t index, const std::vector<uint8_t> &data,
+                              std::chrono::milliseconds) {
+    std::vector<uint8_t> buf(data);
+    uint16_t len = static_cast<uint16_t>(buf.size());
+
+    return mock_usb_control(0x40, request, value, index, buf.data(), len) == len;
+}
+
+} // namespace usb_mdio
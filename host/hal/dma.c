@@ -0,0 +1,355 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// DMA channels of the mock HAL. Transfers run in zero wall time on the thread that triggered them; the
+// virtual clock is moved to the time of the last word that came out of a state machine.
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/structs/timer.h"
+
+#include "mock_internal.h"
+
+struct mock_dma_channel {
+    bool claimed;
+    bool busy;
+    bool irq0_enabled;
+    bool irq1_enabled;
+    dma_channel_config config;
+    const volatile uint8_t *read_addr;
+    volatile uint8_t *write_addr;
+    uint32_t trans_count;       // Reload value
+    uint32_t remaining;
+};
+
+static struct mock_dma_channel mock_dma_channels[NUM_DMA_CHANNELS];
+static dma_channel_hw_t mock_dma_hw[NUM_DMA_CHANNELS];
+static uint32_t mock_dma_ints[2]; // DMA_IRQ_0, DMA_IRQ_1
+static bool mock_dma_running;
+
+static struct mock_dma_channel *mock_dma_get(uint channel) {
+    if (channel >= NUM_DMA_CHANNELS)
+        panic("Invalid DMA channel %u", channel);
+
+    return &mock_dma_channels[channel];
+}
+
+static void mock_dma_update_hw(const struct mock_dma_channel *ch) {
+    dma_channel_hw_t *hw = &mock_dma_hw[ch - mock_dma_channels];
+
+    hw->read_addr = (uintptr_t) ch->read_addr;
+    hw->write_addr = (uintptr_t) ch->write_addr;
+    hw->transfer_count = ch->remaining;
+}
+
+/**
+ * @brief Address after a transfer of size bytes, wrapped if the ring of the channel applies to it
+ */
+static uintptr_t mock_dma_next_addr(const struct mock_dma_channel *ch, uintptr_t addr, uint size, bool write) {
+    uintptr_t next = addr + size;
+
+    if (ch->config.ring_size_bits && ch->config.ring_write == write) {
+        uintptr_t mask = ((uintptr_t) 1 << ch->config.ring_size_bits) - 1;
+        next = (addr & ~mask) | (next & mask);
+    }
+
+    return next;
+}
+
+/**
+ * @brief Move one word of a channel if its DREQ allows it. Returns false if the channel has to wait.
+ */
+static bool mock_dma_transfer_one(struct mock_dma_channel *ch, uint64_t *time_ps) {
+    uint pio;
+    uint sm;
+    bool tx;
+    uint size = 1u << ch->config.size;
+    uint32_t data = 0;
+
+    // Pacing: a PIO DREQ runs its state machine until the FIFO is ready or the state machine stalls
+    if (ch->config.dreq != DREQ_FORCE) {
+        uint dreq = ch->config.dreq;
+
+        pio = dreq / 8;
+        sm = dreq % 4;
+        bool dreq_tx = (dreq % 8) < 4;
+
+        while (dreq_tx ? mock_pio_tx_full(pio, sm) : mock_pio_rx_empty(pio, sm)) {
+            if (!mock_pio_step(pio, sm))
+                return false;
+        }
+    }
+
+    if (mock_pio_fifo_addr(ch->read_addr, &pio, &sm, &tx) && !tx) {
+        if (mock_pio_rx_empty(pio, sm))
+            return false;
+
+        uint64_t word_time_ps;
+        data = mock_pio_rx_pop(pio, sm, &word_time_ps);
+        *time_ps = MAX(*time_ps, word_time_ps);
+    } else if (ch->read_addr == (const volatile uint8_t *) &timer_hw->timerawl) {
+        // Not before the words moved so far in this run
+        data = (uint32_t) (MAX(*time_ps, mock_time_ps()) / MOCK_PS_PER_US);
+    } else {
+        memcpy(&data, (const void *) ch->read_addr, size);
+    }
+
+    if (mock_pio_fifo_addr(ch->write_addr, &pio, &sm, &tx) && tx) {
+        if (mock_pio_tx_full(pio, sm))
+            return false;
+
+        mock_pio_tx_push(pio, sm, data, mock_time_ps());
+    } else {
+        memcpy((void *) ch->write_addr, &data, size);
+    }
+
+    if (ch->config.read_increment)
+        ch->read_addr = (const volatile uint8_t *) mock_dma_next_addr(ch, (uintptr_t) ch->read_addr, size, false);
+    if (ch->config.write_increment)
+        ch->write_addr = (volatile uint8_t *) mock_dma_next_addr(ch, (uintptr_t) ch->write_addr, size, true);
+    ch->remaining--;
+    mock_dma_update_hw(ch);
+
+    return true;
+}
+
+static void mock_dma_trigger(uint channel) {
+    struct mock_dma_channel *ch = mock_dma_get(channel);
+
+    ch->remaining = ch->trans_count;
+    ch->busy = ch->config.enable;
+}
+
+void mock_dma_run(void) {
+    uint64_t time_ps = 0;
+    bool progress = true;
+
+    // Transfers started from within a run (chaining, IRQ free) are picked up by the outer loop
+    if (mock_dma_running)
+        return;
+
+    mock_lock();
+    mock_dma_running = true;
+
+    while (progress) {
+        progress = false;
+
+        for (uint i = 0; i < NUM_DMA_CHANNELS; i++) {
+            struct mock_dma_channel *ch = &mock_dma_channels[i];
+
+            while (ch->busy && ch->remaining && mock_dma_transfer_one(ch, &time_ps))
+                progress = true;
+
+            if (!ch->busy || ch->remaining)
+                continue;
+
+            ch->busy = false;
+            progress = true;
+
+            if (ch->irq0_enabled) {
+                mock_dma_ints[0] |= 1u << i;
+                mock_irq_raise(DMA_IRQ_0);
+            }
+            if (ch->irq1_enabled) {
+                mock_dma_ints[1] |= 1u << i;
+                mock_irq_raise(DMA_IRQ_1);
+            }
+
+            if (ch->config.chain_to != i)
+                mock_dma_trigger(ch->config.chain_to);
+        }
+    }
+
+    mock_dma_running = false;
+
+    // Whoever sees the completion sees it no earlier than the last word was sampled
+    if (time_ps > mock_time_ps())
+        mock_time_advance_to(time_ps);
+    mock_unlock();
+}
+
+bool mock_dma_irq_level(uint index) {
+    return mock_dma_ints[index] != 0;
+}
+
+// ********** SDK API **********
+// *****************************
+
+void dma_channel_claim(uint channel) {
+    mock_lock();
+    if (mock_dma_get(channel)->claimed)
+        panic("DMA channel %u already claimed", channel);
+    mock_dma_get(channel)->claimed = true;
+    mock_unlock();
+}
+
+void dma_channel_unclaim(uint channel) {
+    mock_lock();
+    mock_dma_get(channel)->claimed = false;
+    mock_unlock();
+}
+
+int dma_claim_unused_channel(bool required) {
+    int found = -1;
+
+    mock_lock();
+    for (uint i = 0; i < NUM_DMA_CHANNELS; i++) {
+        if (!mock_dma_channels[i].claimed) {
+            mock_dma_channels[i].claimed = true;
+            found = (int) i;
+            break;
+        }
+    }
+    mock_unlock();
+
+    if (found < 0 && required)
+        panic("No DMA channels are available");
+
+    return found;
+}
+
+bool dma_channel_is_claimed(uint channel) {
+    return mock_dma_get(channel)->claimed;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    return (dma_channel_config) {
+        .size = DMA_SIZE_32,
+        .read_increment = true,
+        .write_increment = false,
+        .dreq = DREQ_FORCE,
+        .chain_to = (uint8_t) channel,
+        .enable = true,
+    };
+}
+
+dma_channel_config dma_get_channel_config(uint channel) {
+    return mock_dma_get(channel)->config;
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger) {
+    mock_lock();
+    mock_dma_get(channel)->config = *config;
+    if (trigger)
+        dma_channel_start(channel);
+    mock_unlock();
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+    mock_lock();
+    mock_dma_get(channel)->read_addr = read_addr;
+    mock_dma_update_hw(mock_dma_get(channel));
+    if (trigger)
+        dma_channel_start(channel);
+    mock_unlock();
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger) {
+    mock_lock();
+    mock_dma_get(channel)->write_addr = write_addr;
+    mock_dma_update_hw(mock_dma_get(channel));
+    if (trigger)
+        dma_channel_start(channel);
+    mock_unlock();
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    mock_lock();
+    mock_dma_get(channel)->trans_count = trans_count;
+    if (trigger)
+        dma_channel_start(channel);
+    mock_unlock();
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    mock_lock();
+    dma_channel_set_read_addr(channel, read_addr, false);
+    dma_channel_set_write_addr(channel, write_addr, false);
+    dma_channel_set_trans_count(channel, transfer_count, false);
+    dma_channel_set_config(channel, config, trigger);
+    mock_unlock();
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count) {
+    mock_lock();
+    dma_channel_set_trans_count(channel, transfer_count, false);
+    dma_channel_set_read_addr(channel, read_addr, true);
+    mock_unlock();
+}
+
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void *write_addr, uint32_t transfer_count) {
+    mock_lock();
+    dma_channel_set_trans_count(channel, transfer_count, false);
+    dma_channel_set_write_addr(channel, write_addr, true);
+    mock_unlock();
+}
+
+void dma_channel_start(uint channel) {
+    mock_lock();
+    mock_dma_trigger(channel);
+    mock_dma_run();
+    mock_unlock();
+}
+
+void dma_channel_abort(uint channel) {
+    mock_lock();
+    mock_dma_get(channel)->busy = false;
+    mock_unlock();
+}
+
+bool dma_channel_is_busy(uint channel) {
+    mock_lock();
+    mock_dma_run();
+    bool busy = mock_dma_get(channel)->busy;
+    mock_unlock();
+
+    return busy;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel) {
+    while (dma_channel_is_busy(channel))
+        tight_loop_contents();
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+    mock_lock();
+    mock_dma_get(channel)->irq0_enabled = enabled;
+    mock_unlock();
+}
+
+bool dma_channel_get_irq0_status(uint channel) {
+    return __atomic_load_n(&mock_dma_ints[0], __ATOMIC_SEQ_CST) & (1u << channel);
+}
+
+void dma_channel_acknowledge_irq0(uint channel) {
+    __atomic_fetch_and(&mock_dma_ints[0], ~(1u << channel), __ATOMIC_SEQ_CST);
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled) {
+    mock_lock();
+    mock_dma_get(channel)->irq1_enabled = enabled;
+    if (!enabled)
+        __atomic_fetch_and(&mock_dma_ints[1], ~(1u << channel), __ATOMIC_SEQ_CST);
+    mock_unlock();
+}
+
+bool dma_channel_get_irq1_status(uint channel) {
+    return __atomic_load_n(&mock_dma_ints[1], __ATOMIC_SEQ_CST) & (1u << channel);
+}
+
+void dma_channel_acknowledge_irq1(uint channel) {
+    __atomic_fetch_and(&mock_dma_ints[1], ~(1u << channel), __ATOMIC_SEQ_CST);
+}
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel) {
+    mock_dma_get(channel);
+    return &mock_dma_hw[channel];
+}
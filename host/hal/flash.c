@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// Flash: erase/program of the XIP array and flash_safe_execute()
+
+#include <string.h>
+
+#include "hardware/flash.h"
+#include "pico/flash.h"
+
+#include "mock_internal.h"
+
+uint8_t mock_flash[PICO_FLASH_SIZE_BYTES];
+
+// Erased like a new chip before anything runs, the driver may program an image before mock_hal_start()
+__attribute__((constructor)) static void mock_flash_init(void) {
+    memset(mock_flash, 0xff, sizeof(mock_flash));
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    if (flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES)
+        panic("Invalid flash erase of %u bytes at 0x%x", (uint) count, (uint) flash_offs);
+
+    mock_lock();
+    memset(&mock_flash[flash_offs], 0xff, count);
+    mock_unlock();
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    if (flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES)
+        panic("Invalid flash program of %u bytes at 0x%x", (uint) count, (uint) flash_offs);
+
+    mock_lock();
+    for (size_t i = 0; i < count; i++)
+        mock_flash[flash_offs + i] &= data[i];
+    mock_unlock();
+}
+
+void mock_flash_write(uint32_t offset, const void *data, size_t len) {
+    if (offset + len > PICO_FLASH_SIZE_BYTES)
+        panic("Flash image of %u bytes at 0x%x does not fit", (uint) len, (uint) offset);
+
+    mock_lock();
+    memcpy(&mock_flash[offset], data, len);
+    mock_unlock();
+}
+
+bool flash_safe_execute_core_init(void) {
+    return true;
+}
+
+int flash_safe_execute(void (*func)(void *), void *param, __unused uint32_t enter_exit_timeout_ms) {
+    mock_lock();
+    func(param);
+    mock_unlock();
+
+    return PICO_OK;
+}
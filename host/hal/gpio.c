@@ -0,0 +1,288 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// GPIO pins of the mock HAL: SIO, pads and external drivers
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+
+#include "mock_internal.h"
+
+#define MOCK_MAX_DRIVERS 64
+#define MOCK_MAX_LISTENERS 8
+
+struct mock_gpio {
+    enum gpio_function function;
+    bool pull_up;
+    bool pull_down;
+    bool sio_out;
+    bool sio_oe;
+    enum gpio_drive_strength drive;
+    enum gpio_slew_rate slew;
+    bool hysteresis;
+
+    bool level;
+    bool oe; // Driven by SIO or PIO
+    uint32_t contention;
+};
+
+// Reset state of the pads: pull-down enabled, 4 mA, slow slew, Schmitt trigger on
+static struct mock_gpio mock_gpios[NUM_BANK0_GPIOS];
+static bool mock_gpios_reset;
+
+static struct {
+    uint pin;
+    enum mock_gpio_drive drive;
+} mock_drivers[MOCK_MAX_DRIVERS];
+static uint mock_num_drivers;
+
+static struct {
+    mock_gpio_listener_t listener;
+    void *context;
+} mock_listeners[MOCK_MAX_LISTENERS];
+static uint mock_num_listeners;
+
+// Time of the change the listeners are called for. Drivers changed by a listener change at the same time.
+static uint64_t mock_listener_time_ps;
+static uint mock_listener_depth;
+
+static struct mock_gpio *mock_gpio_get(uint pin) {
+    if (pin >= NUM_BANK0_GPIOS)
+        panic("Invalid GPIO %u", pin);
+
+    if (!mock_gpios_reset) {
+        for (uint i = 0; i < NUM_BANK0_GPIOS; i++) {
+            mock_gpios[i] = (struct mock_gpio) {
+                .function = GPIO_FUNC_NULL,
+                .pull_down = true,
+                .drive = GPIO_DRIVE_STRENGTH_4MA,
+                .slew = GPIO_SLEW_RATE_SLOW,
+                .hysteresis = true,
+            };
+        }
+        mock_gpios_reset = true;
+    }
+
+    return &mock_gpios[pin];
+}
+
+/**
+ * @brief Resolve the level of a pin from everything driving it and tell the listeners if it changed.
+ * Called with the HAL locked.
+ */
+void mock_gpio_update(uint pin, uint64_t time_ps) {
+    struct mock_gpio *g = mock_gpio_get(pin);
+    bool low = false;
+    bool high = false;
+    bool oe = false;
+    bool out = false;
+
+    switch (g->function) {
+        case GPIO_FUNC_SIO:
+            oe = g->sio_oe;
+            out = g->sio_out;
+            break;
+        case GPIO_FUNC_PIO0:
+        case GPIO_FUNC_PIO1:
+            oe = mock_pio_pin_oe(g->function - GPIO_FUNC_PIO0) & (1u << pin);
+            out = mock_pio_pin_out(g->function - GPIO_FUNC_PIO0) & (1u << pin);
+            break;
+        default:
+            break;
+    }
+
+    if (oe) {
+        low = !out;
+        high = out;
+    }
+
+    for (uint i = 0; i < mock_num_drivers; i++) {
+        if (mock_drivers[i].pin != pin)
+            continue;
+
+        low |= mock_drivers[i].drive == MOCK_GPIO_LOW;
+        high |= mock_drivers[i].drive == MOCK_GPIO_HIGH;
+    }
+
+    bool level = g->level; // Floating pins keep their level
+    if (low && high) {
+        g->contention++;
+        level = false;
+    } else if (low || high) {
+        level = high;
+    } else if (g->pull_up || g->pull_down) {
+        level = g->pull_up;
+    }
+
+    if (level == g->level) {
+        if (oe != g->oe) {
+            g->oe = oe;
+            mock_wave_record(pin, level, oe, time_ps);
+        }
+        return;
+    }
+
+    g->level = level;
+    g->oe = oe;
+    mock_wave_record(pin, level, oe, time_ps);
+
+    uint64_t previous_time_ps = mock_listener_time_ps;
+    mock_listener_time_ps = time_ps;
+    mock_listener_depth++;
+
+    for (uint i = 0; i < mock_num_listeners; i++)
+        mock_listeners[i].listener(mock_listeners[i].context, pin, level, time_ps);
+
+    mock_listener_depth--;
+    mock_listener_time_ps = previous_time_ps;
+}
+
+void mock_gpio_update_mask(uint32_t mask, uint64_t time_ps) {
+    while (mask) {
+        uint pin = __builtin_ctz(mask);
+        mask &= mask - 1;
+
+        if (pin < NUM_BANK0_GPIOS)
+            mock_gpio_update(pin, time_ps);
+    }
+}
+
+// ********** SDK API **********
+// *****************************
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+    mock_lock();
+    mock_gpio_get(gpio)->function = fn;
+    mock_gpio_update(gpio, mock_time_ps());
+    mock_unlock();
+}
+
+enum gpio_function gpio_get_function(uint gpio) {
+    return mock_gpio_get(gpio)->function;
+}
+
+void gpio_init(uint gpio) {
+    mock_lock();
+    struct mock_gpio *g = mock_gpio_get(gpio);
+    g->sio_oe = false;
+    g->sio_out = false;
+    gpio_set_function(gpio, GPIO_FUNC_SIO);
+    mock_unlock();
+}
+
+void gpio_deinit(uint gpio) {
+    gpio_set_function(gpio, GPIO_FUNC_NULL);
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down) {
+    mock_lock();
+    struct mock_gpio *g = mock_gpio_get(gpio);
+    g->pull_up = up;
+    g->pull_down = down;
+    mock_gpio_update(gpio, mock_time_ps());
+    mock_unlock();
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    mock_lock();
+    mock_gpio_get(gpio)->sio_oe = out;
+    mock_gpio_update(gpio, mock_time_ps());
+    mock_unlock();
+}
+
+void gpio_put(uint gpio, bool value) {
+    mock_lock();
+    mock_gpio_get(gpio)->sio_out = value;
+    mock_gpio_update(gpio, mock_time_ps());
+    mock_unlock();
+}
+
+bool gpio_get(uint gpio) {
+    return mock_gpio_level(gpio);
+}
+
+bool gpio_get_out_level(uint gpio) {
+    return mock_gpio_get(gpio)->sio_out;
+}
+
+void gpio_set_drive_strength(uint gpio, enum gpio_drive_strength drive) {
+    mock_gpio_get(gpio)->drive = drive;
+}
+
+enum gpio_drive_strength gpio_get_drive_strength(uint gpio) {
+    return mock_gpio_get(gpio)->drive;
+}
+
+void gpio_set_slew_rate(uint gpio, enum gpio_slew_rate slew) {
+    mock_gpio_get(gpio)->slew = slew;
+}
+
+enum gpio_slew_rate gpio_get_slew_rate(uint gpio) {
+    return mock_gpio_get(gpio)->slew;
+}
+
+void gpio_set_input_hysteresis_enabled(uint gpio, bool enabled) {
+    mock_gpio_get(gpio)->hysteresis = enabled;
+}
+
+bool gpio_is_input_hysteresis_enabled(uint gpio) {
+    return mock_gpio_get(gpio)->hysteresis;
+}
+
+// ********** Driver API **********
+// ********************************
+
+int mock_gpio_driver_add(uint pin) {
+    mock_lock();
+    mock_gpio_get(pin);
+
+    if (mock_num_drivers == MOCK_MAX_DRIVERS)
+        panic("Too many GPIO drivers");
+
+    int driver = (int) mock_num_drivers++;
+    mock_drivers[driver].pin = pin;
+    mock_drivers[driver].drive = MOCK_GPIO_RELEASE;
+    mock_unlock();
+
+    return driver;
+}
+
+void mock_gpio_driver_set(int driver, enum mock_gpio_drive drive) {
+    mock_lock();
+    if (mock_drivers[driver].drive != drive) {
+        mock_drivers[driver].drive = drive;
+        mock_gpio_update(mock_drivers[driver].pin, mock_listener_depth ? mock_listener_time_ps : mock_time_ps());
+    }
+    mock_unlock();
+}
+
+void mock_gpio_add_listener(mock_gpio_listener_t listener, void *context) {
+    mock_lock();
+    if (mock_num_listeners == MOCK_MAX_LISTENERS)
+        panic("Too many GPIO listeners");
+
+    mock_listeners[mock_num_listeners].listener = listener;
+    mock_listeners[mock_num_listeners].context = context;
+    mock_num_listeners++;
+    mock_unlock();
+}
+
+bool mock_gpio_level(uint pin) {
+    mock_lock();
+    bool level = mock_gpio_get(pin)->level;
+    mock_unlock();
+
+    return level;
+}
+
+bool mock_gpio_oe(uint pin) {
+    return mock_gpio_get(pin)->oe;
+}
+
+uint32_t mock_gpio_contention(uint pin) {
+    return mock_gpio_get(pin)->contention;
+}
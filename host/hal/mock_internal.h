@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef MOCK_INTERNAL_H_
+#define MOCK_INTERNAL_H_
+
+#include "pico.h"
+#include "hardware/address_mapped.h"
+#include "hardware/clocks.h"
+#include "mock_hal.h"
+
+// Shared between the parts of the mock HAL, not used by the firmware or the driver
+
+#define MOCK_PS_PER_US 1000000ull
+#define MOCK_SYS_CLK_PS (1000000000000ull / MOCK_CLK_SYS_HZ)
+
+// Everything below the SDK API is serialized by mock_lock(). Interrupts are never raised while it is held:
+// mock_irq_raise() called with the lock held is deferred until the outermost mock_unlock().
+
+// Move the virtual clock forward to time_ps (never backwards). Runs the state machines up to the new time.
+void mock_time_advance_to(uint64_t time_ps);
+
+void mock_irq_raise(uint irq);
+
+// Enabled on any core
+bool mock_irq_enabled(uint irq);
+
+// Wall clock for timeouts
+uint64_t mock_wall_ms(void);
+
+// GPIO
+void mock_gpio_update(uint pin, uint64_t time_ps);
+void mock_gpio_update_mask(uint32_t mask, uint64_t time_ps);
+bool mock_gpio_oe(uint pin);
+
+// Waveform recording, called for every change of the level or the output enable of a pin
+void mock_wave_record(uint pin, bool level, bool oe, uint64_t time_ps);
+
+// PIO
+bool mock_pio_fifo_addr(const volatile void *addr, uint *pio, uint *sm, bool *tx);
+bool mock_pio_step(uint pio, uint sm);
+bool mock_pio_tx_full(uint pio, uint sm);
+bool mock_pio_rx_empty(uint pio, uint sm);
+void mock_pio_tx_push(uint pio, uint sm, uint32_t data, uint64_t time_ps);
+uint32_t mock_pio_rx_pop(uint pio, uint sm, uint64_t *time_ps);
+void mock_pio_run_until(uint64_t time_ps);
+uint32_t mock_pio_pin_out(uint pio);
+uint32_t mock_pio_pin_oe(uint pio);
+
+// DMA
+void mock_dma_run(void);
+bool mock_dma_irq_level(uint index); // 0 for DMA_IRQ_0, 1 for DMA_IRQ_1
+
+// USB
+void mock_usb_reset(void);
+bool mock_usb_irq_level(void);
+
+#endif
@@ -0,0 +1,939 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// PIO emulator of the mock HAL. Every state machine has its own position on the virtual clock: the issue time
+// of its next instruction. A stalled instruction keeps that time until the FIFO it waits for is served; a
+// word written to a FIFO carries the time it was written, so the state machine continues no earlier than that.
+
+#include <sched.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+
+#include "mock_internal.h"
+
+#define MOCK_PIO_FIFO_MAX 8 // Joined FIFO
+
+enum {
+    PIO_OP_JMP = 0,
+    PIO_OP_WAIT,
+    PIO_OP_IN,
+    PIO_OP_OUT,
+    PIO_OP_PUSH_PULL,
+    PIO_OP_MOV,
+    PIO_OP_IRQ,
+    PIO_OP_SET,
+};
+
+struct mock_pio_fifo {
+    uint32_t data[MOCK_PIO_FIFO_MAX];
+    uint64_t time_ps[MOCK_PIO_FIFO_MAX];
+    uint head;
+    uint level;
+};
+
+struct mock_pio_sm {
+    bool claimed;
+    bool enabled;
+    pio_sm_config config;
+
+    uint8_t pc;
+    uint32_t x;
+    uint32_t y;
+    uint32_t osr;
+    uint32_t isr;
+    uint8_t osr_count; // Bits shifted out of the OSR, 32 is empty
+    uint8_t isr_count; // Bits shifted into the ISR
+
+    struct mock_pio_fifo tx;
+    struct mock_pio_fifo rx;
+
+    // Instruction executed instead of the one at pc (pio_sm_exec, OUT/MOV EXEC)
+    bool exec_pending;
+    uint16_t exec_instr;
+    // IRQ WAIT set its flag and waits for it to be cleared
+    bool irq_waiting;
+
+    uint64_t time_ps;
+};
+
+struct mock_pio {
+    uint16_t instr_mem[PIO_INSTRUCTION_COUNT];
+    uint32_t used_instr;
+    uint32_t pin_out;
+    uint32_t pin_oe;
+    uint8_t irq;
+    struct mock_pio_sm sm[NUM_PIO_STATE_MACHINES];
+};
+
+pio_hw_t mock_pio_hw[NUM_PIOS];
+static struct mock_pio mock_pios[NUM_PIOS];
+
+static struct mock_pio_sm *mock_sm(PIO pio, uint sm) {
+    return &mock_pios[pio_get_index(pio)].sm[sm];
+}
+
+static uint mock_fifo_depth(const struct mock_pio_sm *s, bool tx) {
+    enum pio_fifo_join join = s->config.fifo_join;
+
+    if (join == PIO_FIFO_JOIN_NONE)
+        return PIO_FIFO_DEPTH;
+
+    return (join == PIO_FIFO_JOIN_TX) == tx ? 2 * PIO_FIFO_DEPTH : 0;
+}
+
+static void mock_fifo_push(struct mock_pio_fifo *f, uint32_t data, uint64_t time_ps) {
+    uint i = (f->head + f->level++) % MOCK_PIO_FIFO_MAX;
+
+    f->data[i] = data;
+    f->time_ps[i] = time_ps;
+}
+
+static uint32_t mock_fifo_pop(struct mock_pio_fifo *f, uint64_t *time_ps) {
+    uint32_t data = f->data[f->head];
+
+    if (time_ps)
+        *time_ps = f->time_ps[f->head];
+
+    f->head = (f->head + 1) % MOCK_PIO_FIFO_MAX;
+    f->level--;
+    return data;
+}
+
+static uint64_t mock_sm_cycle_ps(const struct mock_pio_sm *s) {
+    uint64_t div = (uint64_t) (s->config.clkdiv_int ? s->config.clkdiv_int : 65536) * 256 + s->config.clkdiv_frac;
+
+    return MOCK_SYS_CLK_PS * div / 256;
+}
+
+// ********** Pins **********
+// **************************
+
+uint32_t mock_pio_pin_out(uint pio) {
+    return mock_pios[pio].pin_out;
+}
+
+uint32_t mock_pio_pin_oe(uint pio) {
+    return mock_pios[pio].pin_oe;
+}
+
+static uint32_t mock_pin_mask(uint base, uint count) {
+    uint32_t mask = count >= 32 ? 0xffffffff : (1u << count) - 1;
+
+    return (mask << base) | (base ? mask >> (32 - base) : 0);
+}
+
+static uint32_t mock_pin_values(uint32_t values, uint base) {
+    return (values << base) | (base ? values >> (32 - base) : 0);
+}
+
+static void mock_write_pins(struct mock_pio *p, bool oe, uint base, uint count, uint32_t values, uint64_t time_ps) {
+    uint32_t mask = mock_pin_mask(base, count);
+    uint32_t *reg = oe ? &p->pin_oe : &p->pin_out;
+    uint32_t updated = (*reg & ~mask) | (mock_pin_values(values, base) & mask);
+
+    if (updated == *reg)
+        return;
+
+    *reg = updated;
+    mock_gpio_update_mask(mask, time_ps);
+}
+
+static uint32_t mock_read_pins(uint base) {
+    uint32_t levels = 0;
+
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++)
+        levels |= (uint32_t) mock_gpio_level(i) << i;
+
+    return (levels >> base) | (base ? levels << (32 - base) : 0);
+}
+
+// ********** Execution **********
+// *******************************
+
+static uint32_t mock_shift_out(struct mock_pio_sm *s, uint count) {
+    uint32_t data;
+
+    if (count == 32) {
+        data = s->osr;
+        s->osr = 0;
+    } else if (s->config.out_shift_right) {
+        data = s->osr & ((1u << count) - 1);
+        s->osr >>= count;
+    } else {
+        data = s->osr >> (32 - count);
+        s->osr <<= count;
+    }
+
+    s->osr_count = MIN(32, s->osr_count + count);
+    return data;
+}
+
+static void mock_shift_in(struct mock_pio_sm *s, uint32_t data, uint count) {
+    if (count == 32)
+        s->isr = data;
+    else if (s->config.in_shift_right)
+        s->isr = (s->isr >> count) | (data << (32 - count));
+    else
+        s->isr = (s->isr << count) | (data & ((1u << count) - 1));
+
+    s->isr_count = MIN(32, s->isr_count + count);
+}
+
+static bool mock_pull(struct mock_pio_sm *s) {
+    if (s->tx.level == 0)
+        return false;
+
+    uint64_t time_ps;
+    s->osr = mock_fifo_pop(&s->tx, &time_ps);
+    s->osr_count = 0;
+
+    // The word can not be used before it was written
+    s->time_ps = MAX(s->time_ps, time_ps);
+    return true;
+}
+
+static bool mock_push(struct mock_pio_sm *s) {
+    if (s->rx.level >= mock_fifo_depth(s, false))
+        return false;
+
+    mock_fifo_push(&s->rx, s->isr, s->time_ps);
+    s->isr = 0;
+    s->isr_count = 0;
+    return true;
+}
+
+static uint mock_irq_index(uint sm, uint index) {
+    // Relative IRQ numbers add the state machine number modulo 4
+    if (index & 0x10)
+        return (index & 0x4) | ((index + sm) & 0x3);
+
+    return index & 0x7;
+}
+
+/**
+ * @brief Execute one instruction of a state machine. Returns false if it stalls.
+ */
+static bool mock_execute(struct mock_pio *p, uint sm_num) {
+    struct mock_pio_sm *s = &p->sm[sm_num];
+    const pio_sm_config *c = &s->config;
+    bool from_exec = s->exec_pending;
+    uint16_t instr = from_exec ? s->exec_instr : p->instr_mem[s->pc];
+
+    uint op = instr >> 13;
+    uint arg1 = (instr >> 5) & 0x7;
+    uint arg2 = instr & 0x1f;
+
+    // Delay and side-set share bits 12:8
+    uint sideset_bits = c->sideset_bit_count;
+    uint delay_bits = 5 - sideset_bits;
+    uint delay = (instr >> 8) & ((1u << delay_bits) - 1);
+
+    if (sideset_bits) {
+        uint field = (instr >> (8 + delay_bits)) & ((1u << sideset_bits) - 1);
+        uint value_bits = sideset_bits - (c->sideset_optional ? 1 : 0);
+        bool enabled = !c->sideset_optional || (field >> value_bits);
+
+        if (enabled)
+            mock_write_pins(p, c->sideset_pindirs, c->sideset_base, value_bits, field & ((1u << value_bits) - 1),
+                            s->time_ps);
+    }
+
+    bool jump = false;
+    uint8_t target = 0;
+
+    switch (op) {
+        case PIO_OP_JMP: {
+            bool condition;
+
+            switch (arg1) {
+                case 0: condition = true; break;
+                case 1: condition = s->x == 0; break;
+                case 2: condition = s->x-- != 0; break;
+                case 3: condition = s->y == 0; break;
+                case 4: condition = s->y-- != 0; break;
+                case 5: condition = s->x != s->y; break;
+                case 6: condition = mock_gpio_level(c->jmp_pin); break;
+                default: condition = s->osr_count < c->pull_threshold; break;
+            }
+
+            jump = condition;
+            target = arg2;
+            break;
+        }
+
+        case PIO_OP_WAIT: {
+            bool polarity = arg1 >> 2;
+            bool level;
+
+            switch (arg1 & 0x3) {
+                case 0: level = mock_gpio_level(arg2); break;
+                case 1: level = mock_read_pins(c->in_base + arg2) & 1; break;
+                case 2: level = p->irq & (1u << mock_irq_index(sm_num, arg2)); break;
+                default: panic("Invalid WAIT source in 0x%04x", instr);
+            }
+
+            if (level != polarity)
+                return false;
+
+            if ((arg1 & 0x3) == 2 && polarity)
+                p->irq &= ~(1u << mock_irq_index(sm_num, arg2));
+            break;
+        }
+
+        case PIO_OP_IN: {
+            uint count = arg2 ? arg2 : 32;
+            uint32_t data;
+
+            if (c->autopush && s->isr_count >= c->push_threshold && !mock_push(s))
+                return false;
+
+            switch (arg1) {
+                case 0: data = mock_read_pins(c->in_base); break;
+                case 1: data = s->x; break;
+                case 2: data = s->y; break;
+                case 3: data = 0; break;
+                case 6: data = s->isr; break;
+                case 7: data = s->osr; break;
+                default: panic("Invalid IN source in 0x%04x", instr);
+            }
+
+            mock_shift_in(s, data, count);
+
+            if (c->autopush && s->isr_count >= c->push_threshold)
+                mock_push(s);
+            break;
+        }
+
+        case PIO_OP_OUT: {
+            uint count = arg2 ? arg2 : 32;
+
+            if (c->autopull && s->osr_count >= c->pull_threshold && !mock_pull(s))
+                return false;
+
+            uint32_t data = mock_shift_out(s, count);
+
+            switch (arg1) {
+                case 0: mock_write_pins(p, false, c->out_base, MIN(count, c->out_count), data, s->time_ps); break;
+                case 1: s->x = data; break;
+                case 2: s->y = data; break;
+                case 3: break;
+                case 4: mock_write_pins(p, true, c->out_base, MIN(count, c->out_count), data, s->time_ps); break;
+                case 5: jump = true; target = data & 0x1f; break;
+                case 6: s->isr = data; s->isr_count = count; break;
+                case 7: s->exec_instr = (uint16_t) data; break;
+            }
+            break;
+        }
+
+        case PIO_OP_PUSH_PULL: {
+            bool pull = instr & 0x80;
+            bool if_flag = instr & 0x40;
+            bool block = instr & 0x20;
+
+            if (pull) {
+                if (if_flag && s->osr_count < c->pull_threshold)
+                    break;
+
+                if (!mock_pull(s)) {
+                    if (block)
+                        return false;
+
+                    // Non-blocking PULL from an empty FIFO copies X
+                    s->osr = s->x;
+                    s->osr_count = 0;
+                }
+            } else {
+                if (if_flag && s->isr_count < c->push_threshold)
+                    break;
+
+                if (!mock_push(s)) {
+                    if (block)
+                        return false;
+
+                    s->isr = 0;
+                    s->isr_count = 0;
+                }
+            }
+            break;
+        }
+
+        case PIO_OP_MOV: {
+            uint32_t data;
+
+            switch (instr & 0x7) {
+                case 0: data = mock_read_pins(c->in_base); break;
+                case 1: data = s->x; break;
+                case 2: data = s->y; break;
+                case 3: data = 0; break;
+                case 5: {
+                    uint level = c->status_sel == STATUS_TX_LESSTHAN ? s->tx.level : s->rx.level;
+                    data = level < c->status_n ? 0xffffffff : 0;
+                    break;
+                }
+                case 6: data = s->isr; break;
+                case 7: data = s->osr; break;
+                default: panic("Invalid MOV source in 0x%04x", instr);
+            }
+
+            switch ((instr >> 3) & 0x3) {
+                case 1: data = ~data; break;
+                case 2: {
+                    uint32_t reversed = 0;
+                    for (uint i = 0; i < 32; i++)
+                        reversed |= ((data >> i) & 1u) << (31 - i);
+                    data = reversed;
+                    break;
+                }
+            }
+
+            switch (arg1) {
+                case 0: mock_write_pins(p, false, c->out_base, c->out_count, data, s->time_ps); break;
+                case 1: s->x = data; break;
+                case 2: s->y = data; break;
+                case 4: s->exec_instr = (uint16_t) data; break;
+                case 5: jump = true; target = data & 0x1f; break;
+                case 6: s->isr = data; s->isr_count = 0; break;
+                case 7: s->osr = data; s->osr_count = 0; break;
+                default: panic("Invalid MOV destination in 0x%04x", instr);
+            }
+            break;
+        }
+
+        case PIO_OP_IRQ: {
+            uint bit = 1u << mock_irq_index(sm_num, arg2);
+            bool clear = instr & 0x40;
+            bool wait = instr & 0x20;
+
+            if (clear) {
+                p->irq &= ~bit;
+            } else if (!s->irq_waiting) {
+                p->irq |= bit;
+                s->irq_waiting = wait;
+            }
+
+            if (s->irq_waiting) {
+                if (p->irq & bit)
+                    return false;
+                s->irq_waiting = false;
+            }
+            break;
+        }
+
+        case PIO_OP_SET:
+            switch (arg1) {
+                case 0: mock_write_pins(p, false, c->set_base, c->set_count, arg2, s->time_ps); break;
+                case 1: s->x = arg2; break;
+                case 2: s->y = arg2; break;
+                case 4: mock_write_pins(p, true, c->set_base, c->set_count, arg2, s->time_ps); break;
+                default: panic("Invalid SET destination in 0x%04x", instr);
+            }
+            break;
+    }
+
+    // The instruction completed. OUT/MOV EXEC queue the next instruction in exec_instr.
+    bool exec_next = (op == PIO_OP_OUT && arg1 == 7) || (op == PIO_OP_MOV && arg1 == 4);
+
+    s->exec_pending = exec_next;
+    if (jump)
+        s->pc = target;
+    else if (!from_exec)
+        s->pc = s->pc == c->wrap ? c->wrap_target : (s->pc + 1) % PIO_INSTRUCTION_COUNT;
+
+    s->time_ps += mock_sm_cycle_ps(s) * (exec_next ? 1 : 1 + delay);
+    return true;
+}
+
+bool mock_pio_step(uint pio, uint sm) {
+    struct mock_pio *p = &mock_pios[pio];
+
+    if (!p->sm[sm].enabled && !p->sm[sm].exec_pending)
+        return false;
+
+    return mock_execute(p, sm);
+}
+
+void mock_pio_run_until(uint64_t time_ps) {
+    for (uint i = 0; i < NUM_PIOS; i++) {
+        for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+            struct mock_pio_sm *s = &mock_pios[i].sm[sm];
+
+            if (!s->enabled)
+                continue;
+
+            // A stalled state machine waits at its time, it can not be behind the clock when it continues
+            while (s->time_ps < time_ps && mock_execute(&mock_pios[i], sm))
+                ;
+
+            // Pins only change in between, so a WAIT for a pin was not satisfied up to now either
+            uint16_t instr = s->exec_pending ? s->exec_instr : mock_pios[i].instr_mem[s->pc];
+            if (s->time_ps < time_ps && instr >> 13 == PIO_OP_WAIT && ((instr >> 5) & 0x3) != 2)
+                s->time_ps = time_ps;
+        }
+    }
+}
+
+bool mock_pio_fifo_addr(const volatile void *addr, uint *pio, uint *sm, bool *tx) {
+    for (uint i = 0; i < NUM_PIOS; i++) {
+        for (uint n = 0; n < NUM_PIO_STATE_MACHINES; n++) {
+            if (addr == &mock_pio_hw[i].txf[n] || addr == &mock_pio_hw[i].rxf[n]) {
+                *pio = i;
+                *sm = n;
+                *tx = addr == &mock_pio_hw[i].txf[n];
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool mock_pio_tx_full(uint pio, uint sm) {
+    struct mock_pio_sm *s = &mock_pios[pio].sm[sm];
+
+    return s->tx.level >= mock_fifo_depth(s, true);
+}
+
+bool mock_pio_rx_empty(uint pio, uint sm) {
+    return mock_pios[pio].sm[sm].rx.level == 0;
+}
+
+void mock_pio_tx_push(uint pio, uint sm, uint32_t data, uint64_t time_ps) {
+    struct mock_pio_sm *s = &mock_pios[pio].sm[sm];
+
+    if (s->tx.level < mock_fifo_depth(s, true))
+        mock_fifo_push(&s->tx, data, time_ps);
+}
+
+uint32_t mock_pio_rx_pop(uint pio, uint sm, uint64_t *time_ps) {
+    struct mock_pio_sm *s = &mock_pios[pio].sm[sm];
+
+    if (s->rx.level == 0) {
+        *time_ps = s->time_ps;
+        return 0;
+    }
+
+    return mock_fifo_pop(&s->rx, time_ps);
+}
+
+// ********** SDK API: configuration **********
+// ********************************************
+
+pio_sm_config pio_get_default_sm_config(void) {
+    pio_sm_config c = {0};
+
+    c.clkdiv_int = 1;
+    c.wrap_target = 0;
+    c.wrap = PIO_INSTRUCTION_COUNT - 1;
+    c.in_shift_right = true;
+    c.out_shift_right = true;
+    c.pull_threshold = 32;
+    c.push_threshold = 32;
+    c.out_count = 32;
+    return c;
+}
+
+void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count) {
+    c->out_base = out_base;
+    c->out_count = out_count;
+}
+
+void sm_config_set_set_pins(pio_sm_config *c, uint set_base, uint set_count) {
+    c->set_base = set_base;
+    c->set_count = set_count;
+}
+
+void sm_config_set_in_pins(pio_sm_config *c, uint in_base) {
+    c->in_base = in_base;
+}
+
+void sm_config_set_sideset_pins(pio_sm_config *c, uint sideset_base) {
+    c->sideset_base = sideset_base;
+}
+
+void sm_config_set_sideset(pio_sm_config *c, uint bit_count, bool optional, bool pindirs) {
+    c->sideset_bit_count = bit_count;
+    c->sideset_optional = optional;
+    c->sideset_pindirs = pindirs;
+}
+
+void sm_config_set_clkdiv_int_frac(pio_sm_config *c, uint16_t div_int, uint8_t div_frac) {
+    c->clkdiv_int = div_int;
+    c->clkdiv_frac = div_frac;
+}
+
+static void mock_clkdiv_split(float div, uint16_t *div_int, uint8_t *div_frac) {
+    *div_int = (uint16_t) div;
+    *div_frac = *div_int ? (uint8_t) ((div - (float) *div_int) * 256.0f) : 0;
+}
+
+void sm_config_set_clkdiv(pio_sm_config *c, float div) {
+    uint16_t div_int;
+    uint8_t div_frac;
+
+    mock_clkdiv_split(div, &div_int, &div_frac);
+    sm_config_set_clkdiv_int_frac(c, div_int, div_frac);
+}
+
+void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap) {
+    c->wrap_target = wrap_target;
+    c->wrap = wrap;
+}
+
+void sm_config_set_jmp_pin(pio_sm_config *c, uint pin) {
+    c->jmp_pin = pin;
+}
+
+void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold) {
+    c->in_shift_right = shift_right;
+    c->autopush = autopush;
+    c->push_threshold = push_threshold ? push_threshold : 32;
+}
+
+void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold) {
+    c->out_shift_right = shift_right;
+    c->autopull = autopull;
+    c->pull_threshold = pull_threshold ? pull_threshold : 32;
+}
+
+void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join) {
+    c->fifo_join = join;
+}
+
+void sm_config_set_mov_status(pio_sm_config *c, enum pio_mov_status_type status_sel, uint status_n) {
+    c->status_sel = status_sel;
+    c->status_n = status_n;
+}
+
+// ********** SDK API: instruction memory **********
+// *************************************************
+
+uint pio_get_index(PIO pio) {
+    return pio == pio1 ? 1 : 0;
+}
+
+static int mock_find_offset(struct mock_pio *p, const pio_program_t *program) {
+    uint32_t mask = (1u << program->length) - 1;
+
+    if (program->origin >= 0) {
+        if (program->origin + program->length > PIO_INSTRUCTION_COUNT)
+            return -1;
+        return (p->used_instr & (mask << program->origin)) ? -1 : program->origin;
+    }
+
+    // Like the SDK: highest free offset first
+    for (int offset = PIO_INSTRUCTION_COUNT - program->length; offset >= 0; offset--) {
+        if (!(p->used_instr & (mask << offset)))
+            return offset;
+    }
+
+    return -1;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program) {
+    mock_lock();
+    bool ok = mock_find_offset(&mock_pios[pio_get_index(pio)], program) >= 0;
+    mock_unlock();
+
+    return ok;
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+    mock_lock();
+    struct mock_pio *p = &mock_pios[pio_get_index(pio)];
+    int offset = mock_find_offset(p, program);
+
+    if (offset < 0)
+        panic("No program space");
+
+    for (uint i = 0; i < program->length; i++) {
+        uint16_t instr = program->instructions[i];
+
+        // JMP targets are relative to the program
+        if ((instr >> 13) == PIO_OP_JMP)
+            instr += offset;
+
+        p->instr_mem[offset + i] = instr;
+    }
+
+    p->used_instr |= ((1u << program->length) - 1) << offset;
+    mock_unlock();
+
+    return (uint) offset;
+}
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset) {
+    mock_lock();
+    mock_pios[pio_get_index(pio)].used_instr &= ~(((1u << program->length) - 1) << loaded_offset);
+    mock_unlock();
+}
+
+void pio_clear_instruction_memory(PIO pio) {
+    mock_lock();
+    mock_pios[pio_get_index(pio)].used_instr = 0;
+    memset(mock_pios[pio_get_index(pio)].instr_mem, 0, sizeof(mock_pios[0].instr_mem));
+    mock_unlock();
+}
+
+// ********** SDK API: state machines **********
+// *********************************************
+
+void pio_sm_claim(PIO pio, uint sm) {
+    mock_lock();
+    if (mock_sm(pio, sm)->claimed)
+        panic("PIO %u SM %u already claimed", pio_get_index(pio), sm);
+    mock_sm(pio, sm)->claimed = true;
+    mock_unlock();
+}
+
+void pio_sm_unclaim(PIO pio, uint sm) {
+    mock_lock();
+    mock_sm(pio, sm)->claimed = false;
+    mock_unlock();
+}
+
+int pio_claim_unused_sm(PIO pio, bool required) {
+    int found = -1;
+
+    mock_lock();
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (!mock_sm(pio, sm)->claimed) {
+            mock_sm(pio, sm)->claimed = true;
+            found = (int) sm;
+            break;
+        }
+    }
+    mock_unlock();
+
+    if (found < 0 && required)
+        panic("No PIO state machines are available");
+
+    return found;
+}
+
+bool pio_sm_is_claimed(PIO pio, uint sm) {
+    return mock_sm(pio, sm)->claimed;
+}
+
+void pio_gpio_init(PIO pio, uint pin) {
+    gpio_set_function(pin, pio == pio1 ? GPIO_FUNC_PIO1 : GPIO_FUNC_PIO0);
+}
+
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config) {
+    mock_lock();
+    mock_sm(pio, sm)->config = *config;
+    mock_unlock();
+}
+
+void pio_sm_restart(PIO pio, uint sm) {
+    mock_lock();
+    struct mock_pio_sm *s = mock_sm(pio, sm);
+    s->osr_count = 32;
+    s->isr_count = 0;
+    s->exec_pending = false;
+    s->irq_waiting = false;
+    mock_unlock();
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+    mock_lock();
+    struct mock_pio_sm *s = mock_sm(pio, sm);
+    s->tx.level = 0;
+    s->rx.level = 0;
+    mock_unlock();
+}
+
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+    mock_lock();
+    struct mock_pio_sm *s = mock_sm(pio, sm);
+
+    s->enabled = false;
+    s->config = *config;
+    pio_sm_clear_fifos(pio, sm);
+    pio_sm_restart(pio, sm);
+    s->pc = initial_pc;
+    s->time_ps = mock_time_ps();
+    mock_unlock();
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+    mock_lock();
+    struct mock_pio_sm *s = mock_sm(pio, sm);
+
+    // Bring the other state machines up to now first
+    mock_pio_run_until(mock_time_ps());
+
+    if (enabled && !s->enabled)
+        s->time_ps = MAX(s->time_ps, mock_time_ps());
+    s->enabled = enabled;
+    mock_unlock();
+}
+
+void pio_sm_clkdiv_restart(PIO pio, uint sm) {
+    mock_lock();
+    struct mock_pio_sm *s = mock_sm(pio, sm);
+    s->time_ps = MAX(s->time_ps, mock_time_ps());
+    mock_unlock();
+}
+
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac) {
+    mock_lock();
+    sm_config_set_clkdiv_int_frac(&mock_sm(pio, sm)->config, div_int, div_frac);
+    mock_unlock();
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div) {
+    uint16_t div_int;
+    uint8_t div_frac;
+
+    mock_clkdiv_split(div, &div_int, &div_frac);
+    pio_sm_set_clkdiv_int_frac(pio, sm, div_int, div_frac);
+}
+
+uint8_t pio_sm_get_pc(PIO pio, uint sm) {
+    return mock_sm(pio, sm)->pc;
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr) {
+    mock_lock();
+    struct mock_pio_sm *s = mock_sm(pio, sm);
+
+    s->exec_pending = true;
+    s->exec_instr = (uint16_t) instr;
+    s->time_ps = MAX(s->time_ps, mock_time_ps());
+    mock_execute(&mock_pios[pio_get_index(pio)], sm);
+    s->exec_pending = false;
+    mock_unlock();
+}
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask) {
+    (void) sm;
+    mock_lock();
+    struct mock_pio *p = &mock_pios[pio_get_index(pio)];
+    p->pin_out = (p->pin_out & ~pin_mask) | (pin_values & pin_mask);
+    mock_gpio_update_mask(pin_mask, mock_time_ps());
+    mock_unlock();
+}
+
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values) {
+    pio_sm_set_pins_with_mask(pio, sm, pin_values, 0xffffffff);
+}
+
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask) {
+    (void) sm;
+    mock_lock();
+    struct mock_pio *p = &mock_pios[pio_get_index(pio)];
+    p->pin_oe = (p->pin_oe & ~pin_mask) | (pin_dirs & pin_mask);
+    mock_gpio_update_mask(pin_mask, mock_time_ps());
+    mock_unlock();
+}
+
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+    uint32_t mask = mock_pin_mask(pin_base, pin_count);
+
+    pio_sm_set_pindirs_with_mask(pio, sm, is_out ? mask : 0, mask);
+}
+
+// ********** SDK API: FIFOs **********
+// ************************************
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+    mock_lock();
+    mock_pio_tx_push(pio_get_index(pio), sm, data, mock_time_ps());
+    mock_dma_run();
+    mock_unlock();
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) {
+    uint index = pio_get_index(pio);
+
+    mock_lock();
+    while (mock_pio_tx_full(index, sm)) {
+        // Let the state machine make room. If it waits for somebody else, give the other threads a chance.
+        if (!mock_pio_step(index, sm)) {
+            mock_unlock();
+            sched_yield();
+            mock_lock();
+        }
+    }
+
+    mock_pio_tx_push(index, sm, data, mock_time_ps());
+    mock_dma_run();
+    mock_unlock();
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm) {
+    uint64_t time_ps;
+
+    mock_lock();
+    uint32_t data = mock_pio_rx_pop(pio_get_index(pio), sm, &time_ps);
+    mock_dma_run();
+    mock_unlock();
+
+    return data;
+}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm) {
+    uint index = pio_get_index(pio);
+    uint64_t time_ps;
+
+    mock_lock();
+    while (mock_pio_rx_empty(index, sm)) {
+        if (!mock_pio_step(index, sm)) {
+            mock_unlock();
+            sched_yield();
+            mock_lock();
+        }
+    }
+
+    uint32_t data = mock_pio_rx_pop(index, sm, &time_ps);
+
+    // The CPU waited for the word
+    mock_time_advance_to(time_ps);
+    mock_dma_run();
+    mock_unlock();
+
+    return data;
+}
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm) {
+    struct mock_pio_sm *s = mock_sm(pio, sm);
+
+    return s->rx.level >= mock_fifo_depth(s, false);
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm) {
+    return mock_sm(pio, sm)->rx.level == 0;
+}
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm) {
+    return mock_sm(pio, sm)->rx.level;
+}
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm) {
+    return mock_pio_tx_full(pio_get_index(pio), sm);
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm) {
+    return mock_sm(pio, sm)->tx.level == 0;
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm) {
+    return mock_sm(pio, sm)->tx.level;
+}
+
+void pio_sm_drain_tx_fifo(PIO pio, uint sm) {
+    mock_lock();
+    mock_sm(pio, sm)->tx.level = 0;
+    mock_unlock();
+}
+
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+    return (pio == pio1 ? DREQ_PIO1_TX0 : DREQ_PIO0_TX0) + (is_tx ? 0 : 4) + sm;
+}
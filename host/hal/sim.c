@@ -0,0 +1,568 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// Threads, interrupts, spin locks, inter-core FIFOs and the virtual clock of the mock HAL
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "hardware/resets.h"
+#include "hardware/structs/timer.h"
+
+#include "mock_internal.h"
+
+#define MOCK_SHARED_HANDLERS 4
+#define MOCK_FIFO_DEPTH 8
+
+// ********** HAL lock and deferred interrupts **********
+// ******************************************************
+
+static pthread_mutex_t mock_hal_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static __thread uint mock_lock_depth;
+static __thread uint32_t mock_deferred_irqs;
+
+void mock_lock(void) {
+    pthread_mutex_lock(&mock_hal_lock);
+    mock_lock_depth++;
+}
+
+void mock_unlock(void) {
+    uint32_t irqs = 0;
+
+    if (--mock_lock_depth == 0) {
+        irqs = mock_deferred_irqs;
+        mock_deferred_irqs = 0;
+    }
+    pthread_mutex_unlock(&mock_hal_lock);
+
+    while (irqs) {
+        uint irq = __builtin_ctz(irqs);
+        irqs &= irqs - 1;
+        mock_irq_raise(irq);
+    }
+}
+
+// ********** Virtual clock **********
+// ***********************************
+
+static volatile uint64_t mock_now_ps;
+
+timer_hw_t mock_timer_hw;
+
+uint64_t mock_time_ps(void) {
+    return __atomic_load_n(&mock_now_ps, __ATOMIC_SEQ_CST);
+}
+
+void mock_time_advance_to(uint64_t time_ps) {
+    mock_lock();
+    if (time_ps > mock_now_ps)
+        __atomic_store_n(&mock_now_ps, time_ps, __ATOMIC_SEQ_CST);
+
+    mock_pio_run_until(mock_now_ps);
+    mock_dma_run();
+    mock_unlock();
+}
+
+void mock_time_advance_us(uint64_t us) {
+    mock_time_advance_ns(us * 1000);
+}
+
+void mock_time_advance_ns(uint64_t ns) {
+    mock_lock();
+    mock_time_advance_to(mock_now_ps + ns * 1000);
+    mock_unlock();
+}
+
+uint64_t time_us_64(void) {
+    return mock_time_ps() / MOCK_PS_PER_US;
+}
+
+void busy_wait_us(uint64_t delay_us) {
+    mock_time_advance_us(delay_us);
+
+    // The other core keeps running while this one waits
+    sched_yield();
+}
+
+void busy_wait_us_32(uint32_t delay_us) {
+    busy_wait_us(delay_us);
+}
+
+void busy_wait_ms(uint32_t delay_ms) {
+    busy_wait_us((uint64_t) delay_ms * 1000);
+}
+
+uint64_t mock_wall_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    switch (clk_index) {
+        case clk_sys:
+        case clk_peri:
+            return MOCK_CLK_SYS_HZ;
+        case clk_usb:
+        case clk_adc:
+            return 48000000;
+        case clk_ref:
+            return 12000000;
+        case clk_rtc:
+            return 46875;
+        default:
+            return 0;
+    }
+}
+
+void reset_unreset_block_num_wait_blocking(uint block_num) {
+    if (block_num == RESET_USBCTRL)
+        mock_usb_reset();
+}
+
+// ********** Cores and interrupts **********
+// ******************************************
+
+static __thread uint mock_core_num;
+
+// Interrupt mask of a core. Holding the lock means interrupts are disabled on that core.
+struct mock_core {
+    pthread_mutex_t lock;
+    pthread_t owner;
+    uint depth;
+    uint32_t pending; // Raised while the owner had interrupts disabled
+    uint32_t enabled;
+};
+
+static struct mock_core mock_cores[NUM_CORES] = {
+    {.lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP},
+    {.lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP},
+};
+
+static struct {
+    irq_handler_t exclusive;
+    irq_handler_t shared[MOCK_SHARED_HANDLERS];
+    uint8_t order[MOCK_SHARED_HANDLERS];
+    uint num_shared;
+} mock_irq_handlers[NUM_IRQS];
+
+// Default vector of the USB controller. The firmware provides it.
+void isr_usbctrl(void);
+
+uint get_core_num(void) {
+    return mock_core_num;
+}
+
+void tight_loop_contents(void) {
+    sched_yield();
+}
+
+void __wfe(void) {
+    sched_yield();
+}
+
+void __wfi(void) {
+    sched_yield();
+}
+
+static void mock_core_mask(struct mock_core *core) {
+    pthread_mutex_lock(&core->lock);
+    core->owner = pthread_self();
+    core->depth++;
+}
+
+/**
+ * @brief Unmask one level. Returns the interrupts raised meanwhile if interrupts are enabled again.
+ */
+static uint32_t mock_core_unmask(struct mock_core *core) {
+    uint32_t pending = 0;
+
+    if (--core->depth == 0) {
+        pending = core->pending;
+        core->pending = 0;
+    }
+    pthread_mutex_unlock(&core->lock);
+
+    return pending;
+}
+
+static void mock_irq_call_handlers(uint irq) {
+    if (mock_irq_handlers[irq].exclusive) {
+        mock_irq_handlers[irq].exclusive();
+    } else if (mock_irq_handlers[irq].num_shared) {
+        for (uint i = 0; i < mock_irq_handlers[irq].num_shared; i++)
+            mock_irq_handlers[irq].shared[i]();
+    } else if (irq == USBCTRL_IRQ) {
+        isr_usbctrl();
+    } else {
+        panic("Unhandled IRQ %u", irq);
+    }
+}
+
+static void mock_run_pending(uint core_num, uint32_t pending);
+
+/**
+ * @brief Run the handlers of irq as core_num in the calling thread, with interrupts of that core disabled
+ * like the NVIC does for an active interrupt of the same priority.
+ */
+static void mock_irq_run(uint core_num, uint irq) {
+    struct mock_core *core = &mock_cores[core_num];
+    uint previous_core = mock_core_num;
+
+    mock_core_num = core_num;
+    mock_core_mask(core);
+    mock_irq_call_handlers(irq);
+    uint32_t pending = mock_core_unmask(core);
+    mock_core_num = previous_core;
+
+    mock_run_pending(core_num, pending);
+}
+
+static void mock_run_pending(uint core_num, uint32_t pending) {
+    while (pending) {
+        uint irq = __builtin_ctz(pending);
+        pending &= pending - 1;
+        mock_irq_run(core_num, irq);
+    }
+}
+
+void mock_irq_raise(uint irq) {
+    if (mock_lock_depth) {
+        mock_deferred_irqs |= 1u << irq;
+        return;
+    }
+
+    for (uint core_num = 0; core_num < NUM_CORES; core_num++) {
+        struct mock_core *core = &mock_cores[core_num];
+
+        if (!(__atomic_load_n(&core->enabled, __ATOMIC_SEQ_CST) & (1u << irq)))
+            continue;
+
+        // The target core is this thread with interrupts disabled: deliver when they are enabled again
+        if (core->depth && pthread_equal(core->owner, pthread_self())) {
+            core->pending |= 1u << irq;
+            continue;
+        }
+
+        // Otherwise interrupt it, waiting for it to enable interrupts first
+        mock_irq_run(core_num, irq);
+    }
+}
+
+uint32_t save_and_disable_interrupts(void) {
+    struct mock_core *core = &mock_cores[mock_core_num];
+
+    mock_core_mask(core);
+    return core->depth > 1;
+}
+
+void restore_interrupts(__unused uint32_t status) {
+    uint core_num = mock_core_num;
+
+    mock_run_pending(core_num, mock_core_unmask(&mock_cores[core_num]));
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+    mock_irq_handlers[num].exclusive = handler;
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+    uint i = mock_irq_handlers[num].num_shared;
+
+    if (i == MOCK_SHARED_HANDLERS)
+        panic("Too many shared handlers for IRQ %u", num);
+
+    // Higher order priority runs first
+    while (i && mock_irq_handlers[num].order[i - 1] < order_priority) {
+        mock_irq_handlers[num].shared[i] = mock_irq_handlers[num].shared[i - 1];
+        mock_irq_handlers[num].order[i] = mock_irq_handlers[num].order[i - 1];
+        i--;
+    }
+
+    mock_irq_handlers[num].shared[i] = handler;
+    mock_irq_handlers[num].order[i] = order_priority;
+    mock_irq_handlers[num].num_shared++;
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+    if (mock_irq_handlers[num].exclusive == handler) {
+        mock_irq_handlers[num].exclusive = NULL;
+        return;
+    }
+
+    for (uint i = 0; i < mock_irq_handlers[num].num_shared; i++) {
+        if (mock_irq_handlers[num].shared[i] != handler)
+            continue;
+
+        mock_irq_handlers[num].num_shared--;
+        for (; i < mock_irq_handlers[num].num_shared; i++) {
+            mock_irq_handlers[num].shared[i] = mock_irq_handlers[num].shared[i + 1];
+            mock_irq_handlers[num].order[i] = mock_irq_handlers[num].order[i + 1];
+        }
+        return;
+    }
+}
+
+bool mock_irq_enabled(uint irq) {
+    uint32_t enabled = 0;
+
+    for (uint i = 0; i < NUM_CORES; i++)
+        enabled |= __atomic_load_n(&mock_cores[i].enabled, __ATOMIC_SEQ_CST);
+
+    return enabled & (1u << irq);
+}
+
+bool irq_is_enabled(uint num) {
+    return mock_cores[mock_core_num].enabled & (1u << num);
+}
+
+static bool mock_fifo_irq_level(uint core_num);
+
+void irq_set_enabled(uint num, bool enabled) {
+    struct mock_core *core = &mock_cores[mock_core_num];
+
+    if (!enabled) {
+        __atomic_fetch_and(&core->enabled, ~(1u << num), __ATOMIC_SEQ_CST);
+        return;
+    }
+
+    __atomic_fetch_or(&core->enabled, 1u << num, __ATOMIC_SEQ_CST);
+
+    // Interrupt sources are level sensitive. An active source interrupts right away.
+    bool active = false;
+    switch (num) {
+        case USBCTRL_IRQ:
+            active = mock_usb_irq_level();
+            break;
+        case DMA_IRQ_0:
+        case DMA_IRQ_1:
+            active = mock_dma_irq_level(num - DMA_IRQ_0);
+            break;
+        case SIO_IRQ_PROC0:
+        case SIO_IRQ_PROC1:
+            active = mock_fifo_irq_level(num - SIO_IRQ_PROC0);
+            break;
+    }
+
+    if (active)
+        mock_irq_raise(num);
+}
+
+void irq_set_pending(uint num) {
+    mock_irq_raise(num);
+}
+
+// ********** Spin locks **********
+// ********************************
+
+static spin_lock_t mock_spin_locks[NUM_SPIN_LOCKS];
+static pthread_mutex_t mock_spin_lock_mutexes[NUM_SPIN_LOCKS];
+static uint32_t mock_spin_locks_claimed;
+static pthread_once_t mock_spin_locks_once = PTHREAD_ONCE_INIT;
+
+static void mock_spin_locks_init(void) {
+    for (uint i = 0; i < NUM_SPIN_LOCKS; i++)
+        pthread_mutex_init(&mock_spin_lock_mutexes[i], NULL);
+}
+
+spin_lock_t *spin_lock_instance(uint lock_num) {
+    pthread_once(&mock_spin_locks_once, mock_spin_locks_init);
+    return &mock_spin_locks[lock_num];
+}
+
+uint spin_lock_get_num(spin_lock_t *lock) {
+    return (uint) (lock - mock_spin_locks);
+}
+
+spin_lock_t *spin_lock_init(uint lock_num) {
+    return spin_lock_instance(lock_num);
+}
+
+uint32_t spin_lock_blocking(spin_lock_t *lock) {
+    uint32_t save = save_and_disable_interrupts();
+
+    pthread_mutex_lock(&mock_spin_lock_mutexes[spin_lock_get_num(lock)]);
+    return save;
+}
+
+void spin_unlock(spin_lock_t *lock, uint32_t saved_irq) {
+    pthread_mutex_unlock(&mock_spin_lock_mutexes[spin_lock_get_num(lock)]);
+    restore_interrupts(saved_irq);
+}
+
+void spin_lock_claim(uint lock_num) {
+    if (__atomic_fetch_or(&mock_spin_locks_claimed, 1u << lock_num, __ATOMIC_SEQ_CST) & (1u << lock_num))
+        panic("Spin lock %u already claimed", lock_num);
+}
+
+void spin_lock_unclaim(uint lock_num) {
+    __atomic_fetch_and(&mock_spin_locks_claimed, ~(1u << lock_num), __ATOMIC_SEQ_CST);
+}
+
+int spin_lock_claim_unused(bool required) {
+    for (uint i = PICO_SPINLOCK_ID_CLAIM_FREE_FIRST; i < NUM_SPIN_LOCKS; i++) {
+        uint32_t bit = 1u << i;
+
+        if (!(__atomic_fetch_or(&mock_spin_locks_claimed, bit, __ATOMIC_SEQ_CST) & bit))
+            return (int) i;
+    }
+
+    if (required)
+        panic("No spin locks are available");
+
+    return -1;
+}
+
+// ********** Inter-core FIFOs **********
+// **************************************
+
+// mock_fifos[n] is the RX FIFO of core n
+static struct {
+    uint32_t data[MOCK_FIFO_DEPTH];
+    uint head;
+    uint count;
+} mock_fifos[NUM_CORES];
+
+static pthread_mutex_t mock_fifo_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mock_fifo_cond = PTHREAD_COND_INITIALIZER;
+
+static bool mock_fifo_irq_level(uint core_num) {
+    pthread_mutex_lock(&mock_fifo_mutex);
+    bool level = mock_fifos[core_num].count != 0;
+    pthread_mutex_unlock(&mock_fifo_mutex);
+
+    return level;
+}
+
+bool multicore_fifo_rvalid(void) {
+    return mock_fifo_irq_level(mock_core_num);
+}
+
+bool multicore_fifo_wready(void) {
+    pthread_mutex_lock(&mock_fifo_mutex);
+    bool ready = mock_fifos[mock_core_num ^ 1].count < MOCK_FIFO_DEPTH;
+    pthread_mutex_unlock(&mock_fifo_mutex);
+
+    return ready;
+}
+
+void multicore_fifo_push_blocking(uint32_t data) {
+    uint target = mock_core_num ^ 1;
+
+    pthread_mutex_lock(&mock_fifo_mutex);
+    while (mock_fifos[target].count == MOCK_FIFO_DEPTH)
+        pthread_cond_wait(&mock_fifo_cond, &mock_fifo_mutex);
+
+    mock_fifos[target].data[(mock_fifos[target].head + mock_fifos[target].count++) % MOCK_FIFO_DEPTH] = data;
+    pthread_cond_broadcast(&mock_fifo_cond);
+    pthread_mutex_unlock(&mock_fifo_mutex);
+
+    mock_irq_raise(SIO_IRQ_PROC0 + target);
+}
+
+uint32_t multicore_fifo_pop_blocking(void) {
+    uint self = mock_core_num;
+
+    pthread_mutex_lock(&mock_fifo_mutex);
+    while (mock_fifos[self].count == 0)
+        pthread_cond_wait(&mock_fifo_cond, &mock_fifo_mutex);
+
+    uint32_t data = mock_fifos[self].data[mock_fifos[self].head];
+    mock_fifos[self].head = (mock_fifos[self].head + 1) % MOCK_FIFO_DEPTH;
+    mock_fifos[self].count--;
+    pthread_cond_broadcast(&mock_fifo_cond);
+    pthread_mutex_unlock(&mock_fifo_mutex);
+
+    return data;
+}
+
+void multicore_fifo_drain(void) {
+    while (multicore_fifo_rvalid())
+        multicore_fifo_pop_blocking();
+}
+
+void multicore_fifo_clear_irq(void) {
+    // No overflow/underflow flags in the mock
+}
+
+// ********** Threads **********
+// *****************************
+
+struct mock_thread_start {
+    uint core_num;
+    void (*core1_entry)(void);
+    int (*firmware_main)(void);
+};
+
+static void *mock_core_thread(void *arg) {
+    struct mock_thread_start start = *(struct mock_thread_start *) arg;
+
+    free(arg);
+    mock_core_num = start.core_num;
+
+    if (start.firmware_main)
+        start.firmware_main();
+    else
+        start.core1_entry();
+
+    return NULL;
+}
+
+static void mock_start_thread(uint core_num, void (*core1_entry)(void), int (*firmware_main)(void)) {
+    struct mock_thread_start *start = malloc(sizeof(*start));
+    pthread_t thread;
+
+    *start = (struct mock_thread_start) {core_num, core1_entry, firmware_main};
+    if (pthread_create(&thread, NULL, mock_core_thread, start))
+        panic("Can not start core%u", core_num);
+    pthread_detach(thread);
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+    mock_start_thread(1, entry, NULL);
+}
+
+void multicore_reset_core1(void) {
+    panic_unsupported();
+}
+
+void mock_hal_start(int (*firmware_main)(void)) {
+    // Keep the firmware output and the driver output in order
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    mock_start_thread(0, NULL, firmware_main);
+}
+
+void panic(const char *fmt, ...) {
+    va_list args;
+
+    fflush(stdout);
+    fprintf(stderr, "\n*** PANIC on core%u at %llu us ***\n", mock_core_num, (unsigned long long) time_us_64());
+
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+
+    fprintf(stderr, "\n");
+    abort();
+}
+
+void panic_unsupported(void) {
+    panic("not supported");
+}
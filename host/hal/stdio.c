@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// stdio: printf() of the firmware to the host stdout and the stdio drivers of the firmware
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "pico/stdio.h"
+#include "pico/stdio/driver.h"
+
+// Longest output of one printf() handed to the drivers, the host stdout gets everything
+#define MOCK_STDIO_LINE_MAX 512
+#define MOCK_STDIO_MAX_DRIVERS 4
+
+static pthread_mutex_t mock_stdio_mutex = PTHREAD_MUTEX_INITIALIZER;
+static stdio_driver_t *mock_stdio_drivers;
+
+void stdio_set_driver_enabled(stdio_driver_t *driver, bool enabled) {
+    pthread_mutex_lock(&mock_stdio_mutex);
+
+    stdio_driver_t **prev = &mock_stdio_drivers;
+    while (*prev && *prev != driver)
+        prev = &(*prev)->next;
+
+    if (enabled && !*prev) {
+        driver->next = NULL;
+        *prev = driver;
+    } else if (!enabled && *prev) {
+        *prev = driver->next;
+    }
+
+    pthread_mutex_unlock(&mock_stdio_mutex);
+}
+
+int mock_printf(const char *format, ...) {
+    char buf[MOCK_STDIO_LINE_MAX];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+
+    // The drivers are called without the mutex, they take the locks of the firmware (and mask interrupts).
+    // Each gets the output of one printf() in one call.
+    stdio_driver_t *drivers[MOCK_STDIO_MAX_DRIVERS];
+    uint count = 0;
+
+    pthread_mutex_lock(&mock_stdio_mutex);
+    for (stdio_driver_t *driver = mock_stdio_drivers; driver && count < MOCK_STDIO_MAX_DRIVERS; driver = driver->next)
+        drivers[count++] = driver;
+    pthread_mutex_unlock(&mock_stdio_mutex);
+
+    for (uint i = 0; i < count && len > 0; i++)
+        drivers[i]->out_chars(buf, MIN(len, (int) sizeof(buf) - 1));
+
+    return len;
+}
@@ -0,0 +1,367 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// USB device controller of the mock HAL, seen from the host side. Every mock_usb_* call is one transaction
+// on the bus: it looks at the buffer control registers like the controller does, moves the data through
+// the DPRAM, updates the status registers and then raises USBCTRL_IRQ until the firmware handled it.
+
+#include <sched.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/regs/usb.h"
+#include "hardware/structs/usb.h"
+
+#include "mock_internal.h"
+
+// Interrupts the ISR does not clear: the firmware is stuck
+#define MOCK_USB_IRQ_STORM 100
+
+#define USB_REQ_GET_DESCRIPTOR 0x06
+#define USB_REQ_SET_ADDRESS 0x05
+#define USB_REQ_SET_CONFIGURATION 0x09
+#define USB_DT_DEVICE 0x01
+#define USB_DT_CONFIG 0x02
+
+usb_device_dpram_t mock_usb_dpram __aligned(4096);
+usb_hw_t mock_usb_hw;
+
+// Buffer the controller uses next, per endpoint and direction (0 = IN, 1 = OUT)
+static uint8_t mock_usb_buf_sel[USB_NUM_ENDPOINTS][2];
+
+void mock_usb_reset(void) {
+    memset((void *) &mock_usb_hw, 0, sizeof(mock_usb_hw));
+    memset(mock_usb_buf_sel, 0, sizeof(mock_usb_buf_sel));
+}
+
+/**
+ * @brief Compute the interrupt status from the status registers. Called with the HAL locked.
+ */
+static uint32_t mock_usb_update_ints(void) {
+    uint32_t intr = 0;
+    uint32_t sie_status = mock_usb_hw.sie_status;
+
+    if (mock_usb_hw.buf_status)
+        intr |= USB_INTS_BUFF_STATUS_BITS;
+    if (sie_status & USB_SIE_STATUS_SETUP_REC_BITS)
+        intr |= USB_INTS_SETUP_REQ_BITS;
+    if (sie_status & USB_SIE_STATUS_BUS_RESET_BITS)
+        intr |= USB_INTS_BUS_RESET_BITS;
+    if (mock_usb_hw.ep_nak_stall_status)
+        intr |= USB_INTS_EP_STALL_NAK_BITS;
+
+    mock_usb_hw.intr = intr;
+    mock_usb_hw.ints = (intr & mock_usb_hw.inte) | mock_usb_hw.intf;
+    return mock_usb_hw.ints;
+}
+
+bool mock_usb_irq_level(void) {
+    mock_lock();
+    bool level = mock_usb_update_ints() != 0;
+    mock_unlock();
+
+    return level;
+}
+
+/**
+ * @brief Interrupt the firmware until it handled everything the last transaction raised. Called without the
+ * HAL lock: the ISR runs in this thread.
+ */
+static void mock_usb_interrupt(void) {
+    for (uint i = 0; mock_usb_irq_level() && mock_irq_enabled(USBCTRL_IRQ); i++) {
+        if (i == MOCK_USB_IRQ_STORM)
+            panic("USB interrupt 0x%08x is not cleared by the firmware", (uint) mock_usb_hw.ints);
+
+        mock_irq_raise(USBCTRL_IRQ);
+    }
+}
+
+// ********** Transactions **********
+// **********************************
+
+struct mock_usb_buffer {
+    volatile uint16_t *control;
+    volatile uint8_t *data;
+    bool interrupt;
+    bool nak_interrupt;
+};
+
+/**
+ * @brief Find the buffer the controller uses for the next transaction of an endpoint. Returns false if the
+ * endpoint is not enabled.
+ */
+static bool mock_usb_buffer(uint ep, bool in, struct mock_usb_buffer *b) {
+    volatile uint32_t *buf_ctrl = in ? &mock_usb_dpram.ep_buf_ctrl[ep].in : &mock_usb_dpram.ep_buf_ctrl[ep].out;
+    volatile uint16_t *halves = (volatile uint16_t *) buf_ctrl;
+
+    if (ep == 0) {
+        // EP0 is single buffered, both directions share buffer A
+        b->control = &halves[0];
+        b->data = mock_usb_dpram.ep0_buf_a;
+        b->interrupt = mock_usb_hw.sie_ctrl & USB_SIE_CTRL_EP0_INT_1BUF_BITS;
+        b->nak_interrupt = false;
+        return true;
+    }
+
+    uint32_t ep_ctrl = in ? mock_usb_dpram.ep_ctrl[ep - 1].in : mock_usb_dpram.ep_ctrl[ep - 1].out;
+    if (!(ep_ctrl & EP_CTRL_ENABLE_BITS))
+        return false;
+
+    uint sel = 0;
+    if (ep_ctrl & EP_CTRL_DOUBLE_BUFFERED_BITS) {
+        // Prefer the buffer in turn, but take the other one if only that one is available
+        sel = mock_usb_buf_sel[ep][!in];
+        if (!(halves[sel] & USB_BUF_CTRL_AVAIL) && (halves[sel ^ 1] & USB_BUF_CTRL_AVAIL))
+            sel ^= 1;
+        mock_usb_buf_sel[ep][!in] = sel;
+    }
+
+    b->control = &halves[sel];
+    b->data = (volatile uint8_t *) &mock_usb_dpram + (ep_ctrl & 0xffc0) + sel * 64;
+    b->interrupt = ep_ctrl & (EP_CTRL_INTERRUPT_PER_BUFFER | EP_CTRL_INTERRUPT_PER_DOUBLE_BUFFER);
+    b->nak_interrupt = ep_ctrl & EP_CTRL_INTERRUPT_ON_NAK;
+    return true;
+}
+
+/**
+ * @brief Finish a transaction on a buffer: hand it back to the CPU and flag it in buf_status.
+ */
+static void mock_usb_buffer_done(uint ep, bool in, const struct mock_usb_buffer *b, uint16_t control) {
+    *b->control = control;
+
+    if (b->interrupt)
+        mock_usb_hw.buf_status |= 1u << (2 * ep + (in ? 0 : 1));
+
+    if (ep != 0)
+        mock_usb_buf_sel[ep][!in] ^= 1;
+}
+
+/**
+ * @brief A buffer with STALL set answers with a STALL handshake. On EP0 only while the stall is armed, the
+ * controller disarms it with the next SETUP.
+ */
+static bool mock_usb_stall(uint ep, bool in, const struct mock_usb_buffer *b) {
+    if (!(*b->control & USB_BUF_CTRL_STALL))
+        return false;
+
+    if (ep == 0)
+        return mock_usb_hw.ep_stall_arm & (in ? USB_EP_STALL_ARM_EP0_IN_BITS : USB_EP_STALL_ARM_EP0_OUT_BITS);
+
+    return true;
+}
+
+/**
+ * @brief Check for a STALL of an endpoint without a transaction
+ */
+static bool mock_usb_stalled(uint ep, bool in) {
+    struct mock_usb_buffer b;
+
+    mock_lock();
+    bool stalled = mock_usb_buffer(ep & 0xf, in, &b) && mock_usb_stall(ep & 0xf, in, &b);
+    mock_unlock();
+
+    return stalled;
+}
+
+static bool mock_usb_nak(uint ep, bool in, const struct mock_usb_buffer *b) {
+    if (b->nak_interrupt)
+        mock_usb_hw.ep_nak_stall_status |= 1u << (2 * ep + (in ? 0 : 1));
+
+    return false;
+}
+
+bool mock_usb_out(uint8_t ep, const uint8_t *data, uint16_t len) {
+    struct mock_usb_buffer b;
+    bool ack = false;
+
+    mock_lock();
+    if (mock_usb_buffer(ep & 0xf, false, &b)) {
+        uint16_t control = *b.control;
+
+        if (mock_usb_stall(ep & 0xf, false, &b)) {
+            ack = false;
+        } else if (!(control & USB_BUF_CTRL_AVAIL) || (control & USB_BUF_CTRL_LEN_MASK) < len) {
+            ack = mock_usb_nak(ep & 0xf, false, &b);
+        } else {
+            memcpy((void *) b.data, data, len);
+            control &= ~(USB_BUF_CTRL_AVAIL | USB_BUF_CTRL_LEN_MASK);
+            mock_usb_buffer_done(ep & 0xf, false, &b, control | USB_BUF_CTRL_FULL | len);
+            ack = true;
+        }
+    }
+    mock_unlock();
+
+    mock_usb_interrupt();
+    return ack;
+}
+
+int mock_usb_in(uint8_t ep, uint8_t *data, uint16_t max_len) {
+    struct mock_usb_buffer b;
+    int len = MOCK_USB_NAK;
+
+    mock_lock();
+    if (mock_usb_buffer(ep & 0xf, true, &b)) {
+        uint16_t control = *b.control;
+
+        if (mock_usb_stall(ep & 0xf, true, &b)) {
+            len = MOCK_USB_STALL;
+        } else if (!(control & USB_BUF_CTRL_AVAIL) || !(control & USB_BUF_CTRL_FULL)) {
+            mock_usb_nak(ep & 0xf, true, &b);
+        } else {
+            len = control & USB_BUF_CTRL_LEN_MASK;
+            if (len > max_len)
+                panic("EP%u IN packet of %d bytes, host buffer has %u", ep & 0xf, len, max_len);
+
+            memcpy(data, (const void *) b.data, len);
+            mock_usb_buffer_done(ep & 0xf, true, &b, control & ~(USB_BUF_CTRL_AVAIL | USB_BUF_CTRL_FULL));
+        }
+    }
+    mock_unlock();
+
+    mock_usb_interrupt();
+    return len;
+}
+
+bool mock_usb_out_wait(uint8_t ep, const uint8_t *data, uint16_t len, uint32_t timeout_ms) {
+    uint64_t deadline = mock_wall_ms() + timeout_ms;
+
+    while (!mock_usb_out(ep, data, len)) {
+        if (mock_usb_stalled(ep, false) || mock_wall_ms() > deadline)
+            return false;
+        sched_yield();
+    }
+
+    return true;
+}
+
+int mock_usb_in_wait(uint8_t ep, uint8_t *data, uint16_t max_len, uint32_t timeout_ms) {
+    uint64_t deadline = mock_wall_ms() + timeout_ms;
+    int len;
+
+    while ((len = mock_usb_in(ep, data, max_len)) == MOCK_USB_NAK) {
+        if (mock_wall_ms() > deadline)
+            break;
+        sched_yield();
+    }
+
+    return len;
+}
+
+// ********** Bus and control transfers **********
+// ***********************************************
+
+#define MOCK_USB_TIMEOUT_MS 1000
+
+bool mock_usb_connected(void) {
+    return (mock_usb_hw.main_ctrl & USB_MAIN_CTRL_CONTROLLER_EN_BITS) &&
+           (mock_usb_hw.sie_ctrl & USB_SIE_CTRL_PULLUP_EN_BITS);
+}
+
+bool mock_usb_wait_connected(uint32_t timeout_ms) {
+    uint64_t deadline = mock_wall_ms() + timeout_ms;
+
+    while (!mock_usb_connected()) {
+        if (mock_wall_ms() > deadline)
+            return false;
+        sched_yield();
+    }
+
+    return true;
+}
+
+void mock_usb_bus_reset(void) {
+    mock_lock();
+    mock_usb_hw.sie_status |= USB_SIE_STATUS_BUS_RESET_BITS;
+    mock_usb_hw.dev_addr_ctrl = 0;
+    memset(mock_usb_buf_sel, 0, sizeof(mock_usb_buf_sel));
+    mock_unlock();
+
+    mock_usb_interrupt();
+}
+
+static void mock_usb_setup(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+                           uint16_t wLength) {
+    const uint8_t packet[8] = {
+        bmRequestType, bRequest, wValue & 0xff, wValue >> 8, wIndex & 0xff, wIndex >> 8, wLength & 0xff,
+        wLength >> 8,
+    };
+
+    mock_lock();
+    memcpy((void *) mock_usb_dpram.setup_packet, packet, sizeof(packet));
+    mock_usb_hw.sie_status |= USB_SIE_STATUS_SETUP_REC_BITS;
+    mock_usb_hw.ep_stall_arm = 0;
+    mock_unlock();
+
+    mock_usb_interrupt();
+}
+
+int mock_usb_control(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data,
+                     uint16_t wLength) {
+    uint16_t done = 0;
+
+    mock_usb_setup(bmRequestType, bRequest, wValue, wIndex, wLength);
+
+    if (bmRequestType & 0x80) {
+        // Data stage IN until a short packet, status stage OUT
+        while (done < wLength) {
+            uint8_t packet[64];
+            int len = mock_usb_in_wait(0, packet, sizeof(packet), MOCK_USB_TIMEOUT_MS);
+
+            if (len < 0)
+                return -1;
+
+            memcpy(data + done, packet, MIN((uint) len, (uint) (wLength - done)));
+            done += MIN((uint) len, (uint) (wLength - done));
+
+            if (len < 64)
+                break;
+        }
+
+        return mock_usb_out_wait(0, NULL, 0, MOCK_USB_TIMEOUT_MS) ? done : -1;
+    }
+
+    // Data stage OUT, status stage IN
+    while (done < wLength) {
+        uint16_t len = MIN(64, wLength - done);
+
+        if (!mock_usb_out_wait(0, data + done, len, MOCK_USB_TIMEOUT_MS))
+            return -1;
+
+        done += len;
+    }
+
+    uint8_t zlp[64];
+    return mock_usb_in_wait(0, zlp, sizeof(zlp), MOCK_USB_TIMEOUT_MS) == 0 ? done : -1;
+}
+
+bool mock_usb_enumerate(void) {
+    uint8_t descriptor[256];
+
+    if (!mock_usb_wait_connected(MOCK_USB_TIMEOUT_MS))
+        return false;
+
+    mock_usb_bus_reset();
+
+    // Device descriptor
+    if (mock_usb_control(0x80, USB_REQ_GET_DESCRIPTOR, USB_DT_DEVICE << 8, 0, descriptor, 18) != 18)
+        return false;
+
+    if (mock_usb_control(0x00, USB_REQ_SET_ADDRESS, 1, 0, NULL, 0) != 0 || (mock_usb_hw.dev_addr_ctrl & 0x7f) != 1)
+        return false;
+
+    // Configuration descriptor header first, then with the interfaces and endpoints
+    if (mock_usb_control(0x80, USB_REQ_GET_DESCRIPTOR, USB_DT_CONFIG << 8, 0, descriptor, 9) != 9)
+        return false;
+
+    uint16_t total_length = MIN((uint) (descriptor[2] | (descriptor[3] << 8)), sizeof(descriptor));
+    if (mock_usb_control(0x80, USB_REQ_GET_DESCRIPTOR, USB_DT_CONFIG << 8, 0, descriptor, total_length) !=
+        total_length)
+        return false;
+
+    return mock_usb_control(0x00, USB_REQ_SET_CONFIGURATION, 1, 0, NULL, 0) == 0;
+}
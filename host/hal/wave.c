@@ -0,0 +1,135 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// Waveform recording of the GPIO pins and VCD export
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mock_internal.h"
+
+#define MOCK_WAVE_NAME_LEN 32
+
+static uint32_t mock_wave_pins;
+static struct mock_wave_event *mock_wave;
+static size_t mock_wave_count;
+static size_t mock_wave_size;
+static char mock_wave_names[NUM_BANK0_GPIOS][MOCK_WAVE_NAME_LEN];
+
+void mock_wave_record(uint pin, bool level, bool oe, uint64_t time_ps) {
+    if (!(mock_wave_pins & (1u << pin)))
+        return;
+
+    if (mock_wave_count == mock_wave_size) {
+        mock_wave_size = mock_wave_size ? mock_wave_size * 2 : 4096;
+        mock_wave = realloc(mock_wave, mock_wave_size * sizeof(*mock_wave));
+        if (!mock_wave)
+            panic("Out of memory for the waveform");
+    }
+
+    // State machines run ahead of each other, so events can arrive slightly out of order. Insert them sorted,
+    // events with the same time keep the order they happened in.
+    size_t i = mock_wave_count++;
+    while (i && mock_wave[i - 1].time_ps > time_ps) {
+        mock_wave[i] = mock_wave[i - 1];
+        i--;
+    }
+
+    mock_wave[i] = (struct mock_wave_event) {
+        .time_ps = time_ps,
+        .pin = pin,
+        .level = level,
+        .oe = oe,
+    };
+}
+
+void mock_wave_start(uint32_t pin_mask) {
+    mock_lock();
+    mock_wave_count = 0;
+    mock_wave_pins = pin_mask;
+
+    uint64_t now = mock_time_ps();
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+        if (pin_mask & (1u << pin))
+            mock_wave_record(pin, mock_gpio_level(pin), mock_gpio_oe(pin), now);
+    mock_unlock();
+}
+
+void mock_wave_stop(void) {
+    mock_lock();
+    mock_wave_pins = 0;
+    mock_unlock();
+}
+
+void mock_wave_set_name(uint pin, const char *name) {
+    if (pin >= NUM_BANK0_GPIOS)
+        panic("Invalid GPIO %u", pin);
+
+    snprintf(mock_wave_names[pin], MOCK_WAVE_NAME_LEN, "%s", name);
+}
+
+const struct mock_wave_event *mock_wave_events(size_t *count) {
+    *count = mock_wave_count;
+    return mock_wave;
+}
+
+bool mock_wave_write_vcd(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return false;
+
+    // Every pin has two signals, its level and the output enable. Identifiers are printable characters.
+    uint32_t pins = 0;
+    for (size_t i = 0; i < mock_wave_count; i++)
+        pins |= 1u << mock_wave[i].pin;
+
+    fprintf(f, "$version usb-mdio-adapter host build $end\n");
+    fprintf(f, "$timescale 1ps $end\n");
+    fprintf(f, "$scope module gpio $end\n");
+    for (uint pin = 0; pin < NUM_BANK0_GPIOS; pin++) {
+        if (!(pins & (1u << pin)))
+            continue;
+
+        char name[MOCK_WAVE_NAME_LEN];
+        if (mock_wave_names[pin][0])
+            snprintf(name, sizeof(name), "%s", mock_wave_names[pin]);
+        else
+            snprintf(name, sizeof(name), "gpio%u", pin);
+
+        fprintf(f, "$var wire 1 %c %s $end\n", '!' + 2 * pin, name);
+        fprintf(f, "$var wire 1 %c %s_oe $end\n", '!' + 2 * pin + 1, name);
+    }
+    fprintf(f, "$upscope $end\n");
+    fprintf(f, "$enddefinitions $end\n");
+
+    uint64_t time_ps = UINT64_MAX;
+    bool level[NUM_BANK0_GPIOS] = {0};
+    bool oe[NUM_BANK0_GPIOS] = {0};
+    uint32_t seen = 0;
+
+    for (size_t i = 0; i < mock_wave_count; i++) {
+        const struct mock_wave_event *e = &mock_wave[i];
+        bool first = !(seen & (1u << e->pin));
+
+        if (e->time_ps != time_ps) {
+            time_ps = e->time_ps;
+            fprintf(f, "#%llu\n", (unsigned long long) time_ps);
+        }
+
+        if (first || level[e->pin] != e->level)
+            fprintf(f, "%d%c\n", e->level, '!' + 2 * e->pin);
+        if (first || oe[e->pin] != e->oe)
+            fprintf(f, "%d%c\n", e->oe, '!' + 2 * e->pin + 1);
+
+        level[e->pin] = e->level;
+        oe[e->pin] = e->oe;
+        seen |= 1u << e->pin;
+    }
+
+    return fclose(f) == 0;
+}
@@ -0,0 +1,32 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HARDWARE_ADDRESS_MAPPED_H
+#define _HARDWARE_ADDRESS_MAPPED_H
+
+#include "pico.h"
+
+// The set/clear/xor register aliases of the RP2040 are atomic read-modify-write operations on the register
+// itself. Code has to use these functions instead of writing to an alias pointer.
+
+static inline void hw_set_bits(volatile uint32_t *addr, uint32_t mask) {
+    __atomic_fetch_or(addr, mask, __ATOMIC_SEQ_CST);
+}
+
+static inline void hw_clear_bits(volatile uint32_t *addr, uint32_t mask) {
+    __atomic_fetch_and(addr, ~mask, __ATOMIC_SEQ_CST);
+}
+
+static inline void hw_xor_bits(volatile uint32_t *addr, uint32_t mask) {
+    __atomic_fetch_xor(addr, mask, __ATOMIC_SEQ_CST);
+}
+
+static inline void hw_write_masked(volatile uint32_t *addr, uint32_t values, uint32_t write_mask) {
+    hw_xor_bits(addr, (*addr ^ values) & write_mask);
+}
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HARDWARE_DMA_H
+#define _HARDWARE_DMA_H
+
+#include "pico.h"
+
+// DMA channels of the mock HAL. A triggered channel transfers right away in the calling thread, paced by
+// its DREQ: a PIO FIFO DREQ runs the state machine as far as needed. A channel waiting for a state machine
+// that stalls on something else (e.g. an RX channel armed before the TX channel) is resumed when the
+// state machine makes progress. DMA_IRQ_0/DMA_IRQ_1 are raised when a channel with the interrupt enabled
+// completes. A read of timer_hw->timerawl (hardware/structs/timer.h) gets the virtual time in us.
+
+#define NUM_DMA_CHANNELS 12
+
+#define DREQ_PIO0_TX0 0
+#define DREQ_PIO0_RX0 4
+#define DREQ_PIO1_TX0 8
+#define DREQ_PIO1_RX0 12
+#define DREQ_FORCE 0x3f
+
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2,
+};
+
+typedef struct {
+    enum dma_channel_transfer_size size;
+    bool read_increment;
+    bool write_increment;
+    uint8_t dreq;
+    uint8_t chain_to;
+    bool enable;
+    bool ring_write; // The ring applies to the write address instead of the read address
+    uint8_t ring_size_bits; // 0 for no ring
+} dma_channel_config;
+
+// Address registers, updated with every transfer. Pointer sized on the host.
+typedef struct {
+    volatile uintptr_t read_addr;
+    volatile uintptr_t write_addr;
+    volatile uint32_t transfer_count;
+} dma_channel_hw_t;
+
+dma_channel_hw_t *dma_channel_hw_addr(uint channel);
+
+void dma_channel_claim(uint channel);
+void dma_channel_unclaim(uint channel);
+int dma_claim_unused_channel(bool required);
+bool dma_channel_is_claimed(uint channel);
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+dma_channel_config dma_get_channel_config(uint channel);
+
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+    c->read_increment = incr;
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+    c->write_increment = incr;
+}
+
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+    c->dreq = (uint8_t) dreq;
+}
+
+static inline void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) {
+    c->chain_to = (uint8_t) chain_to;
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    c->size = size;
+}
+
+static inline void channel_config_set_enable(dma_channel_config *c, bool enable) {
+    c->enable = enable;
+}
+
+// The address wraps at a boundary of 1 << size_bits bytes, the buffer must be aligned to it
+static inline void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) {
+    c->ring_write = write;
+    c->ring_size_bits = (uint8_t) size_bits;
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count);
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void *write_addr, uint32_t transfer_count);
+void dma_channel_start(uint channel);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_wait_for_finish_blocking(uint channel);
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+bool dma_channel_get_irq0_status(uint channel);
+void dma_channel_acknowledge_irq0(uint channel);
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+bool dma_channel_get_irq1_status(uint channel);
+void dma_channel_acknowledge_irq1(uint channel);
+
+#endif
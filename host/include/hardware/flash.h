@@ -0,0 +1,25 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HARDWARE_FLASH_H
+#define _HARDWARE_FLASH_H
+
+#include "pico.h"
+
+// The flash is a RAM array mapped at XIP_BASE. Erasing sets bytes to 0xff, programming can only clear bits
+// like on the chip, and both check the alignment the SDK requires.
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+
+extern uint8_t mock_flash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t) mock_flash)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif
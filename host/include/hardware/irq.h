@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HARDWARE_IRQ_H
+#define _HARDWARE_IRQ_H
+
+#include "pico.h"
+
+// RP2040 interrupt numbers. An interrupt is delivered to the cores that enabled it, in the thread that
+// raised it, while holding the interrupt mask of the target core (see hardware/sync.h).
+
+enum irq_num_rp2040 {
+    TIMER_IRQ_0 = 0,
+    TIMER_IRQ_1 = 1,
+    TIMER_IRQ_2 = 2,
+    TIMER_IRQ_3 = 3,
+    PWM_IRQ_WRAP = 4,
+    USBCTRL_IRQ = 5,
+    XIP_IRQ = 6,
+    PIO0_IRQ_0 = 7,
+    PIO0_IRQ_1 = 8,
+    PIO1_IRQ_0 = 9,
+    PIO1_IRQ_1 = 10,
+    DMA_IRQ_0 = 11,
+    DMA_IRQ_1 = 12,
+    IO_IRQ_BANK0 = 13,
+    IO_IRQ_QSPI = 14,
+    SIO_IRQ_PROC0 = 15,
+    SIO_IRQ_PROC1 = 16,
+    CLOCKS_IRQ = 17,
+    SPI0_IRQ = 18,
+    SPI1_IRQ = 19,
+    UART0_IRQ = 20,
+    UART1_IRQ = 21,
+    ADC_IRQ_FIFO = 22,
+    I2C0_IRQ = 23,
+    I2C1_IRQ = 24,
+    RTC_IRQ = 25,
+    NUM_IRQS = 32,
+};
+
+#define PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY 0xff
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+#define PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY 0x00
+#define PICO_DEFAULT_IRQ_PRIORITY 0x80
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority);
+void irq_remove_handler(uint num, irq_handler_t handler);
+void irq_set_enabled(uint num, bool enabled);
+bool irq_is_enabled(uint num);
+void irq_set_pending(uint num);
+
+static inline void irq_set_priority(__unused uint num, __unused uint8_t hardware_priority) {}
+
+#endif
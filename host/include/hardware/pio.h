@@ -0,0 +1,142 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HARDWARE_PIO_H
+#define _HARDWARE_PIO_H
+
+#include "pico.h"
+#include "hardware/gpio.h"
+
+// PIO blocks of the mock HAL. The state machines are executed instruction by instruction on the virtual
+// clock with the RP2040 timing (one instruction per cycle plus delay, stalls on FIFOs). A state machine
+// runs lazily: whenever the firmware or the DMA waits for one of its FIFOs and when the virtual clock
+// advances.
+
+#define NUM_PIOS 2
+#define NUM_PIO_STATE_MACHINES 4
+#define PIO_INSTRUCTION_COUNT 32
+#define PIO_FIFO_DEPTH 4
+
+// Only the FIFO registers exist, they are the DMA addresses of the state machines
+typedef struct {
+    volatile uint32_t txf[NUM_PIO_STATE_MACHINES];
+    volatile uint32_t rxf[NUM_PIO_STATE_MACHINES];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t mock_pio_hw[NUM_PIOS];
+#define pio0 (&mock_pio_hw[0])
+#define pio1 (&mock_pio_hw[1])
+
+enum pio_fifo_join {
+    PIO_FIFO_JOIN_NONE = 0,
+    PIO_FIFO_JOIN_TX = 1,
+    PIO_FIFO_JOIN_RX = 2,
+};
+
+enum pio_mov_status_type {
+    STATUS_TX_LESSTHAN = 0,
+    STATUS_RX_LESSTHAN = 1,
+};
+
+typedef struct {
+    uint16_t clkdiv_int;
+    uint8_t clkdiv_frac;
+    uint8_t wrap_target;
+    uint8_t wrap;
+    uint8_t sideset_bit_count; // Including the enable bit of optional side-set
+    bool sideset_optional;
+    bool sideset_pindirs;
+    uint8_t sideset_base;
+    uint8_t out_base;
+    uint8_t out_count;
+    uint8_t set_base;
+    uint8_t set_count;
+    uint8_t in_base;
+    uint8_t jmp_pin;
+    bool out_shift_right;
+    bool autopull;
+    uint8_t pull_threshold;
+    bool in_shift_right;
+    bool autopush;
+    uint8_t push_threshold;
+    enum pio_fifo_join fifo_join;
+    enum pio_mov_status_type status_sel;
+    uint8_t status_n;
+} pio_sm_config;
+
+typedef struct pio_program {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin; // Required instruction memory origin or -1
+    uint8_t pio_version;
+} pio_program_t;
+
+// Configuration
+pio_sm_config pio_get_default_sm_config(void);
+void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count);
+void sm_config_set_set_pins(pio_sm_config *c, uint set_base, uint set_count);
+void sm_config_set_in_pins(pio_sm_config *c, uint in_base);
+void sm_config_set_sideset_pins(pio_sm_config *c, uint sideset_base);
+void sm_config_set_sideset(pio_sm_config *c, uint bit_count, bool optional, bool pindirs);
+void sm_config_set_clkdiv_int_frac(pio_sm_config *c, uint16_t div_int, uint8_t div_frac);
+void sm_config_set_clkdiv(pio_sm_config *c, float div);
+void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap);
+void sm_config_set_jmp_pin(pio_sm_config *c, uint pin);
+void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold);
+void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold);
+void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join);
+void sm_config_set_mov_status(pio_sm_config *c, enum pio_mov_status_type status_sel, uint status_n);
+
+// Instruction memory
+uint pio_get_index(PIO pio);
+bool pio_can_add_program(PIO pio, const pio_program_t *program);
+uint pio_add_program(PIO pio, const pio_program_t *program);
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset);
+void pio_clear_instruction_memory(PIO pio);
+
+// State machines
+void pio_sm_claim(PIO pio, uint sm);
+void pio_sm_unclaim(PIO pio, uint sm);
+int pio_claim_unused_sm(PIO pio, bool required);
+bool pio_sm_is_claimed(PIO pio, uint sm);
+
+void pio_gpio_init(PIO pio, uint pin);
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_sm_restart(PIO pio, uint sm);
+void pio_sm_clkdiv_restart(PIO pio, uint sm);
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac);
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div);
+uint8_t pio_sm_get_pc(PIO pio, uint sm);
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+
+void pio_sm_set_pins(PIO pio, uint sm, uint32_t pin_values);
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask);
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask);
+void pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+
+// FIFOs
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+uint32_t pio_sm_get(PIO pio, uint sm);
+uint32_t pio_sm_get_blocking(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm);
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+void pio_sm_drain_tx_fifo(PIO pio, uint sm);
+
+// DREQ numbers of the FIFOs, see hardware/dma.h
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx);
+
+#endif
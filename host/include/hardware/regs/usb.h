@@ -0,0 +1,37 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HARDWARE_REGS_USB_H
+#define _HARDWARE_REGS_USB_H
+
+// Register bits of the RP2040 USB controller used by the firmware and modelled by the mock HAL. Values are
+// the ones of the SDK.
+
+#define USB_MAIN_CTRL_CONTROLLER_EN_BITS 0x00000001u
+
+#define USB_SIE_CTRL_EP0_INT_1BUF_BITS 0x20000000u
+#define USB_SIE_CTRL_PULLUP_EN_BITS 0x00010000u
+
+#define USB_SIE_STATUS_BUS_RESET_BITS 0x00080000u
+#define USB_SIE_STATUS_SETUP_REC_BITS 0x00020000u
+#define USB_SIE_STATUS_CONNECTED_BITS 0x00010000u
+
+#define USB_EP_STALL_ARM_EP0_OUT_BITS 0x00000002u
+#define USB_EP_STALL_ARM_EP0_IN_BITS 0x00000001u
+
+#define USB_INTS_EP_STALL_NAK_BITS 0x00080000u
+#define USB_INTS_SETUP_REQ_BITS 0x00010000u
+#define USB_INTS_BUS_RESET_BITS 0x00001000u
+#define USB_INTS_BUFF_STATUS_BITS 0x00000010u
+
+#define USB_USB_MUXING_SOFTCON_BITS 0x00000008u
+#define USB_USB_MUXING_TO_PHY_BITS 0x00000001u
+
+#define USB_USB_PWR_VBUS_DETECT_OVERRIDE_EN_BITS 0x00000008u
+#define USB_USB_PWR_VBUS_DETECT_BITS 0x00000004u
+
+#endif
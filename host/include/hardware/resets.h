@@ -0,0 +1,44 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HARDWARE_RESETS_H
+#define _HARDWARE_RESETS_H
+
+#include "pico.h"
+
+enum reset_num_rp2040 {
+    RESET_ADC = 0,
+    RESET_BUSCTRL = 1,
+    RESET_DMA = 2,
+    RESET_I2C0 = 3,
+    RESET_I2C1 = 4,
+    RESET_IO_BANK0 = 5,
+    RESET_IO_QSPI = 6,
+    RESET_JTAG = 7,
+    RESET_PADS_BANK0 = 8,
+    RESET_PADS_QSPI = 9,
+    RESET_PIO0 = 10,
+    RESET_PIO1 = 11,
+    RESET_PLL_SYS = 12,
+    RESET_PLL_USB = 13,
+    RESET_PWM = 14,
+    RESET_RTC = 15,
+    RESET_SPI0 = 16,
+    RESET_SPI1 = 17,
+    RESET_SYSCFG = 18,
+    RESET_SYSINFO = 19,
+    RESET_TBMAN = 20,
+    RESET_TIMER = 21,
+    RESET_UART0 = 22,
+    RESET_UART1 = 23,
+    RESET_USBCTRL = 24,
+};
+
+// Only RESET_USBCTRL has an effect: it clears the USB controller registers
+void reset_unreset_block_num_wait_blocking(uint block_num);
+
+#endif
@@ -0,0 +1,23 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HARDWARE_STRUCTS_TIMER_H
+#define _HARDWARE_STRUCTS_TIMER_H
+
+#include "pico.h"
+
+// Raw time registers of the timer. They are only meant as DMA source: a DMA read of timerawl gets the
+// virtual time in us (see hardware/dma.h). CPU code uses time_us_32() and friends.
+typedef struct {
+    volatile uint32_t timerawh;
+    volatile uint32_t timerawl;
+} timer_hw_t;
+
+extern timer_hw_t mock_timer_hw;
+#define timer_hw (&mock_timer_hw)
+
+#endif
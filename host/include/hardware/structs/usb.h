@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HARDWARE_STRUCTS_USB_H
+#define _HARDWARE_STRUCTS_USB_H
+
+#include "pico.h"
+#include "hardware/address_mapped.h"
+
+// USB controller registers and DPRAM with the RP2040 layout. The DPRAM is 4 KB aligned so a buffer offset
+// is the low bits of its address like on the device. The controller side is modelled by mock_usb_* in
+// mock_hal.h.
+
+#define USB_NUM_ENDPOINTS 16
+
+// Endpoint control register
+#define EP_CTRL_ENABLE_BITS (1u << 31u)
+#define EP_CTRL_DOUBLE_BUFFERED_BITS (1u << 30u)
+#define EP_CTRL_INTERRUPT_PER_BUFFER (1u << 29u)
+#define EP_CTRL_INTERRUPT_PER_DOUBLE_BUFFER (1u << 28u)
+#define EP_CTRL_INTERRUPT_ON_NAK (1u << 16u)
+#define EP_CTRL_INTERRUPT_ON_STALL (1u << 17u)
+#define EP_CTRL_BUFFER_TYPE_LSB 26u
+#define EP_CTRL_HOST_INTERRUPT_INTERVAL_LSB 16u
+
+// Buffer control register, one half per buffer
+#define USB_BUF_CTRL_FULL 0x00008000u
+#define USB_BUF_CTRL_LAST 0x00004000u
+#define USB_BUF_CTRL_DATA0_PID 0x00000000u
+#define USB_BUF_CTRL_DATA1_PID 0x00002000u
+#define USB_BUF_CTRL_SEL 0x00001000u
+#define USB_BUF_CTRL_STALL 0x00000800u
+#define USB_BUF_CTRL_AVAIL 0x00000400u
+#define USB_BUF_CTRL_LEN_MASK 0x000003ffu
+#define USB_BUF_CTRL_LEN_LSB 0
+
+typedef struct {
+    volatile uint8_t setup_packet[8];
+
+    struct usb_device_dpram_ep_ctrl {
+        volatile uint32_t in;
+        volatile uint32_t out;
+    } ep_ctrl[USB_NUM_ENDPOINTS - 1];
+
+    struct usb_device_dpram_ep_buf_ctrl {
+        volatile uint32_t in;
+        volatile uint32_t out;
+    } ep_buf_ctrl[USB_NUM_ENDPOINTS];
+
+    volatile uint8_t ep0_buf_a[0x40];
+    volatile uint8_t ep0_buf_b[0x40];
+
+    volatile uint8_t epx_data[4096 - 0x180];
+} usb_device_dpram_t;
+
+static_assert(sizeof(usb_device_dpram_t) == 4096, "");
+static_assert(offsetof(usb_device_dpram_t, epx_data) == 0x180, "");
+
+typedef struct {
+    volatile uint32_t dev_addr_ctrl;
+    volatile uint32_t int_ep_addr_ctrl[USB_NUM_ENDPOINTS - 1];
+    volatile uint32_t main_ctrl;
+    volatile uint32_t sof_wr;
+    volatile uint32_t sof_rd;
+    volatile uint32_t sie_ctrl;
+    volatile uint32_t sie_status;
+    volatile uint32_t int_ep_ctrl;
+    volatile uint32_t buf_status;
+    volatile uint32_t buf_cpu_should_handle;
+    volatile uint32_t abort;
+    volatile uint32_t abort_done;
+    volatile uint32_t ep_stall_arm;
+    volatile uint32_t nak_poll;
+    volatile uint32_t ep_nak_stall_status;
+    volatile uint32_t muxing;
+    volatile uint32_t pwr;
+    volatile uint32_t phy_direct;
+    volatile uint32_t phy_direct_override;
+    volatile uint32_t phy_trim;
+    uint32_t _pad0;
+    volatile uint32_t intr;
+    volatile uint32_t inte;
+    volatile uint32_t intf;
+    volatile uint32_t ints;
+} usb_hw_t;
+
+static_assert(offsetof(usb_hw_t, ints) == 0x98, "");
+
+extern usb_device_dpram_t mock_usb_dpram;
+extern usb_hw_t mock_usb_hw;
+
+#define usb_dpram (&mock_usb_dpram)
+#define usb_hw (&mock_usb_hw)
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+#include "pico.h"
+
+// Interrupt masking is per simulated core: interrupts raised for a core while it has them disabled are
+// delivered when the outermost restore_interrupts() enables them again. Hardware spin locks additionally
+// exclude the other core.
+
+#define NUM_SPIN_LOCKS 32
+#define PICO_SPINLOCK_ID_STRIPED_FIRST 16
+#define PICO_SPINLOCK_ID_CLAIM_FREE_FIRST 24
+
+typedef volatile uint32_t spin_lock_t;
+
+static inline void __dmb(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void __mem_fence_acquire(void) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void __mem_fence_release(void) {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void __compiler_memory_barrier(void) {
+    __asm__ volatile ("" : : : "memory");
+}
+
+static inline void __sev(void) {}
+static inline void __nop(void) {}
+
+void __wfe(void);
+void __wfi(void);
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+spin_lock_t *spin_lock_instance(uint lock_num);
+uint spin_lock_get_num(spin_lock_t *lock);
+spin_lock_t *spin_lock_init(uint lock_num);
+uint32_t spin_lock_blocking(spin_lock_t *lock);
+void spin_unlock(spin_lock_t *lock, uint32_t saved_irq);
+void spin_lock_claim(uint lock_num);
+void spin_lock_unclaim(uint lock_num);
+int spin_lock_claim_unused(bool required);
+
+#endif
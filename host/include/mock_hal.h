@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef MOCK_HAL_H_
+#define MOCK_HAL_H_
+
+#include "pico.h"
+
+// Driver side of the mock HAL: runs the firmware, plays the USB host and attaches devices to the pins.
+//
+// The firmware runs unmodified on two threads, one per core. Interrupts are delivered in the thread that
+// raises them, but only while the target core has interrupts enabled (see hardware/sync.h). The USB
+// interrupt is raised by the mock_usb_* functions below, so the USB ISR runs in the driver thread as if
+// core0 was interrupted.
+//
+// Time is virtual (see pico/time.h) and only advances when the firmware waits, when the PIO runs or with
+// mock_time_advance_us(). All timeouts of this API are wall clock time: they only guard against a firmware
+// that never answers.
+
+// Run firmware_main() as core0 in a new thread. The firmware is built with main renamed to firmware_main.
+void mock_hal_start(int (*firmware_main)(void));
+
+// Serialize with the mocked hardware. Everything the firmware does to the hardware happens under this
+// (recursive) lock, so a driver holds it while it changes the state of a device model.
+void mock_lock(void);
+void mock_unlock(void);
+
+// ********** Virtual clock **********
+// ***********************************
+
+uint64_t mock_time_ps(void);
+
+// Move the clock forward and let the state machines run up to the new time
+void mock_time_advance_us(uint64_t us);
+void mock_time_advance_ns(uint64_t ns);
+
+// ********** GPIO **********
+// **************************
+
+// Drive state of an external device on a pin. Levels are resolved like an open drain bus with the pull
+// resistors of the pad: low wins over high (and counts as contention if both are driven).
+enum mock_gpio_drive {
+    MOCK_GPIO_RELEASE,
+    MOCK_GPIO_LOW,
+    MOCK_GPIO_HIGH,
+};
+
+// Register an external driver on a pin, released initially. Returns the driver handle.
+int mock_gpio_driver_add(uint pin);
+void mock_gpio_driver_set(int driver, enum mock_gpio_drive drive);
+
+// Called for every level change of any pin. time_ps is the time of the change on the virtual clock, which
+// can be ahead of mock_time_ps() for pins driven by a state machine. Listeners run with the HAL locked:
+// they may call mock_gpio_* but must not call into the firmware or wait.
+typedef void (*mock_gpio_listener_t)(void *context, uint pin, bool level, uint64_t time_ps);
+void mock_gpio_add_listener(mock_gpio_listener_t listener, void *context);
+
+bool mock_gpio_level(uint pin);
+
+// Number of times the pin was driven high and low at the same time
+uint32_t mock_gpio_contention(uint pin);
+
+// ********** Waveform recording **********
+// ****************************************
+
+// Change of a recorded pin: its level, or whether the firmware drives it (SIO or PIO output enable). oe is
+// false while only external drivers and the pulls set the level.
+struct mock_wave_event {
+    uint64_t time_ps;
+    uint8_t pin;
+    bool level;
+    bool oe;
+};
+
+// Record the pins in pin_mask, starting with their current state. Discards an earlier recording.
+void mock_wave_start(uint32_t pin_mask);
+void mock_wave_stop(void);
+
+// Name of a pin in the VCD file, "gpio<n>" by default
+void mock_wave_set_name(uint pin, const char *name);
+
+// Events of the stopped recording in time order, valid until the next mock_wave_start()
+const struct mock_wave_event *mock_wave_events(size_t *count);
+
+// Write the stopped recording as a VCD file for GTKWave. Every pin gets a second signal <name>_oe.
+bool mock_wave_write_vcd(const char *path);
+
+// ********** Flash **********
+// ***************************
+
+// Program an image at a flash offset like picotool does, e.g. before mock_hal_start(). The flash starts
+// erased (0xff).
+void mock_flash_write(uint32_t offset, const void *data, size_t len);
+
+// ********** USB host **********
+// ******************************
+
+#define MOCK_USB_NAK (-1)
+#define MOCK_USB_STALL (-2)
+
+// Pull-up on D+ enabled by the firmware
+bool mock_usb_connected(void);
+bool mock_usb_wait_connected(uint32_t timeout_ms);
+
+void mock_usb_bus_reset(void);
+
+// Bus reset, device descriptor, SET_ADDRESS, configuration descriptor and SET_CONFIGURATION 1.
+// Returns false if the device did not answer as expected.
+bool mock_usb_enumerate(void);
+
+// Control transfer on EP0 including the status stage. data holds wLength bytes for OUT requests and
+// receives up to wLength bytes for IN requests. Returns the length of the data stage or -1 on failure, e.g. a
+// STALL.
+int mock_usb_control(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint8_t *data,
+                     uint16_t wLength);
+
+// One OUT transaction on a bulk/interrupt endpoint. Returns false if the device NAKed or stalled, the wait
+// gives up right away on a STALL.
+bool mock_usb_out(uint8_t ep, const uint8_t *data, uint16_t len);
+bool mock_usb_out_wait(uint8_t ep, const uint8_t *data, uint16_t len, uint32_t timeout_ms);
+
+// One IN transaction. Returns the packet length, MOCK_USB_NAK or MOCK_USB_STALL.
+int mock_usb_in(uint8_t ep, uint8_t *data, uint16_t max_len);
+int mock_usb_in_wait(uint8_t ep, uint8_t *data, uint16_t max_len, uint32_t timeout_ms);
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _PICO_H
+#define _PICO_H
+
+// Mock of the pico-sdk base header for the host build. Only the parts the firmware uses are provided, with
+// the same names and signatures as the SDK.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include "pico/types.h"
+
+#define PICO_ON_DEVICE 0
+#define PICO_NO_HARDWARE 0
+
+#define NUM_CORES 2
+#define NUM_BANK0_GPIOS 30
+#define PICO_DEFAULT_LED_PIN 25
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+
+// pico/error.h
+enum pico_error_codes {
+    PICO_OK = 0,
+    PICO_ERROR_TIMEOUT = -1,
+    PICO_ERROR_GENERIC = -2,
+};
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+#ifndef __packed
+#define __packed __attribute__((packed))
+#endif
+#define __aligned(x) __attribute__((aligned(x)))
+#define __noinline __attribute__((noinline))
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) __noinline func_name
+
+#define count_of(a) (sizeof(a) / sizeof((a)[0]))
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define hard_assert assert
+#define invalid_params_if(x, test) assert(!(test))
+#define valid_params_if(x, test) assert(test)
+
+void panic(const char *fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+void panic_unsupported(void) __attribute__((noreturn));
+
+// Number of the core the calling thread runs as
+uint get_core_num(void);
+
+// Lets the other simulated cores run. The firmware only calls it in busy loops.
+void tight_loop_contents(void);
+
+#endif
@@ -0,0 +1,19 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _PICO_FLASH_H
+#define _PICO_FLASH_H
+
+#include "pico.h"
+
+// Nothing executes from the mock flash, so func only runs with the HAL locked, which keeps the other core
+// away from the hardware like the lockout does.
+
+bool flash_safe_execute_core_init(void);
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms);
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _PICO_MULTICORE_H
+#define _PICO_MULTICORE_H
+
+#include "pico.h"
+
+// core1 is a thread. The inter-core FIFOs hold 8 words per direction and raise SIO_IRQ_PROC0/1 on the
+// receiving core like the SIO does.
+
+void multicore_launch_core1(void (*entry)(void));
+void multicore_reset_core1(void);
+
+bool multicore_fifo_rvalid(void);
+bool multicore_fifo_wready(void);
+void multicore_fifo_push_blocking(uint32_t data);
+uint32_t multicore_fifo_pop_blocking(void);
+void multicore_fifo_drain(void);
+void multicore_fifo_clear_irq(void);
+
+#endif
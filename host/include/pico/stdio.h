@@ -0,0 +1,23 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _PICO_STDIO_H
+#define _PICO_STDIO_H
+
+#include "pico.h"
+
+// printf() of the firmware goes to the host stdout and, like in the SDK, to every stdio driver the firmware
+// enabled. No CR is added in front of LF.
+#define PICO_STDIO_ENABLE_CRLF_SUPPORT 0
+
+typedef struct stdio_driver stdio_driver_t;
+
+void stdio_set_driver_enabled(stdio_driver_t *driver, bool enabled);
+
+int mock_printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+#include <stdio.h>
+
+#include "pico.h"
+#include "pico/stdio.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+
+// stdout is the host stdout, nothing to set up
+static inline bool stdio_init_all(void) {
+    return true;
+}
+
+// The SDK wraps printf() at link time, here the firmware sources are redirected
+#define printf mock_printf
+
+#endif
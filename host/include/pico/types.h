@@ -0,0 +1,20 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _PICO_TYPES_H
+#define _PICO_TYPES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+// Microseconds since boot of the virtual clock (see mock_hal.h)
+typedef uint64_t absolute_time_t;
+
+#endif
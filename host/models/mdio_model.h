@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef MDIO_MODEL_H_
+#define MDIO_MODEL_H_
+
+#include "mock_hal.h"
+
+// Simulated MDIO devices for the host build. A bus model watches the MDC pin of the mock HAL, samples MDIO
+// on every rising edge and decodes Clause 22 and Clause 45 frames. For a read it drives the second TA bit
+// and the data itself, changing MDIO right after the rising edge like a PHY does. Devices on the bus only
+// see register accesses.
+//
+// All models run in GPIO listeners with the HAL locked. Functions called by a driver take mock_lock()
+// themselves. Times are on the virtual clock of the mock HAL.
+
+#define MDIO_MODEL_PREAMBLE_BITS 32
+
+// ********** Bus **********
+// *************************
+
+struct mdio_model_bus;
+
+// A device answers the frames addressed to it. The callbacks return false for addresses of other devices.
+// The Clause 45 callbacks are optional.
+struct mdio_model_device {
+    bool (*read)(struct mdio_model_device *dev, uint8_t phy, uint8_t reg, uint16_t *value, uint64_t time_ps);
+    bool (*write)(struct mdio_model_device *dev, uint8_t phy, uint8_t reg, uint16_t value, uint64_t time_ps);
+
+    bool (*c45_address)(struct mdio_model_device *dev, uint8_t port, uint8_t devad, uint16_t reg);
+    bool (*c45_read)(struct mdio_model_device *dev, uint8_t port, uint8_t devad, bool increment, uint16_t *value,
+                     uint64_t time_ps);
+    bool (*c45_write)(struct mdio_model_device *dev, uint8_t port, uint8_t devad, uint16_t value, uint64_t time_ps);
+
+    // Answers frames with less than MDIO_MODEL_PREAMBLE_BITS preamble bits (BMSR bit 6)
+    bool preamble_suppression;
+
+    struct mdio_model_device *next;
+};
+
+struct mdio_model_stats {
+    uint32_t frames;
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t c45_frames;
+    uint32_t unanswered;      // No device for the address, or the preamble was too short for it
+    uint32_t short_preamble;  // Frames with less than MDIO_MODEL_PREAMBLE_BITS preamble bits
+    uint32_t ta_errors;       // Write frames without the 10 turnaround, ignored
+    uint64_t first_frame_ps;  // Start of the first and end of the last frame
+    uint64_t last_frame_ps;
+};
+
+// Attach a bus model to an MDC/MDIO pin pair
+struct mdio_model_bus *mdio_model_bus_create(uint mdc_pin, uint mdio_pin);
+
+void mdio_model_bus_add(struct mdio_model_bus *bus, struct mdio_model_device *dev);
+
+void mdio_model_bus_get_stats(struct mdio_model_bus *bus, struct mdio_model_stats *stats);
+void mdio_model_bus_reset_stats(struct mdio_model_bus *bus);
+
+// ********** Generic 802.3 PHY **********
+// ***************************************
+
+// BMCR, BMSR (latching low link status), PHY ID, autonegotiation advertisement and link partner ability,
+// plain storage for the other Clause 22 registers and a small Clause 45 register file.
+
+#define MDIO_MODEL_PHY_C45_REGS 32
+
+struct mdio_model_phy;
+
+struct mdio_model_phy *mdio_model_phy_create(struct mdio_model_bus *bus, uint8_t addr, uint32_t phy_id);
+
+// Link to a partner. Autonegotiation completes aneg_us after the link came up or was restarted.
+void mdio_model_phy_set_link(struct mdio_model_phy *phy, bool up);
+
+// BMCR reset stays set for reset_us, autonegotiation takes aneg_us. Both 0 by default.
+void mdio_model_phy_set_timing(struct mdio_model_phy *phy, uint32_t reset_us, uint32_t aneg_us);
+
+void mdio_model_phy_set_preamble_suppression(struct mdio_model_phy *phy, bool supported);
+
+// Backdoor access to the register file, bypassing the register semantics
+void mdio_model_phy_set_reg(struct mdio_model_phy *phy, uint8_t reg, uint16_t value);
+uint16_t mdio_model_phy_get_reg(struct mdio_model_phy *phy, uint8_t reg);
+void mdio_model_phy_set_c45_reg(struct mdio_model_phy *phy, uint8_t devad, uint16_t reg, uint16_t value);
+
+// ********** RTL8305-like 6-port switch **********
+// ************************************************
+
+// Six PHYs at consecutive addresses with the Realtek ID of the readme example (0x001cc852)
+
+#define MDIO_MODEL_RTL8305_PORTS 6
+#define MDIO_MODEL_RTL8305_PHY_ID 0x001cc852
+
+struct mdio_model_rtl8305;
+
+struct mdio_model_rtl8305 *mdio_model_rtl8305_create(struct mdio_model_bus *bus, uint8_t base_addr);
+struct mdio_model_phy *mdio_model_rtl8305_port(struct mdio_model_rtl8305 *sw, uint port);
+
+// ********** Marvell multi-chip SMI switch **********
+// ***************************************************
+
+// A switch strapped in multi-chip mode. It only answers at its SMI address, with the SMI command (0) and
+// data (1) registers. A command keeps the busy bit set for busy_us, commands written while busy are
+// ignored. The internal devices are 32 register files of 32 registers each.
+
+struct mdio_model_smi_switch;
+
+struct mdio_model_smi_stats {
+    uint32_t commands;
+    uint32_t busy_polls;       // Command register reads that returned busy
+    uint32_t ignored_commands; // Written while busy or malformed
+};
+
+struct mdio_model_smi_switch *mdio_model_smi_switch_create(struct mdio_model_bus *bus, uint8_t smi_addr);
+
+void mdio_model_smi_switch_set_busy_time(struct mdio_model_smi_switch *sw, uint32_t busy_us);
+
+void mdio_model_smi_switch_set_reg(struct mdio_model_smi_switch *sw, uint8_t dev, uint8_t reg, uint16_t value);
+uint16_t mdio_model_smi_switch_get_reg(struct mdio_model_smi_switch *sw, uint8_t dev, uint8_t reg);
+
+void mdio_model_smi_switch_get_stats(struct mdio_model_smi_switch *sw, struct mdio_model_smi_stats *stats);
+
+// ********** Bus master **********
+// ********************************
+
+// Another station mastering the bus, like the MAC of an SoC next to the adapter. It drives MDC and every bit
+// of its frames on MDIO, including the turnaround and data of reads as if a PHY answered, so it is used on
+// pins without a bus model. The driver thread runs the frames and advances the virtual clock by the time
+// they take.
+
+struct mdio_model_master;
+
+struct mdio_model_master *mdio_model_master_create(uint mdc_pin, uint mdio_pin, uint32_t mdc_hz);
+
+// Preamble (1s), the 32 frame bits MSB first starting with ST, then idle bits (MDIO released)
+void mdio_model_master_frame(struct mdio_model_master *master, uint32_t bits, uint preamble_bits, uint idle_bits);
+
+// Stop driving MDC and MDIO
+void mdio_model_master_release(struct mdio_model_master *master);
+
+#endif
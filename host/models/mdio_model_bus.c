@@ -0,0 +1,203 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// MDIO frame decoder on the pins of the mock HAL
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mdio_model.h"
+
+// Bit positions in a frame, counted from the first start bit
+#define FRAME_LAST_HEADER_BIT 13 // ST, OP, PHYAD, REGAD
+#define FRAME_TA1_BIT 14
+#define FRAME_LAST_BIT 31
+
+#define C22_OP_WRITE 0x1
+#define C22_OP_READ 0x2
+#define C45_OP_ADDRESS 0x0
+#define C45_OP_WRITE 0x1
+#define C45_OP_READ_INC 0x2
+#define C45_OP_READ 0x3
+
+struct mdio_model_bus {
+    uint mdc_pin;
+    uint mdio_pin;
+    int driver;
+    struct mdio_model_device *devices;
+
+    bool in_frame;
+    uint ones;      // Consecutive 1s while idle
+    uint preamble;  // Preamble length of the current frame
+    uint pos;       // Position of the last sampled bit
+    uint32_t bits;
+    uint64_t start_ps;
+
+    bool c45;
+    bool read;
+    bool answering;
+    uint16_t value;
+
+    struct mdio_model_stats stats;
+};
+
+static bool preamble_ok(const struct mdio_model_bus *bus, const struct mdio_model_device *dev) {
+    return bus->preamble >= MDIO_MODEL_PREAMBLE_BITS || dev->preamble_suppression;
+}
+
+/**
+ * @brief The header of a read frame is complete: ask the devices for the value.
+ */
+static void frame_read(struct mdio_model_bus *bus, uint op, uint8_t addr, uint8_t reg, uint64_t time_ps) {
+    bus->stats.reads++;
+
+    for (struct mdio_model_device *dev = bus->devices; dev; dev = dev->next) {
+        if (!preamble_ok(bus, dev))
+            continue;
+
+        if (bus->c45) {
+            if (dev->c45_read && dev->c45_read(dev, addr, reg, op == C45_OP_READ_INC, &bus->value, time_ps)) {
+                bus->answering = true;
+                return;
+            }
+        } else if (dev->read(dev, addr, reg, &bus->value, time_ps)) {
+            bus->answering = true;
+            return;
+        }
+    }
+
+    bus->stats.unanswered++;
+}
+
+/**
+ * @brief A write or address frame is complete
+ */
+static void frame_write(struct mdio_model_bus *bus, uint64_t time_ps) {
+    uint op = (bus->bits >> 28) & 0x3;
+    uint8_t addr = (bus->bits >> 23) & 0x1f;
+    uint8_t reg = (bus->bits >> 18) & 0x1f;
+    uint16_t value = bus->bits & 0xffff;
+
+    if (((bus->bits >> 16) & 0x3) != 0x2) {
+        bus->stats.ta_errors++;
+        return;
+    }
+
+    bus->stats.writes++;
+
+    for (struct mdio_model_device *dev = bus->devices; dev; dev = dev->next) {
+        bool done;
+
+        if (!preamble_ok(bus, dev))
+            continue;
+
+        if (!bus->c45)
+            done = dev->write(dev, addr, reg, value, time_ps);
+        else if (op == C45_OP_ADDRESS)
+            done = dev->c45_address && dev->c45_address(dev, addr, reg, value);
+        else
+            done = dev->c45_write && dev->c45_write(dev, addr, reg, value, time_ps);
+
+        if (done)
+            return;
+    }
+
+    bus->stats.unanswered++;
+}
+
+static void sample(struct mdio_model_bus *bus, bool bit, uint64_t time_ps) {
+    if (!bus->in_frame) {
+        if (bit) {
+            bus->ones++;
+            return;
+        }
+
+        // First start bit: 01 for Clause 22, 00 for Clause 45
+        bus->in_frame = true;
+        bus->preamble = bus->ones;
+        bus->ones = 0;
+        bus->pos = 0;
+        bus->bits = 0;
+        bus->answering = false;
+        bus->start_ps = time_ps;
+    } else {
+        bus->pos++;
+    }
+
+    bus->bits = (bus->bits << 1) | bit;
+
+    if (bus->pos == 1) {
+        bus->c45 = !bit;
+    } else if (bus->pos == FRAME_LAST_HEADER_BIT) {
+        uint op = (bus->bits >> 10) & 0x3;
+
+        bus->stats.frames++;
+        if (bus->c45)
+            bus->stats.c45_frames++;
+        if (bus->preamble < MDIO_MODEL_PREAMBLE_BITS)
+            bus->stats.short_preamble++;
+        if (!bus->stats.first_frame_ps)
+            bus->stats.first_frame_ps = bus->start_ps;
+
+        bus->read = bus->c45 ? (op == C45_OP_READ || op == C45_OP_READ_INC) : op == C22_OP_READ;
+        if (bus->read)
+            frame_read(bus, op, (bus->bits >> 5) & 0x1f, bus->bits & 0x1f, time_ps);
+    }
+
+    // A read is answered bit by bit right after the rising edge: second TA bit low, then the data MSB first
+    if (bus->answering && bus->pos >= FRAME_TA1_BIT && bus->pos < FRAME_LAST_BIT) {
+        bool out = bus->pos == FRAME_TA1_BIT ? false : (bus->value >> (FRAME_LAST_BIT - 1 - bus->pos)) & 1;
+        mock_gpio_driver_set(bus->driver, out ? MOCK_GPIO_HIGH : MOCK_GPIO_LOW);
+    }
+
+    if (bus->pos == FRAME_LAST_BIT) {
+        if (bus->answering)
+            mock_gpio_driver_set(bus->driver, MOCK_GPIO_RELEASE);
+        else if (!bus->read)
+            frame_write(bus, time_ps);
+
+        bus->in_frame = false;
+        bus->stats.last_frame_ps = time_ps;
+    }
+}
+
+static void mdc_listener(void *context, uint pin, bool level, uint64_t time_ps) {
+    struct mdio_model_bus *bus = context;
+
+    if (pin == bus->mdc_pin && level)
+        sample(bus, mock_gpio_level(bus->mdio_pin), time_ps);
+}
+
+struct mdio_model_bus *mdio_model_bus_create(uint mdc_pin, uint mdio_pin) {
+    struct mdio_model_bus *bus = calloc(1, sizeof(*bus));
+
+    bus->mdc_pin = mdc_pin;
+    bus->mdio_pin = mdio_pin;
+    bus->driver = mock_gpio_driver_add(mdio_pin);
+    mock_gpio_add_listener(mdc_listener, bus);
+
+    return bus;
+}
+
+void mdio_model_bus_add(struct mdio_model_bus *bus, struct mdio_model_device *dev) {
+    mock_lock();
+    dev->next = bus->devices;
+    bus->devices = dev;
+    mock_unlock();
+}
+
+void mdio_model_bus_get_stats(struct mdio_model_bus *bus, struct mdio_model_stats *stats) {
+    mock_lock();
+    *stats = bus->stats;
+    mock_unlock();
+}
+
+void mdio_model_bus_reset_stats(struct mdio_model_bus *bus) {
+    mock_lock();
+    memset(&bus->stats, 0, sizeof(bus->stats));
+    mock_unlock();
+}
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// Another MDIO master on the pins of the mock HAL, e.g. the MAC of an SoC sharing the bus with the adapter
+
+#include <stdlib.h>
+
+#include "mdio_model.h"
+
+#define FRAME_BITS 32
+
+struct mdio_model_master {
+    int mdc;
+    int mdio;
+    uint32_t half_period_ns;
+};
+
+struct mdio_model_master *mdio_model_master_create(uint mdc_pin, uint mdio_pin, uint32_t mdc_hz) {
+    struct mdio_model_master *master = calloc(1, sizeof(*master));
+
+    master->mdc = mock_gpio_driver_add(mdc_pin);
+    master->mdio = mock_gpio_driver_add(mdio_pin);
+    master->half_period_ns = 500000000 / mdc_hz;
+
+    return master;
+}
+
+/**
+ * @brief One MDC period with MDIO set up while MDC is low
+ */
+static void master_bit(struct mdio_model_master *master, enum mock_gpio_drive mdio) {
+    mock_gpio_driver_set(master->mdio, mdio);
+    mock_time_advance_ns(master->half_period_ns);
+    mock_gpio_driver_set(master->mdc, MOCK_GPIO_HIGH);
+    mock_time_advance_ns(master->half_period_ns);
+    mock_gpio_driver_set(master->mdc, MOCK_GPIO_LOW);
+}
+
+void mdio_model_master_frame(struct mdio_model_master *master, uint32_t bits, uint preamble_bits, uint idle_bits) {
+    mock_gpio_driver_set(master->mdc, MOCK_GPIO_LOW);
+
+    for (uint i = 0; i < preamble_bits; i++)
+        master_bit(master, MOCK_GPIO_RELEASE);
+    for (int i = FRAME_BITS - 1; i >= 0; i--)
+        master_bit(master, bits & (1u << i) ? MOCK_GPIO_RELEASE : MOCK_GPIO_LOW);
+    for (uint i = 0; i < idle_bits; i++)
+        master_bit(master, MOCK_GPIO_RELEASE);
+}
+
+void mdio_model_master_release(struct mdio_model_master *master) {
+    mock_gpio_driver_set(master->mdio, MOCK_GPIO_RELEASE);
+    mock_gpio_driver_set(master->mdc, MOCK_GPIO_RELEASE);
+}
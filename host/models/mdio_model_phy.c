@@ -0,0 +1,282 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// Generic IEEE 802.3 Clause 22 PHY with a small Clause 45 register file
+
+#include <stdlib.h>
+
+#include "mdio_model.h"
+
+#define REG_BMCR 0
+#define REG_BMSR 1
+#define REG_PHYID1 2
+#define REG_PHYID2 3
+#define REG_ANAR 4
+#define REG_ANLPAR 5
+
+#define BMCR_RESET (1u << 15)
+#define BMCR_ANEG_ENABLE (1u << 12)
+#define BMCR_ANEG_RESTART (1u << 9)
+#define BMCR_DEFAULT 0x3100 // 100 Mbit/s, autonegotiation, full duplex
+
+// 100BASE-TX/10BASE-T full and half duplex, autonegotiation ability, extended capabilities
+#define BMSR_CAPABILITIES 0x7809
+#define BMSR_PREAMBLE_SUPPRESSION (1u << 6)
+#define BMSR_ANEG_COMPLETE (1u << 5)
+#define BMSR_ANEG_ABILITY (1u << 3)
+#define BMSR_LINK (1u << 2)
+
+#define ANAR_DEFAULT 0x01e1
+#define ANLPAR_LINK_UP 0x45e1 // Link partner with the same abilities, acknowledge
+
+#define PS_PER_US 1000000ull
+
+struct c45_reg {
+    uint8_t devad;
+    uint16_t reg;
+    uint16_t value;
+};
+
+struct mdio_model_phy {
+    struct mdio_model_device dev; // First member, the bus hands it to the callbacks
+    uint8_t addr;
+
+    uint16_t regs[32];
+    bool link;
+    bool link_latched_low;
+    uint64_t reset_until_ps;
+    uint64_t aneg_done_ps;
+    uint32_t reset_us;
+    uint32_t aneg_us;
+
+    struct c45_reg c45[MDIO_MODEL_PHY_C45_REGS];
+    uint c45_count;
+    uint16_t c45_address[32];
+};
+
+static void phy_defaults(struct mdio_model_phy *phy, uint32_t phy_id) {
+    for (uint i = 0; i < 32; i++)
+        if (i != REG_PHYID1 && i != REG_PHYID2)
+            phy->regs[i] = 0;
+
+    if (phy_id) {
+        phy->regs[REG_PHYID1] = phy_id >> 16;
+        phy->regs[REG_PHYID2] = phy_id & 0xffff;
+    }
+
+    phy->regs[REG_BMCR] = BMCR_DEFAULT;
+    phy->regs[REG_ANAR] = ANAR_DEFAULT;
+    phy->link_latched_low = !phy->link;
+}
+
+static void aneg_restart(struct mdio_model_phy *phy, uint64_t time_ps) {
+    phy->aneg_done_ps = time_ps + phy->aneg_us * PS_PER_US;
+}
+
+/**
+ * @brief Finish a reset whose time has passed
+ */
+static void phy_update(struct mdio_model_phy *phy, uint64_t time_ps) {
+    if (phy->reset_until_ps && time_ps >= phy->reset_until_ps) {
+        phy->reset_until_ps = 0;
+        phy_defaults(phy, 0);
+        aneg_restart(phy, time_ps);
+    }
+}
+
+static uint16_t phy_bmsr(struct mdio_model_phy *phy, uint64_t time_ps) {
+    uint16_t bmsr = BMSR_CAPABILITIES;
+
+    if (phy->dev.preamble_suppression)
+        bmsr |= BMSR_PREAMBLE_SUPPRESSION;
+
+    // Latching low: a link loss is reported once even if the link came back
+    if (phy->link && !phy->link_latched_low)
+        bmsr |= BMSR_LINK;
+    phy->link_latched_low = !phy->link;
+
+    if (phy->link && (phy->regs[REG_BMCR] & BMCR_ANEG_ENABLE) && time_ps >= phy->aneg_done_ps)
+        bmsr |= BMSR_ANEG_COMPLETE;
+
+    return bmsr;
+}
+
+static bool phy_read(struct mdio_model_device *dev, uint8_t addr, uint8_t reg, uint16_t *value, uint64_t time_ps) {
+    struct mdio_model_phy *phy = (struct mdio_model_phy *) dev;
+
+    if (addr != phy->addr)
+        return false;
+
+    phy_update(phy, time_ps);
+
+    switch (reg) {
+    case REG_BMSR:
+        *value = phy_bmsr(phy, time_ps);
+        break;
+    case REG_ANLPAR:
+        *value = phy->link ? ANLPAR_LINK_UP : 0;
+        break;
+    default:
+        *value = phy->regs[reg];
+        break;
+    }
+
+    return true;
+}
+
+static bool phy_write(struct mdio_model_device *dev, uint8_t addr, uint8_t reg, uint16_t value, uint64_t time_ps) {
+    struct mdio_model_phy *phy = (struct mdio_model_phy *) dev;
+
+    if (addr != phy->addr)
+        return false;
+
+    phy_update(phy, time_ps);
+
+    switch (reg) {
+    case REG_BMCR:
+        if (value & BMCR_RESET) {
+            phy->regs[REG_BMCR] = value;
+            phy->reset_until_ps = time_ps + phy->reset_us * PS_PER_US;
+            if (!phy->reset_us)
+                phy_update(phy, time_ps);
+            break;
+        }
+
+        phy->regs[REG_BMCR] = value & ~BMCR_ANEG_RESTART;
+        if (value & BMCR_ANEG_RESTART)
+            aneg_restart(phy, time_ps);
+        break;
+    case REG_BMSR:
+    case REG_PHYID1:
+    case REG_PHYID2:
+    case REG_ANLPAR:
+        break;
+    default:
+        phy->regs[reg] = value;
+        break;
+    }
+
+    return true;
+}
+
+static struct c45_reg *c45_find(struct mdio_model_phy *phy, uint8_t devad, uint16_t reg) {
+    for (uint i = 0; i < phy->c45_count; i++)
+        if (phy->c45[i].devad == devad && phy->c45[i].reg == reg)
+            return &phy->c45[i];
+
+    return NULL;
+}
+
+static bool phy_c45_address(struct mdio_model_device *dev, uint8_t port, uint8_t devad, uint16_t reg) {
+    struct mdio_model_phy *phy = (struct mdio_model_phy *) dev;
+
+    if (port != phy->addr)
+        return false;
+
+    phy->c45_address[devad] = reg;
+    return true;
+}
+
+static bool phy_c45_read(struct mdio_model_device *dev, uint8_t port, uint8_t devad, bool increment, uint16_t *value,
+                         uint64_t time_ps) {
+    struct mdio_model_phy *phy = (struct mdio_model_phy *) dev;
+    (void) time_ps;
+
+    if (port != phy->addr)
+        return false;
+
+    // Unimplemented registers read as 0
+    struct c45_reg *r = c45_find(phy, devad, phy->c45_address[devad]);
+    *value = r ? r->value : 0;
+
+    if (increment)
+        phy->c45_address[devad]++;
+
+    return true;
+}
+
+static bool phy_c45_write(struct mdio_model_device *dev, uint8_t port, uint8_t devad, uint16_t value,
+                          uint64_t time_ps) {
+    struct mdio_model_phy *phy = (struct mdio_model_phy *) dev;
+    (void) time_ps;
+
+    if (port != phy->addr)
+        return false;
+
+    // Only registers set up by mdio_model_phy_set_c45_reg() are writable
+    struct c45_reg *r = c45_find(phy, devad, phy->c45_address[devad]);
+    if (r)
+        r->value = value;
+
+    return true;
+}
+
+struct mdio_model_phy *mdio_model_phy_create(struct mdio_model_bus *bus, uint8_t addr, uint32_t phy_id) {
+    struct mdio_model_phy *phy = calloc(1, sizeof(*phy));
+
+    phy->dev.read = phy_read;
+    phy->dev.write = phy_write;
+    phy->dev.c45_address = phy_c45_address;
+    phy->dev.c45_read = phy_c45_read;
+    phy->dev.c45_write = phy_c45_write;
+    phy->addr = addr;
+    phy_defaults(phy, phy_id);
+
+    mdio_model_bus_add(bus, &phy->dev);
+    return phy;
+}
+
+void mdio_model_phy_set_link(struct mdio_model_phy *phy, bool up) {
+    mock_lock();
+    if (up && !phy->link)
+        aneg_restart(phy, mock_time_ps());
+    if (!up)
+        phy->link_latched_low = true;
+    phy->link = up;
+    mock_unlock();
+}
+
+void mdio_model_phy_set_timing(struct mdio_model_phy *phy, uint32_t reset_us, uint32_t aneg_us) {
+    mock_lock();
+    phy->reset_us = reset_us;
+    phy->aneg_us = aneg_us;
+    mock_unlock();
+}
+
+void mdio_model_phy_set_preamble_suppression(struct mdio_model_phy *phy, bool supported) {
+    mock_lock();
+    phy->dev.preamble_suppression = supported;
+    mock_unlock();
+}
+
+void mdio_model_phy_set_reg(struct mdio_model_phy *phy, uint8_t reg, uint16_t value) {
+    mock_lock();
+    phy->regs[reg & 0x1f] = value;
+    mock_unlock();
+}
+
+uint16_t mdio_model_phy_get_reg(struct mdio_model_phy *phy, uint8_t reg) {
+    mock_lock();
+    uint16_t value = phy->regs[reg & 0x1f];
+    mock_unlock();
+
+    return value;
+}
+
+void mdio_model_phy_set_c45_reg(struct mdio_model_phy *phy, uint8_t devad, uint16_t reg, uint16_t value) {
+    mock_lock();
+    struct c45_reg *r = c45_find(phy, devad & 0x1f, reg);
+    if (!r) {
+        if (phy->c45_count == MDIO_MODEL_PHY_C45_REGS)
+            panic("mdio_model_phy: Clause 45 register file is full");
+        r = &phy->c45[phy->c45_count++];
+        r->devad = devad & 0x1f;
+        r->reg = reg;
+    }
+    r->value = value;
+    mock_unlock();
+}
@@ -0,0 +1,36 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// RTL8305-like 6-port switch: six generic PHYs at consecutive addresses
+
+#include <stdlib.h>
+
+#include "mdio_model.h"
+
+struct mdio_model_rtl8305 {
+    struct mdio_model_phy *ports[MDIO_MODEL_RTL8305_PORTS];
+};
+
+struct mdio_model_rtl8305 *mdio_model_rtl8305_create(struct mdio_model_bus *bus, uint8_t base_addr) {
+    struct mdio_model_rtl8305 *sw = calloc(1, sizeof(*sw));
+
+    for (uint i = 0; i < MDIO_MODEL_RTL8305_PORTS; i++) {
+        sw->ports[i] = mdio_model_phy_create(bus, base_addr + i, MDIO_MODEL_RTL8305_PHY_ID);
+
+        // The readme example reads BMSR 0x786d, so the PHYs accept frames without preamble
+        mdio_model_phy_set_preamble_suppression(sw->ports[i], true);
+    }
+
+    return sw;
+}
+
+struct mdio_model_phy *mdio_model_rtl8305_port(struct mdio_model_rtl8305 *sw, uint port) {
+    if (port >= MDIO_MODEL_RTL8305_PORTS)
+        panic("mdio_model_rtl8305: No port %u", port);
+
+    return sw->ports[port];
+}
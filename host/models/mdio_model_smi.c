@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// Marvell switch in multi-chip mode: indirect access through the SMI command and data registers
+
+#include <stdlib.h>
+
+#include "mdio_model.h"
+
+#define SMI_REG_CMD 0
+#define SMI_REG_DATA 1
+
+#define SMI_CMD_BUSY (1u << 15)
+#define SMI_CMD_CLAUSE_22 (1u << 12)
+#define SMI_CMD_OP_MASK (0x3u << 10)
+#define SMI_CMD_OP_WRITE (0x1u << 10)
+#define SMI_CMD_OP_READ (0x2u << 10)
+#define SMI_CMD_DEV_SHIFT 5
+
+#define PS_PER_US 1000000ull
+
+struct mdio_model_smi_switch {
+    struct mdio_model_device dev; // First member, the bus hands it to the callbacks
+    uint8_t smi_addr;
+
+    uint16_t cmd;
+    uint16_t data;
+    uint64_t busy_until_ps;
+    uint32_t busy_us;
+
+    uint16_t regs[32][32];
+    struct mdio_model_smi_stats stats;
+};
+
+static bool smi_busy(struct mdio_model_smi_switch *sw, uint64_t time_ps) {
+    return time_ps < sw->busy_until_ps;
+}
+
+static bool smi_read(struct mdio_model_device *dev, uint8_t addr, uint8_t reg, uint16_t *value, uint64_t time_ps) {
+    struct mdio_model_smi_switch *sw = (struct mdio_model_smi_switch *) dev;
+
+    if (addr != sw->smi_addr)
+        return false;
+
+    switch (reg) {
+    case SMI_REG_CMD:
+        if (smi_busy(sw, time_ps)) {
+            sw->stats.busy_polls++;
+            *value = sw->cmd | SMI_CMD_BUSY;
+        } else {
+            *value = sw->cmd & ~SMI_CMD_BUSY;
+        }
+        break;
+    case SMI_REG_DATA:
+        *value = sw->data;
+        break;
+    default:
+        // Nothing else is decoded in multi-chip mode, the bus floats
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Execute a command. The result is visible at once, the busy bit only delays when a driver may look.
+ */
+static void smi_command(struct mdio_model_smi_switch *sw, uint16_t cmd, uint64_t time_ps) {
+    uint8_t dev = (cmd >> SMI_CMD_DEV_SHIFT) & 0x1f;
+    uint8_t reg = cmd & 0x1f;
+
+    if (!(cmd & SMI_CMD_BUSY) || !(cmd & SMI_CMD_CLAUSE_22) || smi_busy(sw, time_ps)) {
+        sw->stats.ignored_commands++;
+        return;
+    }
+
+    switch (cmd & SMI_CMD_OP_MASK) {
+    case SMI_CMD_OP_READ:
+        sw->data = sw->regs[dev][reg];
+        break;
+    case SMI_CMD_OP_WRITE:
+        sw->regs[dev][reg] = sw->data;
+        break;
+    default:
+        sw->stats.ignored_commands++;
+        return;
+    }
+
+    sw->stats.commands++;
+    sw->cmd = cmd;
+    sw->busy_until_ps = time_ps + sw->busy_us * PS_PER_US;
+}
+
+static bool smi_write(struct mdio_model_device *dev, uint8_t addr, uint8_t reg, uint16_t value, uint64_t time_ps) {
+    struct mdio_model_smi_switch *sw = (struct mdio_model_smi_switch *) dev;
+
+    if (addr != sw->smi_addr)
+        return false;
+
+    switch (reg) {
+    case SMI_REG_CMD:
+        smi_command(sw, value, time_ps);
+        break;
+    case SMI_REG_DATA:
+        // The data register is not latched while a command runs
+        if (!smi_busy(sw, time_ps))
+            sw->data = value;
+        break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+struct mdio_model_smi_switch *mdio_model_smi_switch_create(struct mdio_model_bus *bus, uint8_t smi_addr) {
+    struct mdio_model_smi_switch *sw = calloc(1, sizeof(*sw));
+
+    sw->dev.read = smi_read;
+    sw->dev.write = smi_write;
+    sw->smi_addr = smi_addr;
+
+    mdio_model_bus_add(bus, &sw->dev);
+    return sw;
+}
+
+void mdio_model_smi_switch_set_busy_time(struct mdio_model_smi_switch *sw, uint32_t busy_us) {
+    mock_lock();
+    sw->busy_us = busy_us;
+    mock_unlock();
+}
+
+void mdio_model_smi_switch_set_reg(struct mdio_model_smi_switch *sw, uint8_t dev, uint8_t reg, uint16_t value) {
+    mock_lock();
+    sw->regs[dev & 0x1f][reg & 0x1f] = value;
+    mock_unlock();
+}
+
+uint16_t mdio_model_smi_switch_get_reg(struct mdio_model_smi_switch *sw, uint8_t dev, uint8_t reg) {
+    mock_lock();
+    uint16_t value = sw->regs[dev & 0x1f][reg & 0x1f];
+    mock_unlock();
+
+    return value;
+}
+
+void mdio_model_smi_switch_get_stats(struct mdio_model_smi_switch *sw, struct mdio_model_smi_stats *stats) {
+    mock_lock();
+    *stats = sw->stats;
+    mock_unlock();
+}
@@ -0,0 +1,256 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// MDIO timing checker on a recorded waveform
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mdio_timing.h"
+
+// Rising MDC edges of a frame, counted from the first start bit
+#define FRAME_LAST_HEADER_BIT 13
+#define FRAME_TA1_BIT 14
+#define FRAME_TA2_BIT 15
+#define FRAME_LAST_BIT 31
+
+struct stat_sum {
+    uint32_t count;
+    uint64_t min_ps;
+    uint64_t max_ps;
+    double sum;
+    double sum_sq;
+};
+
+struct checker {
+    const struct mdio_timing_limits *limits;
+    struct mdio_timing_report *report;
+
+    bool mdc;
+    bool have_rise;
+    bool have_fall;
+    uint64_t rise_ps;
+    uint64_t fall_ps;
+
+    bool mdio;
+    bool mdio_oe;
+    bool mdio_changed; // Since the last rising edge
+    uint64_t mdio_change_ps;
+
+    bool in_frame;
+    bool read;
+    uint pos;
+    uint32_t bits;
+
+    struct stat_sum period, high, low, setup, hold;
+};
+
+static void stat_add(struct stat_sum *s, uint64_t value_ps) {
+    if (!s->count || value_ps < s->min_ps)
+        s->min_ps = value_ps;
+    if (!s->count || value_ps > s->max_ps)
+        s->max_ps = value_ps;
+
+    s->count++;
+    s->sum += (double) value_ps;
+    s->sum_sq += (double) value_ps * (double) value_ps;
+}
+
+static void stat_finish(const struct stat_sum *s, struct mdio_timing_stat *stat) {
+    memset(stat, 0, sizeof(*stat));
+    if (!s->count)
+        return;
+
+    double mean = s->sum / s->count;
+    double variance = s->sum_sq / s->count - mean * mean;
+
+    stat->count = s->count;
+    stat->min_ps = s->min_ps;
+    stat->max_ps = s->max_ps;
+    stat->mean_ps = (uint64_t) llround(mean);
+    stat->stddev_ps = variance > 0 ? (uint64_t) llround(sqrt(variance)) : 0;
+}
+
+static void violation(struct checker *c, uint32_t *counter, uint64_t time_ps) {
+    (*counter)++;
+    if (!c->report->first_violation_ps)
+        c->report->first_violation_ps = time_ps;
+}
+
+/**
+ * @brief Follow the frame on a rising MDC edge and check who drives the turnaround bits
+ */
+static void frame_bit(struct checker *c, uint64_t time_ps) {
+    if (!c->in_frame) {
+        if (c->mdio)
+            return;
+
+        c->in_frame = true;
+        c->read = false;
+        c->pos = 0;
+        c->bits = 0;
+    } else {
+        c->pos++;
+    }
+
+    c->bits = (c->bits << 1) | c->mdio;
+
+    if (c->pos == FRAME_LAST_HEADER_BIT) {
+        bool c45 = !(c->bits & (1u << 12));
+        uint op = (c->bits >> 10) & 0x3;
+
+        c->report->frames++;
+        c->read = c45 ? op >= 0x2 : op == 0x2;
+        if (c->read)
+            c->report->reads++;
+    } else if (c->pos == FRAME_TA1_BIT || c->pos == FRAME_TA2_BIT) {
+        bool expected = c->pos == FRAME_TA1_BIT;
+
+        if (c->read ? c->mdio_oe : (!c->mdio_oe || c->mdio != expected))
+            violation(c, &c->report->turnaround_violations, time_ps);
+    } else if (c->pos == FRAME_LAST_BIT) {
+        c->in_frame = false;
+    }
+}
+
+static void mdc_edge(struct checker *c, bool level, uint64_t time_ps) {
+    const struct mdio_timing_limits *l = c->limits;
+    struct mdio_timing_report *r = c->report;
+
+    if (!level) {
+        if (c->have_rise) {
+            uint64_t high = time_ps - c->rise_ps;
+            if (high <= l->gap_ps) {
+                stat_add(&c->high, high);
+                if (high < l->mdc_high_min_ps)
+                    violation(c, &r->high_violations, time_ps);
+            }
+        }
+
+        c->fall_ps = time_ps;
+        c->have_fall = true;
+        return;
+    }
+
+    if (c->have_rise && c->have_fall) {
+        uint64_t period = time_ps - c->rise_ps;
+        uint64_t low = time_ps - c->fall_ps;
+
+        if (period <= l->gap_ps) {
+            stat_add(&c->period, period);
+            stat_add(&c->low, low);
+            if (period < l->mdc_period_min_ps)
+                violation(c, &r->period_violations, time_ps);
+            if (low < l->mdc_low_min_ps)
+                violation(c, &r->low_violations, time_ps);
+        }
+    }
+
+    uint64_t setup = time_ps - c->mdio_change_ps;
+    if (c->mdio_changed && setup <= l->gap_ps) {
+        stat_add(&c->setup, setup);
+        if (setup < l->setup_min_ps)
+            violation(c, &r->setup_violations, time_ps);
+    }
+
+    c->rise_ps = time_ps;
+    c->have_rise = true;
+    c->mdio_changed = false;
+
+    frame_bit(c, time_ps);
+}
+
+static void mdio_edge(struct checker *c, bool level, bool oe, uint64_t time_ps) {
+    const struct mdio_timing_limits *l = c->limits;
+    bool changed = level != c->mdio;
+
+    c->mdio = level;
+    c->mdio_oe = oe;
+    if (!changed || !c->have_rise)
+        return;
+
+    uint64_t since_rise = time_ps - c->rise_ps;
+
+    if (oe) {
+        // Changes long after the last edge happen between frames, they say nothing about the hold time
+        if (since_rise <= l->gap_ps) {
+            stat_add(&c->hold, since_rise);
+            if (since_rise < l->hold_min_ps)
+                violation(c, &c->report->hold_violations, time_ps);
+        }
+    } else if (c->in_frame && c->read && c->pos >= FRAME_TA1_BIT && c->pos < FRAME_LAST_BIT) {
+        if (since_rise > l->phy_delay_max_ps)
+            violation(c, &c->report->phy_delay_violations, time_ps);
+    }
+
+    c->mdio_changed = true;
+    c->mdio_change_ps = time_ps;
+}
+
+void mdio_timing_limits_default(struct mdio_timing_limits *limits) {
+    *limits = (struct mdio_timing_limits) {
+        .mdc_high_min_ps = 160000,
+        .mdc_low_min_ps = 160000,
+        .mdc_period_min_ps = 400000,
+        .setup_min_ps = 10000,
+        .hold_min_ps = 10000,
+        .phy_delay_max_ps = 300000,
+        .gap_ps = 10000000,
+    };
+}
+
+bool mdio_timing_check(const struct mock_wave_event *events, size_t count, uint mdc_pin, uint mdio_pin,
+                       const struct mdio_timing_limits *limits, struct mdio_timing_report *report) {
+    struct checker c = {
+        .limits = limits,
+        .report = report,
+        .mdio = true,
+    };
+
+    memset(report, 0, sizeof(*report));
+
+    for (size_t i = 0; i < count; i++) {
+        const struct mock_wave_event *e = &events[i];
+
+        if (e->pin == mdc_pin && e->level != c.mdc) {
+            c.mdc = e->level;
+            mdc_edge(&c, e->level, e->time_ps);
+        } else if (e->pin == mdio_pin) {
+            mdio_edge(&c, e->level, e->oe, e->time_ps);
+        }
+    }
+
+    stat_finish(&c.period, &report->period);
+    stat_finish(&c.high, &report->high);
+    stat_finish(&c.low, &report->low);
+    stat_finish(&c.setup, &report->setup);
+    stat_finish(&c.hold, &report->hold);
+
+    return !report->first_violation_ps;
+}
+
+static void print_stat(const char *name, const struct mdio_timing_stat *s) {
+    printf("  %-7s %6u  min %8.1f ns  max %8.1f ns  mean %8.1f ns  stddev %6.1f ns\n", name, (uint) s->count,
+           s->min_ps / 1000.0, s->max_ps / 1000.0, s->mean_ps / 1000.0, s->stddev_ps / 1000.0);
+}
+
+void mdio_timing_print(const struct mdio_timing_report *report) {
+    printf("MDIO timing: %u frames, %u reads\n", (uint) report->frames, (uint) report->reads);
+    print_stat("period", &report->period);
+    print_stat("high", &report->high);
+    print_stat("low", &report->low);
+    print_stat("setup", &report->setup);
+    print_stat("hold", &report->hold);
+    printf("  jitter  %.1f ns peak to peak\n", (report->period.max_ps - report->period.min_ps) / 1000.0);
+    printf("  violations: period %u, high %u, low %u, setup %u, hold %u, PHY delay %u, turnaround %u\n",
+           (uint) report->period_violations, (uint) report->high_violations, (uint) report->low_violations,
+           (uint) report->setup_violations, (uint) report->hold_violations, (uint) report->phy_delay_violations,
+           (uint) report->turnaround_violations);
+    if (report->first_violation_ps)
+        printf("  first violation at %llu ps\n", (unsigned long long) report->first_violation_ps);
+}
@@ -0,0 +1,63 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef MDIO_TIMING_H_
+#define MDIO_TIMING_H_
+
+#include "mock_hal.h"
+
+// IEEE 802.3 Clause 22.3.4 timing check of a waveform recorded with mock_wave_start(). The checker follows
+// the frames on the bus to tell the bits driven by the station from the ones driven by the PHY.
+
+struct mdio_timing_limits {
+    uint64_t mdc_high_min_ps;
+    uint64_t mdc_low_min_ps;
+    uint64_t mdc_period_min_ps;
+    uint64_t setup_min_ps;     // MDIO stable before the rising MDC edge, whoever drives it
+    uint64_t hold_min_ps;      // MDIO stable after the rising MDC edge, driven by the station
+    uint64_t phy_delay_max_ps; // Rising MDC edge to MDIO driven by the PHY
+    uint64_t gap_ps;           // Longer MDC periods are pauses between frames and not part of the statistics
+};
+
+struct mdio_timing_stat {
+    uint32_t count;
+    uint64_t min_ps;
+    uint64_t max_ps;
+    uint64_t mean_ps;
+    uint64_t stddev_ps;
+};
+
+struct mdio_timing_report {
+    uint32_t frames;
+    uint32_t reads;
+
+    struct mdio_timing_stat period;
+    struct mdio_timing_stat high;
+    struct mdio_timing_stat low;
+    struct mdio_timing_stat setup;
+    struct mdio_timing_stat hold;
+
+    uint32_t period_violations;
+    uint32_t high_violations;
+    uint32_t low_violations;
+    uint32_t setup_violations;
+    uint32_t hold_violations;
+    uint32_t phy_delay_violations;
+    uint32_t turnaround_violations; // Station still driving in TA of a read, or no 10 in TA of a write
+    uint64_t first_violation_ps;    // 0 without violations
+};
+
+// Limits of 802.3: 2.5 MHz MDC with 160 ns high and low time, 10 ns setup and hold, 300 ns PHY delay
+void mdio_timing_limits_default(struct mdio_timing_limits *limits);
+
+// Returns true if there was no violation
+bool mdio_timing_check(const struct mock_wave_event *events, size_t count, uint mdc_pin, uint mdio_pin,
+                       const struct mdio_timing_limits *limits, struct mdio_timing_report *report);
+
+void mdio_timing_print(const struct mdio_timing_report *report);
+
+#endif
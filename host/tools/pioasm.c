@@ -0,0 +1,538 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// Minimal PIO assembler for the host build. It understands the subset of the pioasm language the firmware
+// uses (.program, .side_set, .wrap_target, .wrap, .origin, .define, labels, all RP2040 instructions with
+// side-set and delay, % c-sdk blocks) and writes a header in the layout of pioasm's C output, so the
+// firmware includes it unchanged.
+//
+// Usage: host-pioasm <input.pio> <output.h>
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_INSTRUCTIONS 32
+#define MAX_SYMBOLS 64
+#define MAX_TOKENS 16
+#define MAX_LINE 512
+
+struct symbol {
+    char name[64];
+    int value;
+    bool is_label;
+    bool is_public;
+};
+
+struct instruction {
+    char text[MAX_LINE];
+    char tokens[MAX_TOKENS][64];
+    int num_tokens;
+    int side;       // -1 if none
+    int delay;
+    int line;
+};
+
+struct program {
+    char name[64];
+    int sideset_bits;
+    bool sideset_opt;
+    bool sideset_pindirs;
+    int origin;
+    int wrap_target;
+    int wrap;
+    struct instruction instructions[MAX_INSTRUCTIONS];
+    int length;
+    struct symbol symbols[MAX_SYMBOLS];
+    int num_symbols;
+    char *c_sdk;
+    size_t c_sdk_len;
+};
+
+static const char *input_name;
+
+static void fail(int line, const char *fmt, ...) {
+    va_list args;
+
+    fprintf(stderr, "%s:%d: error: ", input_name, line);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    exit(1);
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char) *s))
+        s++;
+
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char) end[-1]))
+        *--end = '\0';
+
+    return s;
+}
+
+static void strip_comment(char *s) {
+    char *c = strchr(s, ';');
+    if (c)
+        *c = '\0';
+
+    c = strstr(s, "//");
+    if (c)
+        *c = '\0';
+}
+
+static struct symbol *find_symbol(struct program *p, const char *name) {
+    for (int i = 0; i < p->num_symbols; i++) {
+        if (!strcmp(p->symbols[i].name, name))
+            return &p->symbols[i];
+    }
+
+    return NULL;
+}
+
+static void add_symbol(struct program *p, int line, const char *name, int value, bool is_label, bool is_public) {
+    if (find_symbol(p, name))
+        fail(line, "'%s' is already defined", name);
+    if (p->num_symbols == MAX_SYMBOLS)
+        fail(line, "too many symbols");
+
+    struct symbol *s = &p->symbols[p->num_symbols++];
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->value = value;
+    s->is_label = is_label;
+    s->is_public = is_public;
+}
+
+static int parse_value(struct program *p, int line, const char *token) {
+    char *end;
+    long value;
+
+    if (!strncmp(token, "0b", 2))
+        value = strtol(token + 2, &end, 2);
+    else
+        value = strtol(token, &end, 0);
+
+    if (end != token && *end == '\0')
+        return (int) value;
+
+    struct symbol *s = find_symbol(p, token);
+    if (!s)
+        fail(line, "unknown symbol '%s'", token);
+
+    return s->value;
+}
+
+/**
+ * @brief Split an instruction into tokens. Commas separate like blanks, "side n" and "[n]" are taken out.
+ */
+static void tokenize(struct program *p, struct instruction *in, char *text) {
+    char *save;
+
+    in->num_tokens = 0;
+    in->side = -1;
+    in->delay = 0;
+
+    // Delay
+    char *bracket = strchr(text, '[');
+    if (bracket) {
+        char *close = strchr(bracket, ']');
+        if (!close)
+            fail(in->line, "missing ']'");
+        *close = '\0';
+        in->delay = parse_value(p, in->line, trim(bracket + 1));
+        *bracket = '\0';
+    }
+
+    for (char *t = strtok_r(text, " \t,", &save); t; t = strtok_r(NULL, " \t,", &save)) {
+        if (!strcmp(t, "side") || !strcmp(t, "sideset")) {
+            char *value = strtok_r(NULL, " \t,", &save);
+            if (!value)
+                fail(in->line, "missing side-set value");
+            in->side = parse_value(p, in->line, value);
+            continue;
+        }
+
+        if (in->num_tokens == MAX_TOKENS)
+            fail(in->line, "too many operands");
+        snprintf(in->tokens[in->num_tokens++], sizeof(in->tokens[0]), "%s", t);
+    }
+}
+
+static int lookup(int line, const char *token, const char *const *names, int count, const char *what) {
+    for (int i = 0; i < count; i++) {
+        if (names[i] && !strcmp(token, names[i]))
+            return i;
+    }
+
+    fail(line, "invalid %s '%s'", what, token);
+    return -1;
+}
+
+static void need_operands(const struct instruction *in, int count) {
+    if (in->num_tokens < count + 1)
+        fail(in->line, "'%s' needs %d operands", in->tokens[0], count);
+}
+
+static uint16_t encode(struct program *p, struct instruction *in) {
+    static const char *const jmp_conditions[] = {"", "!x", "x--", "!y", "y--", "x!=y", "pin", "!osre"};
+    static const char *const in_sources[] = {"pins", "x", "y", "null", NULL, NULL, "isr", "osr"};
+    static const char *const out_destinations[] = {"pins", "x", "y", "null", "pindirs", "pc", "isr", "exec"};
+    static const char *const mov_destinations[] = {"pins", "x", "y", NULL, "exec", "pc", "isr", "osr"};
+    static const char *const mov_sources[] = {"pins", "x", "y", "null", NULL, "status", "isr", "osr"};
+    static const char *const set_destinations[] = {"pins", "x", "y", NULL, "pindirs"};
+    static const char *const wait_sources[] = {"gpio", "pin", "irq"};
+
+    const char *op = in->tokens[0];
+    uint16_t instr;
+    int line = in->line;
+
+    if (!strcmp(op, "nop")) {
+        instr = 0xa042; // mov y, y
+    } else if (!strcmp(op, "jmp")) {
+        need_operands(in, 1);
+        int condition = in->num_tokens > 2 ? lookup(line, in->tokens[1], jmp_conditions, 8, "condition") : 0;
+        int target = parse_value(p, line, in->tokens[in->num_tokens - 1]);
+        instr = (uint16_t) (0x0000 | condition << 5 | target);
+    } else if (!strcmp(op, "wait")) {
+        need_operands(in, 3);
+        int polarity = parse_value(p, line, in->tokens[1]);
+        int source = lookup(line, in->tokens[2], wait_sources, 3, "wait source");
+        int index = parse_value(p, line, in->tokens[3]);
+        if (in->num_tokens > 4 && !strcmp(in->tokens[4], "rel"))
+            index |= 0x10;
+        instr = (uint16_t) (0x2000 | polarity << 7 | source << 5 | index);
+    } else if (!strcmp(op, "in")) {
+        need_operands(in, 2);
+        int source = lookup(line, in->tokens[1], in_sources, 8, "in source");
+        instr = (uint16_t) (0x4000 | source << 5 | (parse_value(p, line, in->tokens[2]) & 0x1f));
+    } else if (!strcmp(op, "out")) {
+        need_operands(in, 2);
+        int destination = lookup(line, in->tokens[1], out_destinations, 8, "out destination");
+        instr = (uint16_t) (0x6000 | destination << 5 | (parse_value(p, line, in->tokens[2]) & 0x1f));
+    } else if (!strcmp(op, "push") || !strcmp(op, "pull")) {
+        bool pull = !strcmp(op, "pull");
+        bool if_flag = false;
+        bool block = true;
+
+        for (int i = 1; i < in->num_tokens; i++) {
+            if (!strcmp(in->tokens[i], pull ? "ifempty" : "iffull"))
+                if_flag = true;
+            else if (!strcmp(in->tokens[i], "block"))
+                block = true;
+            else if (!strcmp(in->tokens[i], "noblock"))
+                block = false;
+            else
+                fail(line, "invalid %s option '%s'", op, in->tokens[i]);
+        }
+        instr = (uint16_t) (0x8000 | pull << 7 | if_flag << 6 | block << 5);
+    } else if (!strcmp(op, "mov")) {
+        need_operands(in, 2);
+        int destination = lookup(line, in->tokens[1], mov_destinations, 8, "mov destination");
+        const char *source = in->tokens[2];
+        int operation = 0;
+
+        if (source[0] == '!' || source[0] == '~') {
+            operation = 1;
+            source++;
+        } else if (!strncmp(source, "::", 2)) {
+            operation = 2;
+            source += 2;
+        }
+        instr = (uint16_t) (0xa000 | destination << 5 | operation << 3 |
+                            lookup(line, source, mov_sources, 8, "mov source"));
+    } else if (!strcmp(op, "irq")) {
+        need_operands(in, 1);
+        int clear = 0;
+        int wait = 0;
+        int t = 1;
+
+        if (!strcmp(in->tokens[t], "set") || !strcmp(in->tokens[t], "nowait")) {
+            t++;
+        } else if (!strcmp(in->tokens[t], "wait")) {
+            wait = 1;
+            t++;
+        } else if (!strcmp(in->tokens[t], "clear")) {
+            clear = 1;
+            t++;
+        }
+
+        if (t >= in->num_tokens)
+            fail(line, "missing irq number");
+
+        int index = parse_value(p, line, in->tokens[t]);
+        if (t + 1 < in->num_tokens && !strcmp(in->tokens[t + 1], "rel"))
+            index |= 0x10;
+        instr = (uint16_t) (0xc000 | clear << 6 | wait << 5 | index);
+    } else if (!strcmp(op, "set")) {
+        need_operands(in, 2);
+        int destination = lookup(line, in->tokens[1], set_destinations, 5, "set destination");
+        instr = (uint16_t) (0xe000 | destination << 5 | (parse_value(p, line, in->tokens[2]) & 0x1f));
+    } else {
+        fail(line, "unknown instruction '%s'", op);
+        return 0;
+    }
+
+    // Side-set and delay share bits 12:8, the side-set takes the upper bits
+    int delay_bits = 5 - p->sideset_bits;
+    if (in->delay >= (1 << delay_bits))
+        fail(line, "delay %d does not fit in %d bits", in->delay, delay_bits);
+
+    int field = in->delay;
+    if (in->side >= 0) {
+        int value_bits = p->sideset_bits - (p->sideset_opt ? 1 : 0);
+
+        if (!p->sideset_bits)
+            fail(line, "side-set without .side_set");
+        if (in->side >= (1 << value_bits))
+            fail(line, "side-set value %d does not fit in %d bits", in->side, value_bits);
+
+        field |= (in->side | (p->sideset_opt ? 1 << value_bits : 0)) << delay_bits;
+    } else if (p->sideset_bits && !p->sideset_opt) {
+        fail(line, "side-set is not optional");
+    }
+
+    return (uint16_t) (instr | field << 8);
+}
+
+// ********** Output **********
+// ****************************
+
+static void write_program(FILE *out, struct program *p) {
+    uint16_t code[MAX_INSTRUCTIONS];
+
+    // Labels may be used before they are defined: the instructions are parsed once all are known
+    for (int i = 0; i < p->length; i++) {
+        char text[MAX_LINE];
+
+        snprintf(text, sizeof(text), "%s", p->instructions[i].text);
+        tokenize(p, &p->instructions[i], text);
+        code[i] = encode(p, &p->instructions[i]);
+    }
+
+    if (p->wrap < 0)
+        p->wrap = p->length - 1;
+
+    size_t name_len = strlen(p->name);
+    static const char dashes[] = "----------------------------------------------------------------";
+
+    fprintf(out, "// %.*s //\n// %s //\n// %.*s //\n\n", (int) name_len, dashes, p->name, (int) name_len, dashes);
+
+    fprintf(out, "#define %s_wrap_target %d\n", p->name, p->wrap_target);
+    fprintf(out, "#define %s_wrap %d\n", p->name, p->wrap);
+    fprintf(out, "#define %s_pio_version 0\n\n", p->name);
+
+    for (int i = 0; i < p->num_symbols; i++) {
+        if (p->symbols[i].is_public)
+            fprintf(out, "#define %s_offset_%s %du\n", p->name, p->symbols[i].name, p->symbols[i].value);
+    }
+
+    fprintf(out, "static const uint16_t %s_program_instructions[] = {\n", p->name);
+    for (int i = 0; i < p->length; i++) {
+        if (i == p->wrap_target)
+            fprintf(out, "            //     .wrap_target\n");
+        fprintf(out, "    0x%04x, // %2d: %s\n", code[i], i, p->instructions[i].text);
+        if (i == p->wrap)
+            fprintf(out, "            //     .wrap\n");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "#if !PICO_NO_HARDWARE\n");
+    fprintf(out, "static const struct pio_program %s_program = {\n", p->name);
+    fprintf(out, "    .instructions = %s_program_instructions,\n", p->name);
+    fprintf(out, "    .length = %d,\n", p->length);
+    fprintf(out, "    .origin = %d,\n", p->origin);
+    fprintf(out, "    .pio_version = %s_pio_version,\n", p->name);
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static inline pio_sm_config %s_program_get_default_config(uint offset) {\n", p->name);
+    fprintf(out, "    pio_sm_config c = pio_get_default_sm_config();\n");
+    fprintf(out, "    sm_config_set_wrap(&c, offset + %s_wrap_target, offset + %s_wrap);\n", p->name, p->name);
+    if (p->sideset_bits)
+        fprintf(out, "    sm_config_set_sideset(&c, %d, %s, %s);\n", p->sideset_bits, p->sideset_opt ? "true" : "false",
+                p->sideset_pindirs ? "true" : "false");
+    fprintf(out, "    return c;\n}\n");
+
+    if (p->c_sdk)
+        fprintf(out, "\n%s", p->c_sdk);
+
+    fprintf(out, "#endif\n\n");
+}
+
+// ********** Input **********
+// ***************************
+
+static void parse_directive(struct program *p, int line, char *text) {
+    char *save;
+    char *directive = strtok_r(text, " \t", &save);
+    char *arg = strtok_r(NULL, " \t", &save);
+
+    if (!strcmp(directive, ".side_set")) {
+        if (!arg)
+            fail(line, ".side_set needs a bit count");
+        p->sideset_bits = parse_value(p, line, arg);
+
+        for (char *opt = strtok_r(NULL, " \t", &save); opt; opt = strtok_r(NULL, " \t", &save)) {
+            if (!strcmp(opt, "opt"))
+                p->sideset_opt = true;
+            else if (!strcmp(opt, "pindirs"))
+                p->sideset_pindirs = true;
+            else
+                fail(line, "invalid .side_set option '%s'", opt);
+        }
+
+        if (p->sideset_opt)
+            p->sideset_bits++;
+        if (p->sideset_bits > 5)
+            fail(line, "too many side-set bits");
+    } else if (!strcmp(directive, ".wrap_target")) {
+        p->wrap_target = p->length;
+    } else if (!strcmp(directive, ".wrap")) {
+        p->wrap = p->length - 1;
+    } else if (!strcmp(directive, ".origin")) {
+        p->origin = parse_value(p, line, arg);
+    } else if (!strcmp(directive, ".define")) {
+        bool is_public = arg && !strcmp(arg, "public");
+        char *name = is_public ? strtok_r(NULL, " \t", &save) : arg;
+        char *value = strtok_r(NULL, " \t", &save);
+
+        if (!name || !value)
+            fail(line, ".define needs a name and a value");
+        add_symbol(p, line, name, parse_value(p, line, value), false, is_public);
+    } else if (!strcmp(directive, ".lang_opt") || !strcmp(directive, ".pio_version")) {
+        // Nothing to do for the C output
+    } else {
+        fail(line, "unsupported directive '%s'", directive);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <input.pio> <output.h>\n", argv[0]);
+        return 2;
+    }
+
+    input_name = argv[1];
+    FILE *in = fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    fprintf(out, "// ------------------------------------------------------- //\n");
+    fprintf(out, "// This file is autogenerated by host-pioasm; do not edit! //\n");
+    fprintf(out, "// ------------------------------------------------------- //\n\n");
+    fprintf(out, "#pragma once\n\n#if !PICO_NO_HARDWARE\n#include \"hardware/pio.h\"\n#endif\n\n");
+
+    static struct program program;
+    struct program *p = NULL;
+    bool in_c_sdk = false;
+    char buffer[MAX_LINE];
+
+    for (int line = 1; fgets(buffer, sizeof(buffer), in); line++) {
+        if (in_c_sdk) {
+            char *end = buffer + strspn(buffer, " \t");
+            if (!strncmp(end, "%}", 2)) {
+                in_c_sdk = false;
+                continue;
+            }
+
+            size_t len = strlen(buffer);
+            p->c_sdk = realloc(p->c_sdk, p->c_sdk_len + len + 1);
+            memcpy(p->c_sdk + p->c_sdk_len, buffer, len + 1);
+            p->c_sdk_len += len;
+            continue;
+        }
+
+        strip_comment(buffer);
+        char *text = trim(buffer);
+        if (!*text)
+            continue;
+
+        if (text[0] == '%') {
+            if (!p)
+                fail(line, "code block outside of a program");
+            // Only the C SDK output exists here, other languages are skipped
+            in_c_sdk = strstr(text, "c-sdk") != NULL;
+            if (!in_c_sdk) {
+                while (fgets(buffer, sizeof(buffer), in) && strncmp(trim(buffer), "%}", 2))
+                    line++;
+                line++;
+            }
+            continue;
+        }
+
+        if (!strncmp(text, ".program", 8)) {
+            if (p) {
+                write_program(out, p);
+                free(p->c_sdk);
+            }
+
+            p = &program;
+            memset(p, 0, sizeof(*p));
+            p->origin = -1;
+            p->wrap = -1;
+            snprintf(p->name, sizeof(p->name), "%s", trim(text + 8));
+            continue;
+        }
+
+        if (!p)
+            fail(line, "expected .program");
+
+        if (text[0] == '.') {
+            parse_directive(p, line, text);
+            continue;
+        }
+
+        // Labels, optionally public
+        char *label = text;
+        bool is_public = !strncmp(label, "public ", 7);
+        if (is_public)
+            label = trim(label + 7);
+
+        char *colon = label;
+        while (isalnum((unsigned char) *colon) || *colon == '_')
+            colon++;
+
+        if (colon != label && *colon == ':') {
+            *colon = '\0';
+            add_symbol(p, line, label, p->length, true, is_public);
+            text = trim(colon + 1);
+            if (!*text)
+                continue;
+        }
+
+        if (p->length == MAX_INSTRUCTIONS)
+            fail(line, "program is too long");
+
+        struct instruction *instruction = &p->instructions[p->length++];
+        instruction->line = line;
+        snprintf(instruction->text, sizeof(instruction->text), "%s", text);
+    }
+
+    if (in_c_sdk)
+        fail(0, "unterminated code block");
+
+    if (p) {
+        write_program(out, p);
+        free(p->c_sdk);
+    }
+
+    fclose(in);
+    return fclose(out) ? 1 : 0;
+}
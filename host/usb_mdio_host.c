@@ -0,0 +1,418 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+// Example driver for the host build: runs the firmware on the mock HAL, enumerates it and exchanges a few
+// packets on EP2/EP6 and EP0. An RTL8305-like switch is attached to bus 0 and a Marvell switch in
+// multi-chip mode to bus 1, see models/mdio_model.h. The flash holds an init sequence for the switch that runs
+// at power-on. The reads on bus 0 are recorded and checked against the 802.3 timing, "usb-mdio-host <file.vcd>"
+// also writes the waveform for GTKWave. Finally another master runs frames on bus 3 while the adapter sniffs
+// it (client/client_demo.cpp writes them as a pcap file). The log of the firmware is read back from its
+// CDC-ACM interface.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mdio_model.h"
+#include "mdio_timing.h"
+#include "mock_hal.h"
+#include "mdio_boot.h"
+#include "usb_mdio_protocol.h"
+
+#define HOST_TIMEOUT_MS 2000
+
+#define SMI_ADDR 16
+#define SMI_BUSY_US 2
+#define C45_RANGE_REG 0x0800
+#define C45_RANGE_COUNT 8
+#define THROUGHPUT_READS 100
+
+// Bus 3 is left to another master and sniffed
+#define SNIFF_BUS 3
+#define SNIFF_MDC_PIN 20
+#define SNIFF_MDIO_PIN 21
+#define SNIFF_MDC_HZ 2500000
+#define SNIFF_FRAMES 300
+
+// CDC-ACM function of the firmware, see telemetry.h
+#define CDC_COMM_INTERFACE 1
+#define CDC_DATA_IN_EP 10
+#define CDC_LOG_MAX 16384
+#define SNIFF_STOP_LOG "MDIO sniffer - bus: 3 mode: 0 " // Trace line of USB_MDIO_SNIFF_STOP on SNIFF_BUS
+
+int firmware_main(void);
+
+// Init sequence: isolate ports 0 and 1 (BMCR bit 10), then wait for the link of port 2
+static const uint8_t init_sequence[] = {
+    /* 0x00 */ USB_MDIO_PROG_SET, 0, 2, 0,
+    /* 0x04 */ USB_MDIO_PROG_SET, 1, 0, 0,
+    /* 0x08 */ USB_MDIO_PROG_MODIFY, USB_MDIO_PROG_ADDR_REG | 1, 0, 0x00, 0x04, 0x00, 0x04,
+    /* 0x0f */ USB_MDIO_PROG_ADD, 1, 1, 0,
+    /* 0x13 */ USB_MDIO_PROG_LOOP, 0, 0x08, 0,
+    /* 0x17 */ USB_MDIO_PROG_POLL, 2, 1, 0x04, 0, 0x04, 0, 100, 0, 0x50, 0xc3, 0, 0,
+    /* 0x24 */ USB_MDIO_PROG_JMP_IFNOT, 0x28, 0,
+    /* 0x27 */ USB_MDIO_PROG_END,
+    /* 0x28 */ USB_MDIO_PROG_FAIL, USB_MDIO_STATUS_TIMEOUT,
+};
+
+/**
+ * @brief Read the result of the init sequence, waiting until it and a pending store are done. Returns false on
+ * any error.
+ */
+static bool init_status(uint8_t *status) {
+    // Wall clock time, core 1 runs the sequence on its own
+    for (int ms = 0; ms < HOST_TIMEOUT_MS; ms++) {
+        if (mock_usb_control(0xc0, USB_MDIO_VENDOR_GET_INIT_STATUS, 0, 0, status, USB_MDIO_INIT_STATUS_LEN) !=
+            USB_MDIO_INIT_STATUS_LEN)
+            return false;
+        if (status[0] != USB_MDIO_INIT_RUNNING && status[18] != USB_MDIO_INIT_STORE_PENDING)
+            return true;
+        usleep(1000);
+    }
+
+    return false;
+}
+
+static void dump(const char *what, const uint8_t *data, int len) {
+    printf("%s:", what);
+    for (int i = 0; i < len; i++)
+        printf(" %02x", data[i]);
+    printf("\n");
+}
+
+/**
+ * @brief Send one command on EP2 and wait for its response on EP6. Returns the response length or -1.
+ */
+static int command(const uint8_t *request, uint16_t len, uint8_t *response) {
+    if (!mock_usb_out_wait(2, request, len, HOST_TIMEOUT_MS)) {
+        fprintf(stderr, "EP2 command was not accepted\n");
+        return -1;
+    }
+
+    int response_len = mock_usb_in_wait(6, response, USB_MDIO_PACKET_SIZE, HOST_TIMEOUT_MS);
+    if (response_len < 0)
+        fprintf(stderr, "No EP6 response\n");
+
+    return response_len;
+}
+
+/**
+ * @brief Extended command whose response carries a 16 bit value in byte 2..3. Returns false on any error.
+ */
+static bool read_value(const char *what, const uint8_t *request, uint16_t len, uint16_t *value) {
+    uint8_t response[USB_MDIO_PACKET_SIZE];
+
+    int response_len = command(request, len, response);
+    if (response_len < USB_MDIO_RESPONSE_HEADER_LEN + 2)
+        return false;
+    dump(what, response, response_len);
+
+    *value = response[2] | (response[3] << 8);
+    return response[0] == USB_MDIO_STATUS_OK;
+}
+
+static uint32_t le32(const uint8_t *buf) {
+    return buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t) buf[3] << 24;
+}
+
+/**
+ * @brief Frame number i of the other master: Clause 22 reads and writes of a PHY and Clause 45 address and
+ * read frames, with the data a PHY would drive
+ */
+static uint32_t sniff_test_frame(uint i) {
+    uint16_t data = (uint16_t) (0x1000 + i * 0x0101);
+
+    switch (i % 4) {
+        case 0: // C22 read of PHY 1 register i
+            return 0x1u << 30 | 0x2u << 28 | 1u << 23 | (i & 0x1f) << 18 | 0x2u << 16 | data;
+        case 1: // C22 write of PHY 1 register 0
+            return 0x1u << 30 | 0x1u << 28 | 1u << 23 | 0x2u << 16 | data;
+        case 2: // C45 address of port 2, device 1
+            return 0x0u << 30 | 0x0u << 28 | 2u << 23 | 1u << 18 | 0x2u << 16 | (i & 0xffff);
+        default: // C45 read of port 2, device 1
+            return 0x0u << 30 | 0x3u << 28 | 2u << 23 | 1u << 18 | 0x2u << 16 | data;
+    }
+}
+
+/**
+ * @brief Sniff bus 3 while another master runs frames on it. Returns false if a frame was missed or corrupted.
+ */
+static bool sniff_test(void) {
+    static uint32_t timestamps[SNIFF_FRAMES];
+    static uint32_t frames[SNIFF_FRAMES];
+    uint8_t response[USB_MDIO_PACKET_SIZE];
+    uint8_t packet[USB_MDIO_PACKET_SIZE];
+    uint count = 0;
+    bool ok = true;
+
+    const uint8_t start[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_SNIFF, SNIFF_BUS, 0, USB_MDIO_SNIFF_START};
+    if (command(start, sizeof(start), response) < USB_MDIO_RESPONSE_HEADER_LEN + 10 ||
+        response[0] != USB_MDIO_STATUS_OK || response[2] != SNIFF_BUS)
+        return false;
+
+    // Back to back at full speed: a preamble for the first frame only, one idle bit in between
+    struct mdio_model_master *master = mdio_model_master_create(SNIFF_MDC_PIN, SNIFF_MDIO_PIN, SNIFF_MDC_HZ);
+    uint64_t start_ps = mock_time_ps();
+    for (uint i = 0; i < SNIFF_FRAMES; i++)
+        mdio_model_master_frame(master, sniff_test_frame(i), i ? 0 : MDIO_MODEL_PREAMBLE_BITS, 1);
+    uint64_t elapsed_ps = mock_time_ps() - start_ps;
+    mdio_model_master_release(master);
+
+    while (count < SNIFF_FRAMES) {
+        int len = mock_usb_in_wait(8, packet, sizeof(packet), HOST_TIMEOUT_MS);
+        if (len < USB_MDIO_SNIFF_HEADER_LEN || packet[0] != SNIFF_BUS || le32(&packet[4]) ||
+            len != USB_MDIO_SNIFF_HEADER_LEN + USB_MDIO_SNIFF_RECORD_LEN * packet[1] || count + packet[1] > SNIFF_FRAMES) {
+            fprintf(stderr, "Bad EP8 packet after %u frames\n", count);
+            return false;
+        }
+
+        for (uint i = 0; i < packet[1]; i++, count++) {
+            const uint8_t *record = &packet[USB_MDIO_SNIFF_HEADER_LEN + USB_MDIO_SNIFF_RECORD_LEN * i];
+
+            timestamps[count] = le32(&record[0]);
+            frames[count] = le32(&record[4]);
+            ok &= frames[count] == sniff_test_frame(count);
+            ok &= !count || timestamps[count] >= timestamps[count - 1];
+        }
+    }
+
+    const uint8_t stop[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_SNIFF, SNIFF_BUS, 0, USB_MDIO_SNIFF_STOP};
+    if (command(stop, sizeof(stop), response) < USB_MDIO_RESPONSE_HEADER_LEN + 10)
+        return false;
+    dump("Sniffer", response, USB_MDIO_RESPONSE_HEADER_LEN + 10);
+    ok &= response[0] == USB_MDIO_STATUS_OK && response[2] == USB_MDIO_SNIFF_NO_BUS &&
+          le32(&response[4]) == SNIFF_FRAMES && le32(&response[8]) == 0;
+
+    printf("Sniffer: %u frames in %u us, %u frames/s on the bus, first at %u us, last at %u us\n", count,
+           (uint) (elapsed_ps / 1000000), (uint) (SNIFF_FRAMES * 1000000000000ull / elapsed_ps), (uint) timestamps[0],
+           (uint) timestamps[count - 1]);
+
+    return ok;
+}
+
+/**
+ * @brief Open the CDC-ACM interface like a terminal and read the log until it has the trace of the sniffer
+ * stop, the last command before. Most of the startup messages were overwritten by then, the ring keeps the
+ * newest lines. Returns false if the interface does not work.
+ */
+static bool log_test(void) {
+    static char log[CDC_LOG_MAX + 1];
+    uint8_t line_coding[7] = {0x00, 0x10, 0x0e, 0x00, 0, 0, 8}; // 921600 8N1
+    uint8_t readback[sizeof(line_coding)];
+    size_t len = 0;
+
+    if (mock_usb_control(0x21, 0x20, 0, CDC_COMM_INTERFACE, line_coding, sizeof(line_coding)) != sizeof(line_coding) ||
+        mock_usb_control(0xa1, 0x21, 0, CDC_COMM_INTERFACE, readback, sizeof(readback)) != sizeof(readback) ||
+        memcmp(line_coding, readback, sizeof(line_coding)) ||
+        mock_usb_control(0x21, 0x22, 0x0003, CDC_COMM_INTERFACE, NULL, 0) != 0) {
+        fprintf(stderr, "CDC-ACM requests failed\n");
+        return false;
+    }
+
+    // Core0 sends the log from its idle loop, a NAK only means it did not get to it yet
+    while (len < CDC_LOG_MAX) {
+        int packet_len = mock_usb_in_wait(CDC_DATA_IN_EP, (uint8_t *) &log[len], MIN(64, CDC_LOG_MAX - len),
+                                          HOST_TIMEOUT_MS);
+        if (packet_len < 0)
+            break;
+
+        len += packet_len;
+        log[len] = '\0';
+        if (strstr(log, SNIFF_STOP_LOG))
+            break;
+    }
+
+    printf("Log: %u bytes on EP%u\n", (uint) len, CDC_DATA_IN_EP);
+    return strstr(log, SNIFF_STOP_LOG);
+}
+
+int main(int argc, char **argv) {
+    uint8_t response[USB_MDIO_PACKET_SIZE];
+    uint16_t value;
+    bool ok = true;
+
+    struct mdio_model_bus *bus0 = mdio_model_bus_create(14, 15);
+    struct mdio_model_rtl8305 *rtl8305 = mdio_model_rtl8305_create(bus0, 0);
+    mdio_model_phy_set_link(mdio_model_rtl8305_port(rtl8305, 2), true);
+    for (uint i = 0; i < C45_RANGE_COUNT; i++)
+        mdio_model_phy_set_c45_reg(mdio_model_rtl8305_port(rtl8305, 2), 1, C45_RANGE_REG + i, 0xc450 + i);
+
+    struct mdio_model_bus *bus1 = mdio_model_bus_create(16, 17);
+    struct mdio_model_smi_switch *smi = mdio_model_smi_switch_create(bus1, SMI_ADDR);
+    mdio_model_smi_switch_set_busy_time(smi, SMI_BUSY_US);
+    mdio_model_smi_switch_set_reg(smi, 0x10, 3, 0x0991);
+
+    // As if programmed with picotool
+    uint8_t image[MDIO_BOOT_IMAGE_MAX];
+    mock_flash_write(MDIO_BOOT_FLASH_OFFSET, image, mdio_boot_image(image, init_sequence, sizeof(init_sequence)));
+
+    mock_hal_start(firmware_main);
+
+    if (!mock_usb_enumerate()) {
+        fprintf(stderr, "Enumeration failed\n");
+        return EXIT_FAILURE;
+    }
+    printf("Enumerated at %llu us\n", (unsigned long long) (mock_time_ps() / 1000000));
+
+    // The init sequence ran while USB enumerated
+    uint8_t init[USB_MDIO_INIT_STATUS_LEN];
+    if (!init_status(init)) {
+        fprintf(stderr, "GET_INIT_STATUS failed\n");
+        return EXIT_FAILURE;
+    }
+    dump("Init status", init, sizeof(init));
+    printf("Init sequence: status %u at 0x%04x, started at %u us, took %u us\n", init[1], init[2] | (init[3] << 8),
+           (uint) (init[4] | init[5] << 8 | init[6] << 16 | (uint32_t) init[7] << 24),
+           (uint) (init[8] | init[9] << 8 | init[10] << 16 | (uint32_t) init[11] << 24));
+    ok &= init[0] == USB_MDIO_INIT_DONE && init[1] == USB_MDIO_STATUS_OK;
+
+    const uint8_t bmcr_read[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_C22_READ, 0, 1, 0, 0};
+    ok &= read_value("C22 read", bmcr_read, sizeof(bmcr_read), &value) && value == 0x3500;
+
+    // Store it again over USB: load it into slot 0, remove the stored one, store slot 0
+    uint8_t code[sizeof(init_sequence)];
+    memcpy(code, init_sequence, sizeof(code));
+    ok &= mock_usb_control(0x40, USB_MDIO_VENDOR_LOAD_PROGRAM, 0, 0, code, sizeof(code)) == sizeof(code);
+    ok &= mock_usb_control(0x40, USB_MDIO_VENDOR_STORE_INIT, 0, 0, NULL, 0) == 0;
+    ok &= init_status(init) && init[12] == 0 && init[13] == 0 && init[18] == USB_MDIO_INIT_STORE_DONE;
+    ok &= mock_usb_control(0x40, USB_MDIO_VENDOR_STORE_INIT, 0, sizeof(code) + 1, NULL, 0) < 0;
+    ok &= mock_usb_control(0x40, USB_MDIO_VENDOR_STORE_INIT, 0, sizeof(code), NULL, 0) == 0;
+    ok &= init_status(init) && init[18] == USB_MDIO_INIT_STORE_DONE && (init[12] | (init[13] << 8)) == sizeof(code) &&
+          (init[14] | init[15] << 8 | init[16] << 16 | (uint32_t) init[17] << 24) ==
+          mdio_boot_crc32(init_sequence, sizeof(init_sequence));
+    dump("Init status", init, sizeof(init));
+
+    // Extended Clause 22 reads of the PHY ID and the BMSR of port 2 on bus 0
+    const uint8_t id_read[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_C22_READ, 0, 1, 2, 0};
+    ok &= read_value("C22 read", id_read, sizeof(id_read), &value) && value == MDIO_MODEL_RTL8305_PHY_ID >> 16;
+
+    const uint8_t bmsr_read[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_C22_READ, 0, 2, 1, 0};
+    ok &= read_value("C22 read", bmsr_read, sizeof(bmsr_read), &value) && value == 0x786d;
+
+    // mvusb read of PHY 1 register 2, as sent by the Linux driver
+    const uint8_t mvusb_read[] = {0x00, 0xe8, 0x01, 0x00, 0x22, 0xa4};
+    int len = command(mvusb_read, sizeof(mvusb_read), response);
+    if (len < 0)
+        return EXIT_FAILURE;
+    dump("mvusb read", response, len);
+
+    // Scan of bus 0, the switch has its PHYs at 0 .. 5. Reads of the empty addresses stay off the bus afterwards.
+    const uint8_t scan[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_SCAN, 0, 0, USB_MDIO_SCAN_RUN};
+    len = command(scan, sizeof(scan), response);
+    if (len < 0)
+        return EXIT_FAILURE;
+    dump("Scan", response, len);
+    ok &= len == USB_MDIO_SCAN_HEADER_LEN + 4 * MDIO_MODEL_RTL8305_PORTS && response[0] == USB_MDIO_STATUS_OK &&
+          response[1] == MDIO_MODEL_RTL8305_PORTS && response[2] == 0x3f && !response[3] && !response[4] &&
+          !response[5] &&
+          (response[6] | response[7] << 8 | response[8] << 16 | (uint32_t) response[9] << 24) ==
+              MDIO_MODEL_RTL8305_PHY_ID;
+
+    struct mdio_model_stats before, after;
+    const uint8_t empty_read[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_C22_READ, 0, 20, 2, 0};
+    mdio_model_bus_get_stats(bus0, &before);
+    ok &= read_value("C22 read", empty_read, sizeof(empty_read), &value) && value == 0xffff;
+    mdio_model_bus_get_stats(bus0, &after);
+    ok &= after.frames == before.frames;
+
+    // Other registers of an empty address go to the bus until one of them is not answered either
+    const uint8_t empty_mvusb_read[] = {0x00, 0xe8, 0x01, 0x00, 0x80, 0xa6};
+    for (int i = 0; i < 2; i++) {
+        mdio_model_bus_get_stats(bus0, &before);
+        ok &= command(empty_mvusb_read, sizeof(empty_mvusb_read), response) == 2 && response[0] == 0xff &&
+              response[1] == 0xff;
+        mdio_model_bus_get_stats(bus0, &after);
+        ok &= after.frames == before.frames + (i == 0);
+    }
+
+    // Preamble suppression is only discovered on request and only enabled on the PHYs
+    const uint8_t preamble[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_PREAMBLE_SUPPRESSION, 0, 0,
+                                USB_MDIO_PREAMBLE_PROBE_ALL};
+    len = command(preamble, sizeof(preamble), response);
+    if (len < 0)
+        return EXIT_FAILURE;
+    dump("Preamble suppression", response, len);
+    ok &= len >= 6 && response[0] == USB_MDIO_STATUS_OK &&
+          (response[2] | response[3] << 8 | response[4] << 16 | (uint32_t) response[5] << 24) ==
+              (1u << MDIO_MODEL_RTL8305_PORTS) - 1;
+
+    // Clause 45 range, one ADDRESS and the post-read-increment frames in one batch
+    const uint8_t c45_range[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_C45_READ_RANGE, 0, 2, 1, C45_RANGE_COUNT,
+                                 C45_RANGE_REG & 0xff, C45_RANGE_REG >> 8};
+    len = command(c45_range, sizeof(c45_range), response);
+    if (len < 0)
+        return EXIT_FAILURE;
+    dump("C45 range", response, len);
+    ok &= len == 2 + 2 * C45_RANGE_COUNT && response[0] == USB_MDIO_STATUS_OK && response[1] == C45_RANGE_COUNT;
+    for (uint i = 0; ok && i < C45_RANGE_COUNT; i++)
+        ok &= (response[2 + 2 * i] | response[3 + 2 * i] << 8) == (int) (0xc450 + i);
+
+    // Indirect read through the SMI registers of the switch on bus 1
+    const uint8_t smi_read[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_SMI_READ, 1, SMI_ADDR, 0x10, 3};
+    ok &= read_value("SMI read", smi_read, sizeof(smi_read), &value) && value == 0x0991;
+
+    struct mdio_model_smi_stats smi_stats;
+    mdio_model_smi_switch_get_stats(smi, &smi_stats);
+    printf("SMI: %u commands, %u busy polls, %u ignored\n", (uint) smi_stats.commands, (uint) smi_stats.busy_polls,
+           (uint) smi_stats.ignored_commands);
+
+    // Throughput on the virtual clock, independent of the speed of the machine running the simulation
+    mdio_model_bus_reset_stats(bus0);
+    mock_wave_set_name(14, "mdc0");
+    mock_wave_set_name(15, "mdio0");
+    mock_wave_start((1u << 14) | (1u << 15));
+    for (int i = 0; i < THROUGHPUT_READS; i++) {
+        const uint8_t read[] = {USB_MDIO_EXT_MAGIC, USB_MDIO_OP_C22_READ, 0, i % MDIO_MODEL_RTL8305_PORTS, 4, 0};
+        if (command(read, sizeof(read), response) < 0 || response[0] != USB_MDIO_STATUS_OK)
+            return EXIT_FAILURE;
+    }
+
+    struct mdio_model_stats stats;
+    mdio_model_bus_get_stats(bus0, &stats);
+    uint64_t elapsed_ps = stats.last_frame_ps - stats.first_frame_ps;
+    printf("Bus 0: %u frames (%u reads, %u writes, %u unanswered, %u short preamble, %u TA errors)",
+           (uint) stats.frames, (uint) stats.reads, (uint) stats.writes, (uint) stats.unanswered,
+           (uint) stats.short_preamble, (uint) stats.ta_errors);
+    if (elapsed_ps)
+        printf(", %u frames/s on the bus", (uint) (stats.frames * 1000000000000ull / elapsed_ps));
+    printf("\n");
+    ok &= stats.unanswered == 0 && stats.ta_errors == 0;
+
+    mock_wave_stop();
+    if (argc > 1 && !mock_wave_write_vcd(argv[1])) {
+        fprintf(stderr, "Cannot write %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    struct mdio_timing_limits limits;
+    struct mdio_timing_report timing;
+    size_t events;
+    const struct mock_wave_event *wave = mock_wave_events(&events);
+    mdio_timing_limits_default(&limits);
+    ok &= mdio_timing_check(wave, events, 14, 15, &limits, &timing);
+    mdio_timing_print(&timing);
+
+    ok &= sniff_test();
+    ok &= log_test();
+
+    // An IN request sent as OUT has no status stage from the device, it is stalled
+    uint8_t counters[USB_MDIO_VENDOR_COUNTERS * 4];
+    ok &= mock_usb_control(0x40, USB_MDIO_VENDOR_GET_COUNTERS, 0, 0, NULL, 0) < 0;
+
+    len = mock_usb_control(0xc0, USB_MDIO_VENDOR_GET_COUNTERS, 0, 0, counters, sizeof(counters));
+    if (len < 0) {
+        fprintf(stderr, "GET_COUNTERS failed\n");
+        return EXIT_FAILURE;
+    }
+    dump("Counters", counters, len);
+    // Stalled: the store beyond the loaded bytes and the request with the wrong direction
+    ok &= len == sizeof(counters) && counters[4 * (USB_MDIO_VENDOR_COUNTERS - 1)] == 2;
+
+    printf("Done at %llu us\n", (unsigned long long) (mock_time_ps() / 1000000));
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -7,37 +7,380 @@
 
 #include <stdio.h>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/flash.h"
 
 #include "usb_mvmdio.h"
+#include "usb_mdio_protocol.h"
 #include "mdio.h"
+#include "mdio_cache.h"
+#include "mdio_watch.h"
+#include "mdio_boot.h"
+#include "mdio_sniff.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "perf.h"
 
 #define VERSION "0.0.1"
 
-uint16_t usb_mdio_pull_request_callback(uint8_t dev, uint8_t reg) {
+// Serve static registers from the register cache and drop redundant page select writes (see mdio_cache.h). Off
+// by default, with it only the PHYs found by a scan of the host and the registers it marks static are cached.
+#define MDIO_REGISTER_CACHE 0
+
+// Scan all addresses during startup and log the PHYs found. Reads of empty addresses still go to the bus until
+// the host asks for a scan itself (USB_MDIO_OP_SCAN).
+#define MDIO_SCAN_AT_STARTUP 0
+
+// Probe the PHYs on all addresses for preamble suppression support (BMSR bit 6) during startup. Off by default,
+// the host starts the discovery with USB_MDIO_PREAMBLE_PROBE_ALL.
+#define MDIO_PREAMBLE_DISCOVERY 0
+
+uint16_t usb_mdio_pull_request_callback(uint8_t bus, uint8_t dev, uint8_t reg) {
+    uint32_t start = time_us_32();
     uint16_t reg_val = 0;
-    reg_val = mdio_read(dev, reg);
+#if MDIO_REGISTER_CACHE
+    reg_val = mdio_cache_read(bus, dev, reg);
+#else
+    reg_val = mdio_read(bus, dev, reg);
+#endif
 
-    printf("MDIO read - dev: %i reg: %i reg_val: 0x%x\n", dev, reg, reg_val);
+    trace_record(TRACE_MDIO_READ, bus, dev, 0, reg, reg_val, time_us_32() - start);
+    perf_add(PERF_MDIO_READS, 1);
 
     return reg_val;
 }
 
-void usb_mdio_push_request_callback(uint8_t dev, uint8_t reg, uint16_t reg_val) {
-    printf("MDIO write - dev: %i reg: %i reg_val: 0x%x\n", dev, reg, reg_val);
-    mdio_write(dev, reg, reg_val);
+void usb_mdio_push_request_callback(uint8_t bus, uint8_t dev, uint8_t reg, uint16_t reg_val) {
+    uint32_t start = time_us_32();
+#if MDIO_REGISTER_CACHE
+    mdio_cache_write(bus, dev, reg, reg_val);
+#else
+    mdio_write(bus, dev, reg, reg_val);
+#endif
+
+    trace_record(TRACE_MDIO_WRITE, bus, dev, 0, reg, reg_val, time_us_32() - start);
+    perf_add(PERF_MDIO_WRITES, 1);
+}
+
+/**
+ * @brief Queue as many commands as fit into one DMA batch and run it. The batch runs out of space with more than
+ * USB_MDIO_BATCH_MAX commands (dumps) or of segments with too many timing profile changes.
+ *
+ * @return number of commands executed, the read values are appended to reg_vals
+ */
+static uint8_t usb_mdio_run_batch(uint8_t bus, const struct usb_mdio_batch_command *commands, uint8_t count,
+                                  uint16_t *reg_vals, uint8_t *reads) {
+    uint32_t words[USB_MDIO_BATCH_MAX * MDIO_MAX_FRAME_WORDS];
+    uint32_t results[USB_MDIO_BATCH_MAX];
+    struct mdio_batch batch;
+    uint8_t queued = 0;
+
+    mdio_batch_init(&batch, bus, words, count_of(words), results, count_of(results));
+
+    for (; queued < count; queued++) {
+        const struct usb_mdio_batch_command *command = &commands[queued];
+        bool added = command->write ? mdio_batch_add_write(&batch, command->dev, command->reg, command->reg_val)
+                                    : mdio_batch_add_read(&batch, command->dev, command->reg);
+        if (!added)
+            break;
+
+#if MDIO_REGISTER_CACHE
+        // The frames bypass the cache, it must not keep a page the batch might change
+        if (command->write)
+            mdio_cache_invalidate(bus, command->dev);
+#endif
+    }
+
+    mdio_batch_start(&batch, NULL);
+    mdio_batch_wait(bus);
+
+    for (uint8_t i = 0; i < queued; i++) {
+        if (!commands[i].write)
+            reg_vals[(*reads)++] = mdio_batch_result(&batch, i);
+    }
+
+    return queued;
+}
+
+void usb_mdio_batch_request_callback(uint8_t bus, const struct usb_mdio_batch_command *commands, uint8_t count,
+                                     uint16_t *reg_vals) {
+    uint32_t start = time_us_32();
+    uint8_t reads = 0;
+
+    for (uint8_t done = 0; done < count;)
+        done += usb_mdio_run_batch(bus, &commands[done], count - done, reg_vals, &reads);
+
+    trace_record(TRACE_MDIO_BATCH, bus, 0, 0, count, reads, time_us_32() - start);
+    perf_add(PERF_MDIO_READS, reads);
+    perf_add(PERF_MDIO_WRITES, count - reads);
+}
+
+uint16_t usb_mdio_c45_pull_request_callback(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg) {
+    uint32_t start = time_us_32();
+    uint16_t reg_val = mdio_c45_read(bus, port, devad, reg);
+
+    trace_record(TRACE_MDIO_C45_READ, bus, port, devad, reg, reg_val, time_us_32() - start);
+    perf_add(PERF_MDIO_READS, 1);
+
+    return reg_val;
+}
+
+void usb_mdio_c45_push_request_callback(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t reg_val) {
+    uint32_t start = time_us_32();
+    mdio_c45_write(bus, port, devad, reg, reg_val);
+
+    trace_record(TRACE_MDIO_C45_WRITE, bus, port, devad, reg, reg_val, time_us_32() - start);
+    perf_add(PERF_MDIO_WRITES, 1);
+}
+
+void usb_mdio_c45_pull_range_request_callback(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t *reg_vals, uint8_t count) {
+    uint32_t start = time_us_32();
+    mdio_c45_read_range(bus, port, devad, reg, reg_vals, count);
+
+    trace_record(TRACE_MDIO_C45_RANGE, bus, port, devad, reg, count, time_us_32() - start);
+    perf_add(PERF_MDIO_READS, count);
+}
+
+bool usb_mdio_smi_pull_request_callback(uint8_t bus, uint8_t chip, uint8_t dev, uint8_t reg, uint16_t *reg_val) {
+    uint32_t start = time_us_32();
+    bool ok = mdio_smi_read(bus, chip, dev, reg, reg_val);
+
+    trace_record(TRACE_MDIO_SMI_READ | (ok ? 0 : TRACE_FAILED), bus, chip, dev, reg, ok ? *reg_val : 0,
+                 time_us_32() - start);
+    perf_add(PERF_MDIO_READS, 1);
+
+    return ok;
+}
+
+bool usb_mdio_smi_push_request_callback(uint8_t bus, uint8_t chip, uint8_t dev, uint8_t reg, uint16_t reg_val) {
+    uint32_t start = time_us_32();
+    bool ok = mdio_smi_write(bus, chip, dev, reg, reg_val);
+
+    trace_record(TRACE_MDIO_SMI_WRITE | (ok ? 0 : TRACE_FAILED), bus, chip, dev, reg, reg_val, time_us_32() - start);
+    perf_add(PERF_MDIO_WRITES, 1);
+
+    return ok;
+}
+
+bool usb_mdio_poll_request_callback(uint8_t bus, uint8_t dev, uint8_t reg, uint16_t mask, uint16_t expected,
+                                    uint32_t interval_us, uint32_t timeout_us, struct mdio_poll_result *result) {
+    bool matched = mdio_poll(bus, dev, reg, mask, expected, interval_us, timeout_us, result);
+
+    trace_record(TRACE_MDIO_POLL | (matched ? 0 : TRACE_FAILED), bus, dev, 0, reg, result->value, result->elapsed_us);
+    perf_add(PERF_MDIO_READS, result->iterations);
+
+    return matched;
+}
+
+void usb_mdio_cache_request_callback(uint8_t bus, uint8_t dev, uint8_t mode, uint8_t reg, struct mdio_cache_stats *stats) {
+    switch (mode) {
+        case USB_MDIO_CACHE_RESET_STATS:
+            mdio_cache_reset_stats();
+            break;
+        case USB_MDIO_CACHE_FLUSH:
+            mdio_cache_invalidate(bus, dev);
+            break;
+        case USB_MDIO_CACHE_SET_STATIC:
+        case USB_MDIO_CACHE_SET_VOLATILE:
+            mdio_cache_set_policy(bus, dev, reg, mode == USB_MDIO_CACHE_SET_STATIC);
+            break;
+        case USB_MDIO_CACHE_SET_PAGE_REG:
+            mdio_cache_set_page_register(bus, dev, reg);
+            break;
+    }
+
+    mdio_cache_get_stats(stats);
+    trace_record(TRACE_MDIO_CACHE, bus, dev, mode, reg, 0, 0);
+}
+
+int usb_mdio_watch_request_callback(uint8_t bus, uint8_t dev, uint8_t mode, uint8_t reg, uint16_t mask, uint32_t interval_us) {
+    int index = 0;
+
+    switch (mode) {
+        case USB_MDIO_WATCH_ADD:
+            index = mdio_watch_add(bus, dev, reg, mask);
+            break;
+        case USB_MDIO_WATCH_CLEAR:
+            mdio_watch_clear();
+            break;
+        case USB_MDIO_WATCH_SET_INTERVAL:
+            mdio_watch_set_interval(interval_us);
+            break;
+    }
+
+    trace_record(TRACE_MDIO_WATCH | (index < 0 ? TRACE_FAILED : 0), bus, dev, mode, reg, index, 0);
+
+    return index;
+}
+
+uint32_t usb_mdio_preamble_suppression_request_callback(uint8_t bus, uint8_t dev, uint8_t mode) {
+    uint32_t start = time_us_32();
+
+    switch (mode) {
+        case USB_MDIO_PREAMBLE_DISABLE:
+        case USB_MDIO_PREAMBLE_ENABLE:
+            mdio_set_preamble_suppression(bus, dev, mode == USB_MDIO_PREAMBLE_ENABLE);
+            break;
+        case USB_MDIO_PREAMBLE_PROBE:
+            mdio_probe_preamble_suppression(bus, dev);
+            break;
+        case USB_MDIO_PREAMBLE_PROBE_ALL:
+            mdio_discover_preamble_suppression(bus);
+            break;
+    }
+
+    uint32_t bitmap = mdio_get_preamble_suppression(bus);
+    trace_record(TRACE_MDIO_PREAMBLE, bus, dev, mode, bitmap >> 16, bitmap & 0xffff, time_us_32() - start);
+
+    return bitmap;
+}
+
+uint32_t usb_mdio_scan_request_callback(uint8_t bus, uint8_t mode, uint32_t *ids) {
+    uint32_t start = time_us_32();
+
+    switch (mode) {
+        case USB_MDIO_SCAN_RUN:
+            mdio_scan(bus, ids);
+            mdio_set_skip_absent(bus, true);
+#if MDIO_REGISTER_CACHE
+            for (uint8_t dev = 0; dev < 32; dev++) {
+                if (ids[dev] && mdio_is_phy(bus, dev))
+                    mdio_cache_set_phy_id(bus, dev, ids[dev]);
+            }
+#endif
+            break;
+        case USB_MDIO_SCAN_FORGET:
+            mdio_clear_absent(bus);
+            mdio_set_skip_absent(bus, false);
+            break;
+    }
+
+    // Right after a scan these are the present addresses
+    uint32_t bitmap = ~mdio_get_absent(bus);
+    trace_record(TRACE_MDIO_SCAN, bus, 0, mode, bitmap >> 16, bitmap & 0xffff, time_us_32() - start);
+
+    return bitmap;
+}
+
+void usb_mdio_sniff_request_callback(uint8_t bus, uint8_t mode, struct mdio_sniff_status *status) {
+    uint32_t start = time_us_32();
+
+    switch (mode) {
+        case USB_MDIO_SNIFF_START:
+            mdio_sniff_start(bus);
+            break;
+        case USB_MDIO_SNIFF_STOP:
+            mdio_sniff_stop();
+            break;
+    }
+
+    mdio_sniff_get_status(status);
+    if (mode != USB_MDIO_SNIFF_STATUS)
+        trace_record(TRACE_MDIO_SNIFF, bus, 0, mode, status->lost >> 16, status->lost & 0xffff, time_us_32() - start);
+}
+
+bool usb_mdio_timing_request_callback(uint8_t bus, uint8_t dev, uint8_t op, struct mdio_timing_profile *profile) {
+    uint32_t start = time_us_32();
+
+    if (op == USB_MDIO_OP_SET_TIMING && !mdio_set_timing_profile(bus, dev, profile)) {
+        trace_record(TRACE_MDIO_TIMING | TRACE_FAILED, bus, dev, op, 0, profile->mdc_hz / 1000, 0);
+        return false;
+    }
+
+    if (op == USB_MDIO_OP_CALIBRATE && !mdio_calibrate(bus, dev, NULL)) {
+        trace_record(TRACE_MDIO_TIMING | TRACE_FAILED, bus, dev, op, 0, 0, time_us_32() - start);
+        return false;
+    }
+
+    mdio_get_timing_profile(bus, dev, profile);
+    trace_record(TRACE_MDIO_TIMING, bus, dev, op, 0, profile->mdc_hz / 1000, time_us_32() - start);
+
+    return true;
+}
+
+static const struct usb_mdio_callbacks usb_mdio_callbacks = {
+    .pull_request = &usb_mdio_pull_request_callback,
+    .push_request = &usb_mdio_push_request_callback,
+    .batch_request = &usb_mdio_batch_request_callback,
+    .c45_pull_request = &usb_mdio_c45_pull_request_callback,
+    .c45_push_request = &usb_mdio_c45_push_request_callback,
+    .c45_pull_range_request = &usb_mdio_c45_pull_range_request_callback,
+    .smi_pull_request = &usb_mdio_smi_pull_request_callback,
+    .smi_push_request = &usb_mdio_smi_push_request_callback,
+    .poll_request = &usb_mdio_poll_request_callback,
+    .cache_request = &usb_mdio_cache_request_callback,
+    .watch_request = &usb_mdio_watch_request_callback,
+    .preamble_suppression_request = &usb_mdio_preamble_suppression_request_callback,
+    .scan_request = &usb_mdio_scan_request_callback,
+    .sniff_request = &usb_mdio_sniff_request_callback,
+    .timing_request = &usb_mdio_timing_request_callback,
+};
+
+// Init sequence from flash, same MDIO paths as the host requests
+static const struct mdio_vm_ops mdio_boot_ops = {
+    .pull_request = &usb_mdio_pull_request_callback,
+    .push_request = &usb_mdio_push_request_callback,
+    .c45_pull_request = &usb_mdio_c45_pull_request_callback,
+    .c45_push_request = &usb_mdio_c45_push_request_callback,
+    .poll_request = &usb_mdio_poll_request_callback,
+};
+
+/**
+ * @brief Core1: owns the MDIO buses and executes the commands queued by the USB side on core0
+ */
+static void core1_main(void) {
+    // Core0 writes the flash (init sequence), this core pauses meanwhile
+    flash_safe_execute_core_init();
+
+    // DMA and PIO interrupts of the buses are handled on this core
+    mdio_init();
+    mdio_cache_init();
+    mdio_watch_init(&usb_notify_watch);
+
+    // Tell core0 that the MDIO side is ready
+    multicore_fifo_push_blocking(0);
+
+    // Configure the devices on the buses right away, while core0 brings up USB. Commands from the host wait until
+    // it and the probes below are done.
+    mdio_boot_run(&mdio_boot_ops);
+
+#if MDIO_SCAN_AT_STARTUP
+    for (uint8_t bus = 0; bus < MDIO_NUM_BUSES; bus++)
+        printf("MDIO bus %i PHYs: 0x%08x\n", bus, (uint) mdio_scan(bus, NULL));
+#endif
+
+#if MDIO_PREAMBLE_DISCOVERY
+    for (uint8_t bus = 0; bus < MDIO_NUM_BUSES; bus++)
+        printf("MDIO bus %i preamble suppression bitmap: 0x%08x\n", bus, (uint) mdio_discover_preamble_suppression(bus));
+#endif
+
+    while (1) {
+        usb_mdio_task();
+        mdio_watch_task();
+        tight_loop_contents();
+    }
 }
 
 int main(void) {
     stdio_init_all();
+#if USB_MDIO_CDC_ACM
+    // Everything printed from here on waits in the telemetry ring for the CDC-ACM interface
+    telemetry_init();
+#endif
     printf("\n");
     printf("%s startup\n", get_usb_product_string());
     printf("Copyright (c) 2025 Albrecht Lohofener\n");
     printf("Version %s\n", VERSION);
     printf("\n");
 
-    mdio_init();
+    perf_init();
+    multicore_launch_core1(core1_main);
+    multicore_fifo_pop_blocking();
+
+    // Sniffed frames are drained into EP8 on this core
+    mdio_sniff_init(&usb_notify_sniff);
 
-    usb_device_init(&usb_mdio_pull_request_callback, &usb_mdio_push_request_callback);
+    usb_device_init(&usb_mdio_callbacks);
     
     // Wait until configured
     while (!get_usb_configured()) {
@@ -45,19 +388,22 @@ int main(void) {
     }
 
     /*printf("Test MDIO - Read RTL8305SC MAC address\n");
-    uint16_t reg_val = mdio_read(3, 16);
+    uint16_t reg_val = mdio_read(0, 3, 16);
     printf("reg_val1=[0x%x]\n", reg_val);
 
-    reg_val = mdio_read(3, 17);
+    reg_val = mdio_read(0, 3, 17);
     printf("reg_val2=[0x%x]\n", reg_val);
 
-    reg_val = mdio_read(3, 18);
+    reg_val = mdio_read(0, 3, 18);
     printf("reg_val3=[0x%x]\n", reg_val);*/
 
     usb_start();
 
-    // Everything is interrupt driven so just loop here
+    // USB is interrupt driven and MDIO runs on core1, so this loop only prints the trace and writes flash
     while (1) {
+        trace_task();
+        usb_telemetry_task();
+        usb_init_store_task();
         tight_loop_contents();
     }
 }
@@ -2,167 +2,963 @@
  * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
  *
  * SPDX-License-Identifier: BSD-3-Clause
- * 
+ *
  * Based on https://github.com/cioban/arduino-projects/blob/master/smi/smi.ino
  */
 
 #include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+
+#include "mdio.h"
+#include "perf.h"
+#include "mdio.pio.h"
+
+#define MDIO_DEFAULT_MDC_HZ 2500000 // 802.3 maximum. The former bit-banged version ran with 50 kHz.
+#define MDIO_DEFAULT_DRIVE_MA 4     // RP2040 reset values for the pads
+
+// MDC/MDIO pin pairs, one per bus. Bus 0 is the one from the pinout in the readme.
+static const struct {
+    uint mdc_pin;
+    uint mdio_pin;
+} mdio_bus_pins[MDIO_NUM_BUSES] = {
+    {14, 15},
+#if MDIO_NUM_BUSES > 1
+    {16, 17},
+#endif
+#if MDIO_NUM_BUSES > 2
+    {18, 19},
+#endif
+#if MDIO_NUM_BUSES > 3
+    {20, 21},
+#endif
+};
+
+// Clause 22 frame fields as shifted out by the PIO program (MSB first)
+#define MDIO_C22_START      (0x1u << 30)
+#define MDIO_C22_OP_WRITE   (0x1u << 28)
+#define MDIO_C22_OP_READ    (0x2u << 28)
+#define MDIO_FRAME_PHY(x)   (((uint32_t) (x) & 0x1f) << 23)
+#define MDIO_FRAME_REG(x)   (((uint32_t) (x) & 0x1f) << 18)
+#define MDIO_FRAME_TA_WRITE (0x2u << 16)
+
+// Clause 45 frame fields. PHYAD is the port address and REGAD the device address.
+#define MDIO_C45_START      (0x0u << 30)
+#define MDIO_C45_OP_ADDRESS (0x0u << 28)
+#define MDIO_C45_OP_WRITE   (0x1u << 28)
+#define MDIO_C45_OP_READ_INC (0x2u << 28) // Post-read-increment-address
+#define MDIO_C45_OP_READ    (0x3u << 28)
+
+// Bit 16 of a sampled read frame is the second TA bit. A present PHY drives it low.
+#define MDIO_TA_DRIVEN(x)   (!((x) & (1u << 16)))
+#define MDIO_RAW_NO_PHY     0x3ffff // TA and data of a read nobody answered, pulled up
+
+#define MDIO_REG_BMCR       0
+#define MDIO_REG_BMSR       1
+#define MDIO_REG_PHYSID1    2
+#define MDIO_REG_PHYSID2    3
+#define MDIO_BMCR_RESET     (1u << 15)
+#define MDIO_BMSR_MF_PREAMBLE_SUPPRESSION (1u << 6)
+#define MDIO_BMSR_EXTENDED_CAPABILITY     (1u << 0)
+
+#define MDIO_PREAMBLE_BITS    32
+#define MDIO_READ_DRIVE_BITS  14 // ST, OP, PHYAD and REGAD
+#define MDIO_READ_SAMPLE_BITS 18 // TA and data
+#define MDIO_WRITE_DRIVE_BITS 32
+
+// Frames of one batch of mdio_c45_read_range(), the ADDRESS frame and the reads
+#define MDIO_C45_RANGE_BATCH_FRAMES 32
+
+// MDC frequencies tried by the calibration, slowest first
+static const uint32_t mdio_calibration_steps[] = {
+    1000000, 2500000, 5000000, 8000000, 10000000, 12500000, 15625000, 20000000
+};
+#define MDIO_CALIBRATION_READS 16
+
+// State of one bus. Every bus has its own state machine and DMA channels, so buses run concurrently.
+struct mdio_bus {
+    uint mdc_pin;
+    uint mdio_pin;
+
+    PIO pio;
+    uint sm;
+
+    // DMA channels feeding the PIO TX FIFO and draining its RX FIFO for batches
+    uint dma_tx;
+    uint dma_rx;
+    struct mdio_batch *volatile active_batch;
+    uint32_t batch_start_us;
+
+    // Timing profile per address and the profile the state machine and pads currently run with
+    struct mdio_timing_profile profiles[32];
+    struct mdio_timing_profile applied_profile;
+
+    // Addresses that accept frames without preamble, one bit per address
+    uint32_t preamble_suppression;
+    // Addresses that get one full preamble again with the next frame (e.g. after a PHY reset)
+    uint32_t preamble_pending;
+
+    // Addresses found empty by mdio_scan(), those of them that also left another register unanswered and when a
+    // read of each last went to the bus. Reads only take them into account while skip_absent is set.
+    uint32_t absent;
+    uint32_t absent_silent;
+    uint32_t absent_checked_us[32];
+    bool skip_absent;
+
+    // MDC and MDIO are inputs, another station is the master (mdio_set_passive())
+    bool passive;
+};
+
+static struct mdio_bus mdio_buses[MDIO_NUM_BUSES];
+
+// Out of range bus numbers fall back to bus 0. The USB layer rejects them before they get here.
+static inline struct mdio_bus *mdio_get_bus(uint8_t bus) {
+    return &mdio_buses[bus < MDIO_NUM_BUSES ? bus : 0];
+}
 
-#define PULSE_DELAY_US 10 // 50 kHz MDIO cycle. With 5 kHz the Linux mdio bus ran into a timeout.
+/**
+ * @brief Encode a frame into the word stream consumed by the PIO program. The preamble is left out
+ * for addresses with preamble suppression enabled.
+ *
+ * @param words, output buffer. Needs space for MDIO_MAX_FRAME_WORDS words.
+ * @param frame, the frame bits following the preamble, MSB aligned
+ * @param drive_bits, number of frame bits the station drives
+ * @param sample_bits, number of bits to sample after the drive phase
+ * @return number of words written
+ */
+static uint mdio_encode_frame(struct mdio_bus *b, uint32_t *words, uint32_t frame, uint drive_bits, uint sample_bits) {
+    uint32_t phy_bit = 1u << ((frame >> 23) & 0x1f);
 
-const uint MDC_PIN = 14;
-const uint MDIO_PIN = 15;
+    if ((b->preamble_suppression & phy_bit) && !(b->preamble_pending & phy_bit)) {
+        words[0] = (drive_bits - 1) | (sample_bits << 16);
+        words[1] = frame;
+        return 2;
+    }
 
-void mdio_init(void) {
-    gpio_init(MDC_PIN);
-    gpio_set_dir(MDC_PIN, GPIO_OUT);
+    b->preamble_pending &= ~phy_bit;
 
-    gpio_init(MDIO_PIN);
-    gpio_set_dir(MDIO_PIN, GPIO_OUT);
+    words[0] = (MDIO_PREAMBLE_BITS + drive_bits - 1) | (sample_bits << 16);
+    words[1] = 0xffffffff; // Preamble
+    words[2] = frame;
+    return 3;
 }
 
-void mdio_pulse(void) {
-    // This function should be improved because the RP2040 is nice features that should be utilized
+/**
+ * @brief Number of bits to sample for a read frame. With a sample delay the PHY data arrives whole MDC
+ * periods late. Sampling that many extra bits keeps TA and data in the lowest 18 bits of the result.
+ */
+static uint mdio_read_sample_bits(struct mdio_bus *b, uint8_t phy) {
+    return MDIO_READ_SAMPLE_BITS + b->profiles[phy & 0x1f].sample_delay;
+}
 
-    gpio_put(MDC_PIN, false);
-    busy_wait_us_32(PULSE_DELAY_US); // sleep_us creates CPU hangup - no idea why. Use busy wait instead
+static uint mdio_encode_c22_read(struct mdio_bus *b, uint32_t *words, uint8_t phy, uint8_t reg) {
+    uint32_t frame = MDIO_C22_START | MDIO_C22_OP_READ | MDIO_FRAME_PHY(phy) | MDIO_FRAME_REG(reg);
 
-    gpio_put(MDC_PIN, true);
-    busy_wait_us_32(PULSE_DELAY_US); // sleep_us creates CPU hangup - no idea why. Use busy wait instead
+    return mdio_encode_frame(b, words, frame, MDIO_READ_DRIVE_BITS, mdio_read_sample_bits(b, phy));
 }
 
-uint16_t mdio_read(uint8_t phy, uint8_t reg) {
-    uint8_t byte;
-    uint16_t word, data;
+static uint mdio_encode_c22_write(struct mdio_bus *b, uint32_t *words, uint8_t phy, uint8_t reg, uint16_t data) {
+    // 802.3 wants a full preamble again after a reset
+    if (reg == MDIO_REG_BMCR && (data & MDIO_BMCR_RESET))
+        b->preamble_pending |= 1u << (phy & 0x1f);
+
+    // Whoever writes expects a PHY there (e.g. one that was just powered up), read it from the bus again
+    b->absent &= ~(1u << (phy & 0x1f));
+    b->absent_silent &= ~(1u << (phy & 0x1f));
+
+    uint32_t frame = MDIO_C22_START | MDIO_C22_OP_WRITE | MDIO_FRAME_PHY(phy) | MDIO_FRAME_REG(reg) |
+                     MDIO_FRAME_TA_WRITE | data;
 
-    /* MDIO pin is output */
-    gpio_set_dir(MDIO_PIN, GPIO_OUT);
+    return mdio_encode_frame(b, words, frame, MDIO_WRITE_DRIVE_BITS, 0);
+}
+
+static uint mdio_encode_c45(struct mdio_bus *b, uint32_t *words, uint32_t op, uint8_t port, uint8_t devad, uint16_t data) {
+    uint32_t frame = MDIO_C45_START | op | MDIO_FRAME_PHY(port) | MDIO_FRAME_REG(devad);
 
-    gpio_put(MDIO_PIN, true);
+    if (op == MDIO_C45_OP_READ || op == MDIO_C45_OP_READ_INC)
+        return mdio_encode_frame(b, words, frame, MDIO_READ_DRIVE_BITS, mdio_read_sample_bits(b, port));
 
-    for (byte = 0; byte < 32; byte++)
-        mdio_pulse();
+    return mdio_encode_frame(b, words, frame | MDIO_FRAME_TA_WRITE | data, MDIO_WRITE_DRIVE_BITS, 0);
+}
 
-    /* Stat code */
-    gpio_put(MDIO_PIN, false);
-    mdio_pulse();
-    gpio_put(MDIO_PIN, true);
-    mdio_pulse();
+static bool mdio_profile_equal(const struct mdio_timing_profile *a, const struct mdio_timing_profile *b) {
+    return a->mdc_hz == b->mdc_hz &&
+           a->sample_delay == b->sample_delay &&
+           a->drive_ma == b->drive_ma &&
+           a->slew_fast == b->slew_fast &&
+           a->schmitt == b->schmitt;
+}
+
+static float mdio_clkdiv(uint32_t mdc_hz) {
+    // Round up to the 1/256 steps of the divider, the SDK would truncate and run MDC faster than asked for
+    uint64_t cycles = (uint64_t) mdc_hz * MDIO_PIO_CYCLES_PER_BIT;
+    uint64_t div256 = ((uint64_t) clock_get_hz(clk_sys) * 256 + cycles - 1) / cycles;
+
+    // The PIO can not run faster than the system clock
+    return div256 < 256 ? 1.0f : (float) div256 / 256.0f;
+}
+
+static enum gpio_drive_strength mdio_drive_strength(uint8_t ma) {
+    switch (ma) {
+        case 2: return GPIO_DRIVE_STRENGTH_2MA;
+        case 8: return GPIO_DRIVE_STRENGTH_8MA;
+        case 12: return GPIO_DRIVE_STRENGTH_12MA;
+        default: return GPIO_DRIVE_STRENGTH_4MA;
+    }
+}
+
+/**
+ * @brief Switch the state machine and the pads of a bus to the timing profile of an address. Must only
+ * be called while no frame is on the bus.
+ */
+static void mdio_apply_profile(struct mdio_bus *b, uint8_t phy) {
+    const struct mdio_timing_profile *profile = &b->profiles[phy & 0x1f];
+
+    if (mdio_profile_equal(profile, &b->applied_profile))
+        return;
+
+    pio_sm_set_clkdiv(b->pio, b->sm, mdio_clkdiv(profile->mdc_hz));
+    pio_sm_clkdiv_restart(b->pio, b->sm);
+
+    enum gpio_drive_strength drive = mdio_drive_strength(profile->drive_ma);
+    enum gpio_slew_rate slew = profile->slew_fast ? GPIO_SLEW_RATE_FAST : GPIO_SLEW_RATE_SLOW;
+
+    gpio_set_drive_strength(b->mdc_pin, drive);
+    gpio_set_drive_strength(b->mdio_pin, drive);
+    gpio_set_slew_rate(b->mdc_pin, slew);
+    gpio_set_slew_rate(b->mdio_pin, slew);
+    gpio_set_input_hysteresis_enabled(b->mdio_pin, profile->schmitt);
+
+    b->applied_profile = *profile;
+}
 
-    /* Read OP Code */
-    gpio_put(MDIO_PIN, true);
-    mdio_pulse();
-    gpio_put(MDIO_PIN, false);
-    mdio_pulse();
+static void mdio_bus_batch_wait(struct mdio_bus *b);
+static bool mdio_batch_add_c45(struct mdio_batch *batch, uint32_t op, uint8_t port, uint8_t devad, uint16_t data);
+
+/**
+ * @brief Run one encoded frame on the bus and wait until it is done. A running batch is finished first.
+ *
+ * @return the sampled bits (TA and data for reads, 0 for writes), MDIO_RAW_NO_PHY on a passive bus
+ */
+static uint32_t mdio_transfer(struct mdio_bus *b, uint8_t phy, const uint32_t *words, uint count) {
+    mdio_bus_batch_wait(b);
+
+    if (b->passive)
+        return MDIO_RAW_NO_PHY;
+
+    mdio_apply_profile(b, phy);
+
+    uint32_t start = time_us_32();
+
+    for (uint i = 0; i < count; i++)
+        pio_sm_put_blocking(b->pio, b->sm, words[i]);
+
+    uint32_t rx = pio_sm_get_blocking(b->pio, b->sm);
+    uint32_t elapsed = time_us_32() - start;
+
+    perf_add(PERF_MDIO_FRAMES, 1);
+    perf_add(PERF_BUS_BUSY_US, elapsed);
+    perf_histogram_add(PERF_HIST_FRAME_TIME, elapsed);
+
+    return rx;
+}
+
+/**
+ * @brief Start the DMA transfers for the next segment of a batch. All frames of a segment share one
+ * timing profile, the profile is switched in between.
+ */
+static void mdio_batch_start_segment(struct mdio_bus *b, struct mdio_batch *batch) {
+    uint i = batch->next_segment++;
+    const struct mdio_batch_segment *segment = &batch->segments[i];
+    bool last = batch->next_segment == batch->num_segments;
+
+    uint end_word = last ? batch->num_words : batch->segments[i + 1].first_word;
+    uint end_frame = last ? batch->num_frames : batch->segments[i + 1].first_frame;
+
+    mdio_apply_profile(b, segment->phy);
+
+    // Arm the result channel first so no RX word is missed, then start feeding frames
+    dma_channel_transfer_to_buffer_now(b->dma_rx, &batch->results[segment->first_frame],
+                                       end_frame - segment->first_frame);
+    dma_channel_transfer_from_buffer_now(b->dma_tx, &batch->words[segment->first_word],
+                                         end_word - segment->first_word);
+}
+
+/**
+ * @brief Handle the end of a segment if the RX channel of the bus raised its interrupt. Starts the next
+ * segment or returns the finished batch. Safe against the DMA interrupt running concurrently on this core.
+ */
+static struct mdio_batch *mdio_batch_advance(struct mdio_bus *b) {
+    struct mdio_batch *batch = NULL;
+
+    uint32_t save = save_and_disable_interrupts();
+    if (dma_channel_get_irq0_status(b->dma_rx)) {
+        dma_channel_acknowledge_irq0(b->dma_rx);
+        batch = b->active_batch;
+
+        if (batch && batch->next_segment < batch->num_segments) {
+            mdio_batch_start_segment(b, batch);
+            batch = NULL;
+        } else {
+            b->active_batch = NULL;
+        }
+    }
+    restore_interrupts(save);
+
+    if (batch) {
+        perf_add(PERF_MDIO_FRAMES, batch->num_frames);
+        perf_add(PERF_BUS_BUSY_US, time_us_32() - b->batch_start_us);
+    }
+
+    return batch;
+}
+
+/**
+ * @brief DMA interrupt. The RX channel of a bus finishes after the last frame of a segment was sampled.
+ */
+static void mdio_dma_irq_handler(void) {
+    for (uint i = 0; i < MDIO_NUM_BUSES; i++) {
+        struct mdio_batch *batch = mdio_batch_advance(&mdio_buses[i]);
 
-    /* PHY address - 5 bits */
-    for (byte = 0x10; byte != 0;)
-    {
-        if (byte & phy)
-            gpio_put(MDIO_PIN, true);
-        else
-            gpio_put(MDIO_PIN, false);
+        if (batch && batch->callback)
+            batch->callback(batch);
+    }
+}
 
-        mdio_pulse();
+static void mdio_dma_init(struct mdio_bus *b) {
+    b->dma_tx = dma_claim_unused_channel(true);
+    b->dma_rx = dma_claim_unused_channel(true);
+
+    // Encoded frames -> PIO TX FIFO
+    dma_channel_config c = dma_channel_get_default_config(b->dma_tx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, pio_get_dreq(b->pio, b->sm, true));
+    dma_channel_configure(b->dma_tx, &c, &b->pio->txf[b->sm], NULL, 0, false);
+
+    // PIO RX FIFO -> results, one word per frame
+    c = dma_channel_get_default_config(b->dma_rx);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, pio_get_dreq(b->pio, b->sm, false));
+    dma_channel_configure(b->dma_rx, &c, NULL, &b->pio->rxf[b->sm], 0, false);
+
+    dma_channel_set_irq0_enabled(b->dma_rx, true);
+}
 
-        byte = byte >> 1;
+void mdio_init(void) {
+    // All buses share one copy of the program and get a state machine each
+    PIO pio = pio0;
+    uint offset = pio_add_program(pio, &mdio_program);
+
+    for (uint i = 0; i < MDIO_NUM_BUSES; i++) {
+        struct mdio_bus *b = &mdio_buses[i];
+
+        b->mdc_pin = mdio_bus_pins[i].mdc_pin;
+        b->mdio_pin = mdio_bus_pins[i].mdio_pin;
+        b->pio = pio;
+        b->sm = pio_claim_unused_sm(pio, true);
+
+        for (uint phy = 0; phy < 32; phy++) {
+            b->profiles[phy] = (struct mdio_timing_profile) {
+                .mdc_hz = MDIO_DEFAULT_MDC_HZ,
+                .sample_delay = 0,
+                .drive_ma = MDIO_DEFAULT_DRIVE_MA,
+                .slew_fast = false,
+                .schmitt = true,
+            };
+        }
+
+        mdio_program_init(b->pio, b->sm, offset, b->mdc_pin, b->mdio_pin, mdio_clkdiv(MDIO_DEFAULT_MDC_HZ));
+        b->applied_profile = b->profiles[0];
+
+        mdio_dma_init(b);
     }
-    /* REG address - 5 bits */
-    for (byte = 0x10; byte != 0;)
-    {
-        if (byte & reg)
-            gpio_put(MDIO_PIN, true);
-        else
-            gpio_put(MDIO_PIN, false);
 
-        mdio_pulse();
+    irq_add_shared_handler(DMA_IRQ_0, mdio_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+}
+
+void mdio_get_pins(uint8_t bus, uint *mdc_pin, uint *mdio_pin) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+
+    *mdc_pin = b->mdc_pin;
+    *mdio_pin = b->mdio_pin;
+}
 
-        byte = byte >> 1;
+void mdio_set_passive(uint8_t bus, bool passive) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+
+    mdio_bus_batch_wait(b);
+    if (passive == b->passive)
+        return;
+
+    if (passive) {
+        // Between frames the program waits for the next control word. MDIO may still be driven after a write,
+        // so release both pins explicitly.
+        pio_sm_set_enabled(b->pio, b->sm, false);
+        pio_sm_set_consecutive_pindirs(b->pio, b->sm, b->mdc_pin, 1, false);
+        pio_sm_set_consecutive_pindirs(b->pio, b->sm, b->mdio_pin, 1, false);
+    } else {
+        pio_sm_set_pins_with_mask(b->pio, b->sm, 0, 1u << b->mdc_pin);
+        pio_sm_set_consecutive_pindirs(b->pio, b->sm, b->mdc_pin, 1, true);
+        pio_sm_set_enabled(b->pio, b->sm, true);
     }
-    /* Turn around bits */
-    /* MDIO now is input */
-    gpio_set_dir(MDIO_PIN, GPIO_IN);
-    mdio_pulse();
-    mdio_pulse();
-    /* Data - 16 bits */
-    data = 0;
-    for (word = 0x8000; word != 0;)
-    {
 
-        if (gpio_get(MDIO_PIN))
-            data |= word;
+    b->passive = passive;
+}
+
+bool mdio_get_passive(uint8_t bus) {
+    return mdio_get_bus(bus)->passive;
+}
+
+uint32_t mdio_set_mdc_frequency(uint8_t bus, uint32_t hz) {
+    struct mdio_bus *b = mdio_get_bus(bus);
 
-        mdio_pulse();
+    for (uint phy = 0; phy < 32; phy++)
+        b->profiles[phy].mdc_hz = hz;
 
-        word = word >> 1;
+    return (uint32_t) ((float) clock_get_hz(clk_sys) / (mdio_clkdiv(hz) * MDIO_PIO_CYCLES_PER_BIT));
+}
+
+static uint32_t mdio_read_frame(struct mdio_bus *b, uint8_t phy, uint8_t reg) {
+    uint32_t words[MDIO_MAX_FRAME_WORDS];
+    uint count = mdio_encode_c22_read(b, words, phy, reg);
+
+    return mdio_transfer(b, phy, words, count);
+}
+
+/**
+ * @brief Clause 22 read. Addresses marked absent are answered like the pulled up bus would without a frame,
+ * except for one read every MDIO_ABSENT_RECHECK_MS. Only the PHY ID registers are answered that way until the
+ * address also left another register unanswered: a switch in multi-chip mode has no PHY ID, but answers its
+ * SMI command register.
+ */
+static uint32_t mdio_read_raw(struct mdio_bus *b, uint8_t phy, uint8_t reg) {
+    uint32_t phy_bit = 1u << (phy & 0x1f);
+    uint32_t *checked_us = &b->absent_checked_us[phy & 0x1f];
+    bool id_reg = reg == MDIO_REG_PHYSID1 || reg == MDIO_REG_PHYSID2;
+
+    if (!b->skip_absent || !(b->absent & phy_bit))
+        return mdio_read_frame(b, phy, reg);
+
+    if ((id_reg || (b->absent_silent & phy_bit)) && time_us_32() - *checked_us < MDIO_ABSENT_RECHECK_MS * 1000)
+        return MDIO_RAW_NO_PHY;
+
+    uint32_t raw = mdio_read_frame(b, phy, reg);
+
+    if (MDIO_TA_DRIVEN(raw)) {
+        b->absent &= ~phy_bit;
+        b->absent_silent &= ~phy_bit;
+    } else {
+        if (!id_reg)
+            b->absent_silent |= phy_bit;
+        *checked_us = time_us_32();
     }
 
-    /* This is needed for some reason... */
-    mdio_pulse();
+    return raw;
+}
+
+uint16_t mdio_read(uint8_t bus, uint8_t phy, uint8_t reg) {
+    return mdio_read_raw(mdio_get_bus(bus), phy, reg) & 0xffff;
+}
+
+bool mdio_try_read(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t *data) {
+    uint32_t raw = mdio_read_raw(mdio_get_bus(bus), phy, reg);
 
-    return data;
+    *data = raw & 0xffff;
+    return MDIO_TA_DRIVEN(raw);
 }
 
-void mdio_write(uint8_t phy, uint8_t reg, uint16_t data)
+void mdio_write(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t data)
 {
-    uint8_t byte;
-    uint16_t word;
-
-    /* MDIO pin is output */
-    gpio_set_dir(MDIO_PIN, GPIO_OUT);
-
-    gpio_put(MDIO_PIN, true);
-    for (byte = 0; byte < 32; byte++)
-        mdio_pulse();
-
-    /* Stat code */
-    gpio_put(MDIO_PIN, false);
-    mdio_pulse();
-    gpio_put(MDIO_PIN, true);
-    mdio_pulse();
-
-    /* Write OP Code */
-    gpio_put(MDIO_PIN, false);
-    mdio_pulse();
-    gpio_put(MDIO_PIN, true);
-    mdio_pulse();
-
-    /* PHY address - 5 bits */
-    for (byte = 0x10; byte != 0; byte = byte >> 1)
-    {
-        if (byte & phy)
-            gpio_put(MDIO_PIN, true);
-        else
-            gpio_put(MDIO_PIN, false);
-        mdio_pulse();
-    }
-    /* REG address - 5 bits */
-    for (byte = 0x10; byte != 0; byte = byte >> 1)
-    {
-        if (byte & reg)
-            gpio_put(MDIO_PIN, true);
-        else
-            gpio_put(MDIO_PIN, false);
-
-        mdio_pulse();
-    }
-    /* Turn around bits */
-    gpio_put(MDIO_PIN, true);
-    mdio_pulse();
-    gpio_put(MDIO_PIN, false);
-    mdio_pulse();
-
-    /* Data - 16 bits */
-    for (word = 0x8000; word != 0; word = word >> 1)
-    {
-        if (word & data)
-            gpio_put(MDIO_PIN, true);
-        else
-            gpio_put(MDIO_PIN, false);
-
-        mdio_pulse();
-    }
-
-    /* This is needed for some reason... */
-    mdio_pulse();
-}
\ No newline at end of file
+    struct mdio_bus *b = mdio_get_bus(bus);
+    uint32_t words[MDIO_MAX_FRAME_WORDS];
+    uint count = mdio_encode_c22_write(b, words, phy, reg, data);
+
+    mdio_transfer(b, phy, words, count);
+}
+
+bool mdio_poll(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t mask, uint16_t expected,
+               uint32_t interval_us, uint32_t timeout_us, struct mdio_poll_result *result) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+    uint32_t start = time_us_32();
+    uint32_t elapsed;
+    uint16_t reg_val;
+    uint32_t iterations = 0;
+    bool matched;
+
+    // At least one read, even with a timeout of 0
+    for (;;) {
+        reg_val = mdio_read_raw(b, phy, reg) & 0xffff;
+        iterations++;
+        elapsed = time_us_32() - start;
+
+        matched = (reg_val & mask) == (expected & mask);
+        if (matched || elapsed >= timeout_us)
+            break;
+
+        if (interval_us)
+            busy_wait_us_32(interval_us);
+    }
+
+    if (result) {
+        result->value = reg_val;
+        result->iterations = iterations;
+        result->elapsed_us = elapsed;
+    }
+
+    return matched;
+}
+
+// ********** Timing profiles **********
+// *************************************
+
+bool mdio_set_timing_profile(uint8_t bus, uint8_t phy, const struct mdio_timing_profile *profile) {
+    if (profile->mdc_hz == 0 || profile->sample_delay > MDIO_MAX_SAMPLE_DELAY)
+        return false;
+
+    if (profile->drive_ma != 2 && profile->drive_ma != 4 && profile->drive_ma != 8 && profile->drive_ma != 12)
+        return false;
+
+    struct mdio_bus *b = mdio_get_bus(bus);
+    mdio_bus_batch_wait(b);
+    b->profiles[phy & 0x1f] = *profile;
+    return true;
+}
+
+void mdio_get_timing_profile(uint8_t bus, uint8_t phy, struct mdio_timing_profile *profile) {
+    *profile = mdio_get_bus(bus)->profiles[phy & 0x1f];
+}
+
+static bool mdio_calibration_check(struct mdio_bus *b, uint8_t phy, uint32_t phy_id) {
+    for (uint i = 0; i < MDIO_CALIBRATION_READS; i++) {
+        uint32_t id1 = mdio_read_raw(b, phy, MDIO_REG_PHYSID1);
+        uint32_t id2 = mdio_read_raw(b, phy, MDIO_REG_PHYSID2);
+
+        if (!MDIO_TA_DRIVEN(id1) || !MDIO_TA_DRIVEN(id2))
+            return false;
+
+        if (((id1 & 0xffff) << 16 | (id2 & 0xffff)) != phy_id)
+            return false;
+    }
+
+    return true;
+}
+
+bool mdio_calibrate(uint8_t bus, uint8_t phy, struct mdio_timing_profile *result) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+    struct mdio_timing_profile *profile = &b->profiles[phy & 0x1f];
+    struct mdio_timing_profile original = *profile;
+    uint8_t sample_delays[count_of(mdio_calibration_steps)];
+    int fastest = -1;
+
+    mdio_bus_batch_wait(b);
+
+    // Reference PHY ID at the slowest step
+    profile->mdc_hz = mdio_calibration_steps[0];
+    profile->sample_delay = 0;
+
+    uint32_t id1 = mdio_read_raw(b, phy, MDIO_REG_PHYSID1);
+    uint32_t id2 = mdio_read_raw(b, phy, MDIO_REG_PHYSID2);
+
+    if (!MDIO_TA_DRIVEN(id1) || !MDIO_TA_DRIVEN(id2)) {
+        *profile = original;
+        return false;
+    }
+
+    uint32_t phy_id = (id1 & 0xffff) << 16 | (id2 & 0xffff);
+    uint32_t max_hz = clock_get_hz(clk_sys) / MDIO_PIO_CYCLES_PER_BIT;
+
+    // Ramp MDC up until the PHY ID can not be read back anymore with any sample delay
+    for (uint step = 0; step < count_of(mdio_calibration_steps); step++) {
+        if (mdio_calibration_steps[step] > max_hz)
+            break; // Faster than the PIO can go
+
+        bool passed = false;
+
+        profile->mdc_hz = mdio_calibration_steps[step];
+        for (uint8_t delay = 0; delay <= MDIO_MAX_SAMPLE_DELAY && !passed; delay++) {
+            profile->sample_delay = delay;
+            passed = mdio_calibration_check(b, phy, phy_id);
+            sample_delays[step] = delay;
+        }
+
+        if (!passed)
+            break;
+
+        fastest = step;
+    }
+
+    if (fastest < 0) {
+        *profile = original;
+        return false;
+    }
+
+    // Safety margin: one step below the fastest one that passed
+    uint step = fastest > 0 ? fastest - 1 : 0;
+    profile->mdc_hz = mdio_calibration_steps[step];
+    profile->sample_delay = sample_delays[step];
+
+    if (result)
+        *result = *profile;
+
+    return true;
+}
+
+// ********** Preamble suppression **********
+// ******************************************
+
+void mdio_set_preamble_suppression(uint8_t bus, uint8_t phy, bool enable) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+    uint32_t phy_bit = 1u << (phy & 0x1f);
+
+    if (enable)
+        b->preamble_suppression |= phy_bit;
+    else
+        b->preamble_suppression &= ~phy_bit;
+}
+
+uint32_t mdio_get_preamble_suppression(uint8_t bus) {
+    return mdio_get_bus(bus)->preamble_suppression;
+}
+
+/**
+ * @brief An 802.3 PHY has a PHY ID and a BMSR that is neither all zeros nor all ones and has the extended
+ * register set. Registers 1..3 of other devices have a different meaning, e.g. bit 6 of register 1 is an RGMII
+ * timing bit on the ports of Marvell switches.
+ */
+static bool mdio_check_phy(struct mdio_bus *b, uint8_t phy, uint32_t bmsr) {
+    uint32_t id1 = mdio_read_raw(b, phy, MDIO_REG_PHYSID1);
+    uint32_t id2 = mdio_read_raw(b, phy, MDIO_REG_PHYSID2);
+
+    if (!MDIO_TA_DRIVEN(id1) || !MDIO_TA_DRIVEN(id2) || !MDIO_TA_DRIVEN(bmsr))
+        return false;
+
+    uint32_t id = (id1 & 0xffff) << 16 | (id2 & 0xffff);
+    bmsr &= 0xffff;
+    return id != 0 && id != 0xffffffff && bmsr != 0xffff && (bmsr & MDIO_BMSR_EXTENDED_CAPABILITY);
+}
+
+bool mdio_is_phy(uint8_t bus, uint8_t phy) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+
+    return mdio_check_phy(b, phy, mdio_read_raw(b, phy, MDIO_REG_BMSR));
+}
+
+bool mdio_probe_preamble_suppression(uint8_t bus, uint8_t phy) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+    uint32_t phy_bit = 1u << (phy & 0x1f);
+    bool enabled = b->preamble_suppression & phy_bit;
+
+    // Probe with a full preamble, the PHY might not support suppression at all
+    mdio_set_preamble_suppression(bus, phy, false);
+
+    uint32_t bmsr = mdio_read_raw(b, phy, MDIO_REG_BMSR);
+    if (!mdio_check_phy(b, phy, bmsr)) {
+        // Not a PHY, keep what the host set
+        mdio_set_preamble_suppression(bus, phy, enabled);
+        return false;
+    }
+
+    bool supported = bmsr & MDIO_BMSR_MF_PREAMBLE_SUPPRESSION;
+
+    mdio_set_preamble_suppression(bus, phy, supported);
+    return supported;
+}
+
+uint32_t mdio_discover_preamble_suppression(uint8_t bus) {
+    for (uint8_t phy = 0; phy < 32; phy++)
+        mdio_probe_preamble_suppression(bus, phy);
+
+    return mdio_get_preamble_suppression(bus);
+}
+
+// ********** Bus scan **********
+// ******************************
+
+uint32_t mdio_scan(uint8_t bus, uint32_t *ids) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+    uint32_t present = 0;
+
+    // Nobody would answer, keep what the last scan found
+    if (b->passive) {
+        for (uint phy = 0; ids && phy < 32; phy++)
+            ids[phy] = 0;
+        return 0;
+    }
+
+    for (uint8_t phy = 0; phy < 32; phy++) {
+        // Straight to the bus, this is what refreshes the absent addresses
+        uint32_t id1 = mdio_read_frame(b, phy, MDIO_REG_PHYSID1);
+
+        if (!MDIO_TA_DRIVEN(id1)) {
+            b->absent_checked_us[phy] = time_us_32();
+            if (ids)
+                ids[phy] = 0;
+            continue;
+        }
+
+        uint32_t id2 = mdio_read_frame(b, phy, MDIO_REG_PHYSID2);
+
+        present |= 1u << phy;
+        if (ids)
+            ids[phy] = (id1 & 0xffff) << 16 | (id2 & 0xffff);
+    }
+
+    b->absent = ~present;
+    b->absent_silent &= b->absent;
+    return present;
+}
+
+uint32_t mdio_get_absent(uint8_t bus) {
+    return mdio_get_bus(bus)->absent;
+}
+
+void mdio_clear_absent(uint8_t bus) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+
+    b->absent = 0;
+    b->absent_silent = 0;
+}
+
+void mdio_set_skip_absent(uint8_t bus, bool enable) {
+    mdio_get_bus(bus)->skip_absent = enable;
+}
+
+// ********** Clause 45 **********
+// *******************************
+
+static uint32_t mdio_c45_frame(struct mdio_bus *b, uint32_t op, uint8_t port, uint8_t devad, uint16_t data) {
+    uint32_t words[MDIO_MAX_FRAME_WORDS];
+    uint count = mdio_encode_c45(b, words, op, port, devad, data);
+
+    return mdio_transfer(b, port, words, count);
+}
+
+uint16_t mdio_c45_read(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+
+    mdio_c45_frame(b, MDIO_C45_OP_ADDRESS, port, devad, reg);
+    return mdio_c45_frame(b, MDIO_C45_OP_READ, port, devad, 0) & 0xffff;
+}
+
+void mdio_c45_write(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t data) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+
+    mdio_c45_frame(b, MDIO_C45_OP_ADDRESS, port, devad, reg);
+    mdio_c45_frame(b, MDIO_C45_OP_WRITE, port, devad, data);
+}
+
+void mdio_c45_read_range(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t *data, uint count) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+    uint32_t words[MDIO_C45_RANGE_BATCH_FRAMES * MDIO_MAX_FRAME_WORDS];
+    uint32_t results[MDIO_C45_RANGE_BATCH_FRAMES];
+    struct mdio_batch batch;
+
+    // One ADDRESS frame, then the MMD increments the address after every read. The frames run as a DMA batch.
+    for (uint done = 0; done < count;) {
+        uint reads = MIN(count - done, MDIO_C45_RANGE_BATCH_FRAMES - 1);
+
+        mdio_batch_init(&batch, bus, words, count_of(words), results, count_of(results));
+        mdio_batch_add_c45(&batch, MDIO_C45_OP_ADDRESS, port, devad, reg + done);
+        for (uint i = 0; i < reads; i++)
+            mdio_batch_add_c45(&batch, MDIO_C45_OP_READ_INC, port, devad, 0);
+
+        mdio_batch_start(&batch, NULL);
+        mdio_bus_batch_wait(b);
+
+        for (uint i = 0; i < reads; i++)
+            data[done + i] = mdio_batch_result(&batch, 1 + i);
+        done += reads;
+    }
+}
+
+// ********** Batches **********
+// *****************************
+
+void mdio_batch_init(struct mdio_batch *batch, uint8_t bus, uint32_t *words, uint max_words,
+                     uint32_t *results, uint max_frames) {
+    batch->bus = bus < MDIO_NUM_BUSES ? bus : 0;
+    batch->words = words;
+    batch->max_words = max_words;
+    batch->num_words = 0;
+    batch->results = results;
+    batch->max_frames = max_frames;
+    batch->num_frames = 0;
+    batch->num_segments = 0;
+    batch->next_segment = 0;
+    batch->callback = NULL;
+}
+
+/**
+ * @brief Check for space and start a new segment if the timing profile of phy differs from the
+ * previous frame.
+ */
+static bool mdio_batch_begin_frame(struct mdio_bus *b, struct mdio_batch *batch, uint8_t phy) {
+    if (batch->num_frames >= batch->max_frames || batch->num_words + MDIO_MAX_FRAME_WORDS > batch->max_words)
+        return false;
+
+    if (batch->num_segments > 0) {
+        const struct mdio_batch_segment *last = &batch->segments[batch->num_segments - 1];
+        if (mdio_profile_equal(&b->profiles[last->phy & 0x1f], &b->profiles[phy & 0x1f]))
+            return true;
+    }
+
+    if (batch->num_segments == MDIO_BATCH_MAX_SEGMENTS)
+        return false;
+
+    struct mdio_batch_segment *segment = &batch->segments[batch->num_segments++];
+    segment->first_word = batch->num_words;
+    segment->first_frame = batch->num_frames;
+    segment->phy = phy;
+    return true;
+}
+
+bool mdio_batch_add_read(struct mdio_batch *batch, uint8_t phy, uint8_t reg) {
+    struct mdio_bus *b = mdio_get_bus(batch->bus);
+
+    if (!mdio_batch_begin_frame(b, batch, phy))
+        return false;
+
+    batch->num_words += mdio_encode_c22_read(b, &batch->words[batch->num_words], phy, reg);
+    batch->num_frames++;
+    return true;
+}
+
+static bool mdio_batch_add_c45(struct mdio_batch *batch, uint32_t op, uint8_t port, uint8_t devad, uint16_t data) {
+    struct mdio_bus *b = mdio_get_bus(batch->bus);
+
+    if (!mdio_batch_begin_frame(b, batch, port))
+        return false;
+
+    batch->num_words += mdio_encode_c45(b, &batch->words[batch->num_words], op, port, devad, data);
+    batch->num_frames++;
+    return true;
+}
+
+bool mdio_batch_add_write(struct mdio_batch *batch, uint8_t phy, uint8_t reg, uint16_t data) {
+    struct mdio_bus *b = mdio_get_bus(batch->bus);
+
+    if (!mdio_batch_begin_frame(b, batch, phy))
+        return false;
+
+    batch->num_words += mdio_encode_c22_write(b, &batch->words[batch->num_words], phy, reg, data);
+    batch->num_frames++;
+    return true;
+}
+
+void mdio_batch_start(struct mdio_batch *batch, void (*callback)(struct mdio_batch *batch)) {
+    struct mdio_bus *b = mdio_get_bus(batch->bus);
+
+    mdio_bus_batch_wait(b);
+
+    // Nothing goes to a passive bus, the reads look unanswered
+    if (b->passive) {
+        for (uint i = 0; i < batch->num_frames; i++)
+            batch->results[i] = MDIO_RAW_NO_PHY;
+    }
+
+    if (batch->num_frames == 0 || b->passive) {
+        if (callback)
+            callback(batch);
+        return;
+    }
+
+    batch->callback = callback;
+    batch->next_segment = 0;
+    b->batch_start_us = time_us_32();
+    b->active_batch = batch;
+
+    mdio_batch_start_segment(b, batch);
+}
+
+bool mdio_batch_busy(uint8_t bus) {
+    return mdio_get_bus(bus)->active_batch != NULL;
+}
+
+static void mdio_bus_batch_wait(struct mdio_bus *b) {
+    // Poll the hardware instead of waiting for the interrupt, the caller might be an interrupt handler itself.
+    // Segments are advanced here in case the DMA interrupt can not preempt the caller.
+    while (b->active_batch != NULL) {
+        struct mdio_batch *batch = mdio_batch_advance(b);
+
+        if (batch && batch->callback)
+            batch->callback(batch);
+    }
+}
+
+void mdio_batch_wait(uint8_t bus) {
+    mdio_bus_batch_wait(mdio_get_bus(bus));
+}
+
+// ********** Marvell multi-chip SMI **********
+// ********************************************
+
+// Indirect access registers of a Marvell switch strapped in multi-chip mode
+#define MDIO_SMI_REG_CMD          0
+#define MDIO_SMI_REG_DATA         1
+#define MDIO_SMI_CMD_BUSY         (1u << 15)
+#define MDIO_SMI_CMD_CLAUSE_22    (1u << 12)
+#define MDIO_SMI_CMD_OP_WRITE     (0x1u << 10)
+#define MDIO_SMI_CMD_OP_READ      (0x2u << 10)
+#define MDIO_SMI_CMD_DEV(x)       (((uint16_t) (x) & 0x1f) << 5)
+#define MDIO_SMI_CMD_REG(x)       ((uint16_t) (x) & 0x1f)
+#define MDIO_SMI_TIMEOUT_US       10000
+
+/**
+ * @brief Poll the SMI command register until the busy bit is cleared.
+ *
+ * @return false if the switch does not respond or stays busy for MDIO_SMI_TIMEOUT_US
+ */
+static bool mdio_smi_wait(struct mdio_bus *b, uint8_t chip) {
+    uint32_t start = time_us_32();
+
+    do {
+        // Not through the absent addresses, a switch in multi-chip mode does not answer the PHY ID registers
+        uint32_t cmd = mdio_read_frame(b, chip, MDIO_SMI_REG_CMD);
+
+        if (!MDIO_TA_DRIVEN(cmd))
+            return false;
+
+        if (!(cmd & MDIO_SMI_CMD_BUSY))
+            return true;
+    } while (time_us_32() - start < MDIO_SMI_TIMEOUT_US);
+
+    return false;
+}
+
+bool mdio_smi_read(uint8_t bus, uint8_t chip, uint8_t dev, uint8_t reg, uint16_t *data) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+
+    if (!mdio_smi_wait(b, chip))
+        return false;
+
+    mdio_write(bus, chip, MDIO_SMI_REG_CMD, MDIO_SMI_CMD_BUSY | MDIO_SMI_CMD_CLAUSE_22 | MDIO_SMI_CMD_OP_READ |
+                                            MDIO_SMI_CMD_DEV(dev) | MDIO_SMI_CMD_REG(reg));
+
+    if (!mdio_smi_wait(b, chip))
+        return false;
+
+    *data = mdio_read(bus, chip, MDIO_SMI_REG_DATA);
+    return true;
+}
+
+bool mdio_smi_write(uint8_t bus, uint8_t chip, uint8_t dev, uint8_t reg, uint16_t data) {
+    struct mdio_bus *b = mdio_get_bus(bus);
+
+    if (!mdio_smi_wait(b, chip))
+        return false;
+
+    mdio_write(bus, chip, MDIO_SMI_REG_DATA, data);
+    mdio_write(bus, chip, MDIO_SMI_REG_CMD, MDIO_SMI_CMD_BUSY | MDIO_SMI_CMD_CLAUSE_22 | MDIO_SMI_CMD_OP_WRITE |
+                                            MDIO_SMI_CMD_DEV(dev) | MDIO_SMI_CMD_REG(reg));
+
+    // Wait for completion so a following access through another path sees the write
+    return mdio_smi_wait(b, chip);
+}
@@ -2,9 +2,151 @@
  * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
  *
  * SPDX-License-Identifier: BSD-3-Clause
- * 
+ *
  */
 
+#ifndef MDIO_H_
+#define MDIO_H_
+
+// Number of independent buses, each on its own MDC/MDIO pin pair and PIO state machine (max. 4). Only bus 0 by
+// default, the pins of the other buses stay untouched unless a build enables them.
+#ifndef MDIO_NUM_BUSES
+#define MDIO_NUM_BUSES 1
+#endif
+
+// Maximum number of PIO words one encoded frame needs (control word, preamble, frame)
+#define MDIO_MAX_FRAME_WORDS 3
+
+// Highest supported sample delay in MDC periods
+#define MDIO_MAX_SAMPLE_DELAY 4
+
+// Reads of an address marked absent by mdio_scan() go to the bus again after this time, once
+#ifndef MDIO_ABSENT_RECHECK_MS
+#define MDIO_ABSENT_RECHECK_MS 1000
+#endif
+
+// Bus timing used for one PHY address
+struct mdio_timing_profile {
+    uint32_t mdc_hz;
+    uint8_t sample_delay; // MDC periods the PHY data arrives late (for PHYs too slow for the MDC frequency)
+    uint8_t drive_ma;     // Pad drive strength of MDC and MDIO: 2, 4, 8 or 12 mA
+    bool slew_fast;
+    bool schmitt;         // Schmitt trigger on the MDIO input
+};
+
+// Outcome of mdio_poll()
+struct mdio_poll_result {
+    uint16_t value;      // Last value read
+    uint32_t iterations; // Number of reads
+    uint32_t elapsed_us;
+};
+
+// Frames of a batch using the same timing profile
+#define MDIO_BATCH_MAX_SEGMENTS 8
+struct mdio_batch_segment {
+    uint16_t first_word;
+    uint16_t first_frame;
+    uint8_t phy;
+};
+
+// A list of pre-encoded frames that is executed by DMA without CPU involvement.
+// Buffers are provided by the caller and must stay valid until the batch is done.
+struct mdio_batch {
+    uint8_t bus;
+
+    uint32_t *words;   // Encoded frames
+    uint max_words;
+    uint num_words;
+
+    uint32_t *results; // One word per frame, the read value is in the lower 16 bits
+    uint max_frames;
+    uint num_frames;
+
+    // The timing profile is switched in between segments. Profiles are looked up when frames are added.
+    struct mdio_batch_segment segments[MDIO_BATCH_MAX_SEGMENTS];
+    uint num_segments;
+    uint next_segment;
+
+    // Called from the DMA interrupt (or from mdio_batch_wait()) when the batch is done
+    void (*callback)(struct mdio_batch *batch);
+};
+
 void mdio_init(void);
-uint16_t mdio_read(uint8_t phy, uint8_t reg);
-void mdio_write(uint8_t phy, uint8_t reg, uint16_t data);
\ No newline at end of file
+uint16_t mdio_read(uint8_t bus, uint8_t phy, uint8_t reg);
+void mdio_write(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t data);
+// Like mdio_read() but returns false if no PHY drove the turnaround bit
+bool mdio_try_read(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t *data);
+
+uint16_t mdio_c45_read(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg);
+void mdio_c45_write(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t data);
+// Reads count consecutive registers starting at reg with post-read-increment-address frames
+void mdio_c45_read_range(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t *data, uint count);
+
+// Reads reg every interval_us until (value & mask) == (expected & mask) or timeout_us passed.
+// Returns true if the condition was met. result is optional.
+bool mdio_poll(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t mask, uint16_t expected,
+               uint32_t interval_us, uint32_t timeout_us, struct mdio_poll_result *result);
+
+// Preamble suppression per address (802.3 22.2.4.5.1). The bitmap has one bit per address.
+void mdio_set_preamble_suppression(uint8_t bus, uint8_t phy, bool enable);
+uint32_t mdio_get_preamble_suppression(uint8_t bus);
+// True if the address has a plausible PHY ID and BMSR, i.e. it is an 802.3 PHY and not e.g. a switch register set
+bool mdio_is_phy(uint8_t bus, uint8_t phy);
+// Reads BMSR and enables suppression if the PHY advertises it (bit 6). Returns true if enabled. Addresses
+// without a PHY ID or with an implausible BMSR are not PHYs, their setting is left alone and false returned.
+bool mdio_probe_preamble_suppression(uint8_t bus, uint8_t phy);
+// Probes all 32 addresses and returns the resulting bitmap
+uint32_t mdio_discover_preamble_suppression(uint8_t bus);
+
+// Scans all 32 addresses with reads of the PHY ID (registers 2/3). A PHY is present if it drives the turnaround
+// bit low. Returns the bitmap of present addresses, ids (optional, 32 entries) gets the PHY IDs, 0 for absent
+// addresses. Absent addresses are remembered until a Clause 22 write to the address, the next scan or
+// mdio_clear_absent(). Batches, Clause 45 and SMI accesses always go to the bus.
+uint32_t mdio_scan(uint8_t bus, uint32_t *ids);
+// Bitmap of the addresses marked absent
+uint32_t mdio_get_absent(uint8_t bus);
+void mdio_clear_absent(uint8_t bus);
+// Off by default. While enabled, Clause 22 reads of the PHY ID of absent addresses return 0xffff without a frame
+// on the bus, reads of other registers only once the address also left one of them unanswered. Every
+// MDIO_ABSENT_RECHECK_MS one read goes to the bus to see if a PHY showed up.
+void mdio_set_skip_absent(uint8_t bus, bool enable);
+
+// MDC/MDIO pins of a bus
+void mdio_get_pins(uint8_t bus, uint *mdc_pin, uint *mdio_pin);
+
+// Passive bus: MDC and MDIO are released to inputs so another station can be the master (see mdio_sniff.h).
+// Nothing is sent meanwhile, reads return 0xffff like an unanswered bus, writes are dropped, batches complete
+// right away and scans leave the absent addresses alone. Waits for a running batch first.
+void mdio_set_passive(uint8_t bus, bool passive);
+bool mdio_get_passive(uint8_t bus);
+
+// Sets the MDC frequency of all addresses on a bus. Returns the MDC frequency that was actually set.
+uint32_t mdio_set_mdc_frequency(uint8_t bus, uint32_t hz);
+
+bool mdio_set_timing_profile(uint8_t bus, uint8_t phy, const struct mdio_timing_profile *profile);
+void mdio_get_timing_profile(uint8_t bus, uint8_t phy, struct mdio_timing_profile *profile);
+// Ramps MDC up while reading the PHY ID until it fails, then backs off one step.
+// The result is stored as profile of the address. Returns false if the PHY does not respond.
+bool mdio_calibrate(uint8_t bus, uint8_t phy, struct mdio_timing_profile *result);
+
+// Indirect register access of a Marvell switch in multi-chip mode at SMI address chip. Writes the SMI command
+// register, polls its busy bit and transfers the SMI data register. Returns false if the switch does not respond
+// or stays busy.
+bool mdio_smi_read(uint8_t bus, uint8_t chip, uint8_t dev, uint8_t reg, uint16_t *data);
+bool mdio_smi_write(uint8_t bus, uint8_t chip, uint8_t dev, uint8_t reg, uint16_t data);
+
+// A batch runs on one bus. Batches on different buses run concurrently. Used by the watch list, by
+// USB_MDIO_OP_BATCH and the Clause 22 dump through the batch callback and by mdio_c45_read_range().
+void mdio_batch_init(struct mdio_batch *batch, uint8_t bus, uint32_t *words, uint max_words,
+                     uint32_t *results, uint max_frames);
+bool mdio_batch_add_read(struct mdio_batch *batch, uint8_t phy, uint8_t reg);
+bool mdio_batch_add_write(struct mdio_batch *batch, uint8_t phy, uint8_t reg, uint16_t data);
+void mdio_batch_start(struct mdio_batch *batch, void (*callback)(struct mdio_batch *batch));
+bool mdio_batch_busy(uint8_t bus);
+void mdio_batch_wait(uint8_t bus);
+
+static inline uint16_t mdio_batch_result(const struct mdio_batch *batch, uint frame) {
+    return batch->results[frame] & 0xffff;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/sync.h"
+
+#include "mdio_boot.h"
+#include "trace.h"
+
+// How long the writing core waits for the other one to stop executing from flash
+#define MDIO_BOOT_LOCKOUT_TIMEOUT_MS 100
+
+// Result of the run at power-on. Written once by the MDIO core, read by the USB core.
+static volatile uint8_t mdio_boot_state = USB_MDIO_INIT_NONE;
+static volatile uint8_t mdio_boot_run_status;
+static volatile uint16_t mdio_boot_pc;
+static volatile uint32_t mdio_boot_start_us;
+static volatile uint32_t mdio_boot_run_us;
+
+struct mdio_boot_flash_write {
+    const uint8_t *image;
+    size_t len; // 0 to only erase
+};
+
+uint32_t mdio_boot_crc32(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+
+    return ~crc;
+}
+
+/**
+ * @brief Get the header of the sequence in flash. Returns false if there is none.
+ */
+static bool mdio_boot_read_header(struct mdio_boot_header *header) {
+    memcpy(header, (const void *) (XIP_BASE + MDIO_BOOT_FLASH_OFFSET), sizeof(*header));
+
+    return header->magic == MDIO_BOOT_MAGIC && header->len && header->len <= USB_MDIO_PROGRAM_SIZE;
+}
+
+static void mdio_boot_emit(__unused void *context, __unused uint16_t pc, __unused uint16_t value) {
+}
+
+void mdio_boot_run(const struct mdio_vm_ops *ops) {
+    // Run from RAM, a new sequence may be stored while this one runs
+    static uint8_t code[USB_MDIO_PROGRAM_SIZE];
+    struct mdio_boot_header header;
+
+    if (!mdio_boot_read_header(&header))
+        return;
+
+    memcpy(code, (const void *) (XIP_BASE + MDIO_BOOT_FLASH_OFFSET + sizeof(header)), header.len);
+    if (mdio_boot_crc32(code, header.len) != header.crc) {
+        mdio_boot_state = USB_MDIO_INIT_BAD_CRC;
+        trace_record(TRACE_MDIO_BOOT | TRACE_FAILED, 0, 0, USB_MDIO_STATUS_INVALID, 0, header.len, 0);
+        return;
+    }
+
+    struct mdio_vm_ops boot_ops = *ops;
+    struct mdio_vm vm;
+
+    boot_ops.emit = mdio_boot_emit;
+    mdio_vm_init(&vm, code, header.len, 0);
+
+    mdio_boot_start_us = time_us_32();
+    mdio_boot_state = USB_MDIO_INIT_RUNNING;
+
+    uint8_t status = mdio_vm_run(&vm, &boot_ops, USB_MDIO_INIT_TIMEOUT_US);
+
+    mdio_boot_run_us = time_us_32() - mdio_boot_start_us;
+    mdio_boot_run_status = status;
+    mdio_boot_pc = vm.pc;
+    __dmb();
+    mdio_boot_state = USB_MDIO_INIT_DONE;
+
+    trace_record(TRACE_MDIO_BOOT | (status == USB_MDIO_STATUS_OK ? 0 : TRACE_FAILED), vm.bus, 0, status, vm.pc,
+                 header.len, mdio_boot_run_us);
+}
+
+size_t mdio_boot_image(uint8_t *buf, const uint8_t *code, uint16_t len) {
+    struct mdio_boot_header header = {
+        .magic = MDIO_BOOT_MAGIC,
+        .len = len,
+        .reserved = 0xffff,
+        .crc = mdio_boot_crc32(code, len),
+    };
+    size_t image_len = sizeof(header) + len;
+
+    image_len = (image_len + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE;
+    memset(buf, 0xff, image_len);
+    memcpy(buf, &header, sizeof(header));
+    memcpy(&buf[sizeof(header)], code, len);
+
+    return image_len;
+}
+
+/**
+ * @brief Erase the sector and program the image. Called with the other core locked out.
+ */
+static void mdio_boot_flash(void *param) {
+    const struct mdio_boot_flash_write *write = param;
+
+    flash_range_erase(MDIO_BOOT_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+    if (write->len)
+        flash_range_program(MDIO_BOOT_FLASH_OFFSET, write->image, write->len);
+}
+
+bool mdio_boot_store(const uint8_t *code, uint16_t len) {
+    static uint8_t image[MDIO_BOOT_IMAGE_MAX];
+    struct mdio_boot_flash_write write = {.image = image};
+
+    if (len > USB_MDIO_PROGRAM_SIZE)
+        return false;
+    if (len)
+        write.len = mdio_boot_image(image, code, len);
+
+    return flash_safe_execute(mdio_boot_flash, &write, MDIO_BOOT_LOCKOUT_TIMEOUT_MS) == PICO_OK;
+}
+
+void mdio_boot_get_status(struct mdio_boot_status *status) {
+    struct mdio_boot_header header;
+
+    status->state = mdio_boot_state;
+    __dmb();
+    status->status = mdio_boot_run_status;
+    status->pc = mdio_boot_pc;
+    status->start_us = mdio_boot_start_us;
+    status->run_us = mdio_boot_run_us;
+
+    if (mdio_boot_read_header(&header)) {
+        status->stored_len = header.len;
+        status->stored_crc = header.crc;
+    } else {
+        status->stored_len = 0;
+        status->stored_crc = 0;
+    }
+}
@@ -0,0 +1,59 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef MDIO_BOOT_H_
+#define MDIO_BOOT_H_
+
+#include "hardware/flash.h"
+
+#include "mdio_vm.h"
+
+// Init sequence in flash: a microprogram (mdio_vm.h) run once at power-on, before the host driver is up.
+// It lives in the last flash sector, a header with a CRC-32 followed by the program.
+
+#define MDIO_BOOT_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#define MDIO_BOOT_MAGIC 0x4f49444d // "MDIO"
+
+struct mdio_boot_header {
+    uint32_t magic;
+    uint16_t len; // Program bytes following the header
+    uint16_t reserved;
+    uint32_t crc; // CRC-32 of the program
+};
+
+// Header and the longest program, in whole flash pages
+#define MDIO_BOOT_IMAGE_MAX \
+    ((sizeof(struct mdio_boot_header) + USB_MDIO_PROGRAM_SIZE + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE)
+
+struct mdio_boot_status {
+    uint8_t state;       // USB_MDIO_INIT_*
+    uint8_t status;      // USB_MDIO_STATUS_* of the run
+    uint16_t pc;         // Where the program stopped
+    uint32_t start_us;   // Since power-on
+    uint32_t run_us;
+    uint16_t stored_len; // Sequence in flash now, 0 for none
+    uint32_t stored_crc;
+};
+
+// Run the sequence in flash, if there is a valid one. Call once on the core doing MDIO after mdio_init().
+// EMIT values are dropped.
+void mdio_boot_run(const struct mdio_vm_ops *ops);
+
+// Replace the sequence in flash, len 0 removes it. The other core must have called
+// flash_safe_execute_core_init(). Returns false if the flash could not be written.
+bool mdio_boot_store(const uint8_t *code, uint16_t len);
+
+void mdio_boot_get_status(struct mdio_boot_status *status);
+
+// Flash image of a sequence: the header and the program, padded with 0xff to whole pages. buf holds
+// MDIO_BOOT_IMAGE_MAX bytes. Returns the image length.
+size_t mdio_boot_image(uint8_t *buf, const uint8_t *code, uint16_t len);
+
+// CRC-32 (IEEE 802.3)
+uint32_t mdio_boot_crc32(const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,272 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <assert.h>
+
+#include "pico/stdlib.h"
+
+#include "mdio_cache.h"
+
+#define MDIO_CACHE_REG_BMCR     0
+#define MDIO_CACHE_REG_PHYSID1  2
+#define MDIO_CACHE_REG_PHYSID2  3
+#define MDIO_CACHE_REG_ESTATUS  15
+#define MDIO_CACHE_BMCR_RESET   (1u << 15)
+
+// Registers of an 802.3 PHY that only change with a reset
+#define MDIO_CACHE_PHY_STATIC ((1u << MDIO_CACHE_REG_PHYSID1) | (1u << MDIO_CACHE_REG_PHYSID2) | \
+                                   (1u << MDIO_CACHE_REG_ESTATUS))
+
+// PHYSID1 (OUI bits 3..18) of vendors with page select registers
+#define MDIO_CACHE_PHYSID1_MARVELL 0x0141
+#define MDIO_CACHE_PHYSID1_REALTEK 0x001c
+#define MDIO_CACHE_PAGE_REG_MARVELL 22
+#define MDIO_CACHE_PAGE_REG_REALTEK 31
+
+static_assert((MDIO_CACHE_ENTRIES & (MDIO_CACHE_ENTRIES - 1)) == 0, "MDIO_CACHE_ENTRIES must be a power of 2");
+
+struct mdio_cache_phy {
+    uint32_t static_regs;  // Policy, one bit per register
+    uint8_t page_reg;      // 0 if the PHY has no pages
+    bool page_reg_known;   // Detected by OUI or set explicitly
+    bool page_valid;       // page holds the value of the page select register
+    uint16_t page;
+};
+
+struct mdio_cache_entry {
+    bool valid;
+    uint8_t bus;
+    uint8_t phy;
+    uint8_t reg;
+    uint16_t page;
+    uint16_t value;
+};
+
+static struct mdio_cache_phy mdio_cache_phys[MDIO_NUM_BUSES][32];
+static struct mdio_cache_entry mdio_cache_entries[MDIO_CACHE_ENTRIES];
+static struct mdio_cache_stats mdio_cache_stats;
+
+static struct mdio_cache_phy *mdio_cache_get_phy(uint8_t bus, uint8_t phy) {
+    return &mdio_cache_phys[bus < MDIO_NUM_BUSES ? bus : 0][phy & 0x1f];
+}
+
+/**
+ * @brief Direct mapped slot of a register. Colliding registers simply evict each other.
+ */
+static struct mdio_cache_entry *mdio_cache_slot(uint8_t bus, uint8_t phy, uint16_t page, uint8_t reg) {
+    uint32_t key = (uint32_t) bus << 10 | (uint32_t) (phy & 0x1f) << 5 | (reg & 0x1f);
+
+    return &mdio_cache_entries[(key ^ (page * 0x9e37u)) & (MDIO_CACHE_ENTRIES - 1)];
+}
+
+/**
+ * @brief Find the page select register of a PHY by its OUI. Only from values the host read anyway from an
+ * address with a static PHYSID1, the cache never puts a frame of its own on the bus for it.
+ */
+static void mdio_cache_detect_page_reg(struct mdio_cache_phy *p, uint16_t id1) {
+    if (p->page_reg_known)
+        return;
+
+    switch (id1) {
+        case MDIO_CACHE_PHYSID1_MARVELL: p->page_reg = MDIO_CACHE_PAGE_REG_MARVELL; break;
+        case MDIO_CACHE_PHYSID1_REALTEK: p->page_reg = MDIO_CACHE_PAGE_REG_REALTEK; break;
+        default: p->page_reg = 0;
+    }
+    p->page_reg_known = true;
+}
+
+/**
+ * @brief Read a register from the bus and learn the page select register from PHYSID1
+ */
+static bool mdio_cache_read_bus(uint8_t bus, uint8_t phy, struct mdio_cache_phy *p, uint8_t reg, uint16_t *value) {
+    if (!mdio_try_read(bus, phy, reg, value))
+        return false;
+
+    if (reg == MDIO_CACHE_REG_PHYSID1)
+        mdio_cache_detect_page_reg(p, *value);
+
+    return true;
+}
+
+/**
+ * @brief Get the page the PHY is on. Reads the page select register if it is unknown.
+ *
+ * @return false if the PHY does not respond
+ */
+static bool mdio_cache_current_page(uint8_t bus, uint8_t phy, struct mdio_cache_phy *p, uint16_t *page) {
+    if (p->page_reg == 0) {
+        *page = 0;
+        return true;
+    }
+
+    if (!p->page_valid) {
+        if (!mdio_try_read(bus, phy, p->page_reg, &p->page))
+            return false;
+        p->page_valid = true;
+    }
+
+    *page = p->page;
+    return true;
+}
+
+/**
+ * @brief Page a static register is cached on. The PHY ID is the same on all pages, it needs no page select read.
+ */
+static bool mdio_cache_reg_page(uint8_t bus, uint8_t phy, struct mdio_cache_phy *p, uint8_t reg, uint16_t *page) {
+    if (reg == MDIO_CACHE_REG_PHYSID1 || reg == MDIO_CACHE_REG_PHYSID2) {
+        *page = 0;
+        return true;
+    }
+
+    return mdio_cache_current_page(bus, phy, p, page);
+}
+
+void mdio_cache_init(void) {
+    for (uint bus = 0; bus < MDIO_NUM_BUSES; bus++) {
+        for (uint phy = 0; phy < 32; phy++) {
+            mdio_cache_phys[bus][phy] = (struct mdio_cache_phy) {0};
+        }
+    }
+
+    mdio_cache_invalidate_all();
+    mdio_cache_reset_stats();
+}
+
+uint16_t mdio_cache_read(uint8_t bus, uint8_t phy, uint8_t reg) {
+    struct mdio_cache_phy *p = mdio_cache_get_phy(bus, phy);
+    uint16_t page, value;
+
+    reg &= 0x1f;
+
+    // The page select register is shadowed as soon as its value is known
+    if (p->page_reg && reg == p->page_reg && p->page_valid) {
+        mdio_cache_stats.hits++;
+        return p->page;
+    }
+
+    // Until the page select register is known only the PHY ID is cached, it is the same on all pages
+    bool id_reg = reg == MDIO_CACHE_REG_PHYSID1 || reg == MDIO_CACHE_REG_PHYSID2;
+    if (!(p->static_regs & (1u << reg)) || (!p->page_reg_known && !id_reg))
+        return mdio_read(bus, phy, reg);
+
+    if (!mdio_cache_reg_page(bus, phy, p, reg, &page))
+        return mdio_read(bus, phy, reg);
+
+    struct mdio_cache_entry *entry = mdio_cache_slot(bus, phy, page, reg);
+    if (entry->valid && entry->bus == bus && entry->phy == phy && entry->reg == reg && entry->page == page) {
+        mdio_cache_stats.hits++;
+        return entry->value;
+    }
+
+    mdio_cache_stats.misses++;
+
+    // Do not cache the pulled up bus of an absent PHY
+    if (!mdio_cache_read_bus(bus, phy, p, reg, &value))
+        return value;
+
+    *entry = (struct mdio_cache_entry) {
+        .valid = true,
+        .bus = bus,
+        .phy = phy,
+        .reg = reg,
+        .page = page,
+        .value = value,
+    };
+
+    return value;
+}
+
+void mdio_cache_write(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t data) {
+    struct mdio_cache_phy *p = mdio_cache_get_phy(bus, phy);
+
+    reg &= 0x1f;
+
+    if (p->page_reg && reg == p->page_reg) {
+        if (p->page_valid && p->page == data) {
+            mdio_cache_stats.page_writes_suppressed++;
+            return;
+        }
+
+        mdio_write(bus, phy, reg, data);
+        p->page = data;
+        p->page_valid = true;
+        return;
+    }
+
+    mdio_write(bus, phy, reg, data);
+
+    if (reg == MDIO_CACHE_REG_BMCR && (data & MDIO_CACHE_BMCR_RESET)) {
+        mdio_cache_invalidate(bus, phy);
+        return;
+    }
+
+    // Some "static" registers are writable, read them back from the PHY next time
+    if (p->static_regs & (1u << reg)) {
+        uint16_t page;
+        if (!mdio_cache_reg_page(bus, phy, p, reg, &page))
+            return;
+
+        struct mdio_cache_entry *entry = mdio_cache_slot(bus, phy, page, reg);
+        if (entry->bus == bus && entry->phy == phy && entry->reg == reg && entry->page == page)
+            entry->valid = false;
+    }
+}
+
+void mdio_cache_set_policy(uint8_t bus, uint8_t phy, uint8_t reg, bool is_static) {
+    struct mdio_cache_phy *p = mdio_cache_get_phy(bus, phy);
+
+    if (is_static) {
+        p->static_regs |= 1u << (reg & 0x1f);
+    } else {
+        p->static_regs &= ~(1u << (reg & 0x1f));
+        mdio_cache_invalidate(bus, phy);
+    }
+}
+
+void mdio_cache_set_page_register(uint8_t bus, uint8_t phy, uint8_t reg) {
+    struct mdio_cache_phy *p = mdio_cache_get_phy(bus, phy);
+
+    mdio_cache_invalidate(bus, phy);
+    p->page_reg = reg & 0x1f;
+    p->page_reg_known = true;
+}
+
+void mdio_cache_set_phy_id(uint8_t bus, uint8_t phy, uint32_t id) {
+    struct mdio_cache_phy *p = mdio_cache_get_phy(bus, phy);
+
+    p->static_regs |= MDIO_CACHE_PHY_STATIC;
+    mdio_cache_detect_page_reg(p, id >> 16);
+}
+
+void mdio_cache_invalidate(uint8_t bus, uint8_t phy) {
+    for (uint i = 0; i < MDIO_CACHE_ENTRIES; i++) {
+        struct mdio_cache_entry *entry = &mdio_cache_entries[i];
+
+        if (entry->bus == bus && entry->phy == phy)
+            entry->valid = false;
+    }
+
+    mdio_cache_get_phy(bus, phy)->page_valid = false;
+}
+
+void mdio_cache_invalidate_all(void) {
+    for (uint i = 0; i < MDIO_CACHE_ENTRIES; i++)
+        mdio_cache_entries[i].valid = false;
+
+    for (uint bus = 0; bus < MDIO_NUM_BUSES; bus++) {
+        for (uint phy = 0; phy < 32; phy++)
+            mdio_cache_phys[bus][phy].page_valid = false;
+    }
+}
+
+void mdio_cache_get_stats(struct mdio_cache_stats *stats) {
+    *stats = mdio_cache_stats;
+}
+
+void mdio_cache_reset_stats(void) {
+    mdio_cache_stats = (struct mdio_cache_stats) {0};
+}
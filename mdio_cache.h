@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef MDIO_CACHE_H_
+#define MDIO_CACHE_H_
+
+#include "mdio.h"
+
+// Shadow register file in front of the Clause 22 accesses of the host.
+//
+// Registers are cached per (bus, phy, page, reg) if their policy is static. Nothing is static by default, the
+// same register numbers mean something else on e.g. the global register sets of a switch. Addresses a scan
+// confirmed as 802.3 PHYs get the PHY ID registers 2/3 and the extended status register 15 as static, other
+// addresses only the registers the host marks static. Everything else is read from the bus every time.
+//
+// Writes to the page select register of a PHY are dropped if they write the value the register already has.
+// The page select register is found by the OUI (Marvell: 22, Realtek: 31) of a scan or of the first static
+// PHYSID1 read through the cache, or set explicitly. The cache does not read the PHY ID on its own. Until the
+// page select register is known only the PHY ID registers are cached.
+//
+// A BMCR reset invalidates everything known about the PHY. Batches bypass the cache and invalidate the PHYs they
+// write to. Other accesses that bypass the cache (Clause 45, SMI) must not change page select registers.
+
+// Number of cached registers over all buses and PHYs
+#define MDIO_CACHE_ENTRIES 256
+
+struct mdio_cache_stats {
+    uint32_t hits;             // Reads served from the cache
+    uint32_t misses;           // Reads of static registers that went to the bus
+    uint32_t page_writes_suppressed;
+};
+
+void mdio_cache_init(void);
+
+uint16_t mdio_cache_read(uint8_t bus, uint8_t phy, uint8_t reg);
+void mdio_cache_write(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t data);
+
+// Mark reg of a PHY as static (cached on all pages) or volatile (never cached)
+void mdio_cache_set_policy(uint8_t bus, uint8_t phy, uint8_t reg, bool is_static);
+// Override the page select register detection. 0 means the PHY has no pages.
+void mdio_cache_set_page_register(uint8_t bus, uint8_t phy, uint8_t reg);
+// PHY ID (register 2 << 16 | register 3) of an address a scan confirmed as 802.3 PHY. Makes the PHY registers
+// static and selects the page select register by its OUI.
+void mdio_cache_set_phy_id(uint8_t bus, uint8_t phy, uint32_t id);
+// Forget all cached registers and the current page of a PHY
+void mdio_cache_invalidate(uint8_t bus, uint8_t phy);
+void mdio_cache_invalidate_all(void);
+
+void mdio_cache_get_stats(struct mdio_cache_stats *stats);
+void mdio_cache_reset_stats(void);
+
+#endif
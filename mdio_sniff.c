@@ -0,0 +1,214 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/structs/timer.h"
+
+#include "mdio.h"
+#include "mdio_sniff.h"
+#include "mdio.pio.h"
+
+static_assert(MDIO_SNIFF_RING_ORDER + 3 <= 15, "the frame ring does not fit a DMA ring");
+
+// Written by DMA: the state machine words of every frame (bits, sequence number) and the timer after each frame.
+// Each ring is aligned to its size for the DMA address wrapping.
+static uint32_t mdio_sniff_ring[2 * MDIO_SNIFF_RING_FRAMES] __aligned(8 * MDIO_SNIFF_RING_FRAMES);
+static uint32_t mdio_sniff_times[MDIO_SNIFF_RING_FRAMES] __aligned(4 * MDIO_SNIFF_RING_FRAMES);
+
+static PIO mdio_sniff_pio;
+static uint mdio_sniff_sm;
+static uint mdio_sniff_offset;
+
+// Frame words -> frame ring, chains to the timer channel. Timer -> time ring, chains back.
+static uint mdio_sniff_dma_frame;
+static uint mdio_sniff_dma_time;
+
+static void (*mdio_sniff_available)(void);
+
+// Start and stop run on the MDIO core, the ring is drained on the other one
+static spin_lock_t *mdio_sniff_lock;
+static bool mdio_sniff_started; // The rings hold frames of a capture
+static uint8_t mdio_sniff_bus = MDIO_SNIFF_NO_BUS;
+static uint mdio_sniff_read_index;
+static uint32_t mdio_sniff_next_seq; // The state machine counts down from 0xffffffff
+static uint32_t mdio_sniff_frames;
+static uint32_t mdio_sniff_lost;
+
+/**
+ * @brief Ring index the next frame goes to. A frame is complete once its time is written.
+ */
+static uint mdio_sniff_write_index(void) {
+    uintptr_t offset = dma_channel_hw_addr(mdio_sniff_dma_time)->write_addr - (uintptr_t) mdio_sniff_times;
+
+    return (offset / sizeof(mdio_sniff_times[0])) % MDIO_SNIFF_RING_FRAMES;
+}
+
+static void mdio_sniff_irq_handler(void) {
+    if (!dma_channel_get_irq1_status(mdio_sniff_dma_time))
+        return;
+
+    // One interrupt per empty ring, mdio_sniff_read() arms it again
+    dma_channel_set_irq1_enabled(mdio_sniff_dma_time, false);
+    dma_channel_acknowledge_irq1(mdio_sniff_dma_time);
+
+    if (mdio_sniff_available)
+        mdio_sniff_available();
+}
+
+void mdio_sniff_init(void (*available)(void)) {
+    mdio_sniff_available = available;
+    mdio_sniff_lock = spin_lock_init(spin_lock_claim_unused(true));
+
+    // pio0 is taken by the MDIO masters, one state machine each
+    mdio_sniff_pio = pio1;
+    mdio_sniff_offset = pio_add_program(mdio_sniff_pio, &mdio_sniff_program);
+    mdio_sniff_sm = pio_claim_unused_sm(mdio_sniff_pio, true);
+
+    mdio_sniff_dma_frame = dma_claim_unused_channel(true);
+    mdio_sniff_dma_time = dma_claim_unused_channel(true);
+
+    irq_add_shared_handler(DMA_IRQ_1, mdio_sniff_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+}
+
+/**
+ * @brief Point both DMA channels at the start of the rings and arm the frame channel
+ */
+static void mdio_sniff_dma_start(void) {
+    dma_channel_config c = dma_channel_get_default_config(mdio_sniff_dma_frame);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, MDIO_SNIFF_RING_ORDER + 3);
+    channel_config_set_dreq(&c, pio_get_dreq(mdio_sniff_pio, mdio_sniff_sm, false));
+    channel_config_set_chain_to(&c, mdio_sniff_dma_time);
+    dma_channel_configure(mdio_sniff_dma_frame, &c, mdio_sniff_ring, &mdio_sniff_pio->rxf[mdio_sniff_sm], 2, false);
+
+    c = dma_channel_get_default_config(mdio_sniff_dma_time);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, true, MDIO_SNIFF_RING_ORDER + 2);
+    channel_config_set_chain_to(&c, mdio_sniff_dma_frame);
+    dma_channel_configure(mdio_sniff_dma_time, &c, mdio_sniff_times, &timer_hw->timerawl, 1, false);
+
+    dma_channel_start(mdio_sniff_dma_frame);
+}
+
+void mdio_sniff_start(uint8_t bus) {
+    uint mdc_pin;
+    uint mdio_pin;
+
+    mdio_sniff_stop();
+    mdio_set_passive(bus, true);
+    mdio_get_pins(bus, &mdc_pin, &mdio_pin);
+
+    uint32_t save = spin_lock_blocking(mdio_sniff_lock);
+
+    mdio_sniff_program_init(mdio_sniff_pio, mdio_sniff_sm, mdio_sniff_offset, mdc_pin, mdio_pin);
+    mdio_sniff_dma_start();
+    pio_sm_set_enabled(mdio_sniff_pio, mdio_sniff_sm, true);
+
+    mdio_sniff_started = true;
+    mdio_sniff_bus = bus;
+    mdio_sniff_read_index = 0;
+    mdio_sniff_next_seq = 0xffffffff;
+    mdio_sniff_frames = 0;
+    mdio_sniff_lost = 0;
+
+    spin_unlock(mdio_sniff_lock, save);
+}
+
+void mdio_sniff_stop(void) {
+    uint8_t bus = mdio_sniff_bus;
+
+    if (bus == MDIO_SNIFF_NO_BUS)
+        return;
+
+    uint32_t save = spin_lock_blocking(mdio_sniff_lock);
+
+    dma_channel_set_irq1_enabled(mdio_sniff_dma_time, false);
+    pio_sm_set_enabled(mdio_sniff_pio, mdio_sniff_sm, false);
+
+    // Aborting a channel may trigger the one it chains to, so unchain them first. A frame the channels were
+    // in the middle of never gets its time and is not read.
+    dma_channel_config c = dma_get_channel_config(mdio_sniff_dma_frame);
+    channel_config_set_chain_to(&c, mdio_sniff_dma_frame);
+    dma_channel_set_config(mdio_sniff_dma_frame, &c, false);
+    c = dma_get_channel_config(mdio_sniff_dma_time);
+    channel_config_set_chain_to(&c, mdio_sniff_dma_time);
+    dma_channel_set_config(mdio_sniff_dma_time, &c, false);
+
+    dma_channel_abort(mdio_sniff_dma_frame);
+    dma_channel_abort(mdio_sniff_dma_time);
+
+    mdio_sniff_bus = MDIO_SNIFF_NO_BUS;
+
+    spin_unlock(mdio_sniff_lock, save);
+
+    mdio_set_passive(bus, false);
+}
+
+uint mdio_sniff_read(struct mdio_sniff_frame *frames, uint max) {
+    uint count = 0;
+    uint32_t save = spin_lock_blocking(mdio_sniff_lock);
+
+    if (!mdio_sniff_started) {
+        spin_unlock(mdio_sniff_lock, save);
+        return 0;
+    }
+
+    for (;;) {
+        uint write_index = mdio_sniff_write_index();
+
+        // After the DMA lapped the reader these are the newest frames, the overwritten ones show up as a gap in
+        // the sequence numbers
+        while (count < max && mdio_sniff_read_index != write_index) {
+            uint i = mdio_sniff_read_index;
+            uint32_t seq = mdio_sniff_ring[2 * i + 1];
+
+            frames[count].bits = mdio_sniff_ring[2 * i];
+            frames[count].timestamp_us = mdio_sniff_times[i];
+            count++;
+
+            mdio_sniff_lost += mdio_sniff_next_seq - seq;
+            mdio_sniff_next_seq = seq - 1;
+            mdio_sniff_read_index = (i + 1) % MDIO_SNIFF_RING_FRAMES;
+        }
+
+        if (count || mdio_sniff_bus == MDIO_SNIFF_NO_BUS)
+            break;
+
+        // Empty: interrupt with the next frame
+        dma_channel_acknowledge_irq1(mdio_sniff_dma_time);
+        dma_channel_set_irq1_enabled(mdio_sniff_dma_time, true);
+
+        if (mdio_sniff_write_index() == write_index)
+            break;
+
+        // A frame arrived meanwhile, take it now
+        dma_channel_set_irq1_enabled(mdio_sniff_dma_time, false);
+    }
+    mdio_sniff_frames += count;
+
+    spin_unlock(mdio_sniff_lock, save);
+    return count;
+}
+
+void mdio_sniff_get_status(struct mdio_sniff_status *status) {
+    uint32_t save = spin_lock_blocking(mdio_sniff_lock);
+
+    status->bus = mdio_sniff_bus;
+    status->frames = mdio_sniff_frames;
+    status->lost = mdio_sniff_lost;
+
+    spin_unlock(mdio_sniff_lock, save);
+}
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef MDIO_SNIFF_H_
+#define MDIO_SNIFF_H_
+
+#include "pico/stdlib.h"
+
+// Passive sniffer for buses where another station (e.g. the MAC of an SoC) is the master. The bus is switched
+// to inputs with mdio_set_passive() and a state machine on pio1 decodes the Clause 22 and Clause 45 frames on it.
+// Two chained DMA channels copy every frame into a ring and its timer value into a second ring, so frames are
+// captured without the CPU even while both cores are busy. The ring is drained on the core that called
+// mdio_sniff_init().
+//
+// A fully loaded bus (2.5 MHz, no preamble, one idle bit) has about 76000 frames/s, the ring bridges ~13 ms of
+// a consumer that does not keep up. Frames that do not fit are counted as lost, nothing is silently dropped.
+
+// Frames in the ring, as a power of 2. The frame ring (8 bytes per frame) must fit a DMA ring (max. 32 KB).
+#ifndef MDIO_SNIFF_RING_ORDER
+#define MDIO_SNIFF_RING_ORDER 10
+#endif
+#define MDIO_SNIFF_RING_FRAMES (1u << MDIO_SNIFF_RING_ORDER)
+
+// No bus is sniffed
+#define MDIO_SNIFF_NO_BUS 0xff
+
+struct mdio_sniff_frame {
+    uint32_t timestamp_us; // time_us_32() right after the last bit
+    uint32_t bits;         // The 32 bits following the preamble: ST, OP, PHYAD, REGAD, TA, data. MSB first.
+};
+
+struct mdio_sniff_status {
+    uint8_t bus;     // MDIO_SNIFF_NO_BUS if stopped
+    uint32_t frames; // Taken from the ring since the start
+    uint32_t lost;   // Dropped by the state machine or overwritten in the ring since the start
+};
+
+// Claims the state machine and the DMA channels. available is called from DMA_IRQ_1 on the calling core when a
+// frame arrives after mdio_sniff_read() found the ring empty.
+void mdio_sniff_init(void (*available)(void));
+
+// Sniff a bus, stopping the sniffer on another bus first. Call on the core doing MDIO.
+void mdio_sniff_start(uint8_t bus);
+// Hand the bus back to the MDIO master. Frames still in the ring can be read until the next start.
+void mdio_sniff_stop(void);
+
+// Take up to max of the oldest frames from the ring. Returns the number of frames. Call on the core that called
+// mdio_sniff_init().
+uint mdio_sniff_read(struct mdio_sniff_frame *frames, uint max);
+
+void mdio_sniff_get_status(struct mdio_sniff_status *status);
+
+#endif
@@ -0,0 +1,232 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "pico/stdlib.h"
+
+#include "mdio_vm.h"
+
+// Instruction length including the opcode, 0 for unknown opcodes
+static const uint8_t mdio_vm_instruction_len[] = {
+    [USB_MDIO_PROG_END] = 1,
+    [USB_MDIO_PROG_READ] = 4,
+    [USB_MDIO_PROG_WRITE] = 5,
+    [USB_MDIO_PROG_WRITE_REG] = 4,
+    [USB_MDIO_PROG_MODIFY] = 7,
+    [USB_MDIO_PROG_POLL] = 13,
+    [USB_MDIO_PROG_C45_READ] = 6,
+    [USB_MDIO_PROG_C45_WRITE] = 7,
+    [USB_MDIO_PROG_DELAY] = 5,
+    [USB_MDIO_PROG_SET] = 4,
+    [USB_MDIO_PROG_MOV] = 3,
+    [USB_MDIO_PROG_ADD] = 4,
+    [USB_MDIO_PROG_AND] = 4,
+    [USB_MDIO_PROG_OR] = 4,
+    [USB_MDIO_PROG_TEST] = 6,
+    [USB_MDIO_PROG_JMP] = 3,
+    [USB_MDIO_PROG_JMP_IF] = 3,
+    [USB_MDIO_PROG_JMP_IFNOT] = 3,
+    [USB_MDIO_PROG_LOOP] = 4,
+    [USB_MDIO_PROG_EMIT] = 2,
+    [USB_MDIO_PROG_BUS] = 2,
+    [USB_MDIO_PROG_FAIL] = 2,
+};
+
+static inline uint16_t get_le16(const uint8_t *buf) {
+    return buf[1] << 8 | buf[0];
+}
+
+static inline uint32_t get_le32(const uint8_t *buf) {
+    return (uint32_t) get_le16(&buf[2]) << 16 | get_le16(&buf[0]);
+}
+
+/**
+ * @brief Decode an address operand, either an immediate or a register holding the address.
+ *
+ * @return false if the register number or the address in the register is out of range
+ */
+static bool mdio_vm_addr(const struct mdio_vm *vm, uint8_t operand, uint8_t *addr) {
+    if (!(operand & USB_MDIO_PROG_ADDR_REG)) {
+        *addr = operand;
+        return operand < 32;
+    }
+
+    uint8_t reg = operand & ~USB_MDIO_PROG_ADDR_REG;
+    if (reg >= MDIO_VM_REGS || vm->regs[reg] >= 32)
+        return false;
+
+    *addr = vm->regs[reg];
+    return true;
+}
+
+void mdio_vm_init(struct mdio_vm *vm, const uint8_t *code, uint16_t len, uint8_t bus) {
+    *vm = (struct mdio_vm) {
+        .code = code,
+        .len = len,
+        .bus = bus,
+    };
+}
+
+uint8_t mdio_vm_run(struct mdio_vm *vm, const struct mdio_vm_ops *ops, uint32_t timeout_us) {
+    uint32_t start = time_us_32();
+
+    for (;;) {
+        uint32_t elapsed = time_us_32() - start;
+        if (elapsed >= timeout_us)
+            return USB_MDIO_STATUS_TIMEOUT;
+
+        // Programs stop with END, running off the end is an error
+        if (vm->pc >= vm->len)
+            return USB_MDIO_STATUS_INVALID;
+
+        const uint8_t *ins = &vm->code[vm->pc];
+        uint8_t len = ins[0] < count_of(mdio_vm_instruction_len) ? mdio_vm_instruction_len[ins[0]] : 0;
+        if (!len || vm->pc + len > vm->len)
+            return USB_MDIO_STATUS_INVALID;
+
+        uint16_t next = vm->pc + len;
+        uint8_t phy, reg;
+        bool valid = true;
+
+        switch (ins[0]) {
+            case USB_MDIO_PROG_END:
+                return USB_MDIO_STATUS_OK;
+
+            case USB_MDIO_PROG_READ:
+                valid = ins[1] < MDIO_VM_REGS && mdio_vm_addr(vm, ins[2], &phy) && mdio_vm_addr(vm, ins[3], &reg);
+                if (valid)
+                    vm->regs[ins[1]] = ops->pull_request(vm->bus, phy, reg);
+                break;
+
+            case USB_MDIO_PROG_WRITE:
+                valid = mdio_vm_addr(vm, ins[1], &phy) && mdio_vm_addr(vm, ins[2], &reg);
+                if (valid)
+                    ops->push_request(vm->bus, phy, reg, get_le16(&ins[3]));
+                break;
+
+            case USB_MDIO_PROG_WRITE_REG:
+                valid = mdio_vm_addr(vm, ins[1], &phy) && mdio_vm_addr(vm, ins[2], &reg) && ins[3] < MDIO_VM_REGS;
+                if (valid)
+                    ops->push_request(vm->bus, phy, reg, vm->regs[ins[3]]);
+                break;
+
+            case USB_MDIO_PROG_MODIFY: {
+                uint16_t mask = get_le16(&ins[3]);
+
+                valid = mdio_vm_addr(vm, ins[1], &phy) && mdio_vm_addr(vm, ins[2], &reg);
+                if (valid) {
+                    uint16_t reg_val = ops->pull_request(vm->bus, phy, reg);
+                    ops->push_request(vm->bus, phy, reg, (reg_val & ~mask) | (get_le16(&ins[5]) & mask));
+                }
+                break;
+            }
+
+            case USB_MDIO_PROG_POLL: {
+                struct mdio_poll_result result;
+
+                // A poll never runs past the end of the run time
+                valid = mdio_vm_addr(vm, ins[1], &phy) && mdio_vm_addr(vm, ins[2], &reg);
+                if (valid)
+                    vm->flag = ops->poll_request(vm->bus, phy, reg, get_le16(&ins[3]), get_le16(&ins[5]),
+                                                 get_le16(&ins[7]), MIN(get_le32(&ins[9]), timeout_us - elapsed),
+                                                 &result);
+                break;
+            }
+
+            case USB_MDIO_PROG_C45_READ:
+                valid = ins[1] < MDIO_VM_REGS && mdio_vm_addr(vm, ins[2], &phy) && ins[3] < 32;
+                if (valid)
+                    vm->regs[ins[1]] = ops->c45_pull_request(vm->bus, phy, ins[3], get_le16(&ins[4]));
+                break;
+
+            case USB_MDIO_PROG_C45_WRITE:
+                valid = mdio_vm_addr(vm, ins[1], &phy) && ins[2] < 32;
+                if (valid)
+                    ops->c45_push_request(vm->bus, phy, ins[2], get_le16(&ins[3]), get_le16(&ins[5]));
+                break;
+
+            case USB_MDIO_PROG_DELAY: {
+                uint32_t delay_us = get_le32(&ins[1]);
+
+                // Stop at the delay instead of sleeping through the end of the run time
+                if (delay_us >= timeout_us - elapsed)
+                    return USB_MDIO_STATUS_TIMEOUT;
+                busy_wait_us_32(delay_us);
+                break;
+            }
+
+            case USB_MDIO_PROG_SET:
+            case USB_MDIO_PROG_ADD:
+            case USB_MDIO_PROG_AND:
+            case USB_MDIO_PROG_OR: {
+                uint16_t imm = get_le16(&ins[2]);
+
+                valid = ins[1] < MDIO_VM_REGS;
+                if (!valid)
+                    break;
+
+                uint16_t *rd = &vm->regs[ins[1]];
+                if (ins[0] == USB_MDIO_PROG_SET)
+                    *rd = imm;
+                else if (ins[0] == USB_MDIO_PROG_ADD)
+                    *rd += imm;
+                else if (ins[0] == USB_MDIO_PROG_AND)
+                    *rd &= imm;
+                else
+                    *rd |= imm;
+                break;
+            }
+
+            case USB_MDIO_PROG_MOV:
+                valid = ins[1] < MDIO_VM_REGS && ins[2] < MDIO_VM_REGS;
+                if (valid)
+                    vm->regs[ins[1]] = vm->regs[ins[2]];
+                break;
+
+            case USB_MDIO_PROG_TEST: {
+                uint16_t mask = get_le16(&ins[2]);
+
+                valid = ins[1] < MDIO_VM_REGS;
+                if (valid)
+                    vm->flag = (vm->regs[ins[1]] & mask) == (get_le16(&ins[4]) & mask);
+                break;
+            }
+
+            case USB_MDIO_PROG_JMP:
+            case USB_MDIO_PROG_JMP_IF:
+            case USB_MDIO_PROG_JMP_IFNOT:
+                if (ins[0] == USB_MDIO_PROG_JMP || vm->flag == (ins[0] == USB_MDIO_PROG_JMP_IF))
+                    next = get_le16(&ins[1]);
+                break;
+
+            case USB_MDIO_PROG_LOOP:
+                valid = ins[1] < MDIO_VM_REGS;
+                if (valid && --vm->regs[ins[1]])
+                    next = get_le16(&ins[2]);
+                break;
+
+            case USB_MDIO_PROG_EMIT:
+                valid = ins[1] < MDIO_VM_REGS;
+                if (valid)
+                    ops->emit(ops->context, vm->pc, vm->regs[ins[1]]);
+                break;
+
+            case USB_MDIO_PROG_BUS:
+                valid = ins[1] < MDIO_NUM_BUSES;
+                if (valid)
+                    vm->bus = ins[1];
+                break;
+
+            case USB_MDIO_PROG_FAIL:
+                return ins[1];
+        }
+
+        if (!valid)
+            return USB_MDIO_STATUS_INVALID;
+
+        vm->pc = next;
+    }
+}
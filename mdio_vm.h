@@ -0,0 +1,50 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef MDIO_VM_H_
+#define MDIO_VM_H_
+
+#include "mdio.h"
+#include "usb_mdio_protocol.h"
+
+// Interpreter of the MDIO microprograms (USB_MDIO_PROG_* in usb_mdio_protocol.h). A program runs on the
+// device from start to end, so read-modify-write sequences, busy polling and errata workarounds cost one
+// USB round trip instead of one per register access.
+
+#define MDIO_VM_REGS USB_MDIO_PROG_REGS
+
+// The MDIO operations used by the programs. Same meaning as the usb_mdio_callbacks of the same name.
+struct mdio_vm_ops {
+    uint16_t (*pull_request)(uint8_t bus, uint8_t dev, uint8_t reg);
+    void (*push_request)(uint8_t bus, uint8_t dev, uint8_t reg, uint16_t reg_val);
+    uint16_t (*c45_pull_request)(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg);
+    void (*c45_push_request)(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t reg_val);
+    bool (*poll_request)(uint8_t bus, uint8_t dev, uint8_t reg, uint16_t mask, uint16_t expected,
+                         uint32_t interval_us, uint32_t timeout_us, struct mdio_poll_result *result);
+
+    // Called for every EMIT instruction with the program counter of the instruction
+    void (*emit)(void *context, uint16_t pc, uint16_t value);
+    void *context;
+};
+
+struct mdio_vm {
+    const uint8_t *code;
+    uint16_t len;
+    uint16_t pc;
+    uint8_t bus;
+    bool flag;
+    uint16_t regs[MDIO_VM_REGS];
+};
+
+// Prepare a run of a program. All registers and the flag start cleared.
+void mdio_vm_init(struct mdio_vm *vm, const uint8_t *code, uint16_t len, uint8_t bus);
+
+// Run until END, FAIL, an invalid instruction or until timeout_us passed. Returns the status of the run
+// (USB_MDIO_STATUS_*), vm->pc is the instruction the program stopped at.
+uint8_t mdio_vm_run(struct mdio_vm *vm, const struct mdio_vm_ops *ops, uint32_t timeout_us);
+
+#endif
@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include "pico/stdlib.h"
+
+#include "mdio_watch.h"
+
+struct mdio_watch_entry {
+    uint8_t bus;
+    uint8_t phy;
+    uint8_t reg;
+    uint16_t mask;
+    uint16_t last;
+    bool reported;
+};
+
+// One batch per bus so all buses are polled at the same time
+struct mdio_watch_bus {
+    struct mdio_batch batch;
+    uint32_t words[MDIO_WATCH_MAX_ENTRIES * MDIO_MAX_FRAME_WORDS];
+    uint32_t results[MDIO_WATCH_MAX_ENTRIES];
+    uint8_t frame_entry[MDIO_WATCH_MAX_ENTRIES]; // Watch entry of every frame of the batch
+    uint next_entry;                             // Entry the next round starts with
+};
+
+static struct mdio_watch_entry mdio_watch_entries[MDIO_WATCH_MAX_ENTRIES];
+static volatile uint mdio_watch_num_entries;
+static struct mdio_watch_bus mdio_watch_buses[MDIO_NUM_BUSES];
+
+static mdio_watch_notify mdio_watch_notify_callback;
+static uint32_t mdio_watch_interval_us = MDIO_WATCH_DEFAULT_INTERVAL_US;
+static absolute_time_t mdio_watch_next_round;
+
+/**
+ * @brief Batch done (DMA interrupt). Report the entries whose masked value changed.
+ */
+static void mdio_watch_batch_done(struct mdio_batch *batch) {
+    struct mdio_watch_bus *wb = &mdio_watch_buses[batch->bus];
+    uint32_t now = time_us_32();
+
+    for (uint frame = 0; frame < batch->num_frames; frame++) {
+        uint8_t index = wb->frame_entry[frame];
+
+        // The list was cleared while the batch was running
+        if (index >= mdio_watch_num_entries)
+            continue;
+
+        struct mdio_watch_entry *entry = &mdio_watch_entries[index];
+        uint16_t value = mdio_batch_result(batch, frame) & entry->mask;
+
+        if (entry->reported && entry->last == value)
+            continue;
+
+        entry->last = value;
+        entry->reported = true;
+
+        if (mdio_watch_notify_callback)
+            mdio_watch_notify_callback(index, entry->bus, value, now);
+    }
+}
+
+/**
+ * @brief Queue one read of every entry of a bus. If the batch runs out of timing profile segments the
+ * remaining entries are read first in the next round.
+ */
+static void mdio_watch_poll_bus(uint8_t bus) {
+    struct mdio_watch_bus *wb = &mdio_watch_buses[bus];
+    uint count = mdio_watch_num_entries;
+
+    // Still busy with the previous round or with a batch of somebody else. Passive buses are only listened to.
+    if (count == 0 || mdio_batch_busy(bus) || mdio_get_passive(bus))
+        return;
+
+    mdio_batch_init(&wb->batch, bus, wb->words, count_of(wb->words), wb->results, count_of(wb->results));
+
+    uint start = wb->next_entry % count;
+    for (uint k = 0; k < count; k++) {
+        uint i = (start + k) % count;
+        struct mdio_watch_entry *entry = &mdio_watch_entries[i];
+
+        if (entry->bus != bus)
+            continue;
+
+        wb->frame_entry[wb->batch.num_frames] = i;
+        if (!mdio_batch_add_read(&wb->batch, entry->phy, entry->reg)) {
+            wb->next_entry = i;
+            break;
+        }
+    }
+
+    if (wb->batch.num_frames)
+        mdio_batch_start(&wb->batch, mdio_watch_batch_done);
+}
+
+void mdio_watch_task(void) {
+    if (mdio_watch_interval_us == 0 || mdio_watch_num_entries == 0)
+        return;
+
+    absolute_time_t now = get_absolute_time();
+    if (absolute_time_diff_us(now, mdio_watch_next_round) > 0)
+        return;
+
+    // Fixed rate independent of how long a round takes. Rounds missed while commands were executed are
+    // skipped instead of being caught up back to back.
+    mdio_watch_next_round = delayed_by_us(mdio_watch_next_round, mdio_watch_interval_us);
+    if (absolute_time_diff_us(now, mdio_watch_next_round) <= 0)
+        mdio_watch_next_round = delayed_by_us(now, mdio_watch_interval_us);
+
+    for (uint8_t bus = 0; bus < MDIO_NUM_BUSES; bus++)
+        mdio_watch_poll_bus(bus);
+}
+
+void mdio_watch_init(mdio_watch_notify notify) {
+    mdio_watch_notify_callback = notify;
+    mdio_watch_num_entries = 0;
+}
+
+int mdio_watch_add(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t mask) {
+    if (mdio_watch_num_entries == MDIO_WATCH_MAX_ENTRIES || bus >= MDIO_NUM_BUSES)
+        return -1;
+
+    uint index = mdio_watch_num_entries;
+    mdio_watch_entries[index] = (struct mdio_watch_entry) {
+        .bus = bus,
+        .phy = phy,
+        .reg = reg,
+        .mask = mask,
+    };
+    mdio_watch_num_entries = index + 1;
+
+    // First entry: poll right away
+    if (index == 0)
+        mdio_watch_next_round = get_absolute_time();
+
+    return index;
+}
+
+void mdio_watch_clear(void) {
+    mdio_watch_num_entries = 0;
+
+    // A round might still be in flight, its results refer to the old entries
+    for (uint8_t bus = 0; bus < MDIO_NUM_BUSES; bus++) {
+        mdio_batch_wait(bus);
+        mdio_watch_buses[bus].next_entry = 0;
+    }
+}
+
+uint mdio_watch_count(void) {
+    return mdio_watch_num_entries;
+}
+
+void mdio_watch_set_interval(uint32_t interval_us) {
+    mdio_watch_interval_us = interval_us;
+    mdio_watch_next_round = get_absolute_time();
+}
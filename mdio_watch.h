@@ -0,0 +1,36 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef MDIO_WATCH_H_
+#define MDIO_WATCH_H_
+
+#include "mdio.h"
+
+// Registers polled in the background by mdio_watch_task(). Every interval all entries are read with one DMA batch per bus and
+// the notify callback is called for every entry whose masked value changed. The first read of an entry is
+// always reported. Reads are plain Clause 22 reads on whatever page the PHY is on.
+
+#define MDIO_WATCH_MAX_ENTRIES 32
+#define MDIO_WATCH_DEFAULT_INTERVAL_US 10000
+
+// Called from interrupt context on the core running mdio_watch_task() with the masked value of a watch entry
+typedef void (*mdio_watch_notify)(uint8_t index, uint8_t bus, uint16_t value, uint32_t timestamp_us);
+
+void mdio_watch_init(mdio_watch_notify notify);
+
+// Returns the index of the new entry or -1 if the list is full
+int mdio_watch_add(uint8_t bus, uint8_t phy, uint8_t reg, uint16_t mask);
+void mdio_watch_clear(void);
+uint mdio_watch_count(void);
+
+// Poll interval of the whole list. 0 stops polling.
+void mdio_watch_set_interval(uint32_t interval_us);
+
+// Start the next round once the interval has passed. Call in a loop on the core doing MDIO.
+void mdio_watch_task(void);
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "perf.h"
+
+static volatile uint32_t perf_counters[PERF_NUM_COUNTERS];
+static volatile uint32_t perf_histograms[PERF_NUM_HISTOGRAMS][PERF_HIST_BUCKETS];
+
+// Both cores and their interrupts update the same counters
+static spin_lock_t *perf_lock;
+
+static inline uint32_t perf_lock_blocking(void) {
+    return spin_lock_blocking(perf_lock);
+}
+
+static inline uint perf_bucket(uint32_t us) {
+    // Number of significant bits: 0 -> 0, 1 -> 1, 2..3 -> 2, ...
+    uint bucket = us ? 32 - __builtin_clz(us) : 0;
+    return MIN(bucket, PERF_HIST_BUCKETS - 1);
+}
+
+void perf_init(void) {
+    perf_lock = spin_lock_init(spin_lock_claim_unused(true));
+}
+
+void perf_add(enum perf_counter counter, uint32_t n) {
+    uint32_t save = perf_lock_blocking();
+    perf_counters[counter] += n;
+    spin_unlock(perf_lock, save);
+}
+
+void perf_histogram_add(enum perf_histogram histogram, uint32_t us) {
+    uint32_t save = perf_lock_blocking();
+    perf_histograms[histogram][perf_bucket(us)]++;
+    spin_unlock(perf_lock, save);
+}
+
+uint32_t perf_get(enum perf_counter counter) {
+    return perf_counters[counter];
+}
+
+void perf_get_histogram(enum perf_histogram histogram, uint32_t *buckets) {
+    uint32_t save = perf_lock_blocking();
+    for (uint i = 0; i < PERF_HIST_BUCKETS; i++)
+        buckets[i] = perf_histograms[histogram][i];
+    spin_unlock(perf_lock, save);
+}
+
+void perf_reset(void) {
+    uint32_t save = perf_lock_blocking();
+    memset((void *) perf_counters, 0, sizeof(perf_counters));
+    memset((void *) perf_histograms, 0, sizeof(perf_histograms));
+    spin_unlock(perf_lock, save);
+}
@@ -0,0 +1,48 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef PERF_H_
+#define PERF_H_
+
+#include "pico/stdlib.h"
+
+// Performance counters and latency histograms, read by the host with EP0 vendor requests (see
+// usb_mdio_protocol.h). Updates are safe from any context on both cores.
+
+enum perf_counter {
+    PERF_MDIO_READS,         // Register reads requested by the host (cache hits included)
+    PERF_MDIO_WRITES,        // Register writes requested by the host
+    PERF_MDIO_FRAMES,        // Frames on the wire, all buses (C45 address frames, SMI polling and batches included)
+    PERF_BUS_BUSY_US,        // Time spent on the wire, all buses
+    PERF_USB_COMMANDS,       // EP2 packets
+    PERF_USB_BYTES_OUT,      // EP2 payload
+    PERF_USB_BYTES_IN,       // EP6 payload
+    PERF_USB_WINDOW_FULL_US, // Time the command window was full and EP2 NAKed the host
+    PERF_USB_STALLS,         // Control requests answered with a STALL (unknown or wrong direction)
+    PERF_NUM_COUNTERS
+};
+
+enum perf_histogram {
+    PERF_HIST_COMMAND_LATENCY, // EP2 arrival to the response being queued on EP6, in us
+    PERF_HIST_FRAME_TIME,      // Single MDIO frame on the wire, in us
+    PERF_NUM_HISTOGRAMS
+};
+
+// Bucket 0 counts 0 us, bucket n counts [2^(n-1), 2^n) us, the last bucket everything above
+#define PERF_HIST_BUCKETS 16
+
+// Call before anything else, before core1 is started
+void perf_init(void);
+
+void perf_add(enum perf_counter counter, uint32_t n);
+void perf_histogram_add(enum perf_histogram histogram, uint32_t us);
+
+uint32_t perf_get(enum perf_counter counter);
+void perf_get_histogram(enum perf_histogram histogram, uint32_t *buckets);
+void perf_reset(void);
+
+#endif
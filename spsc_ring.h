@@ -0,0 +1,75 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+// Lock-free single producer / single consumer ring of USB packet sized slots, used to pass packets between
+// the cores. The producer fills the slot returned by spsc_ring_produce() in place and publishes it with
+// spsc_ring_produce_commit(). The consumer does the same with spsc_ring_consume()/spsc_ring_consume_commit().
+// Head is only written by the producer and tail only by the consumer, so no locks are needed.
+
+#define SPSC_RING_SLOTS 16 // Power of 2
+#define SPSC_RING_SLOT_SIZE 64
+
+struct spsc_ring_slot {
+    uint32_t timestamp_us; // Arrival of the command the packet belongs to
+    uint16_t len;
+    uint8_t data[SPSC_RING_SLOT_SIZE];
+};
+
+struct spsc_ring {
+    volatile uint32_t head; // Next slot to produce
+    volatile uint32_t tail; // Next slot to consume
+    struct spsc_ring_slot slots[SPSC_RING_SLOTS];
+};
+
+static inline bool spsc_ring_empty(const struct spsc_ring *ring) {
+    return ring->head == ring->tail;
+}
+
+static inline bool spsc_ring_full(const struct spsc_ring *ring) {
+    return ring->head - ring->tail == SPSC_RING_SLOTS;
+}
+
+static inline uint32_t spsc_ring_free(const struct spsc_ring *ring) {
+    return SPSC_RING_SLOTS - (ring->head - ring->tail);
+}
+
+// Returns the next free slot or NULL if the ring is full
+static inline struct spsc_ring_slot *spsc_ring_produce(struct spsc_ring *ring) {
+    if (spsc_ring_full(ring))
+        return NULL;
+
+    return &ring->slots[ring->head % SPSC_RING_SLOTS];
+}
+
+static inline void spsc_ring_produce_commit(struct spsc_ring *ring) {
+    // The slot contents must be visible to the other core before the new head
+    __dmb();
+    ring->head = ring->head + 1;
+}
+
+// Returns the oldest filled slot or NULL if the ring is empty
+static inline struct spsc_ring_slot *spsc_ring_consume(struct spsc_ring *ring) {
+    if (spsc_ring_empty(ring))
+        return NULL;
+
+    __dmb();
+    return &ring->slots[ring->tail % SPSC_RING_SLOTS];
+}
+
+static inline void spsc_ring_consume_commit(struct spsc_ring *ring) {
+    // Done reading the slot before it is handed back to the producer
+    __dmb();
+    ring->tail = ring->tail + 1;
+}
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <assert.h>
+
+#include "pico/stdlib.h"
+#include "pico/stdio.h"
+#include "pico/stdio/driver.h"
+#include "hardware/sync.h"
+
+#include "telemetry.h"
+
+static_assert((TELEMETRY_BUFFER_SIZE & (TELEMETRY_BUFFER_SIZE - 1)) == 0, "TELEMETRY_BUFFER_SIZE must be a power of 2");
+
+// Both cores write, so the ring is guarded by a spin lock. It is only held for the copy.
+static spin_lock_t *telemetry_lock;
+static volatile uint32_t telemetry_head;
+static volatile uint32_t telemetry_tail;
+static volatile uint32_t telemetry_dropped_bytes;
+static uint8_t telemetry_buffer[TELEMETRY_BUFFER_SIZE];
+
+static void telemetry_out_chars(const char *buf, int len) {
+    telemetry_write(buf, len);
+}
+
+static stdio_driver_t telemetry_stdio = {
+    .out_chars = telemetry_out_chars,
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+    .crlf_enabled = PICO_STDIO_DEFAULT_CRLF,
+#endif
+};
+
+void telemetry_init(void) {
+    telemetry_lock = spin_lock_init(spin_lock_claim_unused(true));
+    stdio_set_driver_enabled(&telemetry_stdio, true);
+}
+
+void telemetry_write(const void *data, uint len) {
+    const uint8_t *bytes = data;
+    uint32_t save = spin_lock_blocking(telemetry_lock);
+    uint32_t dropped = 0;
+
+    // Only the end of a write larger than the ring is kept
+    if (len > TELEMETRY_BUFFER_SIZE) {
+        dropped = len - TELEMETRY_BUFFER_SIZE;
+        bytes += dropped;
+        len = TELEMETRY_BUFFER_SIZE;
+    }
+
+    // Newest wins: advance the tail past the bytes that need to go, up to the start of the next line
+    uint32_t free = TELEMETRY_BUFFER_SIZE - (telemetry_head - telemetry_tail);
+    if (len > free) {
+        uint32_t tail = telemetry_tail + len - free;
+
+        while (tail != telemetry_head && telemetry_buffer[(tail - 1) % TELEMETRY_BUFFER_SIZE] != '\n')
+            tail++;
+        dropped += tail - telemetry_tail;
+        telemetry_tail = tail;
+    }
+
+    for (uint i = 0; i < len; i++)
+        telemetry_buffer[(telemetry_head + i) % TELEMETRY_BUFFER_SIZE] = bytes[i];
+    telemetry_head += len;
+    telemetry_dropped_bytes += dropped;
+
+    spin_unlock(telemetry_lock, save);
+}
+
+uint telemetry_read(uint8_t *data, uint max) {
+    uint32_t save = spin_lock_blocking(telemetry_lock);
+    uint count = MIN(max, telemetry_head - telemetry_tail);
+
+    for (uint i = 0; i < count; i++)
+        data[i] = telemetry_buffer[(telemetry_tail + i) % TELEMETRY_BUFFER_SIZE];
+    telemetry_tail += count;
+
+    spin_unlock(telemetry_lock, save);
+    return count;
+}
+
+bool telemetry_empty(void) {
+    return telemetry_head == telemetry_tail;
+}
+
+uint32_t telemetry_dropped(void) {
+    return telemetry_dropped_bytes;
+}
@@ -0,0 +1,41 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include "pico/stdlib.h"
+
+// Byte stream to the CDC-ACM interface of the adapter: logs (stdout) and binary telemetry. Writers only copy
+// into a ring and never wait for USB. If the ring is full the oldest lines make room and are counted, so a host
+// that opens the interface late gets the recent log instead of the one from startup. Any core and any context
+// may write. The ring is drained into the bulk IN endpoint on core0 (see usb_telemetry_task()).
+
+// Composite device with a CDC-ACM interface next to the vendor interface, printf() goes there instead of the
+// UART. Set to 0 for the plain mvusb device and logs on the UART.
+#ifndef USB_MDIO_CDC_ACM
+#define USB_MDIO_CDC_ACM 1
+#endif
+
+#define TELEMETRY_BUFFER_SIZE 4096 // Power of 2
+
+// Claim the lock of the ring and make it the stdout of printf()
+void telemetry_init(void);
+
+// Copy len bytes into the ring, dropping whole lines from the oldest end as needed
+void telemetry_write(const void *data, uint len);
+
+// Take up to max of the oldest bytes from the ring. Returns the number of bytes.
+uint telemetry_read(uint8_t *data, uint max);
+
+// Without the lock, for polling
+bool telemetry_empty(void);
+
+// Bytes dropped to make room for newer ones
+uint32_t telemetry_dropped(void);
+
+#endif
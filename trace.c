@@ -0,0 +1,209 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#include "trace.h"
+
+#if TRACE_ENABLE
+
+// Dropped records are reported in one line for all cores, at most this often
+#define TRACE_DROP_REPORT_MS 1000
+
+static_assert((TRACE_RING_RECORDS & (TRACE_RING_RECORDS - 1)) == 0, "TRACE_RING_RECORDS must be a power of 2");
+
+// One ring per core. Only the owning core produces, so masking its interrupts is enough to serialize the
+// producers. trace_task() is the only consumer.
+struct trace_ring {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t dropped;
+    struct trace_record records[TRACE_RING_RECORDS];
+};
+
+static struct trace_ring trace_rings[NUM_CORES];
+static uint32_t trace_reported_dropped;
+static uint32_t trace_drop_report_us;
+
+void trace_record(uint8_t event, uint8_t bus, uint8_t phy, uint8_t dev, uint16_t reg, uint16_t value,
+                  uint32_t latency_us) {
+    struct trace_ring *ring = &trace_rings[get_core_num()];
+    uint32_t save = save_and_disable_interrupts();
+
+    if (ring->head - ring->tail == TRACE_RING_RECORDS) {
+        ring->dropped = ring->dropped + 1;
+    } else {
+        ring->records[ring->head % TRACE_RING_RECORDS] = (struct trace_record) {
+            .timestamp_us = time_us_32(),
+            .event = event,
+            .bus = bus,
+            .phy = phy,
+            .dev = dev,
+            .reg = reg,
+            .value = value,
+            .latency_us = latency_us,
+        };
+
+        // The record must be visible to the other core before the new head
+        __dmb();
+        ring->head = ring->head + 1;
+    }
+
+    restore_interrupts(save);
+}
+
+/**
+ * @brief Format one record in the style of the former printf() lines
+ */
+static void trace_print(uint core, const struct trace_record *r) {
+    const char *failed = (r->event & TRACE_FAILED) ? " failed" : "";
+
+    printf("[%10u %u] ", (uint) r->timestamp_us, core);
+
+    switch (r->event & ~TRACE_FAILED) {
+        case TRACE_MDIO_READ:
+            printf("MDIO read - bus: %i dev: %i reg: %i reg_val: 0x%x", r->bus, r->phy, r->reg, r->value);
+            break;
+        case TRACE_MDIO_WRITE:
+            printf("MDIO write - bus: %i dev: %i reg: %i reg_val: 0x%x", r->bus, r->phy, r->reg, r->value);
+            break;
+        case TRACE_MDIO_BATCH:
+            printf("MDIO batch - bus: %i commands: %i reads: %i", r->bus, r->reg, r->value);
+            break;
+        case TRACE_MDIO_C45_READ:
+            printf("MDIO C45 read - bus: %i port: %i devad: %i reg: 0x%x reg_val: 0x%x", r->bus, r->phy, r->dev,
+                   r->reg, r->value);
+            break;
+        case TRACE_MDIO_C45_WRITE:
+            printf("MDIO C45 write - bus: %i port: %i devad: %i reg: 0x%x reg_val: 0x%x", r->bus, r->phy, r->dev,
+                   r->reg, r->value);
+            break;
+        case TRACE_MDIO_C45_RANGE:
+            printf("MDIO C45 range read - bus: %i port: %i devad: %i reg: 0x%x count: %i", r->bus, r->phy, r->dev,
+                   r->reg, r->value);
+            break;
+        case TRACE_MDIO_SMI_READ:
+            printf("MDIO SMI read - bus: %i chip: %i dev: %i reg: %i reg_val: 0x%x", r->bus, r->phy, r->dev, r->reg,
+                   r->value);
+            break;
+        case TRACE_MDIO_SMI_WRITE:
+            printf("MDIO SMI write - bus: %i chip: %i dev: %i reg: %i reg_val: 0x%x", r->bus, r->phy, r->dev, r->reg,
+                   r->value);
+            break;
+        case TRACE_MDIO_POLL:
+            printf("MDIO poll - bus: %i dev: %i reg: %i reg_val: 0x%x", r->bus, r->phy, r->reg, r->value);
+            break;
+        case TRACE_MDIO_CACHE:
+            printf("MDIO cache - bus: %i dev: %i mode: %i reg: %i", r->bus, r->phy, r->dev, r->reg);
+            break;
+        case TRACE_MDIO_WATCH:
+            printf("MDIO watch - bus: %i dev: %i mode: %i reg: %i index: %i", r->bus, r->phy, r->dev, r->reg,
+                   (int16_t) r->value);
+            break;
+        case TRACE_MDIO_PREAMBLE:
+            printf("MDIO preamble suppression - bus: %i dev: %i mode: %i bitmap: 0x%04x%04x", r->bus, r->phy, r->dev,
+                   r->reg, r->value);
+            break;
+        case TRACE_MDIO_TIMING:
+            printf("MDIO timing - bus: %i dev: %i op: %i mdc: %u kHz", r->bus, r->phy, r->dev, r->value);
+            break;
+        case TRACE_MDIO_PROGRAM:
+            printf("MDIO program - bus: %i slot: %i status: %i pc: 0x%x", r->bus, r->phy, r->dev, r->reg);
+            break;
+        case TRACE_MDIO_BOOT:
+            printf("MDIO init sequence - bus: %i status: %i pc: 0x%x len: %i", r->bus, r->dev, r->reg, r->value);
+            break;
+        case TRACE_MDIO_SCAN:
+            printf("MDIO scan - bus: %i mode: %i bitmap: 0x%04x%04x", r->bus, r->dev, r->reg, r->value);
+            break;
+        case TRACE_MDIO_SNIFF:
+            printf("MDIO sniffer - bus: %i mode: %i lost: %u", r->bus, r->dev, (uint) r->reg << 16 | r->value);
+            break;
+        case TRACE_USB_BUS_RESET:
+            printf("BUS RESET");
+            break;
+        case TRACE_USB_SET_ADDRESS:
+            printf("Set address %d", r->value);
+            break;
+        case TRACE_USB_CONFIGURED:
+            printf("Device Enumerated");
+            break;
+        case TRACE_USB_GET_DESCRIPTOR:
+            printf("GET DESCRIPTOR type 0x%x index %d", r->value >> 8, r->value & 0xff);
+            break;
+        case TRACE_USB_OTHER_REQUEST:
+            printf("Other %s request (0x%x)", (r->reg & 0x80) ? "IN" : "OUT", r->value);
+            break;
+        case TRACE_USB_EP0_IN:
+            printf("ep0_in_handler() RX %d bytes from host", r->value);
+            break;
+        case TRACE_USB_EP0_OUT:
+            printf("ep0_out_handler() Sent %d bytes to host", r->value);
+            break;
+        case TRACE_USB_BAD_PACKET:
+            printf("EP2 Error: received unsupported amount of data (len=%i). Dropped", r->value);
+            break;
+        case TRACE_USB_UNSUPPORTED_OP:
+            printf("EP2 Error: unsupported extended command 0x%x", r->value);
+            break;
+        case TRACE_USB_DUMMY_EP:
+            printf("ep_dummy_handler() RX %d bytes from host", r->value);
+            break;
+        case TRACE_USB_PROGRAM_LOAD:
+            printf("Load program - slot: %i offset: %i len: %i", r->phy, r->reg, r->value);
+            break;
+        case TRACE_USB_INIT_STORE:
+            printf("Store init sequence - slot: %i len: %i", r->phy, r->value);
+            break;
+        default:
+            printf("Unknown event %i", r->event);
+    }
+
+    if (r->latency_us)
+        printf(" time: %u us", (uint) r->latency_us);
+
+    printf("%s\n", failed);
+}
+
+void trace_task(void) {
+    for (uint core = 0; core < NUM_CORES; core++) {
+        struct trace_ring *ring = &trace_rings[core];
+
+        while (ring->tail != ring->head) {
+            __dmb();
+            struct trace_record record = ring->records[ring->tail % TRACE_RING_RECORDS];
+
+            // Done reading the record before it is handed back to the producer
+            __dmb();
+            ring->tail = ring->tail + 1;
+
+            trace_print(core, &record);
+        }
+    }
+
+    uint32_t dropped = trace_dropped();
+    if (dropped == trace_reported_dropped || time_us_32() - trace_drop_report_us < TRACE_DROP_REPORT_MS * 1000)
+        return;
+
+    printf("Trace: %u records dropped\n", (uint) (dropped - trace_reported_dropped));
+    trace_reported_dropped = dropped;
+    trace_drop_report_us = time_us_32();
+}
+
+uint32_t trace_dropped(void) {
+    uint32_t dropped = 0;
+
+    for (uint core = 0; core < NUM_CORES; core++)
+        dropped += trace_rings[core].dropped;
+
+    return dropped;
+}
+
+#endif
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "pico/stdlib.h"
+
+// Binary trace of MDIO transactions and USB events. trace_record() only copies a 16 byte record into a ring
+// of the calling core and can be used from any context on both cores. The text is formatted and printed by
+// trace_task() on core0 outside of the transaction path. If the rings are full records are dropped and
+// counted, the producer never waits for the log output (UART or CDC-ACM, see telemetry.h). The count is
+// printed at most once a second.
+
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 1
+#endif
+
+#define TRACE_RING_RECORDS 256 // Per core, power of 2
+
+// Set in the event of a failed operation (timeout, no response)
+#define TRACE_FAILED 0x80
+
+enum trace_event {
+    // MDIO operations. phy is the PHY, port or SMI chip address, dev the MMD or SMI device address.
+    TRACE_MDIO_READ = 1,
+    TRACE_MDIO_WRITE,
+    TRACE_MDIO_BATCH,     // reg: number of commands, value: number of reads
+    TRACE_MDIO_C45_READ,
+    TRACE_MDIO_C45_WRITE,
+    TRACE_MDIO_C45_RANGE, // value: number of registers
+    TRACE_MDIO_SMI_READ,
+    TRACE_MDIO_SMI_WRITE,
+    TRACE_MDIO_POLL,      // value: last value
+    TRACE_MDIO_CACHE,     // dev: mode, reg: register
+    TRACE_MDIO_WATCH,     // dev: mode, value: index
+    TRACE_MDIO_PREAMBLE,  // dev: mode, reg/value: bitmap
+    TRACE_MDIO_TIMING,    // dev: op, value: MDC frequency in kHz
+    TRACE_MDIO_PROGRAM,   // phy: slot, dev: status, reg: program counter
+    TRACE_MDIO_BOOT,      // dev: status, reg: program counter, value: length
+    TRACE_MDIO_SCAN,      // dev: mode, reg/value: bitmap
+    TRACE_MDIO_SNIFF,     // bus: sniffed bus, dev: mode, reg/value: frames lost
+
+    // USB
+    TRACE_USB_BUS_RESET,
+    TRACE_USB_SET_ADDRESS,    // value: address
+    TRACE_USB_CONFIGURED,
+    TRACE_USB_GET_DESCRIPTOR, // value: wValue
+    TRACE_USB_OTHER_REQUEST,  // reg: bmRequestType, value: bRequest
+    TRACE_USB_EP0_IN,         // value: length
+    TRACE_USB_EP0_OUT,        // value: length
+    TRACE_USB_BAD_PACKET,     // value: length
+    TRACE_USB_UNSUPPORTED_OP, // value: opcode
+    TRACE_USB_DUMMY_EP,       // value: length
+    TRACE_USB_PROGRAM_LOAD,   // phy: slot, reg: offset, value: length
+    TRACE_USB_INIT_STORE,     // phy: slot, value: length
+};
+
+struct trace_record {
+    uint32_t timestamp_us;
+    uint8_t event; // enum trace_event, TRACE_FAILED
+    uint8_t bus;
+    uint8_t phy;
+    uint8_t dev;
+    uint16_t reg;
+    uint16_t value;
+    uint32_t latency_us;
+};
+
+#if TRACE_ENABLE
+void trace_record(uint8_t event, uint8_t bus, uint8_t phy, uint8_t dev, uint16_t reg, uint16_t value,
+                  uint32_t latency_us);
+
+// Print the queued records. Call from the main loop of core0.
+void trace_task(void);
+
+// Number of records dropped since startup
+uint32_t trace_dropped(void);
+#else
+static inline void trace_record(__unused uint8_t event, __unused uint8_t bus, __unused uint8_t phy,
+                                __unused uint8_t dev, __unused uint16_t reg, __unused uint16_t value,
+                                __unused uint32_t latency_us) {}
+static inline void trace_task(void) {}
+static inline uint32_t trace_dropped(void) { return 0; }
+#endif
+
+#endif
@@ -0,0 +1,323 @@
+/**
+ * Copyright (c) 2025 Albrecht Lohofener <albrechtloh@gmx.de>
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Wire format of the EP2 OUT / EP6 IN bulk protocol.
+ *
+ * Two packet formats are accepted on EP2:
+ *
+ * 1. The Marvell mvusb format used by the Linux mdio-mvusb driver (6 byte read, 8 byte write).
+ *    It starts with a 4 byte preamble (0xe800, ...) and is handled byte-for-byte as the original adapter does.
+ *
+ * 2. Extended commands. They start with USB_MDIO_EXT_MAGIC which never appears in the first byte of
+ *    an mvusb packet. All multi-byte fields are little endian.
+ *
+ *    byte 0    USB_MDIO_EXT_MAGIC
+ *    byte 1    opcode (USB_MDIO_OP_*)
+ *    byte 2    bus (0 .. MDIO_NUM_BUSES - 1)
+ *    byte 3    PHY / port address
+ *    byte 4..  opcode specific
+ *
+ *    Every extended command except USB_MDIO_OP_DUMP and USB_MDIO_OP_RUN_PROGRAM is answered with exactly
+ *    one EP6 packet:
+ *
+ *    byte 0    status (USB_MDIO_STATUS_*)
+ *    byte 1    opcode specific (number of values for range reads)
+ *    byte 2..  opcode specific
+ *
+ * Commands are executed strictly in order and so are their responses. The host does not need to wait for a
+ * response before sending the next command: up to USB_MDIO_COMMAND_WINDOW commands are accepted while
+ * earlier ones are still executing, further packets are NAKed until there is room again.
+ *
+ * EP7 (interrupt IN) carries watch list notifications, up to 8 records of USB_MDIO_WATCH_RECORD_LEN bytes
+ * per packet:
+ *
+ *    byte 0..3 timestamp in us (free running device clock)
+ *    byte 4    watch entry index, USB_MDIO_WATCH_RECORD_LOST is set if records were dropped before this one
+ *    byte 5    bus
+ *    byte 6..7 masked register value
+ *
+ * EP8 (bulk IN) streams the frames of the bus sniffer, see USB_MDIO_OP_SNIFF.
+ */
+
+#ifndef USB_MDIO_PROTOCOL_H_
+#define USB_MDIO_PROTOCOL_H_
+
+#define USB_MDIO_EXT_MAGIC 0xa5
+#define USB_MDIO_EXT_HEADER_LEN 4
+#define USB_MDIO_RESPONSE_HEADER_LEN 2
+
+#define USB_MDIO_PACKET_SIZE 64
+
+// Commands the host may have outstanding (received but not answered yet)
+#define USB_MDIO_COMMAND_WINDOW 16
+
+// Clause 45 read
+//   request:  byte 4 devad, byte 5 reserved, byte 6..7 register
+//   response: byte 2..3 value
+#define USB_MDIO_OP_C45_READ 0x01
+
+// Clause 45 write
+//   request:  byte 4 devad, byte 5 reserved, byte 6..7 register, byte 8..9 value
+#define USB_MDIO_OP_C45_WRITE 0x02
+
+// Clause 45 read of consecutive registers with one ADDRESS and N POST-READ-INCREMENT-ADDRESS frames
+//   request:  byte 4 devad, byte 5 count, byte 6..7 first register
+//   response: byte 1 count, byte 2.. values
+#define USB_MDIO_OP_C45_READ_RANGE 0x03
+#define USB_MDIO_C45_RANGE_MAX ((USB_MDIO_PACKET_SIZE - USB_MDIO_RESPONSE_HEADER_LEN) / 2)
+
+// Preamble suppression
+//   request:  byte 4 mode (USB_MDIO_PREAMBLE_*), byte 3 is the address for the single address modes
+//   response: byte 2..5 bitmap of addresses with suppression enabled
+#define USB_MDIO_OP_PREAMBLE_SUPPRESSION 0x04
+#define USB_MDIO_PREAMBLE_DISABLE 0x00
+#define USB_MDIO_PREAMBLE_ENABLE 0x01
+#define USB_MDIO_PREAMBLE_PROBE 0x02     // Enable if BMSR bit 6 of the PHY is set, non-PHYs are left alone
+#define USB_MDIO_PREAMBLE_PROBE_ALL 0x03 // Probe all 32 addresses, not done at startup
+#define USB_MDIO_PREAMBLE_QUERY 0x04     // Only return the bitmap
+
+// Timing profile of an address. SET_TIMING and CALIBRATE store the profile for the address in byte 3.
+//   request (SET_TIMING only): byte 4..7 MDC frequency in Hz, byte 8 sample delay in MDC periods,
+//                              byte 9 pad drive strength in mA (2, 4, 8, 12), byte 10 flags
+//   response: the resulting profile in byte 2..8 with the same layout
+#define USB_MDIO_OP_SET_TIMING 0x05
+#define USB_MDIO_OP_GET_TIMING 0x06
+#define USB_MDIO_OP_CALIBRATE 0x07 // Ramp MDC up while reading the PHY ID, then back off one step
+#define USB_MDIO_TIMING_SLEW_FAST 0x01
+#define USB_MDIO_TIMING_SCHMITT 0x02
+
+// Clause 22 read and write on the bus in byte 2
+//   request:  byte 4 register, byte 5 reserved, byte 6..7 value (write only)
+//   response: byte 2..3 value (read only)
+#define USB_MDIO_OP_C22_READ 0x08
+#define USB_MDIO_OP_C22_WRITE 0x09
+
+// Select the bus used by mvusb packets. The Linux driver knows nothing about buses, so this is the
+// way to point an unmodified mdio-mvusb at another bus. Defaults to bus 0.
+//   response: byte 2 number of buses
+#define USB_MDIO_OP_SELECT_BUS 0x0a
+
+// Marvell multi-chip SMI indirect access. Byte 3 is the SMI address of the switch chip. The command register
+// write, the busy polling and the data register access are all done on the device.
+//   request:  byte 4 device address, byte 5 register, byte 6..7 value (write only)
+//   response: byte 2..3 value (read only)
+#define USB_MDIO_OP_SMI_READ 0x0b
+#define USB_MDIO_OP_SMI_WRITE 0x0c
+
+// Read a Clause 22 register until (value & mask) == (expected & mask) or the timeout passed
+//   request:  byte 4 register, byte 5 reserved, byte 6..7 mask, byte 8..9 expected value,
+//             byte 10..13 poll interval in us, byte 14..17 timeout in us (max. USB_MDIO_POLL_TIMEOUT_MAX_US)
+//   response: byte 2..3 last value, byte 4..7 number of reads, byte 8..11 elapsed us.
+//             The status is USB_MDIO_STATUS_TIMEOUT if the condition was not met.
+#define USB_MDIO_OP_POLL 0x0d
+#define USB_MDIO_POLL_TIMEOUT_MAX_US 1000000
+
+// Register cache of the Clause 22 accesses (see mdio_cache.h)
+//   request:  byte 4 mode (USB_MDIO_CACHE_*), byte 5 register for the policy modes
+//   response: byte 2..5 hits, byte 6..9 misses, byte 10..13 suppressed page select writes
+#define USB_MDIO_OP_CACHE 0x0e
+#define USB_MDIO_CACHE_STATS 0x00
+#define USB_MDIO_CACHE_RESET_STATS 0x01
+#define USB_MDIO_CACHE_FLUSH 0x02        // Forget everything about the PHY in byte 3
+#define USB_MDIO_CACHE_SET_STATIC 0x03
+#define USB_MDIO_CACHE_SET_VOLATILE 0x04
+#define USB_MDIO_CACHE_SET_PAGE_REG 0x05 // Page select register of the PHY, 0 for none
+
+// Watch list. Entries are polled in the background and changes of the masked value are reported on EP7.
+//   request:  byte 4 mode (USB_MDIO_WATCH_*), byte 5 register, byte 6..7 mask, byte 8..11 poll interval in us
+//   response: byte 2 index of the added entry
+#define USB_MDIO_OP_WATCH 0x0f
+#define USB_MDIO_WATCH_ADD 0x00          // Watch register byte 5 of the PHY in byte 3 on the bus in byte 2
+#define USB_MDIO_WATCH_CLEAR 0x01
+#define USB_MDIO_WATCH_SET_INTERVAL 0x02 // 0 stops polling
+#define USB_MDIO_WATCH_RECORD_LEN 8
+#define USB_MDIO_WATCH_RECORD_LOST 0x80
+
+// Mixed Clause 22 reads and writes on the bus in byte 2, executed in order as one DMA batch. They bypass the
+// register cache and the absent addresses of a scan. Byte 3 is the number of commands, followed by the command
+// records:
+//   read:     byte 0 USB_MDIO_BATCH_READ, byte 1 PHY address, byte 2 register
+//   write:    byte 0 USB_MDIO_BATCH_WRITE, byte 1 PHY address, byte 2 register, byte 3..4 value
+//   response: byte 1 number of values, byte 2.. the values of the reads in command order
+#define USB_MDIO_OP_BATCH 0x10
+#define USB_MDIO_BATCH_READ 0x00
+#define USB_MDIO_BATCH_WRITE 0x01
+#define USB_MDIO_BATCH_READ_LEN 3
+#define USB_MDIO_BATCH_WRITE_LEN 5
+#define USB_MDIO_BATCH_MAX ((USB_MDIO_PACKET_SIZE - USB_MDIO_EXT_HEADER_LEN) / USB_MDIO_BATCH_READ_LEN)
+
+// Dump a range of registers of a range of PHYs. Unlike most other commands this is answered with a stream of
+// EP6 packets, one block of consecutive registers of one PHY (and MMD) each. A block never spans two PHYs.
+//   request:  byte 3 first PHY, byte 4 last PHY, byte 5 mode (USB_MDIO_DUMP_*), byte 6 first MMD,
+//             byte 7 last MMD (Clause 45 only), byte 8..9 first register, byte 10..11 last register
+//   response: byte 1 number of values in this block, USB_MDIO_DUMP_LAST is set in the last block,
+//             byte 2 PHY, byte 3 MMD (0 for Clause 22), byte 4..5 register of the first value,
+//             byte 6.. values
+// Invalid requests are answered with a single packet with USB_MDIO_DUMP_LAST set and no values.
+#define USB_MDIO_OP_DUMP 0x11
+#define USB_MDIO_DUMP_C22 0x00
+#define USB_MDIO_DUMP_C45 0x01
+#define USB_MDIO_DUMP_LAST 0x80
+#define USB_MDIO_DUMP_HEADER_LEN 6
+#define USB_MDIO_DUMP_BLOCK_MAX ((USB_MDIO_PACKET_SIZE - USB_MDIO_DUMP_HEADER_LEN) / 2)
+
+// Run a microprogram (USB_MDIO_PROG_*) from a RAM slot filled with USB_MDIO_VENDOR_LOAD_PROGRAM. Like DUMP
+// this is answered with a stream of EP6 packets, carrying the values of the EMIT instructions. Byte 2 is the
+// bus the program starts on, byte 3 the slot.
+//   request:  byte 4..5 program length, byte 6..9 run time limit in us (max. USB_MDIO_PROGRAM_TIMEOUT_MAX_US),
+//             byte 10.. initial values of r0, r1, ... (optional, the other registers start at 0)
+//   response: byte 1 number of values in this packet, USB_MDIO_PROGRAM_LAST is set in the last packet,
+//             byte 2..3 program counter of the instruction being executed, byte 4.. values
+// The status of the last packet is the result of the run: OK when END was reached, the status of a FAIL
+// instruction, USB_MDIO_STATUS_INVALID for a malformed instruction or jump, USB_MDIO_STATUS_TIMEOUT when
+// the run time limit passed. The program counter of the last packet is where the program stopped.
+#define USB_MDIO_OP_RUN_PROGRAM 0x12
+#define USB_MDIO_PROGRAM_LAST 0x80
+#define USB_MDIO_PROGRAM_HEADER_LEN 4
+#define USB_MDIO_PROGRAM_VALUES_MAX ((USB_MDIO_PACKET_SIZE - USB_MDIO_PROGRAM_HEADER_LEN) / 2)
+#define USB_MDIO_PROGRAM_TIMEOUT_MAX_US 10000000
+#define USB_MDIO_PROGRAM_SLOTS 4
+#define USB_MDIO_PROGRAM_SIZE 2048 // Bytes per slot
+
+// Scan all 32 addresses of the bus with Clause 22 reads of the PHY ID (registers 2/3). A PHY is present if it
+// drives the turnaround bit low. From then on empty addresses are remembered: Clause 22 reads of their PHY ID are
+// answered with 0xffff right away, without a frame on the bus, until the next scan, a Clause 22 write to the
+// address or USB_MDIO_SCAN_FORGET. Reads of other registers still go to the bus until one of them is left
+// unanswered too, so a switch in multi-chip mode (no PHY ID, but an SMI command register) keeps working. This
+// applies to all Clause 22 reads of the bus, mvusb reads included, and is off until the host sends a scan. About
+// once a second one read of such an address goes to the bus, in case a PHY showed up.
+//   request:  byte 3 first address to report the PHY ID of, byte 4 mode (USB_MDIO_SCAN_*)
+//   response: byte 1 number of PHY IDs, byte 2..5 bitmap of present addresses (not known to be empty for
+//             QUERY and FORGET), byte 6.. PHY IDs (register 2 << 16 | register 3) of the present addresses from
+//             byte 3 on, in address order
+// Up to USB_MDIO_SCAN_IDS_MAX IDs fit into the response. With more PHYs, scan again with byte 3 set behind the
+// address of the last reported ID.
+#define USB_MDIO_OP_SCAN 0x13
+#define USB_MDIO_SCAN_RUN 0x00
+#define USB_MDIO_SCAN_QUERY 0x01  // Only return the bitmap, nothing on the bus
+#define USB_MDIO_SCAN_FORGET 0x02 // Forget the empty addresses, all reads go to the bus again
+#define USB_MDIO_SCAN_HEADER_LEN 6
+#define USB_MDIO_SCAN_IDS_MAX ((USB_MDIO_PACKET_SIZE - USB_MDIO_SCAN_HEADER_LEN) / 4)
+
+// Passive bus sniffer. START releases MDC and MDIO of the bus in byte 2 and decodes the Clause 22 and Clause 45
+// frames another station runs on it, STOP hands the bus back. One bus is sniffed at a time, START on another bus
+// stops the running capture. The adapter stays off a sniffed bus: reads return 0xffff (NO_RESPONSE where there
+// is a status), writes are dropped and the watch list skips it.
+//   request:  byte 4 mode (USB_MDIO_SNIFF_*)
+//   response: byte 2 sniffed bus (USB_MDIO_SNIFF_NO_BUS if stopped), byte 3 reserved, byte 4..7 frames sent on
+//             EP8 since START, byte 8..11 frames lost since START
+// The frames are streamed on EP8, up to USB_MDIO_SNIFF_RECORDS_MAX records per packet:
+//    byte 0    bus
+//    byte 1    number of records
+//    byte 2..3 reserved
+//    byte 4..7 frames lost since START. Cumulative, an increase means frames are missing before the first record.
+//    byte 8..  records of USB_MDIO_SNIFF_RECORD_LEN bytes: byte 0..3 timestamp in us (the clock of EP7) right
+//              after the last bit, byte 4..7 the 32 bits following the preamble, ST in bit 31..30, then OP,
+//              PHYAD, REGAD (DEVAD), TA and data in bit 15..0
+// Frames captured after STOP are still sent. A fully loaded 2.5 MHz bus needs about 700 KB/s on EP8: keep
+// reads queued on it. A ring on the device bridges about 13 ms, frames lost beyond that are counted.
+#define USB_MDIO_OP_SNIFF 0x14
+#define USB_MDIO_SNIFF_STOP 0x00
+#define USB_MDIO_SNIFF_START 0x01
+#define USB_MDIO_SNIFF_STATUS 0x02
+#define USB_MDIO_SNIFF_NO_BUS 0xff
+#define USB_MDIO_SNIFF_HEADER_LEN 8
+#define USB_MDIO_SNIFF_RECORD_LEN 8
+#define USB_MDIO_SNIFF_RECORDS_MAX ((USB_MDIO_PACKET_SIZE - USB_MDIO_SNIFF_HEADER_LEN) / USB_MDIO_SNIFF_RECORD_LEN)
+
+// Echo a token. A host that gave up waiting for a response sends this and drops every EP6 packet up to the echo:
+// those are the late responses of the commands it gave up on. Byte 2 has to be a valid bus.
+//   request:  byte 4..7 token
+//   response: byte 2..5 token
+#define USB_MDIO_OP_SYNC 0x15
+#define USB_MDIO_SYNC_LEN 8
+
+// Microprogram instructions. Every instruction is an opcode byte followed by its operands, multi-byte
+// operands are little endian. Operands:
+//   rd, rs  register r0 .. r(USB_MDIO_PROG_REGS - 1), 16 bit each
+//   a       PHY/port address or Clause 22 register: 0 .. 31, or USB_MDIO_PROG_ADDR_REG | n to take it from rn
+//   imm     16 bit immediate
+//   target  16 bit byte offset into the program
+// POLL and TEST set the condition flag that JMP_IF and JMP_IFNOT test.
+#define USB_MDIO_PROG_REGS 16
+#define USB_MDIO_PROG_ADDR_REG 0x80
+#define USB_MDIO_PROG_END 0x00       // Stop with USB_MDIO_STATUS_OK
+#define USB_MDIO_PROG_READ 0x01      // rd, a phy, a reg: Clause 22 read into rd
+#define USB_MDIO_PROG_WRITE 0x02     // a phy, a reg, imm
+#define USB_MDIO_PROG_WRITE_REG 0x03 // a phy, a reg, rs
+#define USB_MDIO_PROG_MODIFY 0x04    // a phy, a reg, imm mask, imm value: reg = (reg & ~mask) | (value & mask)
+#define USB_MDIO_PROG_POLL 0x05      // a phy, a reg, imm mask, imm expected, imm interval us, 32 bit timeout us
+#define USB_MDIO_PROG_C45_READ 0x06  // rd, a port, devad, 16 bit register
+#define USB_MDIO_PROG_C45_WRITE 0x07 // a port, devad, 16 bit register, imm
+#define USB_MDIO_PROG_DELAY 0x08     // 32 bit time in us
+#define USB_MDIO_PROG_SET 0x09       // rd, imm
+#define USB_MDIO_PROG_MOV 0x0a       // rd, rs
+#define USB_MDIO_PROG_ADD 0x0b       // rd, imm (wraps, add 0xffff to decrement)
+#define USB_MDIO_PROG_AND 0x0c       // rd, imm
+#define USB_MDIO_PROG_OR 0x0d        // rd, imm
+#define USB_MDIO_PROG_TEST 0x0e      // rs, imm mask, imm expected: flag = (rs & mask) == (expected & mask)
+#define USB_MDIO_PROG_JMP 0x0f       // target
+#define USB_MDIO_PROG_JMP_IF 0x10    // target, jump if the flag is set
+#define USB_MDIO_PROG_JMP_IFNOT 0x11 // target, jump if the flag is clear
+#define USB_MDIO_PROG_LOOP 0x12      // rd, target: decrement rd, jump if it is not 0
+#define USB_MDIO_PROG_EMIT 0x13      // rs: send the value of rs to the host
+#define USB_MDIO_PROG_BUS 0x14       // bus: switch to another bus
+#define USB_MDIO_PROG_FAIL 0x15      // status: stop with a status (USB_MDIO_STATUS_*)
+
+// EP0 vendor requests (bmRequestType 0xc0 for IN, 0x40 for OUT). Unknown requests and requests with the wrong
+// direction are answered with a STALL.
+//   GET_COUNTERS:   IN, USB_MDIO_VENDOR_COUNTERS little endian uint32: register reads, register writes, MDIO
+//                   frames, bus busy time in us, EP2 commands, EP2 bytes, EP6 bytes, time in us the command
+//                   window was full (EP2 NAKed the host),
+//                   cache hits, cache misses, suppressed page select writes, dropped trace records, uptime in ms,
+//                   log bytes dropped because the CDC-ACM interface was not read, control requests answered
+//                   with a STALL
+//   GET_HISTOGRAM:  IN, wValue selects the histogram (USB_MDIO_HIST_*). 16 little endian uint32 buckets:
+//                   bucket 0 counts 0 us, bucket n counts [2^(n-1), 2^n) us, bucket 15 everything above.
+//   RESET_COUNTERS: OUT without data, resets the counters (uptime excluded) and all histograms
+//   LOAD_PROGRAM:   OUT, up to USB_MDIO_PROGRAM_CHUNK_MAX bytes of a microprogram. wValue is the slot, wIndex
+//                   the byte offset in the slot. Chunks outside of the slot or into the slot of a program
+//                   that is running or queued (its USB_MDIO_OP_RUN_PROGRAM was received on EP2) are dropped,
+//                   USB_MDIO_OP_RUN_PROGRAM only runs the bytes that were loaded.
+//   STORE_INIT:     OUT without data. Stores the first wIndex bytes of program slot wValue in flash, with a
+//                   CRC-32, as the init sequence. At power-on it runs right after the MDIO buses are set up,
+//                   while USB enumerates, starting on bus 0 with a run time limit of USB_MDIO_INIT_TIMEOUT_US.
+//                   Length 0 removes it. The request is stalled for an invalid slot, a length beyond the loaded
+//                   bytes, the slot of a queued or running program or while another store is pending.
+//                   Otherwise the status stage comes right away and the flash is written afterwards (tens of
+//                   ms, EP2/EP6 stall meanwhile). Poll GET_INIT_STATUS for the result.
+//   GET_INIT_STATUS: IN, USB_MDIO_INIT_STATUS_LEN bytes: byte 0 state of the run at boot (USB_MDIO_INIT_*),
+//                   byte 1 its status (USB_MDIO_STATUS_*), byte 2..3 the program counter it stopped at,
+//                   byte 4..7 start in us since power-on, byte 8..11 run time in us, byte 12..13 length and
+//                   byte 14..17 CRC-32 of the sequence in flash now (0 if there is none), byte 18 state of the
+//                   last STORE_INIT (USB_MDIO_INIT_STORE_*)
+#define USB_MDIO_VENDOR_GET_COUNTERS 0x01
+#define USB_MDIO_VENDOR_GET_HISTOGRAM 0x02
+#define USB_MDIO_VENDOR_RESET_COUNTERS 0x03
+#define USB_MDIO_VENDOR_LOAD_PROGRAM 0x04
+#define USB_MDIO_VENDOR_STORE_INIT 0x05
+#define USB_MDIO_VENDOR_GET_INIT_STATUS 0x06
+#define USB_MDIO_VENDOR_COUNTERS 15
+#define USB_MDIO_PROGRAM_CHUNK_MAX 256
+#define USB_MDIO_INIT_STATUS_LEN 19
+#define USB_MDIO_INIT_TIMEOUT_US 1000000
+#define USB_MDIO_INIT_NONE 0x00    // No init sequence in flash at power-on
+#define USB_MDIO_INIT_BAD_CRC 0x01 // The stored sequence is corrupt and was not run
+#define USB_MDIO_INIT_RUNNING 0x02
+#define USB_MDIO_INIT_DONE 0x03
+#define USB_MDIO_INIT_STORE_NONE 0x00    // No STORE_INIT since power-on
+#define USB_MDIO_INIT_STORE_PENDING 0x01 // Accepted, the flash is not written yet
+#define USB_MDIO_INIT_STORE_DONE 0x02
+#define USB_MDIO_INIT_STORE_FAILED 0x03  // The flash could not be written
+#define USB_MDIO_HIST_COMMAND_LATENCY 0x00 // EP2 arrival to the response being queued on EP6
+#define USB_MDIO_HIST_FRAME_TIME 0x01      // Single MDIO frame on the wire
+
+#define USB_MDIO_STATUS_OK 0x00
+#define USB_MDIO_STATUS_INVALID 0x01     // Malformed request or argument (e.g. the bus) out of range
+#define USB_MDIO_STATUS_UNSUPPORTED 0x02 // Unknown opcode
+#define USB_MDIO_STATUS_NO_RESPONSE 0x03 // The PHY did not respond
+#define USB_MDIO_STATUS_TIMEOUT 0x04     // The device did not respond or stayed busy
+
+#endif
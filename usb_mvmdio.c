@@ -8,6 +8,7 @@
  */
 
 #include <stdio.h>
+#include <assert.h>
 
 // Pico
 #include "pico/stdlib.h"
@@ -25,17 +26,101 @@
 #include "hardware/irq.h"
 // For resetting the USB controller
 #include "hardware/resets.h"
+// For passing commands to core1
+#include "pico/multicore.h"
 
 #include "usb_mvmdio.h"
+#include "usb_mdio_protocol.h"
+#include "mdio_vm.h"
+#include "mdio_boot.h"
+#include "spsc_ring.h"
+#include "trace.h"
+#include "perf.h"
 
 // Device descriptors
 #include "usb_mvmdio_descriptor.h"
 
-#define usb_hw_set ((usb_hw_t *)hw_set_alias_untyped(usb_hw))
-#define usb_hw_clear ((usb_hw_t *)hw_clear_alias_untyped(usb_hw))
+static const struct usb_mdio_callbacks *usb_mdio_callbacks;
 
-static uint16_t (*usb_mdio_pull_request_callback)(uint8_t, uint8_t);
-static void (*usb_mdio_push_request_callback)(uint8_t, uint8_t, uint16_t);
+// Bus used by mvusb packets, see USB_MDIO_OP_SELECT_BUS
+static uint8_t usb_mdio_legacy_bus = 0;
+
+// The command window is full since usb_mdio_window_full_since_us, see usb_mdio_service()
+static bool usb_mdio_window_full;
+static uint32_t usb_mdio_window_full_since_us;
+
+// Packets passed between the cores. USB is handled on core0, MDIO commands are executed on core1.
+//   commands:      core0 (EP2 OUT) -> core1
+//   responses:     core1 -> core0 (EP6 IN)
+//   notifications: core1 -> core0 (EP7 IN), one watch record per slot
+static struct spsc_ring usb_mdio_command_ring;
+static struct spsc_ring usb_mdio_response_ring;
+static struct spsc_ring usb_mdio_notify_ring;
+
+// EP2 buffers are only armed for free command slots, so the window is the size of the command ring
+static_assert(USB_MDIO_COMMAND_WINDOW == SPSC_RING_SLOTS, "command window must match the command ring");
+
+// The histogram numbers of the vendor requests are the perf.h indexes
+static_assert(USB_MDIO_HIST_COMMAND_LATENCY == PERF_HIST_COMMAND_LATENCY &&
+              USB_MDIO_HIST_FRAME_TIME == PERF_HIST_FRAME_TIME, "histogram numbers must match perf.h");
+
+// Set on core1 if a notification was dropped because the ring was full
+static bool usb_mdio_notify_lost;
+
+// Microprogram slots. Loaded by core0 (EP0), run by core1.
+static uint8_t usb_mdio_programs[USB_MDIO_PROGRAM_SLOTS][USB_MDIO_PROGRAM_SIZE];
+static volatile uint16_t usb_mdio_program_len[USB_MDIO_PROGRAM_SLOTS]; // End of the highest loaded chunk
+// Runs of a slot queued on core0 and finished on core1, each counter has one writer. The slot is in use while
+// they differ, from the moment USB_MDIO_OP_RUN_PROGRAM arrives on EP2 until its last response is queued.
+static volatile uint8_t usb_mdio_program_queued[USB_MDIO_PROGRAM_SLOTS];
+static volatile uint8_t usb_mdio_program_finished[USB_MDIO_PROGRAM_SLOTS];
+
+static_assert(USB_MDIO_COMMAND_WINDOW < 256, "queued runs of a program slot must fit the counters");
+
+// Init sequence to write to flash (USB_MDIO_VENDOR_STORE_INIT). Accepted by the USB interrupt, written by
+// usb_init_store_task(), both on core0.
+static uint8_t usb_init_store_code[USB_MDIO_PROGRAM_SIZE];
+static uint16_t usb_init_store_slot;
+static uint16_t usb_init_store_len;
+static volatile uint8_t usb_init_store_state = USB_MDIO_INIT_STORE_NONE;
+
+static_assert(USB_MDIO_PROGRAM_CHUNK_MAX <= 256, "program chunks are received into ep0_buf");
+
+// Little endian fields of the packets
+static inline uint16_t get_le16(const uint8_t *buf) {
+    return buf[1] << 8 | buf[0];
+}
+
+static inline bool usb_mdio_program_in_use(uint slot) {
+    return usb_mdio_program_queued[slot] != usb_mdio_program_finished[slot];
+}
+
+/**
+ * @brief Program slot of a USB_MDIO_OP_RUN_PROGRAM command
+ *
+ * @return -1 for other commands and invalid slots
+ */
+static int usb_mdio_program_slot(const uint8_t *buf, uint16_t len) {
+    if (len < USB_MDIO_EXT_HEADER_LEN || buf[0] != USB_MDIO_EXT_MAGIC || buf[1] != USB_MDIO_OP_RUN_PROGRAM ||
+        buf[3] >= USB_MDIO_PROGRAM_SLOTS)
+        return -1;
+
+    return buf[3];
+}
+
+static inline void put_le16(uint8_t *buf, uint16_t val) {
+    buf[0] = val & 0xff;
+    buf[1] = val >> 8;
+}
+
+static inline void put_le32(uint8_t *buf, uint32_t val) {
+    put_le16(&buf[0], val & 0xffff);
+    put_le16(&buf[2], val >> 16);
+}
+
+static inline uint32_t get_le32(const uint8_t *buf) {
+    return (uint32_t) get_le16(&buf[2]) << 16 | get_le16(&buf[0]);
+}
 
 // Function prototypes for our device specific endpoint handlers defined
 // later on
@@ -44,14 +129,41 @@ void ep0_out_handler(uint8_t *buf, uint16_t len);
 void ep2_out_handler(uint8_t *buf, uint16_t len);
 void ep_dummy_handler(uint8_t *buf, uint16_t len);
 void ep6_in_handler(uint8_t *buf, uint16_t len);
+void ep7_in_handler(uint8_t *buf, uint16_t len);
+void ep8_in_handler(uint8_t *buf, uint16_t len);
+#if USB_MDIO_CDC_ACM
+void ep10_out_handler(uint8_t *buf, uint16_t len);
+void ep10_in_handler(uint8_t *buf, uint16_t len);
+#endif
+
+static void usb_mdio_service(void);
 
 // Global device address
 static bool should_set_address = false;
 static uint8_t dev_addr = 0;
 static volatile bool configured = false;
 
-// Global data buffer for EP0
-static uint8_t ep0_buf[64];
+// Global data buffer for EP0. Data stages longer than one packet are sent in 64 byte packets.
+static uint8_t ep0_buf[256];
+
+// Rest of the running EP0 IN data stage
+static const uint8_t *ep0_in_data;
+static uint16_t ep0_in_remaining;
+static bool ep0_in_zlp;
+static bool ep0_in_status_pending; // The host acknowledges the data stage with a ZLP on EP0 OUT
+
+// EP0 OUT data stage. Called with the setup packet and the received data once the data stage is complete.
+typedef void (*usb_ep0_out_complete)(const struct usb_setup_packet *pkt, const uint8_t *data, uint16_t len);
+static struct usb_setup_packet ep0_out_setup;
+static usb_ep0_out_complete ep0_out_complete; // NULL outside of a data stage
+static uint16_t ep0_out_received;
+static uint16_t ep0_out_remaining;
+
+#if USB_MDIO_CDC_ACM
+// Stored for GET_LINE_CODING only, the data goes over USB at whatever rate the host reads
+static uint8_t usb_cdc_line_coding[USB_CDC_LINE_CODING_LEN] = {0x00, 0xc2, 0x01, 0x00, 0, 0, 8}; // 115200 8N1
+static bool usb_cdc_zlp; // The last EP10 packet was full, a short one ends the transfer
+#endif
 
 // Struct defining the device configuration
 static struct usb_device_configuration dev_config = {
@@ -91,36 +203,81 @@ static struct usb_device_configuration dev_config = {
                         .handler = &ep2_out_handler,
                         .endpoint_control = &usb_dpram->ep_ctrl[1].out,
                         .buffer_control = &usb_dpram->ep_buf_ctrl[2].out,
+                        // Two buffers: the next command is received while the current one is executed
                         .data_buffer = &usb_dpram->epx_data[1 * 64],
+                        .double_buffered = true,
                 },
                 {
                         .descriptor = &ep3_out,
                         .handler = &ep_dummy_handler,
                         .endpoint_control = &usb_dpram->ep_ctrl[2].out,
                         .buffer_control = &usb_dpram->ep_buf_ctrl[3].out,
-                        .data_buffer = &usb_dpram->epx_data[2 * 64],
+                        .data_buffer = &usb_dpram->epx_data[3 * 64],
                 },
                 {
                         .descriptor = &ep4_out,
                         .handler = &ep_dummy_handler,
                         .endpoint_control = &usb_dpram->ep_ctrl[3].out,
                         .buffer_control = &usb_dpram->ep_buf_ctrl[4].out,
-                        .data_buffer = &usb_dpram->epx_data[3 * 64],
+                        .data_buffer = &usb_dpram->epx_data[4 * 64],
                 },
                 {
                         .descriptor = &ep5_out,
                         .handler = &ep_dummy_handler,
                         .endpoint_control = &usb_dpram->ep_ctrl[4].out,
                         .buffer_control = &usb_dpram->ep_buf_ctrl[5].out,
-                        .data_buffer = &usb_dpram->epx_data[4 * 64],
+                        .data_buffer = &usb_dpram->epx_data[5 * 64],
                 },
                 {
                         .descriptor = &ep6_in,
                         .handler = &ep6_in_handler,
                         .endpoint_control = &usb_dpram->ep_ctrl[5].in,
                         .buffer_control = &usb_dpram->ep_buf_ctrl[6].in,
-                        .data_buffer = &usb_dpram->epx_data[5 * 64],
-                }
+                        // Two buffers: a response is queued while the previous one waits for the host
+                        .data_buffer = &usb_dpram->epx_data[6 * 64],
+                        .double_buffered = true,
+                },
+                {
+                        .descriptor = &ep7_in,
+                        .handler = &ep7_in_handler,
+                        .endpoint_control = &usb_dpram->ep_ctrl[6].in,
+                        .buffer_control = &usb_dpram->ep_buf_ctrl[7].in,
+                        .data_buffer = &usb_dpram->epx_data[8 * 64],
+                },
+                {
+                        .descriptor = &ep8_in,
+                        .handler = &ep8_in_handler,
+                        .endpoint_control = &usb_dpram->ep_ctrl[7].in,
+                        .buffer_control = &usb_dpram->ep_buf_ctrl[8].in,
+                        // Two buffers: the next packet is filled while the host reads the previous one
+                        .data_buffer = &usb_dpram->epx_data[9 * 64],
+                        .double_buffered = true,
+                },
+#if USB_MDIO_CDC_ACM
+                {
+                        .descriptor = &cdc_acm_descriptors.notification,
+                        .handler = &ep_dummy_handler,
+                        .endpoint_control = &usb_dpram->ep_ctrl[8].in,
+                        .buffer_control = &usb_dpram->ep_buf_ctrl[9].in,
+                        .data_buffer = &usb_dpram->epx_data[11 * 64],
+                },
+                {
+                        .descriptor = &cdc_acm_descriptors.data_out,
+                        .handler = &ep10_out_handler,
+                        .endpoint_control = &usb_dpram->ep_ctrl[9].out,
+                        .buffer_control = &usb_dpram->ep_buf_ctrl[10].out,
+                        .data_buffer = &usb_dpram->epx_data[12 * 64],
+                },
+                {
+                        .descriptor = &cdc_acm_descriptors.data_in,
+                        .handler = &ep10_in_handler,
+                        .endpoint_control = &usb_dpram->ep_ctrl[9].in,
+                        .buffer_control = &usb_dpram->ep_buf_ctrl[10].in,
+                        // Two buffers: the log keeps flowing while the host picks up a packet
+                        .data_buffer = &usb_dpram->epx_data[13 * 64],
+                        .double_buffered = true,
+                },
+#endif
         }
 };
 
@@ -174,7 +331,7 @@ uint8_t usb_prepare_string_descriptor(const unsigned char *str) {
  * @return uint32_t
  */
 static inline uint32_t usb_buffer_offset(volatile uint8_t *buf) {
-    return (uint32_t) buf ^ (uint32_t) usb_dpram;
+    return (uint32_t) ((uintptr_t) buf ^ (uintptr_t) usb_dpram);
 }
 
 /**
@@ -196,6 +353,10 @@ void usb_setup_endpoint(const struct usb_endpoint_configuration *ep) {
                    | EP_CTRL_INTERRUPT_PER_BUFFER
                    | (ep->descriptor->bmAttributes << EP_CTRL_BUFFER_TYPE_LSB)
                    | dpram_offset;
+
+    if (ep->double_buffered)
+        reg |= EP_CTRL_DOUBLE_BUFFERED_BITS;
+
     *ep->endpoint_control = reg;
 }
 
@@ -225,26 +386,62 @@ static inline bool ep_is_tx(struct usb_endpoint_configuration *ep) {
     return ep->descriptor->bEndpointAddress & USB_DIR_IN;
 }
 
+/**
+ * @brief Number of buffers of an endpoint that can take another transfer.
+ *
+ * @param ep, the endpoint configuration
+ * @return 0, 1 or 2 for double buffered endpoints
+ */
+static inline uint usb_endpoint_free_buffers(const struct usb_endpoint_configuration *ep) {
+    uint buffers = ep->double_buffered ? 2 : 1;
+    return buffers - __builtin_popcount(ep->armed);
+}
+
+/**
+ * @brief Number of buffers of an endpoint handed to the controller and not completed yet.
+ *
+ * @param ep, the endpoint configuration
+ */
+static inline uint usb_endpoint_armed_buffers(const struct usb_endpoint_configuration *ep) {
+    return __builtin_popcount(ep->armed);
+}
+
+/**
+ * @brief Forget all transfers of an endpoint and return its buffers to the CPU.
+ *
+ * @param ep, the endpoint configuration
+ */
+static void usb_endpoint_reset_buffers(struct usb_endpoint_configuration *ep) {
+    *ep->buffer_control = 0;
+    ep->armed = 0;
+    ep->next_buf = 0;
+    ep->done_buf = 0;
+}
+
 /**
  * @brief Starts a transfer on a given endpoint.
  *
  * @param ep, the endpoint configuration.
  * @param buf, the data buffer to send. Only applicable if the endpoint is TX
- * @param len, the length of the data in buf (this example limits max len to one packet - 64 bytes)
+ * @param len, the length of the data in buf, one packet - 64 bytes at most
  */
 void usb_start_transfer(struct usb_endpoint_configuration *ep, uint8_t *buf, uint16_t len) {
-    // We are asserting that the length is <= 64 bytes for simplicity of the example.
-    // For multi packet transfers see the tinyusb port.
+    // One packet per buffer. Longer EP0 data stages are split by usb_ep0_send() and usb_ep0_receive().
     assert(len <= 64);
 
     //printf("Start transfer of len %d on ep addr 0x%x\n", len, ep->descriptor->bEndpointAddress);
 
+    // Double buffered endpoints use the buffers alternately
+    uint8_t index = ep->double_buffered ? ep->next_buf : 0;
+    volatile uint8_t *data_buffer = ep->data_buffer + index * 64;
+    assert(!(ep->armed & (1u << index)));
+
     // Prepare buffer control register value
     uint32_t val = len | USB_BUF_CTRL_AVAIL;
 
     if (ep_is_tx(ep)) {
         // Need to copy the data from the user buffer to the usb memory
-        memcpy((void *) ep->data_buffer, (void *) buf, len);
+        memcpy((void *) data_buffer, (void *) buf, len);
         // Mark as full
         val |= USB_BUF_CTRL_FULL;
     }
@@ -253,7 +450,42 @@ void usb_start_transfer(struct usb_endpoint_configuration *ep, uint8_t *buf, uin
     val |= ep->next_pid ? USB_BUF_CTRL_DATA1_PID : USB_BUF_CTRL_DATA0_PID;
     ep->next_pid ^= 1u;
 
-    *ep->buffer_control = val;
+    ep->armed |= 1u << index;
+
+    if (ep->double_buffered) {
+        ep->next_buf ^= 1u;
+        // Only touch the half of this buffer. The controller might be updating the other one right now.
+        ((volatile uint16_t *) ep->buffer_control)[index] = (uint16_t) val;
+    } else {
+        *ep->buffer_control = val;
+    }
+}
+
+/**
+ * @brief Send the next packet of the EP0 IN data stage.
+ */
+static void usb_ep0_send_next(void) {
+    uint16_t len = MIN(ep0_in_remaining, 64);
+
+    usb_start_transfer(usb_get_endpoint_configuration(EP0_IN_ADDR), (uint8_t *) ep0_in_data, len);
+    ep0_in_data += len;
+    ep0_in_remaining -= len;
+}
+
+/**
+ * @brief Start an EP0 IN data stage of any length. A transfer shorter than requested that ends on a packet
+ * boundary is terminated with a zero length packet.
+ *
+ * @param data, the data to send. Must stay valid until the data stage is done.
+ * @param len, the length of the data
+ * @param max_len, wLength of the request
+ */
+static void usb_ep0_send(const uint8_t *data, uint16_t len, uint16_t max_len) {
+    ep0_in_data = data;
+    ep0_in_remaining = MIN(len, max_len);
+    ep0_in_zlp = ep0_in_remaining < max_len && ep0_in_remaining > 0 && ep0_in_remaining % 64 == 0;
+    ep0_in_status_pending = true;
+    usb_ep0_send_next();
 }
 
 /**
@@ -262,11 +494,7 @@ void usb_start_transfer(struct usb_endpoint_configuration *ep, uint8_t *buf, uin
  */
 void usb_handle_device_descriptor(volatile struct usb_setup_packet *pkt) {
     const struct usb_device_descriptor *d = dev_config.device_descriptor;
-    // EP0 in
-    struct usb_endpoint_configuration *ep = usb_get_endpoint_configuration(EP0_IN_ADDR);
-    // Always respond with pid 1
-    ep->next_pid = 1;
-    usb_start_transfer(ep, (uint8_t *) d, MIN(sizeof(struct usb_device_descriptor), pkt->wLength));
+    usb_ep0_send((const uint8_t *) d, sizeof(struct usb_device_descriptor), pkt->wLength);
 }
 
 /**
@@ -288,20 +516,26 @@ void usb_handle_config_descriptor(volatile struct usb_setup_packet *pkt) {
         buf += sizeof(struct usb_interface_descriptor);
         const struct usb_endpoint_configuration *ep = dev_config.endpoints;
 
-        // Copy all the endpoint descriptors starting from EP1
-        for (uint i = 2; i < USB_NUM_ENDPOINTS; i++) {
+        // Copy the endpoint descriptors of the vendor interface starting from EP1, they come first in the table
+        for (uint i = 2; i < 2u + dev_config.interface_descriptor->bNumEndpoints; i++) {
             if (ep[i].descriptor) {
                 memcpy((void *) buf, ep[i].descriptor, sizeof(struct usb_endpoint_descriptor));
                 buf += sizeof(struct usb_endpoint_descriptor);
             }
         }
 
+#if USB_MDIO_CDC_ACM
+        // The CDC-ACM function with its endpoints
+        memcpy((void *) buf, &cdc_acm_descriptors, sizeof(cdc_acm_descriptors));
+        buf += sizeof(cdc_acm_descriptors);
+#endif
+
     }
 
     // Send data
     // Get len by working out end of buffer subtract start of buffer
-    uint32_t len = (uint32_t) buf - (uint32_t) &ep0_buf[0];
-    usb_start_transfer(usb_get_endpoint_configuration(EP0_IN_ADDR), &ep0_buf[0], MIN(len, pkt->wLength));
+    uint32_t len = (uint32_t) (buf - &ep0_buf[0]);
+    usb_ep0_send(&ep0_buf[0], len, pkt->wLength);
 }
 
 /**
@@ -314,6 +548,15 @@ void usb_bus_reset(void) {
     should_set_address = false;
     usb_hw->dev_addr_ctrl = 0;
     configured = false;
+
+    // Responses, notifications and sniffed frames of the old connection are gone
+    usb_endpoint_reset_buffers(usb_get_endpoint_configuration(EP6_IN_ADDR));
+    usb_endpoint_reset_buffers(usb_get_endpoint_configuration(EP7_IN_ADDR));
+    usb_endpoint_reset_buffers(usb_get_endpoint_configuration(EP8_IN_ADDR));
+#if USB_MDIO_CDC_ACM
+    usb_endpoint_reset_buffers(usb_get_endpoint_configuration(EP10_IN_ADDR));
+    usb_cdc_zlp = false;
+#endif
 }
 
 /**
@@ -333,7 +576,7 @@ void usb_handle_string_descriptor(volatile struct usb_setup_packet *pkt) {
         len = usb_prepare_string_descriptor(dev_config.descriptor_strings[i - 1]);
     }
 
-    usb_start_transfer(usb_get_endpoint_configuration(EP0_IN_ADDR), &ep0_buf[0], MIN(len, pkt->wLength));
+    usb_ep0_send(&ep0_buf[0], len, pkt->wLength);
 }
 
 /**
@@ -354,7 +597,7 @@ void usb_set_device_address(volatile struct usb_setup_packet *pkt) {
     // Set address is a bit of a strange case because we have to send a 0 length status packet first with
     // address 0
     dev_addr = (pkt->wValue & 0xff);
-    printf("Set address %d\r\n", dev_addr);
+    trace_record(TRACE_USB_SET_ADDRESS, 0, 0, 0, 0, dev_addr, 0);
     // Will set address in the callback phase
     should_set_address = true;
     usb_acknowledge_out_request();
@@ -368,11 +611,253 @@ void usb_set_device_address(volatile struct usb_setup_packet *pkt) {
  */
 void usb_set_device_configuration(__unused volatile struct usb_setup_packet *pkt) {
     // Only one configuration so just acknowledge the request
-    printf("Device Enumerated\r\n");
+    trace_record(TRACE_USB_CONFIGURED, 0, 0, 0, 0, 0, 0);
     usb_acknowledge_out_request();
     configured = true;
 }
 
+/**
+ * @brief Start an EP0 OUT data stage of any length, one packet at a time. Data beyond ep0_buf is received
+ * but dropped, complete gets the length that was kept. The status stage is sent after complete returns.
+ *
+ * @param pkt, the setup packet from the host
+ * @param complete, called on core0 in interrupt context when the data stage is done
+ */
+static void usb_ep0_receive(volatile struct usb_setup_packet *pkt, usb_ep0_out_complete complete) {
+    ep0_out_setup = *(const struct usb_setup_packet *) pkt;
+    ep0_out_received = 0;
+    ep0_out_remaining = pkt->wLength;
+
+    if (!ep0_out_remaining) {
+        complete(&ep0_out_setup, ep0_buf, 0);
+        usb_acknowledge_out_request();
+        return;
+    }
+
+    ep0_out_complete = complete;
+    usb_start_transfer(usb_get_endpoint_configuration(EP0_OUT_ADDR), NULL, MIN(ep0_out_remaining, 64));
+}
+
+/**
+ * @brief Store a chunk of a microprogram received with USB_MDIO_VENDOR_LOAD_PROGRAM.
+ */
+static void usb_load_program(const struct usb_setup_packet *pkt, const uint8_t *data, uint16_t len) {
+    uint16_t slot = pkt->wValue;
+    uint16_t offset = pkt->wIndex;
+
+    // The slot of a queued or running program is not touched, the program would see a mix of old and new code
+    if (slot >= USB_MDIO_PROGRAM_SLOTS || len != pkt->wLength || len > USB_MDIO_PROGRAM_CHUNK_MAX ||
+        offset + len > USB_MDIO_PROGRAM_SIZE || usb_mdio_program_in_use(slot)) {
+        trace_record(TRACE_USB_PROGRAM_LOAD | TRACE_FAILED, 0, slot, 0, offset, pkt->wLength, 0);
+        return;
+    }
+
+    memcpy(&usb_mdio_programs[slot][offset], data, len);
+    if (offset + len > usb_mdio_program_len[slot])
+        usb_mdio_program_len[slot] = offset + len;
+
+    trace_record(TRACE_USB_PROGRAM_LOAD, 0, slot, 0, offset, len, 0);
+}
+
+/**
+ * @brief Time the command window has been full so far, not yet in PERF_USB_WINDOW_FULL_US
+ */
+static uint32_t usb_mdio_window_full_elapsed_us(void) {
+    return usb_mdio_window_full ? time_us_32() - usb_mdio_window_full_since_us : 0;
+}
+
+/**
+ * @brief Answer the data or status stage of the current control request with a STALL. The controller disarms
+ * it with the next SETUP packet.
+ */
+static void usb_ep0_stall(void) {
+    struct usb_endpoint_configuration *in = usb_get_endpoint_configuration(EP0_IN_ADDR);
+    struct usb_endpoint_configuration *out = usb_get_endpoint_configuration(EP0_OUT_ADDR);
+
+    usb_endpoint_reset_buffers(in);
+    usb_endpoint_reset_buffers(out);
+    *in->buffer_control = USB_BUF_CTRL_STALL;
+    *out->buffer_control = USB_BUF_CTRL_STALL;
+    usb_hw->ep_stall_arm = USB_EP_STALL_ARM_EP0_IN_BITS | USB_EP_STALL_ARM_EP0_OUT_BITS;
+
+    perf_add(PERF_USB_STALLS, 1);
+}
+
+/**
+ * @brief Direction of the data stage of a vendor request
+ *
+ * @return false for unknown requests
+ */
+static bool usb_vendor_request_is_in(uint8_t request, bool *in) {
+    switch (request) {
+        case USB_MDIO_VENDOR_GET_COUNTERS:
+        case USB_MDIO_VENDOR_GET_HISTOGRAM:
+        case USB_MDIO_VENDOR_GET_INIT_STATUS:
+            *in = true;
+            return true;
+
+        case USB_MDIO_VENDOR_RESET_COUNTERS:
+        case USB_MDIO_VENDOR_LOAD_PROGRAM:
+        case USB_MDIO_VENDOR_STORE_INIT:
+            *in = false;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Handle the vendor requests on EP0 (USB_MDIO_VENDOR_*). Unknown requests and requests with the wrong
+ * direction are answered with a STALL, otherwise the host would wait for a data or status stage that never
+ * comes.
+ *
+ * @param pkt, the setup packet from the host.
+ */
+static void usb_handle_vendor_request(volatile struct usb_setup_packet *pkt) {
+    uint8_t *buf = &ep0_buf[0];
+    uint16_t len = 0;
+    bool in;
+
+    if (!usb_vendor_request_is_in(pkt->bRequest, &in) || in != !!(pkt->bmRequestType & USB_DIR_IN)) {
+        trace_record(TRACE_USB_OTHER_REQUEST | TRACE_FAILED, 0, 0, 0, pkt->bmRequestType, pkt->bRequest, 0);
+        usb_ep0_stall();
+        return;
+    }
+
+    switch (pkt->bRequest) {
+        case USB_MDIO_VENDOR_GET_COUNTERS: {
+            struct mdio_cache_stats stats;
+            mdio_cache_get_stats(&stats);
+
+            uint32_t counters[USB_MDIO_VENDOR_COUNTERS] = {
+                perf_get(PERF_MDIO_READS),
+                perf_get(PERF_MDIO_WRITES),
+                perf_get(PERF_MDIO_FRAMES),
+                perf_get(PERF_BUS_BUSY_US),
+                perf_get(PERF_USB_COMMANDS),
+                perf_get(PERF_USB_BYTES_OUT),
+                perf_get(PERF_USB_BYTES_IN),
+                perf_get(PERF_USB_WINDOW_FULL_US) + usb_mdio_window_full_elapsed_us(),
+                stats.hits,
+                stats.misses,
+                stats.page_writes_suppressed,
+                trace_dropped(),
+                to_ms_since_boot(get_absolute_time()),
+                telemetry_dropped(),
+                perf_get(PERF_USB_STALLS),
+            };
+
+            for (uint i = 0; i < USB_MDIO_VENDOR_COUNTERS; i++)
+                put_le32(&buf[4 * i], counters[i]);
+            len = sizeof(counters);
+            break;
+        }
+
+        case USB_MDIO_VENDOR_GET_HISTOGRAM: {
+            uint32_t buckets[PERF_HIST_BUCKETS];
+
+            if (pkt->wValue >= PERF_NUM_HISTOGRAMS)
+                break;
+
+            perf_get_histogram(pkt->wValue, buckets);
+            for (uint i = 0; i < PERF_HIST_BUCKETS; i++)
+                put_le32(&buf[4 * i], buckets[i]);
+            len = sizeof(buckets);
+            break;
+        }
+
+        case USB_MDIO_VENDOR_RESET_COUNTERS:
+            perf_reset();
+            mdio_cache_reset_stats();
+            usb_acknowledge_out_request();
+            return;
+
+        case USB_MDIO_VENDOR_LOAD_PROGRAM:
+            usb_ep0_receive(pkt, usb_load_program);
+            return;
+
+        case USB_MDIO_VENDOR_STORE_INIT: {
+            uint16_t slot = pkt->wValue;
+            uint16_t program_len = pkt->wIndex;
+
+            if (slot >= USB_MDIO_PROGRAM_SLOTS || program_len > usb_mdio_program_len[slot] ||
+                usb_mdio_program_in_use(slot) || usb_init_store_state == USB_MDIO_INIT_STORE_PENDING) {
+                trace_record(TRACE_USB_INIT_STORE | TRACE_FAILED, 0, slot, 0, 0, program_len, 0);
+                usb_ep0_stall();
+                return;
+            }
+
+            // Erasing flash takes tens of ms, it is done by usb_init_store_task() outside of the interrupt.
+            // The copy keeps later loads into the slot out of it.
+            memcpy(usb_init_store_code, usb_mdio_programs[slot], program_len);
+            usb_init_store_slot = slot;
+            usb_init_store_len = program_len;
+            __dmb();
+            usb_init_store_state = USB_MDIO_INIT_STORE_PENDING;
+
+            usb_acknowledge_out_request();
+            return;
+        }
+
+        case USB_MDIO_VENDOR_GET_INIT_STATUS: {
+            struct mdio_boot_status status;
+            mdio_boot_get_status(&status);
+
+            buf[0] = status.state;
+            buf[1] = status.status;
+            put_le16(&buf[2], status.pc);
+            put_le32(&buf[4], status.start_us);
+            put_le32(&buf[8], status.run_us);
+            put_le16(&buf[12], status.stored_len);
+            put_le32(&buf[14], status.stored_crc);
+            buf[18] = usb_init_store_state;
+            len = USB_MDIO_INIT_STATUS_LEN;
+            break;
+        }
+
+        default:
+            return;
+    }
+
+    usb_ep0_send(buf, len, pkt->wLength);
+}
+
+#if USB_MDIO_CDC_ACM
+static void usb_cdc_set_line_coding(__unused const struct usb_setup_packet *pkt, const uint8_t *data, uint16_t len) {
+    if (len == USB_CDC_LINE_CODING_LEN)
+        memcpy(usb_cdc_line_coding, data, len);
+}
+
+/**
+ * @brief Handle the class requests of the CDC-ACM function. The line settings do not matter for USB, they are
+ * only stored so a terminal reads back what it set.
+ *
+ * @param pkt, the setup packet from the host.
+ */
+static void usb_handle_cdc_request(volatile struct usb_setup_packet *pkt) {
+    switch (pkt->bRequest) {
+        case USB_CDC_REQUEST_SET_LINE_CODING:
+            usb_ep0_receive(pkt, usb_cdc_set_line_coding);
+            return;
+
+        case USB_CDC_REQUEST_GET_LINE_CODING:
+            usb_ep0_send(usb_cdc_line_coding, sizeof(usb_cdc_line_coding), pkt->wLength);
+            return;
+
+        case USB_CDC_REQUEST_SET_CONTROL_LINE_STATE:
+            // DTR and RTS. The log is sent whether a terminal is open or not, the host buffers it.
+            usb_acknowledge_out_request();
+            return;
+
+        default:
+            trace_record(TRACE_USB_OTHER_REQUEST, 0, 0, 0, pkt->bmRequestType, pkt->bRequest, 0);
+            if (!(pkt->bmRequestType & USB_DIR_IN))
+                usb_acknowledge_out_request();
+    }
+}
+#endif
+
 /**
  * @brief Respond to a setup packet from the host.
  *
@@ -382,17 +867,28 @@ void usb_handle_setup_packet(void) {
     uint8_t req_direction = pkt->bmRequestType;
     uint8_t req = pkt->bRequest;
 
-    // Reset PID to 1 for EP0 IN
+    // Reset PID to 1 for EP0 IN and OUT. A new setup packet ends a data stage the host gave up on.
     usb_get_endpoint_configuration(EP0_IN_ADDR)->next_pid = 1u;
-
-    if (req_direction == USB_DIR_OUT) {
+    usb_get_endpoint_configuration(EP0_OUT_ADDR)->next_pid = 1u;
+    ep0_in_remaining = 0;
+    ep0_in_zlp = false;
+    ep0_in_status_pending = false;
+    ep0_out_complete = NULL;
+
+    if ((req_direction & USB_REQ_TYPE_TYPE_MASK) == USB_REQ_TYPE_TYPE_VENDOR) {
+        usb_handle_vendor_request(pkt);
+#if USB_MDIO_CDC_ACM
+    } else if ((req_direction & USB_REQ_TYPE_TYPE_MASK) == USB_REQ_TYPE_TYPE_CLASS) {
+        usb_handle_cdc_request(pkt);
+#endif
+    } else if (req_direction == USB_DIR_OUT) {
         if (req == USB_REQUEST_SET_ADDRESS) {
             usb_set_device_address(pkt);
         } else if (req == USB_REQUEST_SET_CONFIGURATION) {
             usb_set_device_configuration(pkt);
         } else {
             usb_acknowledge_out_request();
-            printf("Other OUT request (0x%x)\r\n", pkt->bRequest);
+            trace_record(TRACE_USB_OTHER_REQUEST, 0, 0, 0, req_direction, req, 0);
         }
     } else if (req_direction == USB_DIR_IN) {
         if (req == USB_REQUEST_GET_DESCRIPTOR) {
@@ -401,24 +897,24 @@ void usb_handle_setup_packet(void) {
             switch (descriptor_type) {
                 case USB_DT_DEVICE:
                     usb_handle_device_descriptor(pkt);
-                    printf("GET DEVICE DESCRIPTOR\r\n");
+                    trace_record(TRACE_USB_GET_DESCRIPTOR, 0, 0, 0, 0, pkt->wValue, 0);
                     break;
 
                 case USB_DT_CONFIG:
                     usb_handle_config_descriptor(pkt);
-                    printf("GET CONFIG DESCRIPTOR\r\n");
+                    trace_record(TRACE_USB_GET_DESCRIPTOR, 0, 0, 0, 0, pkt->wValue, 0);
                     break;
 
                 case USB_DT_STRING:
                     usb_handle_string_descriptor(pkt);
-                    printf("GET STRING DESCRIPTOR\r\n");
+                    trace_record(TRACE_USB_GET_DESCRIPTOR, 0, 0, 0, 0, pkt->wValue, 0);
                     break;
 
                 default:
-                    printf("Unhandled GET_DESCRIPTOR type 0x%x\r\n", descriptor_type);
+                    trace_record(TRACE_USB_GET_DESCRIPTOR | TRACE_FAILED, 0, 0, 0, 0, pkt->wValue, 0);
             }
         } else {
-            printf("Other IN request (0x%x)\r\n", pkt->bRequest);
+            trace_record(TRACE_USB_OTHER_REQUEST, 0, 0, 0, req_direction, req, 0);
         }
     }
 }
@@ -429,12 +925,32 @@ void usb_handle_setup_packet(void) {
  * @param ep, the endpoint to notify.
  */
 static void usb_handle_ep_buff_done(struct usb_endpoint_configuration *ep) {
-    uint32_t buffer_control = *ep->buffer_control;
-    // Get the transfer length for this endpoint
-    uint16_t len = buffer_control & USB_BUF_CTRL_LEN_MASK;
+    if (!ep->double_buffered) {
+        uint32_t buffer_control = *ep->buffer_control;
+        // Get the transfer length for this endpoint
+        uint16_t len = buffer_control & USB_BUF_CTRL_LEN_MASK;
 
-    // Call that endpoints buffer done handler
-    ep->handler((uint8_t *) ep->data_buffer, len);
+        ep->armed = 0;
+
+        // Call that endpoints buffer done handler
+        ep->handler((uint8_t *) ep->data_buffer, len);
+        return;
+    }
+
+    // Both buffers might have completed before we got here. They complete in the order they were armed and
+    // the controller clears AVAIL of every buffer it is done with.
+    while (ep->armed & (1u << ep->done_buf)) {
+        uint8_t index = ep->done_buf;
+        uint16_t buffer_control = ((volatile uint16_t *) ep->buffer_control)[index];
+
+        if (buffer_control & USB_BUF_CTRL_AVAIL)
+            break;
+
+        ep->armed &= ~(1u << index);
+        ep->done_buf ^= 1u;
+
+        ep->handler((uint8_t *) ep->data_buffer + index * 64, buffer_control & USB_BUF_CTRL_LEN_MASK);
+    }
 }
 
 /**
@@ -471,7 +987,7 @@ static void usb_handle_buff_status() {
     for (uint i = 0; remaining_buffers && i < USB_NUM_ENDPOINTS * 2; i++) {
         if (remaining_buffers & bit) {
             // clear this in advance
-            usb_hw_clear->buf_status = bit;
+            hw_clear_bits(&usb_hw->buf_status, bit);
             // IN transfer for even i, OUT transfer for odd i
             usb_handle_buff_done(i >> 1u, !(i & 1u));
             remaining_buffers &= ~bit;
@@ -498,7 +1014,7 @@ void isr_usbctrl(void) {
     // Setup packet received
     if (status & USB_INTS_SETUP_REQ_BITS) {
         handled |= USB_INTS_SETUP_REQ_BITS;
-        usb_hw_clear->sie_status = USB_SIE_STATUS_SETUP_REC_BITS;
+        hw_clear_bits(&usb_hw->sie_status, USB_SIE_STATUS_SETUP_REC_BITS);
         usb_handle_setup_packet();
     }
 /// \end::isr_setup_packet[]
@@ -511,9 +1027,9 @@ void isr_usbctrl(void) {
 
     // Bus is reset
     if (status & USB_INTS_BUS_RESET_BITS) {
-        printf("BUS RESET\n");
+        trace_record(TRACE_USB_BUS_RESET, 0, 0, 0, 0, 0, 0);
         handled |= USB_INTS_BUS_RESET_BITS;
-        usb_hw_clear->sie_status = USB_SIE_STATUS_BUS_RESET_BITS;
+        hw_clear_bits(&usb_hw->sie_status, USB_SIE_STATUS_BUS_RESET_BITS);
         usb_bus_reset();
     }
 
@@ -539,38 +1055,376 @@ void print_hex(const uint8_t *buf, uint16_t len) {
 
 
 /**
- * @brief EP0 in transfer complete. Either finish the SET_ADDRESS process, or receive a zero
- * length status packet from the host.
+ * @brief EP0 in transfer complete. Either finish the SET_ADDRESS process, send the next packet of the data
+ * stage or receive a zero length status packet from the host.
  *
  * @param buf the data that was sent
  * @param len the length that was sent
  */
 void ep0_in_handler(__unused uint8_t *buf, __unused uint16_t len) {
-    printf("ep0_in_handler() RX %d bytes from host\n", len);
+    trace_record(TRACE_USB_EP0_IN, 0, 0, 0, 0, len, 0);
     
     if (should_set_address) {
         // Set actual device address in hardware
         usb_hw->dev_addr_ctrl = dev_addr;
         should_set_address = false;
-    } else {
+    } else if (ep0_in_remaining || ep0_in_zlp) {
+        if (!ep0_in_remaining)
+            ep0_in_zlp = false;
+        usb_ep0_send_next();
+    } else if (ep0_in_status_pending) {
         // Receive a zero length status packet from the host on EP0 OUT
+        ep0_in_status_pending = false;
         struct usb_endpoint_configuration *ep = usb_get_endpoint_configuration(EP0_OUT_ADDR);
         usb_start_transfer(ep, NULL, 0);
     }
 }
 
-void ep0_out_handler(__unused uint8_t *buf, __unused uint16_t len) {
-    printf("ep0_out_handler() Sent %d bytes to host\n", len);
+/**
+ * @brief EP0 out transfer complete. Either a packet of an OUT data stage or the zero length status packet
+ * of an IN data stage.
+ *
+ * @param buf the data that was received
+ * @param len the length that was received
+ */
+void ep0_out_handler(uint8_t *buf, uint16_t len) {
+    trace_record(TRACE_USB_EP0_OUT, 0, 0, 0, 0, len, 0);
+
+    if (!ep0_out_complete)
+        return;
+
+    uint16_t keep = MIN(len, sizeof(ep0_buf) - ep0_out_received);
+    memcpy(&ep0_buf[ep0_out_received], buf, keep);
+    ep0_out_received += keep;
+    ep0_out_remaining -= MIN(len, ep0_out_remaining);
+
+    // A short packet ends the data stage early
+    if (ep0_out_remaining && len == 64) {
+        usb_start_transfer(usb_get_endpoint_configuration(EP0_OUT_ADDR), NULL, MIN(ep0_out_remaining, 64));
+        return;
+    }
+
+    usb_ep0_out_complete complete = ep0_out_complete;
+    ep0_out_complete = NULL;
+    complete(&ep0_out_setup, ep0_buf, ep0_out_received);
+    usb_acknowledge_out_request();
+}
+
+/**
+ * @brief Handle SET_TIMING, GET_TIMING and CALIBRATE.
+ *
+ * @return the response status
+ */
+static uint8_t usb_mdio_handle_timing(const uint8_t *buf, uint16_t len, uint8_t *response, uint16_t *response_len) {
+    struct mdio_timing_profile profile = {0};
+    uint8_t op = buf[1];
+
+    if (op == USB_MDIO_OP_SET_TIMING) {
+        if (len < 11)
+            return USB_MDIO_STATUS_INVALID;
+
+        profile.mdc_hz = get_le32(&buf[4]);
+        profile.sample_delay = buf[8];
+        profile.drive_ma = buf[9];
+        profile.slew_fast = buf[10] & USB_MDIO_TIMING_SLEW_FAST;
+        profile.schmitt = buf[10] & USB_MDIO_TIMING_SCHMITT;
+    }
+
+    if (!usb_mdio_callbacks->timing_request(buf[2], buf[3], op, &profile))
+        return op == USB_MDIO_OP_SET_TIMING ? USB_MDIO_STATUS_INVALID : USB_MDIO_STATUS_NO_RESPONSE;
+
+    put_le32(&response[2], profile.mdc_hz);
+    response[6] = profile.sample_delay;
+    response[7] = profile.drive_ma;
+    response[8] = (profile.slew_fast ? USB_MDIO_TIMING_SLEW_FAST : 0) |
+                  (profile.schmitt ? USB_MDIO_TIMING_SCHMITT : 0);
+    *response_len += 7;
+
+    return USB_MDIO_STATUS_OK;
 }
 
-void ep2_out_handler(uint8_t *buf, uint16_t len) {
-    //printf("EP2 RX: ");
-    //print_hex(buf, len);
+/**
+ * @brief Execute an extended command (see usb_mdio_protocol.h).
+ *
+ * @param buf the command received on EP2
+ * @param len the length of the command
+ * @param response buffer for the response, USB_MDIO_PACKET_SIZE bytes
+ * @return the length of the response
+ */
+static uint16_t usb_mdio_handle_ext_command(const uint8_t *buf, uint16_t len, uint8_t *response) {
+    uint16_t response_len = USB_MDIO_RESPONSE_HEADER_LEN;
 
-    // Activate activity LED
-    gpio_put(PICO_DEFAULT_LED_PIN, false);
+    response[0] = USB_MDIO_STATUS_OK;
+    response[1] = 0;
 
-    if(len == 6 || len == 8) { 
+    uint8_t op = buf[1];
+    uint8_t bus = buf[2];
+    uint8_t phy = buf[3];
+
+    if (bus >= MDIO_NUM_BUSES) {
+        response[0] = USB_MDIO_STATUS_INVALID;
+        return response_len;
+    }
+
+    switch (op) {
+        case USB_MDIO_OP_C22_READ:
+            if (len < 5) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+            put_le16(&response[2], usb_mdio_callbacks->pull_request(bus, phy, buf[4]));
+            response_len += 2;
+            break;
+
+        case USB_MDIO_OP_C22_WRITE:
+            if (len < 8) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+            usb_mdio_callbacks->push_request(bus, phy, buf[4], get_le16(&buf[6]));
+            break;
+
+        case USB_MDIO_OP_SMI_READ: {
+            uint16_t reg_val;
+            if (len < 6) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+            if (!usb_mdio_callbacks->smi_pull_request(bus, phy, buf[4], buf[5], &reg_val)) {
+                response[0] = USB_MDIO_STATUS_TIMEOUT;
+                break;
+            }
+            put_le16(&response[2], reg_val);
+            response_len += 2;
+            break;
+        }
+
+        case USB_MDIO_OP_SMI_WRITE:
+            if (len < 8) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+            if (!usb_mdio_callbacks->smi_push_request(bus, phy, buf[4], buf[5], get_le16(&buf[6])))
+                response[0] = USB_MDIO_STATUS_TIMEOUT;
+            break;
+
+        case USB_MDIO_OP_POLL: {
+            struct mdio_poll_result result;
+            if (len < 18 || get_le32(&buf[14]) > USB_MDIO_POLL_TIMEOUT_MAX_US) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+            if (!usb_mdio_callbacks->poll_request(bus, phy, buf[4], get_le16(&buf[6]), get_le16(&buf[8]),
+                                                  get_le32(&buf[10]), get_le32(&buf[14]), &result))
+                response[0] = USB_MDIO_STATUS_TIMEOUT;
+
+            put_le16(&response[2], result.value);
+            put_le32(&response[4], result.iterations);
+            put_le32(&response[8], result.elapsed_us);
+            response_len += 10;
+            break;
+        }
+
+        case USB_MDIO_OP_CACHE: {
+            struct mdio_cache_stats stats;
+            if (len < 6 || buf[4] > USB_MDIO_CACHE_SET_PAGE_REG) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+            usb_mdio_callbacks->cache_request(bus, phy, buf[4], buf[5], &stats);
+
+            put_le32(&response[2], stats.hits);
+            put_le32(&response[6], stats.misses);
+            put_le32(&response[10], stats.page_writes_suppressed);
+            response_len += 12;
+            break;
+        }
+
+        case USB_MDIO_OP_WATCH: {
+            if (len < 12 || buf[4] > USB_MDIO_WATCH_SET_INTERVAL) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+
+            int index = usb_mdio_callbacks->watch_request(bus, phy, buf[4], buf[5], get_le16(&buf[6]),
+                                                          get_le32(&buf[8]));
+            if (index < 0) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+            response[2] = index;
+            response_len += 1;
+            break;
+        }
+
+        case USB_MDIO_OP_BATCH: {
+            struct usb_mdio_batch_command commands[USB_MDIO_BATCH_MAX];
+            uint16_t reg_vals[USB_MDIO_BATCH_MAX];
+            uint8_t count = phy;
+            uint8_t reads = 0;
+            uint16_t offset = USB_MDIO_EXT_HEADER_LEN;
+            bool valid = count <= USB_MDIO_BATCH_MAX;
+
+            // Parse all records first, a malformed request is not executed at all
+            for (uint8_t i = 0; valid && i < count; i++) {
+                const uint8_t *record = &buf[offset];
+
+                if (offset + USB_MDIO_BATCH_READ_LEN > len) {
+                    valid = false;
+                } else if (record[0] == USB_MDIO_BATCH_READ) {
+                    commands[i] = (struct usb_mdio_batch_command) {.write = false, .dev = record[1], .reg = record[2]};
+                    offset += USB_MDIO_BATCH_READ_LEN;
+                    reads++;
+                } else if (record[0] == USB_MDIO_BATCH_WRITE && offset + USB_MDIO_BATCH_WRITE_LEN <= len) {
+                    commands[i] = (struct usb_mdio_batch_command) {
+                        .write = true, .dev = record[1], .reg = record[2], .reg_val = get_le16(&record[3])
+                    };
+                    offset += USB_MDIO_BATCH_WRITE_LEN;
+                } else {
+                    valid = false;
+                }
+            }
+
+            if (!valid) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+
+            usb_mdio_callbacks->batch_request(bus, commands, count, reg_vals);
+
+            response[1] = reads;
+            for (uint8_t i = 0; i < reads; i++)
+                put_le16(&response[2 + 2 * i], reg_vals[i]);
+            response_len += 2 * reads;
+            break;
+        }
+
+        case USB_MDIO_OP_SELECT_BUS:
+            usb_mdio_legacy_bus = bus;
+            response[2] = MDIO_NUM_BUSES;
+            response_len += 1;
+            break;
+
+        case USB_MDIO_OP_C45_READ:
+            if (len < 8) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+            put_le16(&response[2], usb_mdio_callbacks->c45_pull_request(bus, phy, buf[4], get_le16(&buf[6])));
+            response_len += 2;
+            break;
+
+        case USB_MDIO_OP_C45_WRITE:
+            if (len < 10) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+            usb_mdio_callbacks->c45_push_request(bus, phy, buf[4], get_le16(&buf[6]), get_le16(&buf[8]));
+            break;
+
+        case USB_MDIO_OP_C45_READ_RANGE: {
+            uint8_t count = buf[5];
+            if (len < 8 || count == 0 || count > USB_MDIO_C45_RANGE_MAX) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+
+            uint16_t reg_vals[USB_MDIO_C45_RANGE_MAX];
+            usb_mdio_callbacks->c45_pull_range_request(bus, phy, buf[4], get_le16(&buf[6]), reg_vals, count);
+
+            for (uint i = 0; i < count; i++)
+                put_le16(&response[response_len + 2 * i], reg_vals[i]);
+            response[1] = count;
+            response_len += 2 * count;
+            break;
+        }
+
+        case USB_MDIO_OP_PREAMBLE_SUPPRESSION:
+            if (len < 5 || buf[4] > USB_MDIO_PREAMBLE_QUERY) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+            put_le32(&response[2], usb_mdio_callbacks->preamble_suppression_request(bus, phy, buf[4]));
+            response_len += 4;
+            break;
+
+        case USB_MDIO_OP_SCAN: {
+            uint32_t ids[32];
+            uint8_t count = 0;
+            if (len < 5 || phy > 31 || buf[4] > USB_MDIO_SCAN_FORGET) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+
+            uint32_t present = usb_mdio_callbacks->scan_request(bus, buf[4], ids);
+            put_le32(&response[2], present);
+            response_len += 4;
+
+            for (uint addr = phy; buf[4] == USB_MDIO_SCAN_RUN && addr < 32 && count < USB_MDIO_SCAN_IDS_MAX; addr++) {
+                if (present & (1u << addr))
+                    put_le32(&response[USB_MDIO_SCAN_HEADER_LEN + 4 * count++], ids[addr]);
+            }
+            response[1] = count;
+            response_len += 4 * count;
+            break;
+        }
+
+        case USB_MDIO_OP_SNIFF: {
+            struct mdio_sniff_status status;
+            if (len < 5 || buf[4] > USB_MDIO_SNIFF_STATUS) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+
+            usb_mdio_callbacks->sniff_request(bus, buf[4], &status);
+            response[2] = status.bus;
+            response[3] = 0;
+            put_le32(&response[4], status.frames);
+            put_le32(&response[8], status.lost);
+            response_len += 10;
+            break;
+        }
+
+        case USB_MDIO_OP_SYNC:
+            if (len < USB_MDIO_SYNC_LEN) {
+                response[0] = USB_MDIO_STATUS_INVALID;
+                break;
+            }
+
+            memcpy(&response[2], &buf[4], 4);
+            response_len += 4;
+            break;
+
+        case USB_MDIO_OP_SET_TIMING:
+        case USB_MDIO_OP_GET_TIMING:
+        case USB_MDIO_OP_CALIBRATE:
+            response[0] = usb_mdio_handle_timing(buf, len, response, &response_len);
+            break;
+
+        default:
+            trace_record(TRACE_USB_UNSUPPORTED_OP | TRACE_FAILED, bus, phy, 0, 0, op, 0);
+            response[0] = USB_MDIO_STATUS_UNSUPPORTED;
+    }
+
+    return response_len;
+}
+
+/**
+ * @brief Execute one command received on EP2. Runs on core1.
+ *
+ * @param command the command packet
+ * @param response filled with the response packet
+ * @return true if the command has a response for EP6
+ */
+static bool usb_mdio_execute(const struct spsc_ring_slot *command, struct spsc_ring_slot *response) {
+    const uint8_t *buf = command->data;
+    uint16_t len = command->len;
+
+    if (len >= USB_MDIO_EXT_HEADER_LEN && buf[0] == USB_MDIO_EXT_MAGIC) {
+        response->len = usb_mdio_handle_ext_command(buf, len, response->data);
+        return true;
+    }
+    else if(len == 6 || len == 8) { 
         // 16 Byte are in little endian, so change back to big endian
         //uint16_t preamble0 = buf[1] << 8 | buf[0]; // Unknown what that mean, ignore it
         //uint16_t preamble1 = buf[3] << 8 | buf[2]; // Unknown what that mean, ignore it
@@ -582,11 +1436,12 @@ void ep2_out_handler(uint8_t *buf, uint16_t len) {
             //printf("EP2 read mdio_cmd: %04x dev: %i reg: %i\n", mdio_cmd, dev, reg);
 
             // Call callback to handle mdio request
-            uint16_t reg_val = usb_mdio_pull_request_callback(dev, reg);
+            uint16_t reg_val = usb_mdio_callbacks->pull_request(usb_mdio_legacy_bus, dev, reg);
 
             // Send data to the host
-            struct usb_endpoint_configuration *ep = usb_get_endpoint_configuration(EP6_IN_ADDR);
-            usb_start_transfer(ep, (uint8_t*) &reg_val, sizeof(reg_val));
+            put_le16(response->data, reg_val);
+            response->len = sizeof(reg_val);
+            return true;
         }
         else { // Write via MDIO
             uint16_t mdio_reg_val = buf[7] << 8 | buf[6];
@@ -597,37 +1452,200 @@ void ep2_out_handler(uint8_t *buf, uint16_t len) {
             //printf("EP2 write mdio_cmd: %04x dev: %i reg: %i mdio_reg_val: 0x%x\n", mdio_cmd, dev, reg, mdio_reg_val);
             
             // Call callback to handle mdio write request
-            usb_mdio_push_request_callback(dev, reg, mdio_reg_val);
-
-            // Get ready to rx again from host
-            usb_start_transfer(usb_get_endpoint_configuration(EP2_OUT_ADDR), NULL, 64);
-            gpio_put(PICO_DEFAULT_LED_PIN, true);
+            usb_mdio_callbacks->push_request(usb_mdio_legacy_bus, dev, reg, mdio_reg_val);
+            return false;
         }
     }
     else {
-        printf("EP2 Error: received unsupported amount of data (len=%i). Stop device\n", len);
+        trace_record(TRACE_USB_BAD_PACKET | TRACE_FAILED, 0, 0, 0, 0, len, 0);
+        return false;
+    }
+}
+
+/**
+ * @brief Tell core0 that there is something in the response or notification ring, or that a command slot
+ * got free. A full FIFO already means a pending doorbell.
+ */
+static void usb_mdio_doorbell(void) {
+    if (multicore_fifo_wready())
+        multicore_fifo_push_blocking(0);
+}
+
+/**
+ * @brief Move packets between the rings and the endpoints. Runs on core0 in interrupt context.
+ */
+static void usb_mdio_service(void) {
+    struct usb_endpoint_configuration *ep2 = usb_get_endpoint_configuration(EP2_OUT_ADDR);
+    struct usb_endpoint_configuration *ep6 = usb_get_endpoint_configuration(EP6_IN_ADDR);
+    struct usb_endpoint_configuration *ep7 = usb_get_endpoint_configuration(EP7_IN_ADDR);
+    struct usb_endpoint_configuration *ep8 = usb_get_endpoint_configuration(EP8_IN_ADDR);
+    struct spsc_ring_slot *slot;
+
+    // Responses in command order, up to one per EP6 buffer
+    while (usb_endpoint_free_buffers(ep6) && (slot = spsc_ring_consume(&usb_mdio_response_ring))) {
+        usb_start_transfer(ep6, slot->data, slot->len);
+
+        perf_add(PERF_USB_BYTES_IN, slot->len);
+        perf_histogram_add(PERF_HIST_COMMAND_LATENCY, time_us_32() - slot->timestamp_us);
+
+        spsc_ring_consume_commit(&usb_mdio_response_ring);
     }
+
+    // Watch notifications, as many records as fit into one packet
+    if (usb_endpoint_free_buffers(ep7) && configured) {
+        uint8_t packet[USB_MDIO_PACKET_SIZE];
+        uint len = 0;
+
+        while (len + USB_MDIO_WATCH_RECORD_LEN <= sizeof(packet) && (slot = spsc_ring_consume(&usb_mdio_notify_ring))) {
+            memcpy(&packet[len], slot->data, USB_MDIO_WATCH_RECORD_LEN);
+            spsc_ring_consume_commit(&usb_mdio_notify_ring);
+            len += USB_MDIO_WATCH_RECORD_LEN;
+        }
+
+        if (len)
+            usb_start_transfer(ep7, packet, len);
+    }
+
+    // Sniffed frames, straight from the ring into both EP8 buffers. An empty ring arms the sniffer interrupt,
+    // usb_notify_sniff() comes back here with the next frame.
+    while (usb_endpoint_free_buffers(ep8) && configured) {
+        struct mdio_sniff_frame frames[USB_MDIO_SNIFF_RECORDS_MAX];
+        struct mdio_sniff_status status;
+        uint8_t packet[USB_MDIO_PACKET_SIZE];
+        uint count = mdio_sniff_read(frames, USB_MDIO_SNIFF_RECORDS_MAX);
+
+        if (!count)
+            break;
+
+        mdio_sniff_get_status(&status);
+        packet[0] = status.bus;
+        packet[1] = count;
+        put_le16(&packet[2], 0);
+        put_le32(&packet[4], status.lost);
+        for (uint i = 0; i < count; i++) {
+            put_le32(&packet[USB_MDIO_SNIFF_HEADER_LEN + USB_MDIO_SNIFF_RECORD_LEN * i], frames[i].timestamp_us);
+            put_le32(&packet[USB_MDIO_SNIFF_HEADER_LEN + USB_MDIO_SNIFF_RECORD_LEN * i + 4], frames[i].bits);
+        }
+
+        usb_start_transfer(ep8, packet, USB_MDIO_SNIFF_HEADER_LEN + USB_MDIO_SNIFF_RECORD_LEN * count);
+    }
+
+    // Command window: every armed EP2 buffer can receive a command, so only arm a buffer if there is a slot
+    // for it. The host is NAKed otherwise.
+    while (usb_endpoint_free_buffers(ep2) && spsc_ring_free(&usb_mdio_command_ring) > usb_endpoint_armed_buffers(ep2))
+        usb_start_transfer(ep2, NULL, 64);
+
+    // Without a free slot no EP2 buffer is armed and the host is NAKed. Accounted here instead of with an
+    // interrupt per NAK, those would come many times per frame and take the time needed to drain the rings.
+    bool window_full = !spsc_ring_free(&usb_mdio_command_ring);
+    if (window_full != usb_mdio_window_full) {
+        if (window_full)
+            usb_mdio_window_full_since_us = time_us_32();
+        else
+            perf_add(PERF_USB_WINDOW_FULL_US, time_us_32() - usb_mdio_window_full_since_us);
+        usb_mdio_window_full = window_full;
+    }
+
+    // Deactivate activity LED when everything is done
+    if (spsc_ring_empty(&usb_mdio_command_ring) && !usb_endpoint_armed_buffers(ep6))
+        gpio_put(PICO_DEFAULT_LED_PIN, true);
+}
+
+/**
+ * @brief Doorbell interrupt from core1
+ */
+static void usb_mdio_doorbell_irq(void) {
+    while (multicore_fifo_rvalid())
+        multicore_fifo_pop_blocking();
+    multicore_fifo_clear_irq();
+
+    usb_mdio_service();
+}
+
+void ep2_out_handler(uint8_t *buf, uint16_t len) {
+    //printf("EP2 RX: ");
+    //print_hex(buf, len);
+
+    // Activate activity LED
+    gpio_put(PICO_DEFAULT_LED_PIN, false);
+
+    // EP2 buffers are only armed while there is a free slot for them
+    struct spsc_ring_slot *slot = spsc_ring_produce(&usb_mdio_command_ring);
+
+    slot->timestamp_us = time_us_32();
+    slot->len = MIN(len, SPSC_RING_SLOT_SIZE);
+    memcpy(slot->data, buf, slot->len);
+
+    // The program slot is in use from now on, not only once core1 gets to the command
+    int program = usb_mdio_program_slot(slot->data, slot->len);
+    if (program >= 0)
+        usb_mdio_program_queued[program]++;
+
+    spsc_ring_produce_commit(&usb_mdio_command_ring);
+
+    perf_add(PERF_USB_COMMANDS, 1);
+    perf_add(PERF_USB_BYTES_OUT, len);
+
+    usb_mdio_service();
 }
 
 // Device specific functions
-void ep_dummy_handler(uint8_t *buf, uint16_t len) {
-    printf("ep_dummy_handler() RX %d bytes from host\n", len);
-    printf("Data in HEX:\n");
-    print_hex(buf, len);
+void ep_dummy_handler(__unused uint8_t *buf, uint16_t len) {
+    trace_record(TRACE_USB_DUMMY_EP, 0, 0, 0, 0, len, 0);
 }
 
-void ep6_in_handler(__unused uint8_t *buf, uint16_t len) {
+void ep6_in_handler(__unused uint8_t *buf, __unused uint16_t len) {
     //printf("ep6_in_handler() Sent %d bytes to host\n", len);
     //printf("EP6 TX: ");
     //print_hex(buf, len);
 
-    // deactivate activity LED
-    gpio_put(PICO_DEFAULT_LED_PIN, true);
+    usb_mdio_service();
+}
+
+void ep7_in_handler(__unused uint8_t *buf, __unused uint16_t len) {
+    usb_mdio_service();
+}
 
-    // Get ready to rx again from host
-    usb_start_transfer(usb_get_endpoint_configuration(EP2_OUT_ADDR), NULL, 64);
+void ep8_in_handler(__unused uint8_t *buf, __unused uint16_t len) {
+    usb_mdio_service();
 }
 
+#if USB_MDIO_CDC_ACM
+/**
+ * @brief Keep EP10 OUT armed and send the telemetry ring on EP10 IN. Runs on core0 in interrupt context or
+ * with the interrupts masked.
+ */
+static void usb_cdc_service(void) {
+    struct usb_endpoint_configuration *ep_out = usb_get_endpoint_configuration(EP10_OUT_ADDR);
+    struct usb_endpoint_configuration *ep_in = usb_get_endpoint_configuration(EP10_IN_ADDR);
+
+    if (!configured)
+        return;
+
+    // Whatever is typed into the terminal is dropped, the host must not be NAKed forever
+    if (usb_endpoint_free_buffers(ep_out))
+        usb_start_transfer(ep_out, NULL, 64);
+
+    while (usb_endpoint_free_buffers(ep_in)) {
+        uint8_t packet[64];
+        uint16_t len = telemetry_read(packet, sizeof(packet));
+
+        if (!len && !usb_cdc_zlp)
+            break;
+
+        usb_start_transfer(ep_in, packet, len);
+        usb_cdc_zlp = len == sizeof(packet);
+    }
+}
+
+void ep10_out_handler(__unused uint8_t *buf, __unused uint16_t len) {
+    usb_cdc_service();
+}
+
+void ep10_in_handler(__unused uint8_t *buf, __unused uint16_t len) {
+    usb_cdc_service();
+}
+#endif
 
 // ********** Public functions **********
 // **************************************
@@ -636,12 +1654,9 @@ void ep6_in_handler(__unused uint8_t *buf, uint16_t len) {
  * @brief Set up the USB controller in device mode, clearing any previous state.
  *
  */
-void usb_device_init(
-    uint16_t (*_usb_mdio_pull_request_callback)(uint8_t, uint8_t), 
-    void (*_usb_mdio_push_request_callback)(uint8_t, uint8_t, uint16_t)) {
+void usb_device_init(const struct usb_mdio_callbacks *callbacks) {
     // Assign callbacks
-    usb_mdio_pull_request_callback = _usb_mdio_pull_request_callback;
-    usb_mdio_push_request_callback = _usb_mdio_push_request_callback;
+    usb_mdio_callbacks = callbacks;
 
     // Reset usb controller
     reset_unreset_block_num_wait_blocking(RESET_USBCTRL);
@@ -652,6 +1667,10 @@ void usb_device_init(
     // Enable USB interrupt at processor
     irq_set_enabled(USBCTRL_IRQ, true);
 
+    // Doorbell from core1. The MDIO side must be running on core1 already.
+    irq_set_exclusive_handler(SIO_IRQ_PROC0, usb_mdio_doorbell_irq);
+    irq_set_enabled(SIO_IRQ_PROC0, true);
+
     // Mux the controller to the onboard usb phy
     usb_hw->muxing = USB_USB_MUXING_TO_PHY_BITS | USB_USB_MUXING_SOFTCON_BITS;
 
@@ -675,7 +1694,7 @@ void usb_device_init(
     usb_setup_endpoints();
 
     // Present full speed device by enabling pull up on DP
-    usb_hw_set->sie_ctrl = USB_SIE_CTRL_PULLUP_EN_BITS;
+    hw_set_bits(&usb_hw->sie_ctrl, USB_SIE_CTRL_PULLUP_EN_BITS);
 
     // Setup activity LED
     gpio_init(PICO_DEFAULT_LED_PIN);
@@ -685,9 +1704,269 @@ void usb_device_init(
     gpio_put(PICO_DEFAULT_LED_PIN, true);
 }
 
+void usb_notify_watch(uint8_t index, uint8_t bus, uint16_t value, uint32_t timestamp_us) {
+    // Called from the task and from the DMA interrupt on core1. Keep them from producing at the same time.
+    uint32_t save = save_and_disable_interrupts();
+    struct spsc_ring_slot *slot = spsc_ring_produce(&usb_mdio_notify_ring);
+
+    if (!slot) {
+        // Ring full, the host is not reading EP7. Flag the next record that makes it.
+        usb_mdio_notify_lost = true;
+    } else {
+        put_le32(&slot->data[0], timestamp_us);
+        slot->data[4] = index | (usb_mdio_notify_lost ? USB_MDIO_WATCH_RECORD_LOST : 0);
+        slot->data[5] = bus;
+        put_le16(&slot->data[6], value);
+        slot->len = USB_MDIO_WATCH_RECORD_LEN;
+
+        usb_mdio_notify_lost = false;
+        spsc_ring_produce_commit(&usb_mdio_notify_ring);
+    }
+
+    restore_interrupts(save);
+    usb_mdio_doorbell();
+}
+
+void usb_notify_sniff(void) {
+    usb_mdio_service();
+}
+
+/**
+ * @brief Get the next response slot, waiting for the host to pick up responses if all are in use. Runs on core1.
+ */
+static struct spsc_ring_slot *usb_mdio_response_slot(void) {
+    struct spsc_ring_slot *response;
+
+    while (!(response = spsc_ring_produce(&usb_mdio_response_ring)))
+        tight_loop_contents();
+
+    return response;
+}
+
+/**
+ * @brief Execute USB_MDIO_OP_DUMP, queueing one EP6 packet per block. Runs on core1.
+ *
+ * Every block is handed to core0 as soon as it is read, so it is sent while the next block is on the bus.
+ *
+ * @param buf the command received on EP2
+ * @param len the length of the command
+ */
+static void usb_mdio_dump(const uint8_t *buf, uint16_t len, uint32_t timestamp_us) {
+    uint8_t bus = buf[2];
+    uint8_t first_phy = buf[3], last_phy = buf[4];
+    uint8_t mode = buf[5];
+    uint8_t first_mmd = buf[6], last_mmd = buf[7];
+    uint16_t first_reg = get_le16(&buf[8]), last_reg = get_le16(&buf[10]);
+
+    if (mode == USB_MDIO_DUMP_C22) {
+        first_mmd = last_mmd = 0;
+    }
+
+    if (len < 12 || bus >= MDIO_NUM_BUSES || mode > USB_MDIO_DUMP_C45 || first_phy > last_phy || last_phy > 31 ||
+        first_mmd > last_mmd || last_mmd > 31 || first_reg > last_reg || (mode == USB_MDIO_DUMP_C22 && last_reg > 31)) {
+        struct spsc_ring_slot *response = usb_mdio_response_slot();
+        memset(response->data, 0, USB_MDIO_DUMP_HEADER_LEN);
+        response->data[0] = USB_MDIO_STATUS_INVALID;
+        response->data[1] = USB_MDIO_DUMP_LAST;
+        response->len = USB_MDIO_DUMP_HEADER_LEN;
+        response->timestamp_us = timestamp_us;
+        spsc_ring_produce_commit(&usb_mdio_response_ring);
+        return;
+    }
+
+    for (uint phy = first_phy; phy <= last_phy; phy++) {
+        for (uint mmd = first_mmd; mmd <= last_mmd; mmd++) {
+            for (uint reg = first_reg; reg <= last_reg; reg += USB_MDIO_DUMP_BLOCK_MAX) {
+                uint8_t count = MIN(last_reg - reg + 1, USB_MDIO_DUMP_BLOCK_MAX);
+                uint16_t reg_vals[USB_MDIO_DUMP_BLOCK_MAX];
+
+                if (mode == USB_MDIO_DUMP_C45) {
+                    usb_mdio_callbacks->c45_pull_range_request(bus, phy, mmd, reg, reg_vals, count);
+                } else {
+                    struct usb_mdio_batch_command commands[USB_MDIO_DUMP_BLOCK_MAX];
+                    for (uint8_t i = 0; i < count; i++)
+                        commands[i] = (struct usb_mdio_batch_command) {.write = false, .dev = phy, .reg = reg + i};
+                    usb_mdio_callbacks->batch_request(bus, commands, count, reg_vals);
+                }
+
+                bool last = phy == last_phy && mmd == last_mmd && reg + count > last_reg;
+                struct spsc_ring_slot *response = usb_mdio_response_slot();
+
+                response->data[0] = USB_MDIO_STATUS_OK;
+                response->data[1] = count | (last ? USB_MDIO_DUMP_LAST : 0);
+                response->data[2] = phy;
+                response->data[3] = mmd;
+                put_le16(&response->data[4], reg);
+                for (uint8_t i = 0; i < count; i++)
+                    put_le16(&response->data[USB_MDIO_DUMP_HEADER_LEN + 2 * i], reg_vals[i]);
+                response->len = USB_MDIO_DUMP_HEADER_LEN + 2 * count;
+                response->timestamp_us = timestamp_us;
+
+                spsc_ring_produce_commit(&usb_mdio_response_ring);
+                usb_mdio_doorbell();
+            }
+        }
+    }
+}
+
+// EMIT values of a running program that were not sent yet
+struct usb_mdio_program_output {
+    uint16_t values[USB_MDIO_PROGRAM_VALUES_MAX];
+    uint8_t count;
+    uint32_t timestamp_us;
+};
+
+/**
+ * @brief Queue one EP6 packet of a USB_MDIO_OP_RUN_PROGRAM response. Runs on core1.
+ */
+static void usb_mdio_program_send(struct usb_mdio_program_output *out, uint8_t status, uint16_t pc, bool last) {
+    struct spsc_ring_slot *response = usb_mdio_response_slot();
+
+    response->data[0] = status;
+    response->data[1] = out->count | (last ? USB_MDIO_PROGRAM_LAST : 0);
+    put_le16(&response->data[2], pc);
+    for (uint8_t i = 0; i < out->count; i++)
+        put_le16(&response->data[USB_MDIO_PROGRAM_HEADER_LEN + 2 * i], out->values[i]);
+    response->len = USB_MDIO_PROGRAM_HEADER_LEN + 2 * out->count;
+    response->timestamp_us = out->timestamp_us;
+
+    spsc_ring_produce_commit(&usb_mdio_response_ring);
+    usb_mdio_doorbell();
+    out->count = 0;
+}
+
+static void usb_mdio_program_emit(void *context, uint16_t pc, uint16_t value) {
+    struct usb_mdio_program_output *out = context;
+
+    // Full packets go out while the program keeps running
+    if (out->count == USB_MDIO_PROGRAM_VALUES_MAX)
+        usb_mdio_program_send(out, USB_MDIO_STATUS_OK, pc, false);
+
+    out->values[out->count++] = value;
+}
+
+/**
+ * @brief Execute USB_MDIO_OP_RUN_PROGRAM, streaming the EMIT values to EP6. Runs on core1.
+ *
+ * @param buf the command received on EP2
+ * @param len the length of the command
+ */
+static void usb_mdio_run_program(const uint8_t *buf, uint16_t len, uint32_t timestamp_us) {
+    struct usb_mdio_program_output out = {.timestamp_us = timestamp_us};
+    uint8_t bus = buf[2];
+    uint8_t slot = buf[3];
+    uint16_t program_len = get_le16(&buf[4]);
+    uint32_t timeout_us = get_le32(&buf[6]);
+
+    if (len < 10 || bus >= MDIO_NUM_BUSES || slot >= USB_MDIO_PROGRAM_SLOTS || !program_len ||
+        program_len > usb_mdio_program_len[slot] || timeout_us > USB_MDIO_PROGRAM_TIMEOUT_MAX_US) {
+        usb_mdio_program_send(&out, USB_MDIO_STATUS_INVALID, 0, true);
+        return;
+    }
+
+    struct mdio_vm vm;
+    mdio_vm_init(&vm, usb_mdio_programs[slot], program_len, bus);
+    for (uint i = 0; i < MDIO_VM_REGS && 10 + 2 * i + 1 < len; i++)
+        vm.regs[i] = get_le16(&buf[10 + 2 * i]);
+
+    const struct mdio_vm_ops ops = {
+        .pull_request = usb_mdio_callbacks->pull_request,
+        .push_request = usb_mdio_callbacks->push_request,
+        .c45_pull_request = usb_mdio_callbacks->c45_pull_request,
+        .c45_push_request = usb_mdio_callbacks->c45_push_request,
+        .poll_request = usb_mdio_callbacks->poll_request,
+        .emit = usb_mdio_program_emit,
+        .context = &out,
+    };
+
+    uint32_t start = time_us_32();
+    uint8_t status = mdio_vm_run(&vm, &ops, timeout_us);
+
+    trace_record(TRACE_MDIO_PROGRAM | (status == USB_MDIO_STATUS_OK ? 0 : TRACE_FAILED), bus, slot, status, vm.pc, 0,
+                 time_us_32() - start);
+    usb_mdio_program_send(&out, status, vm.pc, true);
+}
+
+void usb_mdio_task(void) {
+    struct spsc_ring_slot *command = spsc_ring_consume(&usb_mdio_command_ring);
+    struct spsc_ring_slot *response;
+
+    if (!command)
+        return;
+
+    // Stream their own responses
+    if (command->len >= USB_MDIO_EXT_HEADER_LEN && command->data[0] == USB_MDIO_EXT_MAGIC &&
+        (command->data[1] == USB_MDIO_OP_DUMP || command->data[1] == USB_MDIO_OP_RUN_PROGRAM)) {
+        int program = usb_mdio_program_slot(command->data, command->len);
+
+        if (command->data[1] == USB_MDIO_OP_DUMP)
+            usb_mdio_dump(command->data, command->len, command->timestamp_us);
+        else
+            usb_mdio_run_program(command->data, command->len, command->timestamp_us);
+
+        // Loads into the slot are accepted again once no other run of it is queued
+        if (program >= 0) {
+            __dmb();
+            usb_mdio_program_finished[program]++;
+        }
+        spsc_ring_consume_commit(&usb_mdio_command_ring);
+        usb_mdio_doorbell();
+        return;
+    }
+
+    // Wait for the host to pick up responses
+    response = usb_mdio_response_slot();
+
+    bool respond = usb_mdio_execute(command, response);
+    response->timestamp_us = command->timestamp_us;
+    spsc_ring_consume_commit(&usb_mdio_command_ring);
+
+    if (respond)
+        spsc_ring_produce_commit(&usb_mdio_response_ring);
+
+    usb_mdio_doorbell();
+}
+
 void usb_start(void) {
-    // Get ready to rx from host
-    usb_start_transfer(usb_get_endpoint_configuration(EP2_OUT_ADDR), NULL, 64);
+    // Get ready to rx from host. Arms both EP2 buffers, the USB and doorbell interrupts use the same state.
+    uint32_t save = save_and_disable_interrupts();
+    usb_mdio_service();
+#if USB_MDIO_CDC_ACM
+    usb_cdc_service();
+#endif
+    restore_interrupts(save);
+}
+
+void usb_telemetry_task(void) {
+#if USB_MDIO_CDC_ACM
+    // Cheap checks first, this runs in the idle loop. The USB interrupt only changes them in favour of
+    // usb_cdc_service() finding nothing to do.
+    if (!configured || telemetry_empty() ||
+        !usb_endpoint_free_buffers(usb_get_endpoint_configuration(EP10_IN_ADDR)))
+        return;
+
+    uint32_t save = save_and_disable_interrupts();
+    usb_cdc_service();
+    restore_interrupts(save);
+#endif
+}
+
+void usb_init_store_task(void) {
+    if (usb_init_store_state != USB_MDIO_INIT_STORE_PENDING)
+        return;
+
+    __dmb();
+    uint32_t start = time_us_32();
+    bool ok = mdio_boot_store(usb_init_store_code, usb_init_store_len);
+
+    trace_record(TRACE_USB_INIT_STORE | (ok ? 0 : TRACE_FAILED), 0, usb_init_store_slot, 0, 0, usb_init_store_len,
+                 time_us_32() - start);
+    usb_init_store_state = ok ? USB_MDIO_INIT_STORE_DONE : USB_MDIO_INIT_STORE_FAILED;
+
+    // The flash write held off the doorbells of core1
+    uint32_t save = save_and_disable_interrupts();
+    usb_mdio_service();
+    restore_interrupts(save);
 }
 
 bool get_usb_configured(void) {
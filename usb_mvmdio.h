@@ -5,10 +5,84 @@
  * 
  */
 
-void usb_device_init(
-    uint16_t (*_usb_mdio_pull_request_callback)(uint8_t, uint8_t),
-    void (*_usb_mdio_push_request_callback)(uint8_t, uint8_t, uint16_t));
+#include "mdio.h"
+#include "mdio_cache.h"
+#include "mdio_sniff.h"
+#include "telemetry.h"
+
+// One command of a USB_MDIO_OP_BATCH request
+struct usb_mdio_batch_command {
+    bool write;
+    uint8_t dev;
+    uint8_t reg;
+    uint16_t reg_val; // Write only
+};
+
+// MDIO operations requested by the host. bus is always below MDIO_NUM_BUSES.
+struct usb_mdio_callbacks {
+    // Clause 22
+    uint16_t (*pull_request)(uint8_t bus, uint8_t dev, uint8_t reg);
+    void (*push_request)(uint8_t bus, uint8_t dev, uint8_t reg, uint16_t reg_val);
+
+    // Clause 22 reads and writes in order. The values of the reads are returned in reg_vals in the same order.
+    void (*batch_request)(uint8_t bus, const struct usb_mdio_batch_command *commands, uint8_t count, uint16_t *reg_vals);
+
+    // Clause 45
+    uint16_t (*c45_pull_request)(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg);
+    void (*c45_push_request)(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t reg_val);
+    void (*c45_pull_range_request)(uint8_t bus, uint8_t port, uint8_t devad, uint16_t reg, uint16_t *reg_vals, uint8_t count);
+
+    // Marvell multi-chip SMI indirect access. Returns false on timeout.
+    bool (*smi_pull_request)(uint8_t bus, uint8_t chip, uint8_t dev, uint8_t reg, uint16_t *reg_val);
+    bool (*smi_push_request)(uint8_t bus, uint8_t chip, uint8_t dev, uint8_t reg, uint16_t reg_val);
+
+    // Poll a register on the device. Returns true if the condition was met.
+    bool (*poll_request)(uint8_t bus, uint8_t dev, uint8_t reg, uint16_t mask, uint16_t expected,
+                         uint32_t interval_us, uint32_t timeout_us, struct mdio_poll_result *result);
+
+    // Register cache control. mode is USB_MDIO_CACHE_*, the counters are returned in stats.
+    void (*cache_request)(uint8_t bus, uint8_t dev, uint8_t mode, uint8_t reg, struct mdio_cache_stats *stats);
+
+    // Watch list. mode is USB_MDIO_WATCH_*. Returns the index of an added entry, -1 on failure.
+    int (*watch_request)(uint8_t bus, uint8_t dev, uint8_t mode, uint8_t reg, uint16_t mask, uint32_t interval_us);
+
+    // Preamble suppression, returns the bitmap of addresses with suppression enabled
+    uint32_t (*preamble_suppression_request)(uint8_t bus, uint8_t dev, uint8_t mode);
+
+    // Bus scan. mode is USB_MDIO_SCAN_*. Returns the bitmap of present addresses and their PHY IDs in ids
+    // (32 entries) for USB_MDIO_SCAN_RUN, the bitmap of the addresses not known to be empty otherwise.
+    uint32_t (*scan_request)(uint8_t bus, uint8_t mode, uint32_t *ids);
+
+    // Bus sniffer. mode is USB_MDIO_SNIFF_*. The state after the request is returned in status.
+    void (*sniff_request)(uint8_t bus, uint8_t mode, struct mdio_sniff_status *status);
+
+    // Timing profile. op is USB_MDIO_OP_SET_TIMING, USB_MDIO_OP_GET_TIMING or USB_MDIO_OP_CALIBRATE.
+    // The resulting profile is returned in profile. Returns false on failure.
+    bool (*timing_request)(uint8_t bus, uint8_t dev, uint8_t op, struct mdio_timing_profile *profile);
+};
+
+void usb_device_init(const struct usb_mdio_callbacks *callbacks);
 void usb_start(void);
 
+// USB runs on core0. Commands received on EP2 are queued for core1 which executes them with usb_mdio_task()
+// and queues the responses for EP6. All callbacks are called on core1.
+
+// Execute the next queued command, if any. Call in a loop on core1.
+void usb_mdio_task(void);
+
+// Queue a watch list change for the host (EP7). Core1 only, safe to call from interrupts.
+void usb_notify_watch(uint8_t index, uint8_t bus, uint16_t value, uint32_t timestamp_us);
+
+// Frames arrived in the sniffer ring (EP8). Core0 only, from interrupts.
+void usb_notify_sniff(void);
+
+// Send what was written to the telemetry ring on the CDC-ACM interface (EP10). Call in the idle loop of core0,
+// writers do not wake up USB themselves.
+void usb_telemetry_task(void);
+
+// Write an init sequence accepted by USB_MDIO_VENDOR_STORE_INIT to flash. Call in the idle loop of core0, the
+// flash write pauses core1 and the interrupts of core0.
+void usb_init_store_task(void);
+
 bool get_usb_configured(void);
 unsigned char * get_usb_product_string(void);
\ No newline at end of file
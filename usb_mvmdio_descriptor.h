@@ -12,6 +12,7 @@
 #define DEV_LOWLEVEL_H_
 
 #include "usb_common.h"
+#include "telemetry.h"
 
 typedef void (*usb_ep_handler)(uint8_t *buf, uint16_t len);
 
@@ -28,6 +29,14 @@ struct usb_endpoint_configuration {
 
     // Toggle after each packet (unless replying to a SETUP)
     uint8_t next_pid;
+
+    // Double buffered endpoints use two 64 byte buffers at data_buffer. The controller works through them
+    // alternately, starting with buffer 0. Buffer 1 is controlled by the upper half of buffer_control.
+    bool double_buffered;
+    uint8_t armed;    // Bitmask of the buffers handed to the controller
+    uint8_t next_buf; // Buffer armed by the next transfer
+    uint8_t done_buf; // Buffer the controller completes next
+
 };
 
 // Struct in which we keep the device configuration
@@ -49,6 +58,11 @@ struct usb_device_configuration {
 #define EP4_OUT_ADDR (USB_DIR_OUT | 4)
 #define EP5_OUT_ADDR (USB_DIR_OUT | 5)
 #define EP6_IN_ADDR  (USB_DIR_IN  | 6)
+#define EP7_IN_ADDR  (USB_DIR_IN  | 7)
+#define EP8_IN_ADDR  (USB_DIR_IN  | 8)
+#define EP9_IN_ADDR  (USB_DIR_IN  | 9)
+#define EP10_OUT_ADDR (USB_DIR_OUT | 10)
+#define EP10_IN_ADDR (USB_DIR_IN  | 10)
 
 // EP0 IN and OUT
 static const struct usb_endpoint_descriptor ep0_out = {
@@ -73,10 +87,17 @@ static const struct usb_endpoint_descriptor ep0_in = {
 static const struct usb_device_descriptor device_descriptor = {
         .bLength         = sizeof(struct usb_device_descriptor),
         .bDescriptorType = USB_DT_DEVICE,
+#if USB_MDIO_CDC_ACM
+        .bcdUSB          = 0x0200, // USB 2.0 device, needed for the interface association
+        .bDeviceClass    = 0xef,   // Miscellaneous: functions are described by interface associations
+        .bDeviceSubClass = 0x02,
+        .bDeviceProtocol = 0x01,
+#else
         .bcdUSB          = 0x0110, // USB 1.1 device
         .bDeviceClass    = 0,      // Specified in interface descriptor
         .bDeviceSubClass = 0,      // No subclass
         .bDeviceProtocol = 0,      // No protocol
+#endif
         .bMaxPacketSize0 = 64,     // Max packet size for ep0
         .idVendor        = 0x1286, // Your vendor id
         .idProduct       = 0x1fa4, // Your product ID
@@ -92,7 +113,7 @@ static const struct usb_interface_descriptor interface_descriptor = {
         .bDescriptorType    = USB_DT_INTERFACE,
         .bInterfaceNumber   = 0,
         .bAlternateSetting  = 0,
-        .bNumEndpoints      = 6,    // Interface has 2 endpoints
+        .bNumEndpoints      = 8,
         .bInterfaceClass    = 0xff, // Vendor specific endpoint
         .bInterfaceSubClass = 0,
         .bInterfaceProtocol = 0,
@@ -158,6 +179,177 @@ static const struct usb_endpoint_descriptor ep6_in = {
         .bInterval        = 0
 };
 
+// Watch list notifications
+static const struct usb_endpoint_descriptor ep7_in = {
+        .bLength          = sizeof(struct usb_endpoint_descriptor),
+        .bDescriptorType  = USB_DT_ENDPOINT,
+        .bEndpointAddress = EP7_IN_ADDR,
+        .bmAttributes     = USB_TRANSFER_TYPE_INTERRUPT,
+        .wMaxPacketSize   = 64,
+        .bInterval        = 1 // Poll every 1 ms
+};
+
+// Frames of the bus sniffer
+static const struct usb_endpoint_descriptor ep8_in = {
+        .bLength          = sizeof(struct usb_endpoint_descriptor),
+        .bDescriptorType  = USB_DT_ENDPOINT,
+        .bEndpointAddress = EP8_IN_ADDR,
+        .bmAttributes     = USB_TRANSFER_TYPE_BULK,
+        .wMaxPacketSize   = 64,
+        .bInterval        = 0
+};
+
+#if USB_MDIO_CDC_ACM
+// CDC-ACM function for logs and telemetry (see telemetry.h), interfaces 1 and 2 after the vendor interface.
+// The vendor interface stays as it is for the mdio-mvusb driver.
+#define USB_DT_INTERFACE_ASSOCIATION 0x0b
+#define USB_DT_CS_INTERFACE 0x24
+
+#define USB_CDC_CLASS_COMM 0x02
+#define USB_CDC_CLASS_DATA 0x0a
+#define USB_CDC_SUBCLASS_ACM 0x02
+
+#define USB_CDC_REQUEST_SET_LINE_CODING 0x20
+#define USB_CDC_REQUEST_GET_LINE_CODING 0x21
+#define USB_CDC_REQUEST_SET_CONTROL_LINE_STATE 0x22
+#define USB_CDC_LINE_CODING_LEN 7
+
+#define USB_CDC_COMM_INTERFACE 1
+#define USB_CDC_DATA_INTERFACE 2
+
+struct usb_cdc_acm_descriptors {
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+        uint8_t bFirstInterface;
+        uint8_t bInterfaceCount;
+        uint8_t bFunctionClass;
+        uint8_t bFunctionSubClass;
+        uint8_t bFunctionProtocol;
+        uint8_t iFunction;
+    } __packed iad;
+    struct usb_interface_descriptor comm_interface;
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+        uint8_t bDescriptorSubtype;
+        uint16_t bcdCDC;
+    } __packed header;
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+        uint8_t bDescriptorSubtype;
+        uint8_t bmCapabilities;
+        uint8_t bDataInterface;
+    } __packed call_management;
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+        uint8_t bDescriptorSubtype;
+        uint8_t bmCapabilities;
+    } __packed acm;
+    struct {
+        uint8_t bLength;
+        uint8_t bDescriptorType;
+        uint8_t bDescriptorSubtype;
+        uint8_t bControlInterface;
+        uint8_t bSubordinateInterface0;
+    } __packed union_functional;
+    struct usb_endpoint_descriptor notification;
+    struct usb_interface_descriptor data_interface;
+    struct usb_endpoint_descriptor data_out;
+    struct usb_endpoint_descriptor data_in;
+} __packed;
+
+static const struct usb_cdc_acm_descriptors cdc_acm_descriptors = {
+        .iad = {
+                .bLength           = sizeof(cdc_acm_descriptors.iad),
+                .bDescriptorType   = USB_DT_INTERFACE_ASSOCIATION,
+                .bFirstInterface   = USB_CDC_COMM_INTERFACE,
+                .bInterfaceCount   = 2,
+                .bFunctionClass    = USB_CDC_CLASS_COMM,
+                .bFunctionSubClass = USB_CDC_SUBCLASS_ACM,
+                .bFunctionProtocol = 0,
+                .iFunction         = 3
+        },
+        .comm_interface = {
+                .bLength            = sizeof(struct usb_interface_descriptor),
+                .bDescriptorType    = USB_DT_INTERFACE,
+                .bInterfaceNumber   = USB_CDC_COMM_INTERFACE,
+                .bAlternateSetting  = 0,
+                .bNumEndpoints      = 1,
+                .bInterfaceClass    = USB_CDC_CLASS_COMM,
+                .bInterfaceSubClass = USB_CDC_SUBCLASS_ACM,
+                .bInterfaceProtocol = 0, // No AT commands
+                .iInterface         = 3
+        },
+        .header = {
+                .bLength            = sizeof(cdc_acm_descriptors.header),
+                .bDescriptorType    = USB_DT_CS_INTERFACE,
+                .bDescriptorSubtype = 0x00,
+                .bcdCDC             = 0x0120
+        },
+        .call_management = {
+                .bLength            = sizeof(cdc_acm_descriptors.call_management),
+                .bDescriptorType    = USB_DT_CS_INTERFACE,
+                .bDescriptorSubtype = 0x01,
+                .bmCapabilities     = 0, // No call management
+                .bDataInterface     = USB_CDC_DATA_INTERFACE
+        },
+        .acm = {
+                .bLength            = sizeof(cdc_acm_descriptors.acm),
+                .bDescriptorType    = USB_DT_CS_INTERFACE,
+                .bDescriptorSubtype = 0x02,
+                .bmCapabilities     = 0x02 // SET_LINE_CODING, GET_LINE_CODING and SET_CONTROL_LINE_STATE
+        },
+        .union_functional = {
+                .bLength                = sizeof(cdc_acm_descriptors.union_functional),
+                .bDescriptorType        = USB_DT_CS_INTERFACE,
+                .bDescriptorSubtype     = 0x06,
+                .bControlInterface      = USB_CDC_COMM_INTERFACE,
+                .bSubordinateInterface0 = USB_CDC_DATA_INTERFACE
+        },
+        // Serial state notifications, never sent
+        .notification = {
+                .bLength          = sizeof(struct usb_endpoint_descriptor),
+                .bDescriptorType  = USB_DT_ENDPOINT,
+                .bEndpointAddress = EP9_IN_ADDR,
+                .bmAttributes     = USB_TRANSFER_TYPE_INTERRUPT,
+                .wMaxPacketSize   = 8,
+                .bInterval        = 255
+        },
+        .data_interface = {
+                .bLength            = sizeof(struct usb_interface_descriptor),
+                .bDescriptorType    = USB_DT_INTERFACE,
+                .bInterfaceNumber   = USB_CDC_DATA_INTERFACE,
+                .bAlternateSetting  = 0,
+                .bNumEndpoints      = 2,
+                .bInterfaceClass    = USB_CDC_CLASS_DATA,
+                .bInterfaceSubClass = 0,
+                .bInterfaceProtocol = 0,
+                .iInterface         = 0
+        },
+        // Input from the terminal, dropped
+        .data_out = {
+                .bLength          = sizeof(struct usb_endpoint_descriptor),
+                .bDescriptorType  = USB_DT_ENDPOINT,
+                .bEndpointAddress = EP10_OUT_ADDR,
+                .bmAttributes     = USB_TRANSFER_TYPE_BULK,
+                .wMaxPacketSize   = 64,
+                .bInterval        = 0
+        },
+        // Logs and telemetry
+        .data_in = {
+                .bLength          = sizeof(struct usb_endpoint_descriptor),
+                .bDescriptorType  = USB_DT_ENDPOINT,
+                .bEndpointAddress = EP10_IN_ADDR,
+                .bmAttributes     = USB_TRANSFER_TYPE_BULK,
+                .wMaxPacketSize   = 64,
+                .bInterval        = 0
+        }
+};
+#endif
+
 static const struct usb_configuration_descriptor config_descriptor = {
         .bLength         = sizeof(struct usb_configuration_descriptor),
         .bDescriptorType = USB_DT_CONFIG,
@@ -168,8 +360,18 @@ static const struct usb_configuration_descriptor config_descriptor = {
                             sizeof(ep3_out) +
                             sizeof(ep4_out) +
                             sizeof(ep5_out) +
-                            sizeof(ep6_in)),
+                            sizeof(ep6_in) +
+                            sizeof(ep7_in) +
+                            sizeof(ep8_in)
+#if USB_MDIO_CDC_ACM
+                            + sizeof(cdc_acm_descriptors)
+#endif
+                            ),
+#if USB_MDIO_CDC_ACM
+        .bNumInterfaces  = 3,
+#else
         .bNumInterfaces  = 1,
+#endif
         .bConfigurationValue = 1, // Configuration 1
         .iConfiguration = 0,      // No string
         .bmAttributes = 0xc0,     // attributes: self powered, no remote wakeup
@@ -184,7 +386,10 @@ static const unsigned char lang_descriptor[] = {
 
 static const unsigned char *descriptor_strings[] = {
         (unsigned char *) "Albrecht Lohofener",    // Vendor
-        (unsigned char *) "Marvell USB MDIO Adapter Clone" // Product
+        (unsigned char *) "Marvell USB MDIO Adapter Clone", // Product
+#if USB_MDIO_CDC_ACM
+        (unsigned char *) "MDIO Adapter Log" // CDC-ACM function
+#endif
 };
 
 #endif
\ No newline at end of file